@@ -0,0 +1,49 @@
+/**
+  \file bench.h
+  \brief Microbenchmark helpers for the host build of the firmware
+*/
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+typedef void (*BenchFunction)( void ) ;
+
+/**
+ * \struct BenchResult
+ * \brief Cost of one call of a benchmarked function
+*/
+struct BenchResult
+{
+  double nsPerCall ;      /*!< Wall-clock time per call, in ns */
+  double allocsPerCall ;  /*!< Number of heap allocations per call */
+} ;
+
+uint64_t benchNowNanos( void ) ;
+uint64_t benchAllocations( void ) ;
+BenchResult benchRun( const char *i_name, uint32_t i_iterations, BenchFunction i_function, BenchFunction i_prepare = 0 ) ;
+
+void benchFirmware( void ) ;
+void benchSampler( void ) ;
+void benchColor( void ) ;
+void benchFrame( void ) ;
+void benchCodec( void ) ;
+void benchConnection( void ) ;
+void benchUploader( void ) ;
+void benchRing( void ) ;
+void benchFlash( void ) ;
+void benchConfig( void ) ;
+void benchBoot( void ) ;
+void benchSound( void ) ;
+void benchStats( void ) ;
+void benchSpectrum( void ) ;
+void benchScheduler( void ) ;
+void benchProbe( void ) ;
+void benchLocal( void ) ;
+void benchReport( void ) ;
+void benchRegistration( void ) ;
+void benchSnapshot( void ) ;
+void benchPyramid( void ) ;
+void benchSettings( void ) ;
+
+#endif
@@ -0,0 +1,143 @@
+/**
+  \file bench_boot.cpp
+  \brief Time from a boot to the first sample and to the registration, values measured before it that reach the server,
+         portals of WiFiManager kept from opening by the local server, and accesses to the flash the interrupt of the
+         sampler could preempt
+*/
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <hal_native.h>
+#include <algorithm>
+
+#include "bench.h"
+#include "../src/config.h"
+#include "../src/connection.h"
+#include "../src/flash_log.h"
+#include "../src/local_server.h"
+#include "../src/probe.h"
+#include "../src/sampler.h"
+#include "../src/server.h"
+#include "../src/uploader.h"
+
+#define BENCH_BOOT_MAX_MS 1800000 /*!< Time given to the values measured before the registration to reach the server, in ms */
+
+void setup() ;
+void loop() ;
+
+extern bool     registered ;
+extern uint32_t firstSampleMillis ;
+
+/**
+ * \struct BenchBootScenario
+ * \brief Conditions of a boot
+*/
+struct BenchBootScenario
+{
+  const char  *name ;
+  bool        configured ;        /*!< Whether the device registered before the boot */
+  uint32_t    associationMillis ; /*!< Time taken by the network to associate */
+  uint32_t    downMillis ;        /*!< Time the server drops the requests after the boot */
+} ;
+
+static const BenchBootScenario benchBootScenarios[] =
+{
+  { "first boot",                 false, HAL_ASSOCIATION_MS_DEFAULT, 0 },
+  { "boot",                       true,  HAL_ASSOCIATION_MS_DEFAULT, 0 },
+  { "boot, slow network",         true,  20000,                      0 },
+  { "boot, network set in the portal", true, 45000,                  0 },
+  { "boot, server down 5 min",    true,  HAL_ASSOCIATION_MS_DEFAULT, 300000 },
+} ;
+
+static uint32_t benchDownMillis ;
+static uint32_t benchNbReceived ;
+
+/**
+ * \fn int16_t benchBootHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server down for the first benchDownMillis ms, then registering the device and counting the values it receives,
+ *        one per entry of "noise", or the number of values of each aggregate of the slow rates
+*/
+static int16_t benchBootHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  std::string body((const char *) i_body, i_length) ;
+  size_t position = body.find("\"noise\":[") ;
+  size_t counts = body.find("\"n\":[") ;
+
+  (void) i_host ;
+  if ( millis() < benchDownMillis )
+    return -1 ;
+
+  *o_response = strcmp(i_endPoint, "/api/device/") == 0 ? "{\"shortID\":\"BENCH1\",\"config\":{\"luminosity\":4}}" : "{}" ;
+  if ( counts != std::string::npos )
+    for ( const char *count = body.c_str() + counts + 5 ; *count != ']' ; count += *count == ',' )
+      benchNbReceived += strtol(count, (char **) &count, 10) ;
+  else if ( position != std::string::npos && body[position + 9] != ']' )
+    benchNbReceived += std::count(body.begin() + position, body.begin() + body.find(']', position), ',') + 1 ;
+  return 200 ;
+}
+
+/**
+ * \fn bool benchBootRun( const BenchBootScenario *i_scenario )
+ * \return False if values measured before the registration never reached the server
+ * \brief Boot the firmware, run loop() until the values measured before the registration are uploaded
+*/
+static bool benchBootRun( const BenchBootScenario *i_scenario )
+{
+  ConfigBlock block ;
+  uint32_t registeredMillis = 0, nbBuffered = 0, start ;
+
+  // Keep the EEPROM of the previous boot, with the short ID, if the device registered before
+  EEPROM.get(CONFIG_BLOCK_ADDRESS, block) ;
+  connectionClose() ;
+  localServerStop() ;
+  halReset() ;
+  probeClear() ;
+  if ( i_scenario->configured )
+  {
+    EEPROM.begin(CONFIG_EEPROM_SIZE) ;
+    EEPROM.put(CONFIG_BLOCK_ADDRESS, block) ;
+    EEPROM.commit() ;
+  }
+  halSetHTTPHandler(benchBootHandler) ;
+  halSetWiFiAssociation(i_scenario->associationMillis) ;
+  benchDownMillis   = i_scenario->downMillis ;
+  benchNbReceived   = 0 ;
+  firstSampleMillis = 0 ;
+  start             = noiseBufferServer.back() ;
+
+  setup() ;
+  while ( millis() < BENCH_BOOT_MAX_MS && ( registeredMillis == 0 || benchNbReceived < nbBuffered || uploaderState() != UPLOADER_IDLE ) )
+  {
+    loop() ;
+    if ( registered && registeredMillis == 0 )
+    {
+      registeredMillis  = millis() ;
+      nbBuffered        = noiseBufferServer.back() - start ;
+    }
+  }
+  samplerStop() ;
+
+  printf("%-40s first sample %6u ms, registered %7u ms, %4u values measured before, %4u received, %u portals blocked, "
+         "%u flash accesses while sampling\n", i_scenario->name, firstSampleMillis, registeredMillis, nbBuffered, benchNbReceived,
+         halCountPortalBlocked(), halCountFlashWhileSampling()) ;
+  return registeredMillis > 0 && benchNbReceived >= nbBuffered && firstSampleMillis <= 100 && halCountPortalBlocked() == 0
+      && halCountFlashWhileSampling() == 0 ;
+}
+
+/**
+ * \fn void benchBoot( void )
+ * \brief Boot the firmware in several conditions, the first sample must not wait for the network
+*/
+void benchBoot( void )
+{
+  bool valid = true ;
+
+  for ( uint8_t iScenario = 0 ; iScenario < sizeof(benchBootScenarios) / sizeof(benchBootScenarios[0]) ; iScenario++ )
+    valid &= benchBootRun(&benchBootScenarios[iScenario]) ;
+  halReset() ;
+
+  if ( !valid )
+  {
+    printf("the first sample waited, values measured before the registration were lost, the local server blocked the portal, or the flash was accessed while sampling\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,120 @@
+/**
+  \file bench_codec.cpp
+  \brief Round trip of the binary noise payload, and its size and cost against the JSON messages
+*/
+#include <Arduino.h>
+
+#include "bench.h"
+#include "../src/noise_codec.h"
+#include "../src/server.h"
+
+#define BENCH_CODEC_NB_VALUES     ( SERVER_SIZE_BUFFER_DATA - 1 ) /*!< Number of values in a full buffer */
+#define BENCH_CODEC_NB_ROUNDTRIPS 10000
+
+static int16_t  benchValues[BENCH_CODEC_NB_VALUES] ;
+static uint8_t  benchBinary[NOISE_CODEC_SIZE_MAX(BENCH_CODEC_NB_VALUES)] ;
+static size_t   benchBinaryLength ;
+static size_t   benchJSONLength ;
+
+/**
+ * \fn void benchFillValues( int16_t i_amplitude )
+ * \param[in] i_amplitude Maximum step between two consecutive values
+ * \brief Fill the values with a random walk between 0 and 1023, as the difference between max and average of the signal
+*/
+static void benchFillValues( int16_t i_amplitude )
+{
+  int16_t value = 40 ;
+
+  for ( uint16_t iValue = 0 ; iValue < BENCH_CODEC_NB_VALUES ; iValue++ )
+  {
+    value += rand() % ( 2 * i_amplitude + 1 ) - i_amplitude ;
+    value  = std::max<int16_t>(std::min<int16_t>(value, 1023), 0) ;
+    benchValues[iValue] = value ;
+  }
+}
+
+/**
+ * \fn bool benchRoundTrips( void )
+ * \return True if every payload decodes to the values and envelope it was encoded from
+ * \brief Encode and decode random series, including extreme values, and check that nothing is lost
+*/
+static bool benchRoundTrips( void )
+{
+  static int16_t decoded[BENCH_CODEC_NB_VALUES] ;
+  uint32_t nbFailures = 0 ;
+
+  for ( uint32_t iRoundTrip = 0 ; iRoundTrip < BENCH_CODEC_NB_ROUNDTRIPS ; iRoundTrip++ )
+  {
+    NoisePayloadHeader header ;
+    LevelSummary summary = { 0, 3750, 350, 360, 400, 500, 650, { 300, 310, 320, 330, 340, 350 } }, decodedSummary ;
+    const LevelSummary *sentSummary = iRoundTrip % 2 ? &summary : NULL ;
+    uint16_t nbValues = rand() % ( BENCH_CODEC_NB_VALUES + 1 ) ;
+    size_t length ;
+    bool valid ;
+
+    for ( uint16_t iValue = 0 ; iValue < nbValues ; iValue++ )
+      benchValues[iValue] = iRoundTrip % 2 ? rand() % 65536 - 32768 : ( rand() % 2 ? INT16_MIN : INT16_MAX ) ;
+
+    length  = noiseCodecEncode(benchBinary, sizeof(benchBinary), "AbC123", 1920, nbValues + 3, iRoundTrip % 3 == 0, benchValues, nbValues, sentSummary, 1200) ;
+    valid   = length > 0 && noiseCodecDecode(benchBinary, length, &header, decoded, BENCH_CODEC_NB_VALUES, &decodedSummary) ;
+    valid  &= header.hasSummary == ( sentSummary != NULL ) ;
+    valid  &= sentSummary == NULL || ( header.summaryAge == 1200 && memcmp(&decodedSummary, &summary, sizeof(summary)) == 0 ) ;
+    valid  &= strcmp(header.shortID, "AbC123") == 0 && header.interval == 1920 && header.nbElements == nbValues + 3 ;
+    valid  &= header.first == ( iRoundTrip % 3 == 0 ) && header.nbValues == nbValues ;
+    valid  &= memcmp(decoded, benchValues, nbValues * sizeof(int16_t)) == 0 ;
+    // A truncated payload must be rejected
+    valid  &= length == 0 || !noiseCodecDecode(benchBinary, length - 1, &header, decoded, BENCH_CODEC_NB_VALUES) ;
+    nbFailures += !valid ;
+  }
+
+  printf("round trips                              %u/%u valid\n", BENCH_CODEC_NB_ROUNDTRIPS - nbFailures, BENCH_CODEC_NB_ROUNDTRIPS) ;
+  return nbFailures == 0 ;
+}
+
+static void benchEncodeBinary( void )
+{
+  benchBinaryLength = noiseCodecEncode(benchBinary, sizeof(benchBinary), "AbC123", 1920, BENCH_CODEC_NB_VALUES, true, benchValues, BENCH_CODEC_NB_VALUES) ;
+}
+
+static void benchDecodeBinary( void )
+{
+  static int16_t decoded[BENCH_CODEC_NB_VALUES] ;
+  NoisePayloadHeader header ;
+
+  noiseCodecDecode(benchBinary, benchBinaryLength, &header, decoded, BENCH_CODEC_NB_VALUES) ;
+}
+
+static void benchEncodeJSON( void )
+{
+  char message[SERVER_SIZE_MESSAGE_JSON] ;
+
+  benchJSONLength = 0 ;
+  for ( uint16_t iValue = 0 ; iValue < BENCH_CODEC_NB_VALUES ; iValue += SERVER_SIZE_MESSAGE_DATA )
+  {
+    uint8_t nbData = std::min<uint16_t>(SERVER_SIZE_MESSAGE_DATA, BENCH_CODEC_NB_VALUES - iValue) ;
+    benchJSONLength += buildDataMessageJSON(message, sizeof(message), "AbC123", 1920, BENCH_CODEC_NB_VALUES, iValue == 0, benchValues + iValue, nbData) ;
+  }
+}
+
+void benchCodec( void )
+{
+  static const int16_t amplitudes[] = { 2, 20, 200 } ;
+  bool valid = benchRoundTrips() ;
+
+  for ( uint8_t iAmplitude = 0 ; iAmplitude < sizeof(amplitudes) / sizeof(amplitudes[0]) ; iAmplitude++ )
+  {
+    benchFillValues(amplitudes[iAmplitude]) ;
+    printf("full buffer, steps up to %3d\n", amplitudes[iAmplitude]) ;
+    benchRun("  JSON, 20 values/message", 10000, benchEncodeJSON) ;
+    benchRun("  binary, one message", 10000, benchEncodeBinary) ;
+    benchRun("  binary decode", 10000, benchDecodeBinary) ;
+    printf("  %u bytes in %u JSON messages, %u bytes in 1 binary message (%.1f%%)\n", (unsigned) benchJSONLength,
+           ( BENCH_CODEC_NB_VALUES + SERVER_SIZE_MESSAGE_DATA - 1 ) / SERVER_SIZE_MESSAGE_DATA, (unsigned) benchBinaryLength, 100.0 * benchBinaryLength / benchJSONLength) ;
+  }
+
+  if ( !valid )
+  {
+    printf("binary payloads do not round-trip\n") ;
+    exit(1) ;
+  }
+}
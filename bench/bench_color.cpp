@@ -0,0 +1,124 @@
+/**
+  \file bench_color.cpp
+  \brief Exhaustive check of the integer and tabulated color conversions against the floating-point reference, and their cost
+*/
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+
+#include "bench.h"
+#include "../src/color.h"
+#include "../src/config.h"
+
+static int16_t  benchHue          = 0 ;
+static int8_t   benchBrightness   = 1 ;
+static volatile uint32_t benchSink ;
+
+/**
+ * \fn bool benchCheckFixed( void )
+ * \return True if HSBToRGBFixed() matches HSBToRGB() closely enough for every hue, saturation and brightness
+ * \brief Compare the integer conversion to the reference one over their whole input space
+ *
+ * The reference truncates floating-point products, so when the exact value is an integer it can land one step below.
+ * The outputs are therefore allowed to differ by one step before gamma correction, which is at most 3 after it.
+*/
+static bool benchCheckFixed( void )
+{
+  uint32_t nbInputs = 0, nbExact = 0, maxError = 0 ;
+
+  for ( int16_t hue = 0 ; hue < 360 ; hue++ )
+  {
+    for ( uint16_t saturation = 0 ; saturation < 256 ; saturation++ )
+    {
+      for ( uint16_t brightness = 0 ; brightness < 256 ; brightness++ )
+      {
+        uint8_t reference[3], fixed[3] ;
+        uint32_t error = 0 ;
+
+        HSBToRGB(hue, saturation, brightness, &reference[0], &reference[1], &reference[2]) ;
+        HSBToRGBFixed(hue, saturation, brightness, &fixed[0], &fixed[1], &fixed[2]) ;
+        for ( uint8_t iChannel = 0 ; iChannel < 3 ; iChannel++ )
+          error = std::max<uint32_t>(error, abs(reference[iChannel] - fixed[iChannel])) ;
+
+        nbInputs++ ;
+        nbExact += error == 0 ;
+        maxError = std::max(maxError, error) ;
+      }
+    }
+  }
+
+  printf("HSBToRGBFixed() vs HSBToRGB()            %u/%u exact, max error %u\n", nbExact, nbInputs, maxError) ;
+  return maxError <= 3 ;
+}
+
+/**
+ * \fn bool benchCheckTable( void )
+ * \return True if hueToColor() matches HSBToRGBFixed() exactly for every hue and brightness level displayed
+*/
+static bool benchCheckTable( void )
+{
+  uint32_t nbMismatches = 0 ;
+
+  for ( int8_t level = configBrightnessServerMin ; level <= configBrightnessServerMax ; level++ )
+  {
+    for ( int16_t hue = 0 ; hue <= COLOR_HUE_MAX ; hue++ )
+    {
+      uint8_t red, green, blue ;
+
+      HSBToRGBFixed(hue, 255, mapBrightnessServerToValue(level), &red, &green, &blue) ;
+      nbMismatches += hueToColor(hue, level) != Adafruit_NeoPixel::Color(red, green, blue) ;
+    }
+  }
+
+  printf("hueToColor() vs HSBToRGBFixed()          %u mismatches\n", nbMismatches) ;
+  return nbMismatches == 0 ;
+}
+
+static void benchNextInput( void )
+{
+  benchHue = ( benchHue + 1 ) % ( COLOR_HUE_MAX + 1 ) ;
+  if ( benchHue == 0 )
+    benchBrightness = benchBrightness % configBrightnessServerMax + 1 ;
+}
+
+static void benchFloat( void )
+{
+  uint8_t red, green, blue ;
+
+  HSBToRGB(benchHue, 255, mapBrightnessServerToValue(benchBrightness), &red, &green, &blue) ;
+  benchSink = Adafruit_NeoPixel::Color(red, green, blue) ;
+  benchNextInput() ;
+}
+
+static void benchFixed( void )
+{
+  uint8_t red, green, blue ;
+
+  HSBToRGBFixed(benchHue, 255, mapBrightnessServerToValue(benchBrightness), &red, &green, &blue) ;
+  benchSink = Adafruit_NeoPixel::Color(red, green, blue) ;
+  benchNextInput() ;
+}
+
+static void benchTable( void )
+{
+  benchSink = hueToColor(benchHue, benchBrightness) ;
+  benchNextInput() ;
+}
+
+/**
+ * \fn void benchColor( void )
+ * \brief Check the color conversions, then time the computation of the color done once per animate() call
+*/
+void benchColor( void )
+{
+  bool valid = benchCheckFixed() & benchCheckTable() ;
+
+  benchRun("color per animate(), HSBToRGB()", 1000000, benchFloat) ;
+  benchRun("color per animate(), HSBToRGBFixed()", 1000000, benchFixed) ;
+  benchRun("color per animate(), hueToColor()", 1000000, benchTable) ;
+
+  if ( !valid )
+  {
+    printf("color conversions do not match the reference\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,184 @@
+/**
+  \file bench_config.cpp
+  \brief EEPROM commits of the settings over repeated boots, migration from the legacy layout and the older
+         versions, and cost of a boot
+*/
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/config.h"
+#include "../src/crc32.h"
+
+#define BENCH_CONFIG_NB_BOOTS 1000
+
+/**
+ * \fn void benchBoot( int8_t i_brightness )
+ * \param[in] i_brightness Brightness pushed by the server
+ * \brief What setup() does with the settings, the server pushing the same ones at every boot but the brightness
+*/
+static void benchBoot( int8_t i_brightness )
+{
+  configBegin() ;
+  writeOffsetToMemory(42) ;
+  writeSensitivityToMemory(3) ;
+  writeDelayDataServerToMemory(1) ;
+  writeBrightnessToMemory(i_brightness) ;
+  configCommit() ;
+}
+
+static void benchConfigBegin( void )
+{
+  configBegin() ;
+}
+
+/**
+ * \fn bool benchSettings( int8_t i_offset, int8_t i_sensitivity, int32_t i_delay, int8_t i_brightness, const char *i_password )
+ * \return True if the settings in RAM are the expected ones
+*/
+static bool benchSettings( int8_t i_offset, int8_t i_sensitivity, int32_t i_delay, int8_t i_brightness, const char *i_password )
+{
+  char password[configPasswordMaxLength + 1] ;
+
+  getAPPassword(password) ;
+  return readOffsetFromMemory() == i_offset && readSensitivityFromMemory() == mapSensitivityServerToValue(i_sensitivity)
+      && readDelayDataServerFromMemory() == i_delay && readBrightnessServerFromMemory() == i_brightness && strcmp(password, i_password) == 0 ;
+}
+
+/**
+ * \fn bool benchMigration( void )
+ * \return False if the settings of the legacy layout were not kept, or a corrupted or older block not handled
+*/
+static bool benchMigration( void )
+{
+  static const char password[] = "secret" ;
+  ConfigBlock block ;
+  bool valid = true ;
+  uint32_t commits ;
+
+  // Legacy layout : offset, sensitivity, password length and characters, delay and brightness
+  EEPROM.clear() ;
+  EEPROM.begin(CONFIG_EEPROM_SIZE) ;
+  EEPROM.write(0, 17) ;
+  EEPROM.write(1, 4) ;
+  EEPROM.write(2, strlen(password)) ;
+  for ( uint8_t iChar = 0 ; iChar <= strlen(password) ; iChar++ )
+    EEPROM.write(3 + iChar, password[iChar]) ;
+  EEPROM.write(3 + configPasswordMaxLength, 2) ;
+  EEPROM.write(4 + configPasswordMaxLength, 6) ;
+  EEPROM.commit() ;
+
+  commits = halCountEEPROMCommit() ;
+  valid  &= !configBegin() && benchSettings(17, 4, configDelayDataServer[2], 6, password) ;
+  valid  &= configCommit() && halCountEEPROMCommit() == commits + 1 ;
+  valid  &= configBegin() && benchSettings(17, 4, configDelayDataServer[2], 6, password) && !configCommit() ;
+
+  // A block written by an older version, without the brightness : it keeps its default value
+  EEPROM.get(CONFIG_BLOCK_ADDRESS, block) ;
+  block.version = CONFIG_VERSION - 1 ;
+  block.size    = offsetof(ConfigBlock, brightness) ;
+  block.crc     = crc32((const uint8_t *) &block + offsetof(ConfigBlock, offset), block.size - offsetof(ConfigBlock, offset)) ;
+  EEPROM.put(CONFIG_BLOCK_ADDRESS, block) ;
+  valid &= configBegin() && benchSettings(17, 4, configDelayDataServer[2], configBrightnessServerMin + 1, "iot-makers") ;
+
+  // A corrupted block : the legacy layout is migrated again
+  EEPROM.write(CONFIG_BLOCK_ADDRESS + offsetof(ConfigBlock, offset), 99) ;
+  valid &= !configBegin() && benchSettings(17, 4, configDelayDataServer[2], 6, password) ;
+
+  printf("%-40s %9s\n", "migration from the legacy layout", valid ? "ok" : "INVALID") ;
+  return valid ;
+}
+
+#define BENCH_CONFIG_END(field) ( offsetof(ConfigBlock, field) + sizeof(((ConfigBlock *) 0)->field) )
+
+/**
+ * \fn bool benchVersions( void )
+ * \return False if a block written by an older version did not keep its settings, or gave other values than the
+ *         defaults to the settings it does not have
+*/
+static bool benchVersions( void )
+{
+  // End of the last setting of each version, its block being as long as its ConfigBlock, padding included
+  static const uint8_t ends[CONFIG_VERSION] = { 0, BENCH_CONFIG_END(password), BENCH_CONFIG_END(shortID), BENCH_CONFIG_END(display),
+                                                BENCH_CONFIG_END(thresholds), BENCH_CONFIG_END(snapshotLevel) } ;
+  bool valid = true ;
+
+  for ( uint8_t iVersion = 1 ; iVersion < CONFIG_VERSION ; iVersion++ )
+  {
+    ConfigBlock block ;
+    int16_t thresholds[CONFIG_NB_THRESHOLDS] ;
+    uint8_t nbThresholds ;
+    bool kept ;
+
+    // Every setting differs from its default, the block then being cut where the one of the version ended
+    memset(&block, 0, sizeof(block)) ;
+    block.magic            = CONFIG_MAGIC ;
+    block.version          = iVersion ;
+    block.size             = ( ends[iVersion] + alignof(ConfigBlock) - 1 ) / alignof(ConfigBlock) * alignof(ConfigBlock) ;
+    block.offset           = 17 ;
+    block.sensitivity      = 4 ;
+    block.iDelayDataServer = 2 ;
+    block.brightness       = 6 ;
+    strcpy(block.password, "secret") ;
+    strcpy(block.shortID, "BENCH1") ;
+    block.display          = configDisplaySpectrum ;
+    block.deadband         = configDeadbandDefault + 4 ;
+    block.thresholds[0]    = 60 ;
+    block.thresholds[1]    = 70 ;
+    block.thresholds[2]    = 80 ;
+    block.snapshotLevel    = 85 ;
+    block.settingsVersion  = 7 ;
+    memset((uint8_t *) &block + block.size, 0xA5, sizeof(block) - block.size) ;
+    block.crc = crc32((const uint8_t *) &block + offsetof(ConfigBlock, offset), block.size - offsetof(ConfigBlock, offset)) ;
+
+    EEPROM.clear() ;
+    EEPROM.begin(CONFIG_EEPROM_SIZE) ;
+    EEPROM.put(CONFIG_BLOCK_ADDRESS, block) ;
+    EEPROM.commit() ;
+
+    kept          = configBegin() && benchSettings(17, 4, configDelayDataServer[2], 6, "secret") ;
+    nbThresholds  = readThresholdsFromMemory(thresholds) ;
+    kept         &= strcmp(readShortIDFromMemory(), iVersion >= 2 ? "BENCH1" : "") == 0 ;
+    kept         &= readDisplayFromMemory() == ( iVersion >= 3 ? configDisplaySpectrum : configDisplayWheel ) ;
+    kept         &= readDeadbandFromMemory() == ( iVersion >= 4 ? configDeadbandDefault + 4 : configDeadbandDefault ) ;
+    kept         &= iVersion >= 4 ? nbThresholds == CONFIG_NB_THRESHOLDS && thresholds[0] == 60 : nbThresholds == 0 ;
+    kept         &= readSnapshotLevelFromMemory() == ( iVersion >= 5 ? 85 : configSnapshotOff ) ;
+    kept         &= readSettingsVersionFromMemory() == 0 ;
+
+    // The settings are then written with the current version, and read back the same
+    kept &= configCommit() && configBegin() && readDeadbandFromMemory() == ( iVersion >= 4 ? configDeadbandDefault + 4 : configDeadbandDefault ) ;
+    printf("%-40s %9u %s\n", iVersion == 1 ? "migration from the older versions" : "", iVersion, kept ? "ok" : "INVALID") ;
+    valid &= kept ;
+  }
+  return valid ;
+}
+
+/**
+ * \fn void benchConfig( void )
+ * \brief Count the EEPROM commits of boots where the server pushes its settings, and check the migration
+*/
+void benchConfig( void )
+{
+  uint32_t commits ;
+  bool valid = true ;
+
+  valid &= benchMigration() ;
+  valid &= benchVersions() ;
+
+  EEPROM.clear() ;
+  commits = halCountEEPROMCommit() ;
+  for ( uint32_t iBoot = 0 ; iBoot < BENCH_CONFIG_NB_BOOTS ; iBoot++ )
+    benchBoot(iBoot < BENCH_CONFIG_NB_BOOTS / 2 ? 5 : 8) ;
+  commits = halCountEEPROMCommit() - commits ;
+  valid  &= commits == 2 && benchSettings(42, 3, configDelayDataServer[1], 8, "iot-makers") ;
+  printf("%-40s %9u boots %9u commits %s\n", "same settings pushed at each boot", BENCH_CONFIG_NB_BOOTS, commits, valid ? "" : "INVALID") ;
+
+  benchRun("configBegin", 100000, benchConfigBegin) ;
+
+  if ( !valid )
+  {
+    printf("the settings were not kept or committed too often\n") ;
+    exit(1) ;
+  }
+}
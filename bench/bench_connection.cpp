@@ -0,0 +1,115 @@
+/**
+  \file bench_connection.cpp
+  \brief Handshakes and latency of flushing the noise buffer, with a connection per request and with the persistent connection
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/connection.h"
+#include "../src/server.h"
+
+#define BENCH_CONNECTION_NB_FLUSHES 20
+
+static void benchFillFullBuffer( void )
+{
+  for ( int16_t iData = 0 ; iData < SERVER_SIZE_BUFFER_DATA - 1 ; iData++ )
+    addDataSendServer(iData) ;
+}
+
+/**
+ * \fn void benchFlushPerRequest( void )
+ * \brief Flush a full buffer as the firmware did before the persistent connection : one connection per message
+*/
+static void benchFlushPerRequest( void )
+{
+  static int16_t data[SERVER_SIZE_MESSAGE_DATA] = { 0 } ;
+
+  for ( int16_t iData = 0 ; iData < SERVER_SIZE_BUFFER_DATA - 1 ; iData += SERVER_SIZE_MESSAGE_DATA )
+  {
+    char message[SERVER_SIZE_MESSAGE_JSON] ;
+    size_t length = buildDataMessageJSON(message, sizeof(message), "HOST01", 1920, SERVER_SIZE_BUFFER_DATA - 1, iData == 0, data, std::min(SERVER_SIZE_MESSAGE_DATA, SERVER_SIZE_BUFFER_DATA - 1 - iData)) ;
+    connectionPost("noisey", "/api/data/", "application/json", (const uint8_t *) message, length, NULL) ;
+    connectionClose() ;
+  }
+}
+
+static void benchFlushPersistent( void )
+{
+  benchFillFullBuffer() ;
+  sendDataServer("noisey", "HOST01", 1920) ;
+}
+
+/**
+ * \fn void benchFlush( const char *i_name, void (*i_flush)( void ) )
+ * \param[in] i_name Name printed in the report
+ * \param[in] i_flush Function flushing a full buffer
+ * \brief Report the handshakes, requests and time on the virtual clock per flush
+*/
+static void benchFlush( const char *i_name, void (*i_flush)( void ) )
+{
+  uint32_t handshakes = halCountHandshake(), requests = halCountHTTPRequest() ;
+  uint64_t start = halMicros() ;
+
+  for ( uint8_t iFlush = 0 ; iFlush < BENCH_CONNECTION_NB_FLUSHES ; iFlush++ )
+    i_flush() ;
+
+  printf("%-40s %8.2f handshakes %8.2f requests %10.1f ms per flush\n", i_name, ( halCountHandshake() - handshakes ) / (double) BENCH_CONNECTION_NB_FLUSHES,
+         ( halCountHTTPRequest() - requests ) / (double) BENCH_CONNECTION_NB_FLUSHES, ( halMicros() - start ) / 1000.0 / BENCH_CONNECTION_NB_FLUSHES) ;
+}
+
+static bool benchDrop = false ; /*!< Whether the server drops the connection instead of answering */
+
+static int16_t benchDropHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  (void) i_host ;
+  (void) i_endPoint ;
+  (void) i_body ;
+  (void) i_length ;
+  *o_response = "{}" ;
+  return benchDrop ? -1 : 200 ;
+}
+
+/**
+ * \fn bool benchRetry( void )
+ * \return False if a dropped request was sent again on the connection it was opened for, or not on a reused one
+ * \brief The server drops a request, on a new connection and on a reused one
+*/
+static bool benchRetry( void )
+{
+  uint8_t message[] = "{}" ;
+  uint32_t requestsNew, requestsReused ;
+
+  halSetHTTPHandler(benchDropHandler) ;
+  connectionClose() ;
+  benchDrop       = true ;
+  requestsNew     = halCountHTTPRequest() ;
+  connectionPost("noisey", "/api/data/", "application/json", message, 2, NULL) ;
+  requestsNew     = halCountHTTPRequest() - requestsNew ;
+
+  benchDrop       = false ;
+  connectionPost("noisey", "/api/data/", "application/json", message, 2, NULL) ;
+  benchDrop       = true ;
+  requestsReused  = halCountHTTPRequest() ;
+  connectionPost("noisey", "/api/data/", "application/json", message, 2, NULL) ;
+  requestsReused  = halCountHTTPRequest() - requestsReused ;
+  halSetHTTPHandler(NULL) ;
+  connectionClose() ;
+
+  printf("%-40s %8u requests on a new connection, %u on a reused one\n", "dropped request", requestsNew, requestsReused) ;
+  return requestsNew == 1 && requestsReused == 2 ;
+}
+
+void benchConnection( void )
+{
+  printf("handshake %u ms, round trip %u ms\n", HAL_HANDSHAKE_US_DEFAULT / 1000, HAL_ROUND_TRIP_US_DEFAULT / 1000) ;
+  benchFlush("connection per request", benchFlushPerRequest) ;
+  connectionClose() ;
+  benchFlush("persistent, pipelined", benchFlushPersistent) ;
+  connectionClose() ;
+  if ( !benchRetry() )
+  {
+    printf("a request that may have reached the server was sent again, or a stale connection was not retried\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,94 @@
+/**
+  \file bench_firmware.cpp
+  \brief Cost of the functions called from the Tickers and from loop() in main.cpp
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/color.h"
+#include "../src/config.h"
+#include "../src/sampler.h"
+#include "../src/server.h"
+
+void measure() ;
+void animate() ;
+void updateColor() ;
+
+extern int8_t   offsetSignal ;
+extern int8_t   sensitivitySignal ;
+extern int8_t   brightness ;
+
+static int16_t benchHue = 0 ;
+
+/**
+ * \fn int16_t benchNoise( uint64_t i_micros )
+ * \param[in] i_micros Current time of the virtual clock, in us
+ * \brief A 440 Hz tone around mid-scale of the ADC, with an amplitude that changes every second
+*/
+static int16_t benchNoise( uint64_t i_micros )
+{
+  int16_t amplitude = 50 + ( i_micros / 1000000 ) % 4 * 100 ;
+  return 512 + amplitude * sin(2 * M_PI * 440 * i_micros / 1e6) ;
+}
+
+static void benchWaitWindow( void )
+{
+  delay(80) ;
+}
+
+static void benchHSBToRGB( void )
+{
+  uint8_t red, green, blue ;
+
+  HSBToRGB(benchHue, 255, mapBrightnessServerToValue(brightness), &red, &green, &blue) ;
+  benchHue = ( benchHue + 1 ) % 121 ;
+}
+
+static void benchFillBuffer( void )
+{
+  for ( int16_t iData = 0 ; iData < SERVER_SIZE_MESSAGE_DATA ; iData++ )
+    addDataSendServer(iData * 7) ;
+}
+
+static void benchFillFullBuffer( void )
+{
+  for ( int16_t iData = 0 ; iData < SERVER_SIZE_BUFFER_DATA - 1 ; iData++ )
+    addDataSendServer(iData * 7) ;
+}
+
+static void benchSendDataServer( void )
+{
+  sendDataServer("noisey", "HOST01", 1920) ;
+}
+
+/**
+ * \fn void benchFirmware( void )
+ * \brief Benchmark the hot functions of the firmware with the configuration of a freshly flashed board
+*/
+void benchFirmware( void )
+{
+  uint32_t analogReads, requests ;
+
+  offsetSignal      = 0 ;
+  sensitivitySignal = 1 ;
+  brightness        = 1 ;
+  halSetAnalogSource(benchNoise) ;
+
+  samplerBegin() ;
+
+  analogReads = halCountAnalogRead() ;
+  benchRun("measure()", 1000, measure, benchWaitWindow) ;
+  printf("%-40s %12.1f samples/window\n", "", ( halCountAnalogRead() - analogReads ) / 1000.0) ;
+
+  benchRun("animate()", 100000, animate) ;
+  benchRun("updateColor()", 100000, updateColor) ;
+  benchRun("HSBToRGB()", 1000000, benchHSBToRGB) ;
+
+  samplerStop() ;
+
+  benchRun("sendDataServer() 20 values", 10000, benchSendDataServer, benchFillBuffer) ;
+  requests = halCountHTTPRequest() ;
+  benchRun("sendDataServer() full buffer", 1000, benchSendDataServer, benchFillFullBuffer) ;
+  printf("%-40s %12.1f requests/flush\n", "", ( halCountHTTPRequest() - requests ) / 1000.0) ;
+}
@@ -0,0 +1,195 @@
+/**
+  \file bench_flash.cpp
+  \brief Throughput of the flash log, and what is left of it after a power loss or a corrupted segment
+*/
+#include <Arduino.h>
+#include <FS.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/flash_log.h"
+
+#define BENCH_FLASH_NB_SEGMENTS 250
+
+static int16_t benchFlashNextValue = 0 ; /*!< Next value appended to the log */
+
+/**
+ * \fn bool benchAppend( void )
+ * \return The result of flashLogAppend() for the next FLASH_LOG_SEGMENT_VALUES values
+*/
+static bool benchAppend( void )
+{
+  int16_t values[FLASH_LOG_SEGMENT_VALUES] ;
+
+  for ( uint16_t iValue = 0 ; iValue < FLASH_LOG_SEGMENT_VALUES ; iValue++ )
+    values[iValue] = benchFlashNextValue++ ;
+  return flashLogAppend(values) ;
+}
+
+/**
+ * \fn bool benchDrain( int16_t i_first, uint32_t i_nbValues, uint32_t i_nbMissing )
+ * \param[in] i_first Expected oldest value of the log
+ * \param[in] i_nbValues Expected number of values read
+ * \param[in] i_nbMissing Expected number of values skipped, from corrupted segments
+ * \return False if the log does not hold the expected values, in order
+ * \brief Read and consume the whole log, one span at a time as the uploader does
+*/
+static bool benchDrain( int16_t i_first, uint32_t i_nbValues, uint32_t i_nbMissing )
+{
+  uint32_t nbValues = 0, nbMissing = 0 ;
+  int16_t next = i_first ;
+
+  while ( !flashLogEmpty() )
+  {
+    uint32_t position = flashLogFront() ;
+    const int16_t *data ;
+    uint16_t nbData = flashLogPeek(position, &data) ;
+
+    for ( uint16_t iData = 0 ; iData < nbData ; iData++ )
+    {
+      nbMissing += data[iData] > next ? data[iData] - next : 0 ;
+      if ( data[iData] < next )
+        return false ;
+      next = data[iData] + 1 ;
+    }
+    nbValues += nbData ;
+    flashLogConsume(position + nbData) ;
+  }
+  return nbValues == i_nbValues && nbMissing == i_nbMissing ;
+}
+
+/**
+ * \fn bool benchThroughput( void )
+ * \return False if the values read back are not the ones written
+ * \brief Time the writes and reads of segments, and the bytes written to flash per value
+*/
+static bool benchThroughput( void )
+{
+  uint64_t start ;
+  double appendNanos, readNanos ;
+  bool valid = true ;
+
+  halResetFlash() ;
+  flashLogBegin() ;
+  benchFlashNextValue = 0 ;
+
+  start = benchNowNanos() ;
+  for ( uint32_t iSegment = 0 ; iSegment < FLASH_LOG_MAX_SEGMENTS ; iSegment++ )
+    valid &= benchAppend() ;
+  appendNanos = ( benchNowNanos() - start ) / (double) FLASH_LOG_MAX_SEGMENTS ;
+
+  start = benchNowNanos() ;
+  valid &= benchDrain(0, FLASH_LOG_MAX_SEGMENTS * FLASH_LOG_SEGMENT_VALUES, 0) ;
+  readNanos = ( benchNowNanos() - start ) / (double) FLASH_LOG_MAX_SEGMENTS ;
+
+  printf("%-40s %9.1f us/segment %9.2f Mvalues/s\n", "flashLogAppend", appendNanos / 1000.0, FLASH_LOG_SEGMENT_VALUES * 1000.0 / appendNanos) ;
+  printf("%-40s %9.1f us/segment %9.2f Mvalues/s\n", "flashLogPeek + flashLogConsume", readNanos / 1000.0, FLASH_LOG_SEGMENT_VALUES * 1000.0 / readNanos) ;
+  printf("%-40s %9.2f bytes written per value\n", "flash", halCountFlashBytes() / (double) ( FLASH_LOG_MAX_SEGMENTS * FLASH_LOG_SEGMENT_VALUES )) ;
+  return valid ;
+}
+
+/**
+ * \fn bool benchRotation( void )
+ * \return False if the oldest segments were not the ones dropped when the log is full
+*/
+static bool benchRotation( void )
+{
+  bool valid = true ;
+  uint32_t dropped = flashLogDropped() ;
+
+  halResetFlash() ;
+  flashLogBegin() ;
+  benchFlashNextValue = 0 ;
+
+  for ( uint32_t iSegment = 0 ; iSegment < BENCH_FLASH_NB_SEGMENTS ; iSegment++ )
+    valid &= benchAppend() ;
+  dropped = flashLogDropped() - dropped ;
+  valid  &= dropped == ( BENCH_FLASH_NB_SEGMENTS - FLASH_LOG_MAX_SEGMENTS ) * FLASH_LOG_SEGMENT_VALUES ;
+  valid  &= benchDrain(dropped, FLASH_LOG_MAX_SEGMENTS * FLASH_LOG_SEGMENT_VALUES, 0) ;
+
+  printf("%-40s %9u segments written %9u values dropped %s\n", "rotation", BENCH_FLASH_NB_SEGMENTS, dropped, valid ? "" : "INVALID") ;
+  return valid ;
+}
+
+/**
+ * \fn bool benchPowerLoss( uint32_t i_cut )
+ * \param[in] i_cut Number of bytes of the fourth segment written before the power is lost
+ * \return False if the three first segments are not intact after the reboot, or if the cut one was kept
+*/
+static bool benchPowerLoss( uint32_t i_cut )
+{
+  bool valid = true ;
+
+  halResetFlash() ;
+  flashLogBegin() ;
+  benchFlashNextValue = 0 ;
+
+  for ( uint8_t iSegment = 0 ; iSegment < 3 ; iSegment++ )
+    valid &= benchAppend() ;
+  halSetFlashWriteBudget(i_cut) ;
+  benchAppend() ;
+
+  // Reboot
+  halSetFlashWriteBudget(UINT32_MAX) ;
+  flashLogBegin() ;
+  valid &= flashLogSize() == 3 * FLASH_LOG_SEGMENT_VALUES ;
+
+  // The sequence number of the cut segment is used again
+  benchFlashNextValue = 3 * FLASH_LOG_SEGMENT_VALUES ;
+  valid &= benchAppend() ;
+  valid &= benchDrain(0, 4 * FLASH_LOG_SEGMENT_VALUES, 0) ;
+  return valid ;
+}
+
+/**
+ * \fn bool benchCorruption( void )
+ * \return False if the values of a corrupted segment in the middle of the log were read, or others were lost
+*/
+static bool benchCorruption( void )
+{
+  char path[sizeof(FLASH_LOG_PREFIX) + 8] ;
+  uint8_t byte = 0xA5 ;
+  File file ;
+  bool valid = true ;
+
+  halResetFlash() ;
+  flashLogBegin() ;
+  benchFlashNextValue = 0 ;
+
+  for ( uint8_t iSegment = 0 ; iSegment < 4 ; iSegment++ )
+    valid &= benchAppend() ;
+
+  sprintf(path, FLASH_LOG_PREFIX "%08x", 1) ;
+  file = SPIFFS.open(path, "r+") ;
+  file.seek(sizeof(FlashLogHeader) + 17) ;
+  file.write(&byte, 1) ;
+  file.close() ;
+
+  flashLogBegin() ;
+  valid &= benchDrain(0, 3 * FLASH_LOG_SEGMENT_VALUES, FLASH_LOG_SEGMENT_VALUES) ;
+  return valid ;
+}
+
+void benchFlash( void )
+{
+  static const uint32_t cuts[] = { 0, 1, sizeof(FlashLogHeader) - 1, sizeof(FlashLogHeader), sizeof(FlashLogHeader) + 1,
+                                   sizeof(FlashLogHeader) + FLASH_LOG_SEGMENT_VALUES, sizeof(FlashLogHeader) + 2 * FLASH_LOG_SEGMENT_VALUES - 1 } ;
+  bool valid = true, recovered = true ;
+
+  valid &= benchThroughput() ;
+  valid &= benchRotation() ;
+  for ( uint8_t iCut = 0 ; iCut < sizeof(cuts) / sizeof(cuts[0]) ; iCut++ )
+    recovered &= benchPowerLoss(cuts[iCut]) ;
+  printf("%-40s %9u cuts %s\n", "power loss during a write", (unsigned int) ( sizeof(cuts) / sizeof(cuts[0]) ), recovered ? "recovered" : "INVALID") ;
+  valid &= recovered ;
+  recovered = benchCorruption() ;
+  printf("%-40s %9s\n", "corrupted segment skipped", recovered ? "yes" : "INVALID") ;
+  valid &= recovered ;
+  halResetFlash() ;
+
+  if ( !valid )
+  {
+    printf("the flash log lost or corrupted values\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,128 @@
+/**
+  \file bench_frame.cpp
+  \brief Frames sent to the strip versus frames skipped by the frame buffer, for typical animations, and the time of a
+         frame against the length of the strip
+*/
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/strip.h"
+
+#define BENCH_FRAME_NB_FRAMES     24000
+#define BENCH_FRAME_BUDGET_MS     80    /*!< delayAnimation, the period of animate() */
+#define BENCH_FRAME_WIRE_NS       30000 /*!< Time to send one pixel, 24 bits at 800 kHz, with the interrupts disabled */
+#define BENCH_FRAME_LATCH_NS      50000 /*!< Low time latching a frame into the strip */
+
+void animate() ;
+
+extern int8_t   brightness ;
+extern int16_t  deltaHue ;
+extern Strip<24> strip ;
+
+static bool benchFrameValid = true ;
+
+/**
+ * \fn void benchAnimation( const char *i_name, int8_t i_brightness, int16_t i_deltaHue )
+ * \param[in] i_name Name printed in the report
+ * \param[in] i_brightness Brightness level of the strip
+ * \param[in] i_deltaHue Change of the shifted hue at each frame
+ * \brief Run animate() and report its cost and how many frames reached the strip
+*/
+static void benchAnimation( const char *i_name, int8_t i_brightness, int16_t i_deltaHue )
+{
+  uint32_t pushed   = strip.frame().framesPushed() ;
+  uint32_t skipped  = strip.frame().framesSkipped() ;
+  uint32_t shows    = halCountShow() ;
+
+  brightness  = i_brightness ;
+  deltaHue    = i_deltaHue ;
+  animate() ;
+  benchRun(i_name, BENCH_FRAME_NB_FRAMES, animate) ;
+  printf("%-40s %12u pushed %8u skipped %8u show()\n", "", strip.frame().framesPushed() - pushed, strip.frame().framesSkipped() - skipped, halCountShow() - shows) ;
+}
+
+/**
+ * \fn bool benchWheel( Strip<N> *io_strip, Adafruit_NeoPixel *i_pixels )
+ * \return False if a frame of a turn does not light N / 2 consecutive pixels from the position of the wheel, or if
+ *         the turn does not bring the wheel back where it started after going through every pixel of a short strip
+*/
+template<uint16_t N> static bool benchWheel( Strip<N> *io_strip, Adafruit_NeoPixel *i_pixels )
+{
+  uint16_t start = io_strip->position(), nbLeading = 0 ;
+  bool valid = true ;
+
+  for ( uint16_t iFrame = 0 ; iFrame < STRIP_FRAMES_PER_TURN ; iFrame++ )
+  {
+    uint16_t position = io_strip->position() ;
+
+    io_strip->renderWheel(1, 0) ;
+    io_strip->show() ;
+    for ( uint16_t iPixel = 0 ; iPixel < N ; iPixel++ )
+      valid &= i_pixels->getPixelColor(( position + iPixel ) % N) == ( iPixel < N / 2 ? 1u : 0u ) ;
+    nbLeading += position != io_strip->position() ? 1 : 0 ;
+  }
+  return valid && io_strip->position() == start && ( N > STRIP_FRAMES_PER_TURN || nbLeading == N ) ;
+}
+
+/**
+ * \fn Strip<N> & benchLengthStrip( Adafruit_NeoPixel **o_pixels )
+ * \return The strip of N pixels of the benchmark, with the pixels it is sent to if o_pixels is not NULL
+*/
+template<uint16_t N> static Strip<N> & benchLengthStrip( Adafruit_NeoPixel **o_pixels = NULL )
+{
+  static Adafruit_NeoPixel pixels(N, 12, NEO_GRB + NEO_KHZ800) ;
+  static Strip<N> lengthStrip(pixels) ;
+
+  if ( o_pixels != NULL )
+    *o_pixels = &pixels ;
+  return lengthStrip ;
+}
+
+template<uint16_t N> static void benchStripFrame( void )
+{
+  benchLengthStrip<N>().renderWheel(0x00FF00, 0) ;
+  benchLengthStrip<N>().show() ;
+}
+
+/**
+ * \fn void benchStrip( void )
+ * \brief Time to build and push a frame of the wheel on a strip of N pixels, against the period of animate()
+*/
+template<uint16_t N> static void benchStrip( void )
+{
+  Adafruit_NeoPixel *pixels ;
+  Strip<N> &lengthStrip = benchLengthStrip<N>(&pixels) ;
+  char name[40] ;
+  BenchResult result ;
+  double wireMs = ( (double) N * BENCH_FRAME_WIRE_NS + BENCH_FRAME_LATCH_NS ) / 1e6 ;
+  bool valid = benchWheel(&lengthStrip, pixels) ;
+
+  snprintf(name, sizeof(name), "Strip<%u> wheel frame", N) ;
+  result = benchRun(name, 2400000 / N, benchStripFrame<N>) ;
+  printf("%-40s %8.2f ns/pixel, wire %7.2f ms, %5.1f%% of %u ms %s\n", "", result.nsPerCall / N, wireMs,
+         ( result.nsPerCall / 1e6 + wireMs ) * 100 / BENCH_FRAME_BUDGET_MS, BENCH_FRAME_BUDGET_MS, valid ? "" : "INVALID") ;
+  benchFrameValid &= valid ;
+}
+
+void benchFrame( void )
+{
+  benchAnimation("animate(), steady hue", 1, 0) ;
+  benchAnimation("animate(), brightness 0", 0, 0) ;
+  benchAnimation("animate(), changing hue", 10, 1) ;
+
+  benchStrip<24>() ;
+  benchStrip<60>() ;
+  benchStrip<150>() ;
+  benchStrip<300>() ;
+  benchStrip<600>() ;
+  benchStrip<1200>() ;
+  printf("%-40s %8u pixels within %u ms on the wire\n", "longest strip", (unsigned) ( ( BENCH_FRAME_BUDGET_MS * 1000000ULL - BENCH_FRAME_LATCH_NS ) / BENCH_FRAME_WIRE_NS ), BENCH_FRAME_BUDGET_MS) ;
+
+  if ( !benchFrameValid )
+  {
+    printf("the wheel does not turn as expected\n") ;
+    exit(1) ;
+  }
+}
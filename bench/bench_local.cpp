@@ -0,0 +1,208 @@
+/**
+  \file bench_local.cpp
+  \brief Requests per second and allocations of the local HTTP server, with clients on loopback sockets, and the
+         checks of its responses and of its streams of events
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <string>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/local_server.h"
+#include "../src/server.h"
+
+#define BENCH_LOCAL_NB_REQUESTS 2000
+#define BENCH_LOCAL_NB_EVENTS   50
+#define BENCH_LOCAL_NB_STREAMS  ( LOCAL_SERVER_MAX_CLIENTS - 1 ) /*!< Streams open while the requests are served */
+
+static bool         benchLocalValid       = true ;
+static const char   *benchLocalPath       = "/levels" ;
+static uint64_t     benchStepAllocations  = 0 ;   /*!< Allocations within localServerStep(), by the server and the sockets of the host */
+
+/**
+ * \fn int benchConnect( const char *i_path, bool i_complete )
+ * \param[in] i_complete Whether to send the blank line ending the headers of the request
+ * \return A socket connected to the local server, which sent the request for i_path, -1 on failure
+*/
+static int benchConnect( const char *i_path, bool i_complete = true )
+{
+  struct sockaddr_in address ;
+  char request[128] ;
+  int fd = socket(AF_INET, SOCK_STREAM, 0) ;
+  size_t length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: noisey.local\r\nAccept: */*\r\n%s", i_path, i_complete ? "\r\n" : "") ;
+
+  memset(&address, 0, sizeof(address)) ;
+  address.sin_family      = AF_INET ;
+  address.sin_port        = htons(halListenPort()) ;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK) ;
+  if ( fd < 0 || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || send(fd, request, length, 0) != (ssize_t) length )
+  {
+    if ( fd >= 0 )
+      close(fd) ;
+    return -1 ;
+  }
+  return fd ;
+}
+
+/**
+ * \fn bool benchReceive( int i_fd, std::string *io_received, bool i_untilClosed )
+ * \brief Step the server and read what it sent, until it closes the connection or, for a stream, until nothing is left
+ * \return False if the server did not close the connection when expected
+*/
+static bool benchReceive( int i_fd, std::string *io_received, bool i_untilClosed )
+{
+  for ( uint32_t iStep = 0 ; iStep < 100000 ; iStep++ )
+  {
+    char buffer[1024] ;
+    ssize_t length ;
+
+    uint64_t allocations = benchAllocations() ;
+
+    localServerStep() ;
+    benchStepAllocations += benchAllocations() - allocations ;
+    while ( ( length = recv(i_fd, buffer, sizeof(buffer), MSG_DONTWAIT) ) > 0 )
+      io_received->append(buffer, length) ;
+    if ( length == 0 )
+      return true ;
+    if ( !i_untilClosed && iStep > 2 )
+      return true ;
+  }
+  return !i_untilClosed ;
+}
+
+/**
+ * \fn std::string benchBody( const std::string &i_response, int *o_code )
+ * \return The body of a chunked response put back together, with the status code, -1 if it is malformed
+*/
+static std::string benchBody( const std::string &i_response, int *o_code )
+{
+  size_t position = i_response.find("\r\n\r\n") ;
+  std::string body ;
+
+  *o_code = -1 ;
+  if ( position == std::string::npos || sscanf(i_response.c_str(), "HTTP/1.1 %d", o_code) != 1 || i_response.find("Transfer-Encoding: chunked") > position )
+    return body ;
+
+  for ( position += 4 ; position < i_response.size() ; )
+  {
+    size_t end = i_response.find("\r\n", position) ;
+    unsigned long size = strtoul(i_response.c_str() + position, NULL, 16) ;
+
+    if ( end == std::string::npos || end + 2 + size + 2 > i_response.size() )
+      break ;
+    if ( size == 0 )
+      return body ;
+    body.append(i_response, end + 2, size) ;
+    position = end + 2 + size + 2 ;
+  }
+  *o_code = -1 ;
+  return body ;
+}
+
+/**
+ * \fn std::string benchGet( const char *i_path, int *o_code )
+ * \return The body of the response to a request for i_path, with its status code
+*/
+static std::string benchGet( const char *i_path, int *o_code )
+{
+  std::string response ;
+  int fd = benchConnect(i_path) ;
+
+  if ( fd < 0 || !benchReceive(fd, &response, true) )
+    response.clear() ;
+  if ( fd >= 0 )
+    close(fd) ;
+  return benchBody(response, o_code) ;
+}
+
+static void benchLocalRequest( void )
+{
+  int code ;
+
+  benchLocalValid &= benchGet(benchLocalPath, &code).size() > 0 && code == 200 ;
+}
+
+void benchLocal( void )
+{
+  std::string expected = "{\"values\":[", body, streams[BENCH_LOCAL_NB_STREAMS] ;
+  int fds[BENCH_LOCAL_NB_STREAMS], extra, code ;
+  char name[40] ;
+  std::string rejected ;
+  uint32_t nbEvents = 0 ;
+
+  halReset() ;
+  localServerBegin() ;
+  for ( int16_t iValue = 0 ; iValue < 3 * SERVER_SIZE_BUFFER_DATA ; iValue++ )
+    addDataSendServer(iValue) ;
+  for ( int16_t iValue = 3 * SERVER_SIZE_BUFFER_DATA - 100 ; iValue < 3 * SERVER_SIZE_BUFFER_DATA ; iValue++ )
+    expected += std::to_string(iValue) + ( iValue + 1 < 3 * SERVER_SIZE_BUFFER_DATA ? "," : "" ) ;
+  expected += "],\"overwritten\":false}" ;
+
+  // The responses, put back together from their chunks
+  body = benchGet("/values?n=100", &code) ;
+  benchLocalValid &= code == 200 && body == expected ;
+  body = benchGet("/metrics", &code) ;
+  benchLocalValid &= code == 200 && body.find("\"requests\":2") != std::string::npos ;
+  benchGet("/nowhere", &code) ;
+  benchLocalValid &= code == 404 ;
+  printf("%-40s %12u bytes for 100 values %s\n", "GET /values?n=100", (unsigned) expected.size(), benchLocalValid ? "" : "INVALID") ;
+
+  // The streams take all the slots but one, which serves the requests one after the other
+  for ( uint8_t iStream = 0 ; iStream < BENCH_LOCAL_NB_STREAMS ; iStream++ )
+  {
+    fds[iStream] = benchConnect("/events") ;
+    benchLocalValid &= fds[iStream] >= 0 && benchReceive(fds[iStream], &streams[iStream], false) ;
+  }
+  benchLocalPath        = "/levels" ;
+  benchStepAllocations  = 0 ;
+  benchRun("GET /levels, streams open", BENCH_LOCAL_NB_REQUESTS, benchLocalRequest) ;
+  snprintf(name, sizeof(name), "GET /values?n=%u", SERVER_SIZE_BUFFER_DATA - 1) ;
+  benchLocalPath        = "/values?n=1000" ;
+  benchRun(name, BENCH_LOCAL_NB_REQUESTS, benchLocalRequest) ;
+  printf("%-40s %12.2f allocs/request in localServerStep(), the host sockets included\n", "", benchStepAllocations / ( 2.0 * BENCH_LOCAL_NB_REQUESTS ) ) ;
+
+  // A client beyond LOCAL_SERVER_MAX_CLIENTS is turned away at once, while the last slot waits for the end of a request
+  extra = benchConnect("/levels", false) ;
+  benchReceive(extra, &rejected, false) ;
+  body  = benchGet("/levels", &code) ;
+  send(extra, "\r\n", 2, 0) ;
+  benchReceive(extra, &rejected, true) ;
+  close(extra) ;
+  benchLocalValid &= code == 503 && localServerRejected() == 1 && benchBody(rejected, &code).size() > 0 && code == 200 ;
+
+  // Each stream gets one event per window published by measure()
+  for ( uint32_t iEvent = 0 ; iEvent < BENCH_LOCAL_NB_EVENTS ; iEvent++ )
+  {
+    localServerPublish(iEvent) ;
+    localServerStep() ;
+  }
+  for ( uint8_t iStream = 0 ; iStream < BENCH_LOCAL_NB_STREAMS ; iStream++ )
+  {
+    size_t position = 0 ;
+
+    benchReceive(fds[iStream], &streams[iStream], false) ;
+    close(fds[iStream]) ;
+    while ( ( position = streams[iStream].find("\ndata: {", position) ) != std::string::npos )
+    {
+      position++ ;
+      nbEvents++ ;
+    }
+  }
+  printf("%-40s %12u events of %u on %u streams\n", "GET /events", nbEvents, ( BENCH_LOCAL_NB_EVENTS + 1 ) * BENCH_LOCAL_NB_STREAMS, BENCH_LOCAL_NB_STREAMS) ;
+  benchLocalValid &= nbEvents == ( BENCH_LOCAL_NB_EVENTS + 1 ) * BENCH_LOCAL_NB_STREAMS ;
+
+  for ( uint8_t iStep = 0 ; iStep < 4 ; iStep++ )
+    localServerStep() ;
+  localServerStop() ;
+  halReset() ;
+
+  if ( !benchLocalValid )
+  {
+    printf("the local server answered wrong\n") ;
+    exit(1) ;
+  }
+}
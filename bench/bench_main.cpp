@@ -0,0 +1,157 @@
+/**
+  \file bench_main.cpp
+  \brief Entry point of the microbenchmarks : run the suites selected on the command line, or all of them
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+
+#include <hal_native.h>
+#include "bench.h"
+
+/**
+ * \struct BenchSuite
+ * \brief A named group of benchmarks
+*/
+struct BenchSuite
+{
+  const char    *name ;
+  BenchFunction run ;
+} ;
+
+static const BenchSuite benchSuites[] =
+{
+  { "firmware", benchFirmware },
+  { "sampler",  benchSampler },
+  { "color",    benchColor },
+  { "frame",    benchFrame },
+  { "codec",    benchCodec },
+  { "connection", benchConnection },
+  { "uploader", benchUploader },
+  { "ring",     benchRing },
+  { "flash",    benchFlash },
+  { "config",   benchConfig },
+  { "boot",     benchBoot },
+  { "sound",    benchSound },
+  { "stats",    benchStats },
+  { "spectrum", benchSpectrum },
+  { "scheduler", benchScheduler },
+  { "probe", benchProbe },
+  { "local", benchLocal },
+  { "report", benchReport },
+  { "registration", benchRegistration },
+  { "snapshot", benchSnapshot },
+  { "pyramid", benchPyramid },
+  { "settings", benchSettings },
+} ;
+
+static uint64_t benchAllocationCount = 0 ;
+
+void * operator new( size_t i_size )
+{
+  void *pointer = malloc(i_size ? i_size : 1) ;
+  if ( pointer == NULL )
+    throw std::bad_alloc() ;
+  benchAllocationCount++ ;
+  return pointer ;
+}
+
+void * operator new[]( size_t i_size )
+{
+  return operator new(i_size) ;
+}
+
+void operator delete( void *i_pointer ) noexcept
+{
+  free(i_pointer) ;
+}
+
+void operator delete[]( void *i_pointer ) noexcept
+{
+  free(i_pointer) ;
+}
+
+void operator delete( void *i_pointer, size_t i_size ) noexcept
+{
+  (void) i_size ;
+  free(i_pointer) ;
+}
+
+void operator delete[]( void *i_pointer, size_t i_size ) noexcept
+{
+  (void) i_size ;
+  free(i_pointer) ;
+}
+
+uint64_t benchNowNanos( void )
+{
+  struct timespec now ;
+
+  clock_gettime(CLOCK_MONOTONIC, &now) ;
+  return now.tv_sec * 1000000000ULL + now.tv_nsec ;
+}
+
+uint64_t benchAllocations( void )
+{
+  return benchAllocationCount ;
+}
+
+/**
+ * \fn BenchResult benchRun( const char *i_name, uint32_t i_iterations, BenchFunction i_function, BenchFunction i_prepare )
+ * \param[in] i_name Name printed in the report
+ * \param[in] i_iterations Number of calls to time
+ * \param[in] i_function Function to time
+ * \param[in] i_prepare Function called before each call and excluded from the measure, may be NULL
+ * \brief Time a function and count its heap allocations, then print one line of report
+*/
+BenchResult benchRun( const char *i_name, uint32_t i_iterations, BenchFunction i_function, BenchFunction i_prepare )
+{
+  BenchResult result ;
+  uint64_t elapsed = 0, allocations = 0 ;
+
+  if ( i_prepare == NULL )
+  {
+    // Time the whole batch, so that the cost of reading the clock does not hide the one of short functions
+    uint64_t startAllocations = benchAllocationCount ;
+    uint64_t start            = benchNowNanos() ;
+    for ( uint32_t iIteration = 0 ; iIteration < i_iterations ; iIteration++ )
+      i_function() ;
+    elapsed     = benchNowNanos() - start ;
+    allocations = benchAllocationCount - startAllocations ;
+  }
+
+  for ( uint32_t iIteration = 0 ; iIteration < i_iterations && i_prepare != NULL ; iIteration++ )
+  {
+    i_prepare() ;
+
+    uint64_t startAllocations = benchAllocationCount ;
+    uint64_t start            = benchNowNanos() ;
+    i_function() ;
+    elapsed     += benchNowNanos() - start ;
+    allocations += benchAllocationCount - startAllocations ;
+  }
+
+  result.nsPerCall      = (double) elapsed / i_iterations ;
+  result.allocsPerCall  = (double) allocations / i_iterations ;
+  printf("%-40s %12.1f ns/call %8.2f allocs/call\n", i_name, result.nsPerCall, result.allocsPerCall) ;
+  return result ;
+}
+
+int main( int argc, char **argv )
+{
+  for ( size_t iSuite = 0 ; iSuite < sizeof(benchSuites) / sizeof(benchSuites[0]) ; iSuite++ )
+  {
+    bool selected = argc < 2 ;
+    for ( int iArg = 1 ; iArg < argc ; iArg++ )
+      selected |= strcmp(argv[iArg], benchSuites[iSuite].name) == 0 ;
+    if ( !selected )
+      continue ;
+
+    printf("== %s\n", benchSuites[iSuite].name) ;
+    halReset() ;
+    benchSuites[iSuite].run() ;
+  }
+  return 0 ;
+}
@@ -0,0 +1,89 @@
+/**
+  \file bench_probe.cpp
+  \brief Cost of a probe, and accuracy of the statistics of probe.cpp against the exact ones of the same durations
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <vector>
+#include <algorithm>
+
+#include "bench.h"
+#include "../src/probe.h"
+#include "../src/server.h"
+
+#define BENCH_PROBE_NB_RUNS     200000  /*!< Runs recorded, enough to halve the histogram several times */
+#define BENCH_PROBE_NB_CALLS    1000000
+#define BENCH_PROBE_LATE_US     1500    /*!< Delay of the start of one run of measure(), the jitter expected */
+
+#ifdef PROBE_ENABLE
+static void benchProbeScope( void )
+{
+  PROBE_SCOPE(PROBE_ANIMATE) ;
+}
+#endif
+
+void benchProbe( void )
+{
+#ifdef PROBE_ENABLE
+  std::vector<uint32_t> durations ;
+  uint32_t cyclesPerMicro = ESP.getCpuFreqMHz(), seed = 12345, start = 0, exactP99 ;
+  uint64_t sum = 0 ;
+  ProbeSummary summary ;
+  char message[SERVER_SIZE_MESSAGE_JSON] ;
+  size_t length ;
+  int16_t data[SERVER_SIZE_MESSAGE_DATA] = { 0 } ;
+  LevelSummary levels ;
+  bool valid ;
+
+  // Durations of a few hundred us, with a tail of long runs up to tens of ms, started every 80 ms on the virtual clock
+  // but one, late by BENCH_PROBE_LATE_US
+  halReset() ;
+  probeClear() ;
+  probeSetPeriod(PROBE_MEASURE, 80) ;
+  for ( uint32_t iRun = 0 ; iRun < BENCH_PROBE_NB_RUNS ; iRun++ )
+  {
+    uint32_t cycles, late = iRun == BENCH_PROBE_NB_RUNS / 2 ? BENCH_PROBE_LATE_US : 0 ;
+
+    seed    = seed * 1103515245 + 12345 ;
+    cycles  = 20000 + ( seed >> 16 ) % 20000 ;
+    cycles <<= ( seed >> 8 ) % 64 == 0 ? ( seed >> 4 ) % 8 : 0 ;
+    halAdvanceMicros(late + cycles / cyclesPerMicro) ;
+    probeRecord(PROBE_MEASURE, start, start + cycles) ;
+    halAdvanceMicros(80 * 1000 - late - cycles / cyclesPerMicro) ;
+    durations.push_back(cycles) ;
+    sum   += cycles ;
+    start += 80 * 1000 * cyclesPerMicro ;
+  }
+  std::sort(durations.begin(), durations.end()) ;
+  exactP99 = durations[( durations.size() * 99 + 99 ) / 100 - 1] ;
+
+  probeSummarize(PROBE_MEASURE, &summary) ;
+  valid = summary.nbCalls == BENCH_PROBE_NB_RUNS && summary.min == durations.front() / cyclesPerMicro && summary.max == durations.back() / cyclesPerMicro &&
+          summary.mean == sum / BENCH_PROBE_NB_RUNS / cyclesPerMicro && summary.jitter == BENCH_PROBE_LATE_US &&
+          summary.p99 >= exactP99 / cyclesPerMicro && summary.p99 <= exactP99 * 5 / 4 / cyclesPerMicro + 1 ;
+  printf("%-40s %12u us p99, exact %u us, max %u us, jitter %u us %s\n", "probe of 200000 runs", summary.p99, exactP99 / cyclesPerMicro, summary.max, summary.jitter, valid ? "" : "INVALID") ;
+
+  // The cost of an empty scope, twice the cycle counter
+  benchRun("PROBE_SCOPE(), empty scope", BENCH_PROBE_NB_CALLS, benchProbeScope) ;
+
+  // The probes fit in the first message of an upload, with the summary of the levels
+  memset(&levels, 0, sizeof(levels)) ;
+  for ( uint8_t iProbe = 0 ; iProbe < PROBE_NB_PROBES ; iProbe++ )
+    probeRecord(iProbe, 0, UINT32_MAX) ;
+  PROBE_HEAP() ;
+  length = buildDataMessageJSON(message, sizeof(message), "AbC123", 1920, SERVER_SIZE_BUFFER_DATA, true, data, SERVER_SIZE_MESSAGE_DATA, &levels, UINT32_MAX) ;
+  printf("%-40s %12u bytes of %u\n", "first message with the probes", (unsigned) length, SERVER_SIZE_MESSAGE_JSON) ;
+  valid &= length < sizeof(message) - 1 && strstr(message, "\"probes\"") != NULL ;
+  probeSetPeriod(PROBE_MEASURE, 0) ;
+  probeClear() ;
+  halReset() ;
+
+  if ( !valid )
+  {
+    printf("the statistics of the probes are wrong\n") ;
+    exit(1) ;
+  }
+#else
+  printf("%-40s built without PROBE_ENABLE\n", "probe") ;
+#endif
+}
@@ -0,0 +1,286 @@
+/**
+  \file bench_pyramid.cpp
+  \brief Cost of a value in the tiers of value_pyramid.h, their aggregates against the ones of the values, and what the
+         server gets at each tier, when healthy and after outages that outlast the buffer or a tier
+
+  The values of the uploads are consecutive numbers, so that an aggregate of them covers the numbers from its minimum to
+  its maximum : every number added must be covered by a value or an aggregate the server acknowledged.
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "../src/connection.h"
+#include "../src/flash_log.h"
+#include "../src/server.h"
+#include "../src/uploader.h"
+#include "../src/value_pyramid.h"
+
+#define BENCH_PYRAMID_NB_CHECKED    ( 8 * PYRAMID_MINUTE_VALUES * PYRAMID_QUARTER_MINUTES ) /*!< Random values whose aggregates are checked */
+#define BENCH_PYRAMID_NB_ADDS       1000000
+#define BENCH_PYRAMID_VALUE_MS      1920    /*!< Delay between two values, delayUpdateValue of the firmware, in ms */
+#define BENCH_PYRAMID_PERIOD_MS     300000  /*!< Delay between two uploads, the slowest fixed rate */
+#define BENCH_PYRAMID_STEP_MS       10      /*!< Delay between two calls of the uploader, in ms */
+#define BENCH_PYRAMID_HEALTHY_MS    3600000 /*!< Time the server is healthy after the outage of a scenario, in ms */
+#define BENCH_PYRAMID_FIRST_VALUE   10000   /*!< First number added, above the values the other suites left in the flash log */
+
+/**
+ * \struct BenchPyramidScenario
+ * \brief Tier uploaded, and outage of the server
+*/
+struct BenchPyramidScenario
+{
+  const char  *name ;
+  bool        aggregated ;  /*!< Whether the tier is the one of pyramidTierFor() at the slowest rate, or PYRAMID_RAW */
+  uint32_t    downMillis ;  /*!< Drop every request during the first ms of the run */
+  bool        noFlash ;     /*!< Whether the flash log fails to write */
+} ;
+
+static const BenchPyramidScenario benchPyramidScenarios[] =
+{
+  { "raw, 300 s",                   false, 0,        false },
+  { "aggregates, 300 s",            true,  0,        false },
+  { "raw, no flash, down 1 h",      false, 3600000,  true },
+  { "aggregates, down 3 h",         true,  10800000, false },
+} ;
+
+static int16_t              benchValue ;
+static uint32_t             benchDownUntil ;
+static std::vector<uint8_t> benchCovered ;  /*!< Whether the server got each number, or an aggregate holding it */
+
+/**
+ * \fn bool benchParseArray( const std::string &i_body, const char *i_key, std::vector<long> *o_values )
+ * \return False if the array is missing
+*/
+static bool benchParseArray( const std::string &i_body, const char *i_key, std::vector<long> *o_values )
+{
+  size_t position = i_body.find(std::string("\"") + i_key + "\":[") ;
+  const char *value ;
+
+  o_values->clear() ;
+  if ( position == std::string::npos )
+    return false ;
+  for ( value = i_body.c_str() + position + strlen(i_key) + 4 ; *value != ']' && *value != '\0' ; )
+  {
+    char *end ;
+
+    o_values->push_back(strtol(value, &end, 10)) ;
+    value = *end == ',' ? end + 1 : end ;
+  }
+  return true ;
+}
+
+/**
+ * \fn void benchCover( long i_from, long i_to )
+ * \brief Mark the numbers from i_from to i_to as received
+*/
+static void benchCover( long i_from, long i_to )
+{
+  for ( long iValue = i_from < 0 ? 0 : i_from ; iValue <= i_to && iValue < (long) benchCovered.size() ; iValue++ )
+    benchCovered[iValue] = 1 ;
+}
+
+/**
+ * \fn int16_t benchPyramidHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server down until benchDownUntil, then marking the numbers of the values and of the aggregates it gets
+*/
+static int16_t benchPyramidHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  std::string body((const char *) i_body, i_length) ;
+  std::vector<long> values, mins, maxs ;
+
+  (void) i_host ;
+  (void) i_endPoint ;
+  *o_response = "{}" ;
+  if ( millis() < benchDownUntil )
+    return -1 ;
+
+  benchParseArray(body, "noise", &values) ;
+  if ( benchParseArray(body, "min", &mins) && benchParseArray(body, "max", &maxs) )
+    for ( size_t iAggregate = 0 ; iAggregate < mins.size() && iAggregate < maxs.size() ; iAggregate++ )
+      benchCover(mins[iAggregate], maxs[iAggregate]) ;
+  else
+    for ( size_t iValue = 0 ; iValue < values.size() ; iValue++ )
+      benchCover(values[iValue], values[iValue]) ;
+  return 200 ;
+}
+
+/**
+ * \fn bool benchCheckAggregate( const PyramidAggregate *i_aggregate, const std::vector<int16_t> &i_values, size_t i_first, uint32_t i_count )
+ * \return True if the aggregate is the one of the i_count values from i_first
+*/
+static bool benchCheckAggregate( const PyramidAggregate *i_aggregate, const std::vector<int16_t> &i_values, size_t i_first, uint32_t i_count )
+{
+  int16_t min = INT16_MAX, max = INT16_MIN ;
+  int64_t sum = 0 ;
+
+  for ( size_t iValue = i_first ; iValue < i_first + i_count ; iValue++ )
+  {
+    min  = i_values[iValue] < min ? i_values[iValue] : min ;
+    max  = i_values[iValue] > max ? i_values[iValue] : max ;
+    sum += i_values[iValue] ;
+  }
+  return i_aggregate->min == min && i_aggregate->max == max && i_aggregate->count == i_count
+      && i_aggregate->mean == (int16_t) lround((double) sum / i_count) ;
+}
+
+/**
+ * \fn bool benchCheckTiers( void )
+ * \return False if an aggregate is not the one of its values
+ * \brief Add random values, mostly small and some at the extremes, and check each aggregate as it is queued
+*/
+static bool benchCheckTiers( void )
+{
+  std::vector<int16_t> values ;
+  uint32_t seed = 777, origin = noiseBufferServer.back(), nbChecked = 0, nbWrong = 0 ;
+
+  for ( uint32_t iValue = 0 ; iValue < BENCH_PYRAMID_NB_CHECKED ; iValue++ )
+  {
+    uint32_t minutes = pyramidMinutes.back(), quarters = pyramidQuarters.back() ;
+    int16_t value ;
+
+    seed  = seed * 1103515245 + 12345 ;
+    value = ( seed >> 8 ) % 50 == 0 ? ( ( seed >> 20 ) & 1 ? INT16_MAX : INT16_MIN ) : (int16_t) ( ( seed >> 16 ) % 201 ) - 100 ;
+    values.push_back(value) ;
+    addDataSendServer(value) ;
+
+    // Only the aggregates whose values were all added here
+    for ( uint8_t iTier = PYRAMID_MINUTE ; iTier < PYRAMID_NB_TIERS ; iTier++ )
+    {
+      PyramidTier tier = (PyramidTier) iTier ;
+      uint32_t position = pyramidRing(tier)->back() - 1 ;
+      const PyramidAggregate *aggregate ;
+
+      if ( pyramidRing(tier)->back() == ( tier == PYRAMID_MINUTE ? minutes : quarters ) || position * pyramidSpan(tier) < origin )
+        continue ;
+      pyramidRing(tier)->peek(position, &aggregate) ;
+      nbChecked++ ;
+      nbWrong += !benchCheckAggregate(aggregate, values, position * pyramidSpan(tier) - origin, pyramidSpan(tier)) ;
+    }
+  }
+
+  printf("%-40s %12u aggregates checked, %u wrong\n", "pyramid", nbChecked, nbWrong) ;
+  return nbWrong == 0 && nbChecked >= BENCH_PYRAMID_NB_CHECKED / PYRAMID_MINUTE_VALUES ;
+}
+
+static void benchPyramidAdd( void )
+{
+  pyramidAdd(benchValue++ & 0x3FF) ;
+}
+
+static void benchPush( void )
+{
+  noiseBufferServer.push(benchValue++ & 0x3FF) ;
+}
+
+static void benchAddDataSendServer( void )
+{
+  addDataSendServer(benchValue++ & 0x3FF) ;
+}
+
+/**
+ * \fn bool benchPyramidRun( const BenchPyramidScenario *i_scenario )
+ * \return False if a number added is covered by nothing the server got
+ * \brief Add a number every BENCH_PYRAMID_VALUE_MS and upload every BENCH_PYRAMID_PERIOD_MS, through the outage and
+ *        for an hour after it
+*/
+static bool benchPyramidRun( const BenchPyramidScenario *i_scenario )
+{
+  PyramidTier tier = i_scenario->aggregated ? pyramidTierFor(BENCH_PYRAMID_PERIOD_MS, BENCH_PYRAMID_VALUE_MS) : PYRAMID_RAW ;
+  uint32_t startMillis = millis(), healthyMillis, lastValueMillis = startMillis, lastUploadMillis = startMillis ;
+  uint32_t requests = 0, first, last, nbCovered = 0 ;
+  uint64_t bytes = 0 ;
+  bool healthy = false ;
+
+  // The previous runs are delivered, and the server is then down for the time of the outage
+  benchDownUntil  = 0 ;
+  uploaderStart("noisey", "HOST01", BENCH_PYRAMID_VALUE_MS, tier) ;
+  while ( uploaderStep() != UPLOADER_IDLE )
+    delay(BENCH_PYRAMID_STEP_MS) ;
+  halSetFlashWriteBudget(i_scenario->noFlash ? 0 : UINT32_MAX) ;
+  first           = benchValue ;
+  startMillis     = millis() ;
+  healthyMillis   = startMillis + i_scenario->downMillis ;
+  benchDownUntil  = healthyMillis ;
+
+  while ( millis() - startMillis < i_scenario->downMillis + BENCH_PYRAMID_HEALTHY_MS )
+  {
+    if ( millis() - lastValueMillis >= BENCH_PYRAMID_VALUE_MS )
+    {
+      lastValueMillis = millis() ;
+      addDataSendServer(benchValue++) ;
+    }
+    if ( millis() - lastUploadMillis >= BENCH_PYRAMID_PERIOD_MS && uploaderState() == UPLOADER_IDLE )
+    {
+      lastUploadMillis = millis() ;
+      uploaderStart("noisey", "HOST01", BENCH_PYRAMID_VALUE_MS, tier) ;
+    }
+    if ( !healthy && (int32_t) ( millis() - healthyMillis ) >= 0 )
+    {
+      healthy   = true ;
+      requests  = halCountHTTPRequest() ;
+      bytes     = halCountWireBytes() ;
+    }
+    uploaderStep() ;
+    delay(1) ;
+  }
+  requests  = halCountHTTPRequest() - requests ;
+  bytes     = halCountWireBytes() - bytes ;
+  halSetFlashWriteBudget(UINT32_MAX) ;
+
+  // The values of the aggregate being filled are sent with the next upload
+  last = tier == PYRAMID_RAW ? benchValue : benchValue - ( noiseBufferServer.back() % pyramidSpan(tier) ) ;
+  uploaderStart("noisey", "HOST01", BENCH_PYRAMID_VALUE_MS, tier) ;
+  while ( uploaderStep() != UPLOADER_IDLE || !flashLogEmpty() )
+  {
+    if ( uploaderState() == UPLOADER_IDLE )
+      uploaderStart("noisey", "HOST01", BENCH_PYRAMID_VALUE_MS, tier) ;
+    delay(BENCH_PYRAMID_STEP_MS) ;
+  }
+  for ( uint32_t iValue = first ; iValue < last ; iValue++ )
+    nbCovered += benchCovered[iValue] ;
+
+  printf("  %-30s %6.1f requests/h %7.1f kB/h once healthy, %5u/%5u values covered%s\n", i_scenario->name,
+         requests * 3600000.0 / BENCH_PYRAMID_HEALTHY_MS, bytes / 1024.0 * 3600000.0 / BENCH_PYRAMID_HEALTHY_MS,
+         nbCovered, last - first, nbCovered == last - first ? "" : " INVALID") ;
+  return nbCovered == last - first ;
+}
+
+/**
+ * \fn void benchPyramid( void )
+ * \brief Aggregates against their values, cost of a value, and uploads at the raw and aggregated tiers
+*/
+void benchPyramid( void )
+{
+  bool valid = true ;
+
+  valid &= benchCheckTiers() ;
+  // As many values in the buffer as in the tiers, which keeps their positions aligned
+  benchRun("pyramidAdd", BENCH_PYRAMID_NB_ADDS, benchPyramidAdd) ;
+  benchRun("noiseBufferServer.push", BENCH_PYRAMID_NB_ADDS, benchPush) ;
+  benchRun("addDataSendServer", BENCH_PYRAMID_NB_ADDS, benchAddDataSendServer) ;
+  valid &= pyramidTierFor(10000, BENCH_PYRAMID_VALUE_MS) == PYRAMID_RAW && pyramidTierFor(60000, BENCH_PYRAMID_VALUE_MS) == PYRAMID_RAW
+        && pyramidTierFor(300000, BENCH_PYRAMID_VALUE_MS) == PYRAMID_MINUTE && pyramidTierFor(14400000, BENCH_PYRAMID_VALUE_MS) == PYRAMID_QUARTER ;
+
+  halReset() ;
+  halSetHTTPHandler(benchPyramidHandler) ;
+  connectionClose() ;
+  flashLogBegin() ;
+  benchCovered.assign(INT16_MAX + 1, 0) ;
+  // Aggregates of the numbers only, none of them holding the values added above
+  for ( benchValue = BENCH_PYRAMID_FIRST_VALUE ; noiseBufferServer.back() % pyramidSpan(PYRAMID_QUARTER) != 0 ; )
+    addDataSendServer(benchValue++) ;
+  for ( uint8_t iScenario = 0 ; iScenario < sizeof(benchPyramidScenarios) / sizeof(benchPyramidScenarios[0]) ; iScenario++ )
+    valid &= benchPyramidRun(&benchPyramidScenarios[iScenario]) ;
+  halSetHTTPHandler(NULL) ;
+  connectionClose() ;
+  halReset() ;
+
+  if ( !valid )
+  {
+    printf("aggregates were wrong, or values were neither delivered nor aggregated\n") ;
+    exit(1) ;
+  }
+}
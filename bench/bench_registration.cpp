@@ -0,0 +1,211 @@
+/**
+  \file bench_registration.cpp
+  \brief Time and heap of parsing the response to /api/device/, as the firmware did with ArduinoJson and with the
+         streaming parser, on typical, oversized and malformed responses, and the checks of what the parser reads
+*/
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <hal_native.h>
+#include <string>
+
+#include "bench.h"
+#include "../src/connection.h"
+#include "../src/registration.h"
+
+#define BENCH_REGISTRATION_NB_PARSES  20000
+#define BENCH_REGISTRATION_PADDING    4096  /*!< Bytes of unknown fields added to the oversized response */
+
+/**
+ * \struct BenchRegistrationCase
+ * \brief A response, and what the parser must read from it
+*/
+struct BenchRegistrationCase
+{
+  const char  *name ;
+  const char  *body ;
+  bool        valid ;
+  const char  *shortID ;
+  uint16_t    fields ;
+  int32_t     offset ;
+  uint8_t     nbThresholds ;
+} ;
+
+#define BENCH_ALL_FIELDS ( REGISTRATION_FIELD(REGISTRATION_NB_FIELDS) - 1 )
+
+static const char benchTypical[] = "{\"shortID\":\"AB12CD\",\"config\":{\"offset\":-3,\"sensitivity\":5,\"luminosity\":4,"
+                                   "\"updateRate\":3,\"display\":1,\"deadband\":7,\"thresholds\":[15,30],\"snapshot\":70,\"version\":12}}" ;
+static const char benchTruncated[] = "{\"shortID\":\"AB12CD\",\"config\":{\"offset\":-3,\"sensi" ;
+
+static const BenchRegistrationCase benchCases[] =
+{
+  { "typical",              benchTypical, true, "AB12CD", BENCH_ALL_FIELDS, -3, 2 },
+  { "short ID only",        "{\"shortID\":\"S00042\"}", true, "S00042", 0, 0, 0 },
+  { "white space, escapes", " {\r\n \"name\" : \"a \\\"quoted\\\" \\\\ name\" ,\n \"shortID\" : \"X1\" , \"config\" : { \"offset\" : 12 } }\r\n",
+                            true, "X1", REGISTRATION_FIELD(REGISTRATION_OFFSET), 12, 0 },
+  { "conversions",          "{\"config\":{\"offset\":3.7e0,\"updateRate\":\"2\",\"display\":true,\"deadband\":null,\"luminosity\":\"bright\"},\"shortID\":\"C0NV\"}",
+                            true, "C0NV", REGISTRATION_FIELD(REGISTRATION_OFFSET) | REGISTRATION_FIELD(REGISTRATION_UPDATE_RATE) | REGISTRATION_FIELD(REGISTRATION_DISPLAY), 3, 0 },
+  { "beyond int32_t",       "{\"shortID\":\"OV\",\"config\":{\"updateRate\":4294967297,\"version\":-99999999999999999999,\"offset\":-2147483648,"
+                            "\"thresholds\":[2147483648,7]}}", true, "OV", REGISTRATION_FIELD(REGISTRATION_OFFSET) | REGISTRATION_FIELD(REGISTRATION_THRESHOLDS), INT32_MIN, 1 },
+  { "too many thresholds",  "{\"shortID\":\"T\",\"config\":{\"thresholds\":[1,2,3,4,5]}}", true, "T", REGISTRATION_FIELD(REGISTRATION_THRESHOLDS), 0, CONFIG_NB_THRESHOLDS },
+  { "settings elsewhere",   "{\"shortID\":\"E\",\"offset\":9,\"config\":[{\"offset\":9}],\"other\":{\"config\":{\"offset\":9}}}", true, "E", 0, 0, 0 },
+  { "no short ID",          "{\"config\":{\"offset\":1}}", false, "", REGISTRATION_FIELD(REGISTRATION_OFFSET), 1, 0 },
+  { "response to an upload", "{\"config\":{\"version\":7,\"offset\":2}}", false, "", REGISTRATION_FIELD(REGISTRATION_VERSION) | REGISTRATION_FIELD(REGISTRATION_OFFSET), 2, 0 },
+  { "short ID too long",    "{\"shortID\":\"ABCDEFGH\"}", false, "", 0, 0, 0 },
+  { "short ID not a string", "{\"shortID\":123456}", false, "", 0, 0, 0 },
+  { "truncated",            benchTruncated, false, "AB12CD", REGISTRATION_FIELD(REGISTRATION_OFFSET), -3, 0 },
+  { "trailing garbage",     "{\"shortID\":\"AB12CD\"} x", false, "AB12CD", 0, 0, 0 },
+  { "root not an object",   "[\"shortID\",\"AB12CD\"]", false, "", 0, 0, 0 },
+  { "unquoted key",         "{shortID:\"AB12CD\"}", false, "", 0, 0, 0 },
+  { "bad literal",          "{\"shortID\":\"AB12CD\",\"config\":{\"offset\":12abc}}", false, "AB12CD", 0, 0, 0 },
+  { "mismatched brackets",  "{\"shortID\":\"AB12CD\",\"config\":{\"thresholds\":[1,2}}}", false, "AB12CD", REGISTRATION_FIELD(REGISTRATION_THRESHOLDS), 0, 2 },
+  { "HTML error page",      "<html><body>502 Bad Gateway</body></html>", false, "", 0, 0, 0 },
+  { "empty",                "", false, "", 0, 0, 0 },
+} ;
+
+static std::string          benchOversized ;
+static std::string          benchDeep ;
+static const char           *benchBody ;
+static size_t               benchLength ;
+static RegistrationResponse benchResponse ;
+static bool                 benchParsed ;
+
+/**
+ * \fn void benchBuildResponses( void )
+ * \brief The typical response after BENCH_REGISTRATION_PADDING bytes of unknown fields, and a response nested too deep
+*/
+static void benchBuildResponses( void )
+{
+  benchOversized = "{\"description\":\"" ;
+  for ( uint32_t iChar = 0 ; iChar < BENCH_REGISTRATION_PADDING / 2 ; iChar++ )
+    benchOversized += (char) ( 'a' + iChar % 26 ) ;
+  benchOversized += "\",\"history\":[" ;
+  for ( uint32_t iEntry = 0 ; benchOversized.size() < BENCH_REGISTRATION_PADDING ; iEntry++ )
+    benchOversized += ( iEntry > 0 ? "," : "" ) + std::string("{\"at\":") + std::to_string(1500000000 + iEntry) + ",\"levels\":[41,52,63]}" ;
+  benchOversized += "]," + std::string(benchTypical + 1) ;
+
+  benchDeep = "{\"shortID\":\"DEEP\",\"a\":" ;
+  for ( uint8_t iDepth = 0 ; iDepth < REGISTRATION_MAX_DEPTH + 8 ; iDepth++ )
+    benchDeep += "[" ;
+  for ( uint8_t iDepth = 0 ; iDepth < REGISTRATION_MAX_DEPTH + 8 ; iDepth++ )
+    benchDeep += "]" ;
+  benchDeep += "}" ;
+}
+
+static void benchParseStream( void )
+{
+  registrationParseBegin(&benchResponse) ;
+  for ( size_t iByte = 0 ; iByte < benchLength ; iByte++ )
+    registrationParse((uint8_t) benchBody[iByte]) ;
+  benchParsed = registrationParseEnd() ;
+}
+
+/**
+ * \fn void benchParseArduinoJson( void )
+ * \brief What registerDevice() did before : the response in a String, parsed by a StaticJsonBuffer<256>
+*/
+static void benchParseArduinoJson( void )
+{
+  StaticJsonBuffer<256> jsonBuffer ;
+  String response ;
+
+  for ( size_t iByte = 0 ; iByte < benchLength ; iByte++ )
+    response += benchBody[iByte] ;
+  JsonObject& root = jsonBuffer.parseObject(response) ;
+  const char *shortID = root["shortID"] ;
+  benchParsed = shortID != NULL ;
+}
+
+/**
+ * \fn bool benchCheck( const BenchRegistrationCase *i_case, const char *i_body, size_t i_length )
+ * \return False if the parser read something else than expected, or allocated
+*/
+static bool benchCheck( const BenchRegistrationCase *i_case, const char *i_body, size_t i_length )
+{
+  uint64_t allocations = benchAllocations() ;
+  bool valid ;
+
+  benchBody   = i_body ;
+  benchLength = i_length ;
+  benchParseStream() ;
+  valid = benchParsed == i_case->valid && strcmp(benchResponse.shortID, i_case->shortID) == 0 && benchResponse.fields == i_case->fields
+       && benchResponse.nbThresholds == i_case->nbThresholds && benchAllocations() == allocations ;
+  if ( i_case->fields & REGISTRATION_FIELD(REGISTRATION_OFFSET) )
+    valid &= benchResponse.values[REGISTRATION_OFFSET] == i_case->offset ;
+  if ( i_case->fields == BENCH_ALL_FIELDS )
+    valid &= benchResponse.values[REGISTRATION_SENSITIVITY] == 5 && benchResponse.values[REGISTRATION_LUMINOSITY] == 4
+          && benchResponse.values[REGISTRATION_UPDATE_RATE] == 3 && benchResponse.values[REGISTRATION_DISPLAY] == 1
+          && benchResponse.values[REGISTRATION_DEADBAND] == 7 && benchResponse.thresholds[0] == 15 && benchResponse.thresholds[1] == 30
+          && benchResponse.values[REGISTRATION_SNAPSHOT] == 70 && benchResponse.values[REGISTRATION_VERSION] == 12 ;
+  if ( !valid )
+    printf("%-40s INVALID\n", i_case->name) ;
+  return valid ;
+}
+
+/**
+ * \fn int16_t benchRegistrationHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server answering the oversized response
+*/
+static int16_t benchRegistrationHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  (void) i_host ;
+  (void) i_endPoint ;
+  (void) i_body ;
+  (void) i_length ;
+  *o_response = benchOversized.c_str() ;
+  return 200 ;
+}
+
+/**
+ * \fn void benchTime( const char *i_label, const char *i_body, size_t i_length )
+ * \brief Time both parsers on a response
+*/
+static void benchTime( const char *i_label, const char *i_body, size_t i_length )
+{
+  char name[64] ;
+  bool streamParsed ;
+
+  benchBody   = i_body ;
+  benchLength = i_length ;
+  snprintf(name, sizeof(name), "stream, %s", i_label) ;
+  benchRun(name, BENCH_REGISTRATION_NB_PARSES, benchParseStream) ;
+  streamParsed = benchParsed ;
+  snprintf(name, sizeof(name), "ArduinoJson, %s", i_label) ;
+  benchRun(name, BENCH_REGISTRATION_NB_PARSES, benchParseArduinoJson) ;
+  printf("%-40s %12u bytes, short ID read by the stream %s, by ArduinoJson %s\n", "", (unsigned) i_length, streamParsed ? "yes" : "no", benchParsed ? "yes" : "no") ;
+}
+
+void benchRegistration( void )
+{
+  static const BenchRegistrationCase oversized = { "oversized", NULL, true, "AB12CD", BENCH_ALL_FIELDS, -3, 2 } ;
+  static const BenchRegistrationCase deep      = { "nested too deep", NULL, false, "DEEP", 0, 0, 0 } ;
+  bool valid = true ;
+  int16_t HTTPCode ;
+
+  benchBuildResponses() ;
+  for ( uint8_t iCase = 0 ; iCase < sizeof(benchCases) / sizeof(benchCases[0]) ; iCase++ )
+    valid &= benchCheck(&benchCases[iCase], benchCases[iCase].body, strlen(benchCases[iCase].body)) ;
+  valid &= benchCheck(&oversized, benchOversized.c_str(), benchOversized.size()) ;
+  valid &= benchCheck(&deep, benchDeep.c_str(), benchDeep.size()) ;
+  printf("%-40s %12u responses checked %s\n", "registration", (unsigned) ( sizeof(benchCases) / sizeof(benchCases[0]) + 2 ), valid ? "" : "INVALID") ;
+
+  benchTime("typical", benchTypical, strlen(benchTypical)) ;
+  benchTime("oversized", benchOversized.c_str(), benchOversized.size()) ;
+  benchTime("truncated", benchTruncated, strlen(benchTruncated)) ;
+
+  // Through the connection, the response parsed as it is read
+  halReset() ;
+  halSetHTTPHandler(benchRegistrationHandler) ;
+  registrationParseBegin(&benchResponse) ;
+  HTTPCode = connectionPostStream("noisey", "/api/device/", "application/json", (const uint8_t *) "{\"id\":\"1\"}", 10, registrationParse) ;
+  valid &= HTTPCode == 200 && registrationParseEnd() && strcmp(benchResponse.shortID, "AB12CD") == 0 && benchResponse.fields == BENCH_ALL_FIELDS ;
+  printf("%-40s %12d HTTP code, %s\n", "connectionPostStream, oversized", HTTPCode, registrationParseEnd() ? "registered" : "INVALID") ;
+  halSetHTTPHandler(NULL) ;
+  connectionClose() ;
+  halReset() ;
+
+  if ( !valid )
+  {
+    printf("the registration parser read the responses wrong\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,247 @@
+/**
+  \file bench_report.cpp
+  \brief Requests and bytes per hour of the fixed rates and of the adaptive reporting, against the error of the value
+         the server has, over a trace of the values uploaded
+
+  The traces are a few hours of a quiet room with cars passing by and a loud hour, and of the quiet room alone, or the
+  values of a file given by BENCH_REPORT_TRACE, one per line. Each value is added to the buffer every delayUpdateValue, as updateColor() does,
+  and uploaded to the in-process server by the uploader, on the virtual clock. The error is the difference between the
+  last value the server got and the current one, sampled before each new value.
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <vector>
+#include <algorithm>
+#include <string>
+
+#include "bench.h"
+#include "../src/config.h"
+#include "../src/connection.h"
+#include "../src/probe.h"
+#include "../src/report.h"
+#include "../src/server.h"
+#include "../src/uploader.h"
+
+#define BENCH_REPORT_VALUE_MS         1920   /*!< Delay between two values, delayUpdateValue of the firmware, in ms */
+#define BENCH_REPORT_STEP_MS          10     /*!< Delay between two calls of the uploader, in ms */
+#define BENCH_REPORT_NB_VALUES        ( 4 * 3600000 / BENCH_REPORT_VALUE_MS ) /*!< Four hours of synthetic trace */
+#define BENCH_REPORT_IDLE_MS          60000  /*!< Idle time after which the server closes the connection */
+#define BENCH_REPORT_HANDSHAKE_BYTES  4500   /*!< Bytes of a TLS handshake, counted in the bytes per hour */
+
+/**
+ * \struct BenchReportMode
+ * \brief Settings of a run
+*/
+struct BenchReportMode
+{
+  const char  *name ;
+  uint32_t    heartbeat ;
+  uint16_t    deadband ;      /*!< REPORT_DEADBAND_OFF for a fixed rate */
+  uint8_t     nbThresholds ;
+} ;
+
+static const BenchReportMode benchReportModes[] =
+{
+  { "fixed 300 s",           300000, REPORT_DEADBAND_OFF, 0 },
+  { "fixed 60 s",            60000,  REPORT_DEADBAND_OFF, 0 },
+  { "fixed 10 s",            10000,  REPORT_DEADBAND_OFF, 0 },
+  { "adaptive, deadband 2",  300000, 2,                   0 },
+  { "adaptive, deadband 5",  300000, 5,                   0 },
+  { "adaptive, deadband 5, thresholds", 300000, 5,        2 },
+  { "adaptive, deadband 10", 300000, 10,                  0 },
+} ;
+
+static const int16_t  benchReportThresholds[] = { 15, 30 } ;
+
+static std::vector<int16_t> benchTrace ;
+static int16_t              benchServerValue = 0 ;   /*!< Last value of the last message the server acknowledged */
+
+/**
+ * \fn int16_t benchReportHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server keeping the last value it got
+*/
+static int16_t benchReportHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  std::string body((const char *) i_body, i_length) ;
+  size_t end = body.find(']', body.find("\"noise\":[")) ;
+  size_t start = end == std::string::npos ? end : body.find_last_of("[,", end) ;
+
+  (void) i_host ;
+  (void) i_endPoint ;
+  *o_response = "{}" ;
+  if ( start != std::string::npos && start + 1 < end )
+    benchServerValue = atoi(body.c_str() + start + 1) ;
+  return 200 ;
+}
+
+/**
+ * \fn void benchSynthesizeTrace( bool i_events )
+ * \param[in] i_events Whether cars pass by and the third hour is loud
+ * \brief A quiet room around 8, cars passing by every few minutes, and a loud hour around 45 in the third hour
+*/
+static void benchSynthesizeTrace( bool i_events )
+{
+  uint32_t seed = 12345 ;
+  int32_t level = 8, car = 0 ;
+
+  for ( uint32_t iValue = 0 ; iValue < BENCH_REPORT_NB_VALUES ; iValue++ )
+  {
+    uint32_t hour = iValue * BENCH_REPORT_VALUE_MS / 3600000 ;
+    int32_t target = hour == 2 && i_events ? 45 : 8 ;
+
+    seed   = seed * 1103515245 + 12345 ;
+    level += ( target - level ) / 8 + (int32_t) ( ( seed >> 16 ) % 3 ) - 1 ;
+    if ( car == 0 && ( seed >> 8 ) % 100 == 0 && i_events )
+      car = 5 + ( seed >> 4 ) % 15 ;
+    car = car > 0 ? car - 1 : 0 ;
+    benchTrace.push_back(level + ( car > 0 ? 20 : 0 )) ;
+  }
+}
+
+/**
+ * \fn bool benchLoadTrace( const char *i_path )
+ * \return False if the file cannot be read or has no value
+*/
+static bool benchLoadTrace( const char *i_path )
+{
+  FILE *file = fopen(i_path, "r") ;
+  int value ;
+
+  if ( file == NULL )
+    return false ;
+  while ( fscanf(file, "%d", &value) == 1 )
+    benchTrace.push_back(value) ;
+  fclose(file) ;
+  return !benchTrace.empty() ;
+}
+
+/**
+ * \fn bool benchReportRun( const BenchReportMode *i_mode )
+ * \return False if the adaptive reporting broke the bound on its error
+ * \brief Run the trace with the settings of a mode, and print its costs and its errors
+*/
+static bool benchReportRun( const BenchReportMode *i_mode )
+{
+  std::vector<uint16_t> errors ;
+  uint32_t startMillis, lastRequestMillis, requests, handshakes, hours ;
+  uint64_t bytes, sumErrors = 0 ;
+  uint16_t maxError, p99Error, bound ;
+  uint32_t outside = 0, outsideRun = 0, maxOutsideRun = 0 ;
+  bool valid = true ;
+
+  // Nothing the suites run before left in the firmware changes the results
+  halReset() ;
+  halSetHTTPHandler(benchReportHandler) ;
+  uploaderClear() ;
+  flashLogBegin() ;
+  noiseBufferServer.clear() ;
+  pyramidClear() ;
+  levelSummaries.clear() ;
+  probeClear() ;
+  reportClear() ;
+  reportConfigure(i_mode->heartbeat, i_mode->deadband == REPORT_DEADBAND_OFF ? i_mode->heartbeat : configDelayDataServer[2], i_mode->deadband,
+                  benchReportThresholds, i_mode->nbThresholds, pyramidTierFor(i_mode->heartbeat, BENCH_REPORT_VALUE_MS)) ;
+  benchServerValue  = 0 ;
+  startMillis       = millis() ;
+  lastRequestMillis = millis() ;
+
+  for ( size_t iValue = 0 ; iValue < benchTrace.size() ; iValue++ )
+  {
+    int16_t value = benchTrace[iValue] ;
+
+    if ( iValue > 0 )
+    {
+      uint16_t error = abs(benchTrace[iValue - 1] - benchServerValue) ;
+
+      errors.push_back(error) ;
+      sumErrors  += error ;
+      outsideRun  = i_mode->deadband != REPORT_DEADBAND_OFF && error > i_mode->deadband ? outsideRun + 1 : 0 ;
+      outside    += outsideRun > 0 ;
+      maxOutsideRun = outsideRun > maxOutsideRun ? outsideRun : maxOutsideRun ;
+    }
+    addDataSendServer(value) ;
+    reportValue(value) ;
+
+    for ( uint32_t iStep = 0 ; iStep < BENCH_REPORT_VALUE_MS / BENCH_REPORT_STEP_MS ; iStep++ )
+    {
+      if ( uploaderState() == UPLOADER_IDLE && reportDue() )
+        uploaderStart("noisey", "HOST01", BENCH_REPORT_VALUE_MS, reportStarted()) ;
+      if ( uploaderState() != UPLOADER_IDLE )
+        lastRequestMillis = millis() ;
+      else if ( millis() - lastRequestMillis >= BENCH_REPORT_IDLE_MS )
+        connectionClose() ;
+      uploaderStep() ;
+      delay(BENCH_REPORT_STEP_MS) ;
+    }
+  }
+
+  hours       = ( millis() - startMillis ) / 3600000 ;
+  hours       = hours > 0 ? hours : 1 ;
+  requests    = halCountHTTPRequest() ;
+  handshakes  = halCountHandshake() ;
+  bytes       = halCountWireBytes() + (uint64_t) handshakes * BENCH_REPORT_HANDSHAKE_BYTES ;
+  std::sort(errors.begin(), errors.end()) ;
+  maxError    = errors.empty() ? 0 : errors.back() ;
+  p99Error    = errors.empty() ? 0 : errors[( errors.size() * 99 + 99 ) / 100 - 1] ;
+  printf("  %-34s %6.0f requests/h %6.1f handshakes/h %7.1f kB/h   error mean %5.2f p99 %3u max %3u",
+         i_mode->name, requests / (double) hours, handshakes / (double) hours, bytes / 1024.0 / hours,
+         errors.empty() ? 0.0 : sumErrors / (double) errors.size(), p99Error, maxError) ;
+
+  // Out of the deadband for no longer than the minimum interval, plus the value during which the upload is made
+  if ( i_mode->deadband != REPORT_DEADBAND_OFF )
+  {
+    bound = configDelayDataServer[2] / BENCH_REPORT_VALUE_MS + 2 ;
+    valid = maxOutsideRun <= bound ;
+    printf("   %4.1f%% out of the deadband, %u values at most%s", 100.0 * outside / errors.size(), maxOutsideRun, valid ? "" : " INVALID") ;
+  }
+  printf("\n") ;
+
+  // The uploader is idle for the next run
+  while ( uploaderState() != UPLOADER_IDLE )
+  {
+    uploaderStep() ;
+    delay(BENCH_REPORT_STEP_MS) ;
+  }
+  halSetHTTPHandler(NULL) ;
+  return valid ;
+}
+
+/**
+ * \fn bool benchReportTrace( const char *i_name )
+ * \return False if the adaptive reporting broke the bound on its error
+ * \brief Run benchTrace in every mode
+*/
+static bool benchReportTrace( const char *i_name )
+{
+  bool valid = true ;
+
+  printf("%-40s %12u values, %.1f h\n", i_name, (unsigned) benchTrace.size(), benchTrace.size() * BENCH_REPORT_VALUE_MS / 3600000.0) ;
+  for ( uint8_t iMode = 0 ; iMode < sizeof(benchReportModes) / sizeof(benchReportModes[0]) ; iMode++ )
+    valid &= benchReportRun(&benchReportModes[iMode]) ;
+  return valid ;
+}
+
+void benchReport( void )
+{
+  const char *path = getenv("BENCH_REPORT_TRACE") ;
+  bool valid = true ;
+
+  benchTrace.clear() ;
+  if ( path != NULL && benchLoadTrace(path) )
+    valid &= benchReportTrace(path) ;
+  else
+  {
+    benchSynthesizeTrace(true) ;
+    valid &= benchReportTrace("synthetic trace") ;
+    benchTrace.clear() ;
+    benchSynthesizeTrace(false) ;
+    valid &= benchReportTrace("synthetic trace, quiet room") ;
+  }
+  halReset() ;
+
+  if ( !valid )
+  {
+    printf("the adaptive reporting left the server out of its deadband for too long\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,149 @@
+/**
+  \file bench_ring.cpp
+  \brief Stress of SpscRing with a producer and a consumer on two threads, with both overflow policies
+*/
+#include <Arduino.h>
+#include <thread>
+
+#include "bench.h"
+#include "../src/spsc_ring.h"
+
+#define BENCH_RING_NB_VALUES  4000000
+#define BENCH_RING_SIZE       256
+
+/**
+ * \struct BenchItem
+ * \brief Value pushed through the ring, whose check word shows whether it was torn by a concurrent overwrite
+*/
+struct BenchItem
+{
+  uint32_t sequence ;
+  uint32_t check ;
+} ;
+
+/**
+ * \struct BenchRingReport
+ * \brief What the consumer saw
+*/
+struct BenchRingReport
+{
+  uint32_t received ;
+  uint32_t skipped ;    /*!< Gaps in the sequence */
+  uint32_t torn ;       /*!< Values read as intact but not matching their check word */
+  uint32_t disordered ; /*!< Values not following the previous one */
+} ;
+
+/**
+ * \fn void benchProduce( SpscRing<BenchItem, BENCH_RING_SIZE, P> *io_ring, uint32_t i_pause )
+ * \param[in,out] io_ring Ring to push to
+ * \param[in] i_pause Number of values pushed between two yields of the producer, 0 to never yield
+ * \brief Push the values, yielding now and then so that the threads interleave even on a single core
+*/
+template<SpscPolicy P> static void benchProduce( SpscRing<BenchItem, BENCH_RING_SIZE, P> *io_ring, uint32_t i_pause )
+{
+  for ( uint32_t iValue = 0 ; iValue < BENCH_RING_NB_VALUES ; iValue++ )
+  {
+    BenchItem item = { iValue, ~iValue * 2654435761u } ;
+    io_ring->push(item) ;
+    if ( i_pause > 0 && iValue % i_pause == 0 )
+      std::this_thread::yield() ;
+  }
+}
+
+/**
+ * \fn BenchRingReport benchConsume( SpscRing<BenchItem, BENCH_RING_SIZE, P> *io_ring, const std::atomic<bool> *i_producing, uint32_t i_pause )
+ * \param[in,out] io_ring Ring to read from
+ * \param[in] i_producing Whether the producer may still push
+ * \param[in] i_pause Number of spans read between two pauses of the consumer, 0 to never pause
+ * \brief Read the spans in place, as the uploader does, and check the values
+*/
+template<SpscPolicy P> static BenchRingReport benchConsume( SpscRing<BenchItem, BENCH_RING_SIZE, P> *io_ring, const std::atomic<bool> *i_producing, uint32_t i_pause )
+{
+  BenchRingReport report = { 0, 0, 0, 0 } ;
+  uint32_t next = 0, nbSpans = 0 ;
+
+  for ( ;; )
+  {
+    bool producing = i_producing->load() ;
+    uint32_t position = io_ring->front() ;
+    const BenchItem *items ;
+    uint16_t nbItems = io_ring->peek(position, &items) ;
+    BenchItem copy[BENCH_RING_SIZE] ;
+
+    if ( nbItems == 0 )
+    {
+      if ( !producing )
+        break ;
+      std::this_thread::yield() ;
+      continue ;
+    }
+
+    memcpy(copy, items, nbItems * sizeof(BenchItem)) ;
+    if ( io_ring->intact(position) )
+    {
+      for ( uint16_t iItem = 0 ; iItem < nbItems ; iItem++ )
+      {
+        report.torn       += copy[iItem].check != ~copy[iItem].sequence * 2654435761u ;
+        report.disordered += copy[iItem].sequence < next ;
+        report.skipped    += copy[iItem].sequence > next ? copy[iItem].sequence - next : 0 ;
+        next               = copy[iItem].sequence + 1 ;
+      }
+      report.received += nbItems ;
+    }
+    io_ring->consume(position + nbItems) ;
+
+    if ( i_pause > 0 && ++nbSpans % i_pause == 0 )
+      std::this_thread::sleep_for(std::chrono::microseconds(50)) ;
+  }
+  report.skipped += BENCH_RING_NB_VALUES - next ;
+  return report ;
+}
+
+/**
+ * \fn bool benchRingRun( const char *i_name, uint32_t i_producerPause, uint32_t i_consumerPause )
+ * \param[in] i_name Name printed in the report
+ * \param[in] i_producerPause Number of values pushed between two yields of the producer, 0 to never yield
+ * \param[in] i_consumerPause Number of spans read between two pauses of the consumer, 0 to never pause
+ * \return False if a value was torn, reordered or lost, or with SPSC_DROP_NEWEST, dropped without being counted
+ * \brief Push BENCH_RING_NB_VALUES values from one thread and read them from another
+*/
+template<SpscPolicy P> static bool benchRingRun( const char *i_name, uint32_t i_producerPause, uint32_t i_consumerPause )
+{
+  static SpscRing<BenchItem, BENCH_RING_SIZE, P> ring ;
+  std::atomic<bool> producing(true) ;
+  BenchRingReport report ;
+  uint32_t overflows = ring.overflows() ;
+  uint64_t start = benchNowNanos() ;
+  bool valid ;
+
+  std::thread producer([&]() { benchProduce<P>(&ring, i_producerPause) ; producing.store(false) ; }) ;
+  report = benchConsume<P>(&ring, &producing, i_consumerPause) ;
+  producer.join() ;
+  overflows = ring.overflows() - overflows ;
+
+  // Overwritten values are skipped by the consumer, as well as the ones it read while they were overwritten
+  valid  = report.torn == 0 && report.disordered == 0 && report.received + report.skipped == BENCH_RING_NB_VALUES ;
+  valid &= P != SPSC_DROP_NEWEST || report.skipped == overflows ;
+
+  printf("%-40s %8.1f Mvalues/s %9u received %9u overflows %9u skipped %s\n", i_name, BENCH_RING_NB_VALUES * 1000.0 / ( benchNowNanos() - start ),
+         report.received, overflows, report.skipped, valid ? "" : "INVALID") ;
+  return valid ;
+}
+
+void benchRing( void )
+{
+  bool valid = true ;
+
+  valid &= benchRingRun<SPSC_DROP_NEWEST>("drop newest, interleaved", 61, 0) ;
+  valid &= benchRingRun<SPSC_DROP_NEWEST>("drop newest, slow consumer", 61, 8) ;
+  valid &= benchRingRun<SPSC_DROP_NEWEST>("drop newest, free running", 0, 0) ;
+  valid &= benchRingRun<SPSC_OVERWRITE_OLDEST>("overwrite oldest, interleaved", 61, 0) ;
+  valid &= benchRingRun<SPSC_OVERWRITE_OLDEST>("overwrite oldest, slow consumer", 61, 8) ;
+  valid &= benchRingRun<SPSC_OVERWRITE_OLDEST>("overwrite oldest, free running", 0, 0) ;
+
+  if ( !valid )
+  {
+    printf("the ring lost, tore or reordered values\n") ;
+    exit(1) ;
+  }
+}
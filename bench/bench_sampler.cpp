@@ -0,0 +1,101 @@
+/**
+  \file bench_sampler.cpp
+  \brief Samples per window and CPU time spent sampling, for the timer-driven sampler against the former busy-wait
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/sampler.h"
+
+#define BENCH_SAMPLER_WINDOW_MS   80  /*!< Period of measure(), in ms */
+#define BENCH_SAMPLER_BUSY_MS     20  /*!< Width of the window of the former busy-wait measure(), in ms */
+#define BENCH_SAMPLER_NB_WINDOWS  1000
+
+void measure() ;
+
+/**
+ * \fn int16_t benchNoise( uint64_t i_micros )
+ * \param[in] i_micros Current time of the virtual clock, in us
+ * \brief A triangle wave around mid-scale of the ADC
+*/
+static int16_t benchNoise( uint64_t i_micros )
+{
+  return 412 + ( i_micros / 10 ) % 200 ;
+}
+
+/**
+ * \fn void benchBusyWait( uint32_t i_conversionMicros )
+ * \param[in] i_conversionMicros Duration of one analogRead(), in us
+ * \brief Report the samples and CPU time of the former measure(), which spun on analogRead() for 20 ms
+*/
+static void benchBusyWait( uint32_t i_conversionMicros )
+{
+  uint32_t minSamples = UINT32_MAX, maxSamples = 0 ;
+
+  halSetAnalogReadMicros(i_conversionMicros) ;
+  for ( uint32_t iWindow = 0 ; iWindow < BENCH_SAMPLER_NB_WINDOWS ; iWindow++ )
+  {
+    unsigned long startMillis = millis() ;
+    uint32_t numberSamples    = 0 ;
+
+    // Jitter the start of the window as the Ticker would
+    delayMicroseconds(iWindow * 37 % 1000) ;
+    startMillis = millis() ;
+    while ( millis() - startMillis < BENCH_SAMPLER_BUSY_MS )
+    {
+      analogRead(A0) ;
+      numberSamples++ ;
+    }
+    minSamples = numberSamples < minSamples ? numberSamples : minSamples ;
+    maxSamples = numberSamples > maxSamples ? numberSamples : maxSamples ;
+  }
+
+  printf("busy-wait, %3u us/conversion            %5u..%-5u samples/window %6.1f%% CPU\n", i_conversionMicros, minSamples, maxSamples, 100.0 * BENCH_SAMPLER_BUSY_MS / BENCH_SAMPLER_WINDOW_MS) ;
+}
+
+/**
+ * \fn void benchTimer( uint32_t i_conversionMicros )
+ * \param[in] i_conversionMicros Duration of one analogRead(), in us
+ * \brief Report the samples and CPU time of the timer-driven sampler, and the cost of measure() consuming its blocks
+*/
+static void benchTimer( uint32_t i_conversionMicros )
+{
+  uint32_t minSamples = UINT32_MAX, maxSamples = 0, overruns ;
+  uint64_t elapsed = 0 ;
+
+  halSetAnalogReadMicros(i_conversionMicros) ;
+  overruns = samplerOverruns() ;
+  samplerBegin() ;
+  for ( uint32_t iWindow = 0 ; iWindow < BENCH_SAMPLER_NB_WINDOWS ; iWindow++ )
+  {
+    uint32_t analogReads = halCountAnalogRead() ;
+    uint64_t start ;
+
+    delay(BENCH_SAMPLER_WINDOW_MS) ;
+    start = benchNowNanos() ;
+    measure() ;
+    elapsed += benchNowNanos() - start ;
+
+    uint32_t numberSamples = halCountAnalogRead() - analogReads ;
+    minSamples = numberSamples < minSamples ? numberSamples : minSamples ;
+    maxSamples = numberSamples > maxSamples ? numberSamples : maxSamples ;
+  }
+  samplerStop() ;
+
+  printf("timer %4u Hz, %3u us/conversion         %5u..%-5u samples/window %6.1f%% CPU %8.1f ns/measure() %u overruns\n",
+         SAMPLER_RATE_HZ, i_conversionMicros, minSamples, maxSamples, 100.0 * i_conversionMicros * SAMPLER_RATE_HZ / 1e6,
+         (double) elapsed / BENCH_SAMPLER_NB_WINDOWS, samplerOverruns() - overruns) ;
+}
+
+void benchSampler( void )
+{
+  static const uint32_t conversionMicros[] = { 10, 50, 100 } ;
+
+  halSetAnalogSource(benchNoise) ;
+  for ( uint8_t iConversion = 0 ; iConversion < sizeof(conversionMicros) / sizeof(conversionMicros[0]) ; iConversion++ )
+  {
+    benchBusyWait(conversionMicros[iConversion]) ;
+    benchTimer(conversionMicros[iConversion]) ;
+  }
+}
@@ -0,0 +1,194 @@
+/**
+  \file bench_scheduler.cpp
+  \brief Jitter and deadline misses of the periodic jobs of the firmware, run by four Tickers as before and by the
+         staggered scheduler, on the virtual clock
+*/
+#include <Arduino.h>
+#include <Ticker.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/scheduler.h"
+
+#define BENCH_SCHEDULER_RUN_MS        60000   /*!< Length of a simulation, on the virtual clock */
+#define BENCH_SCHEDULER_STALL_MS      80      /*!< LOOP_STALL_MS of main.cpp */
+#define BENCH_SCHEDULER_HANDSHAKE_MS  800     /*!< Time a TLS handshake blocks loop() */
+#define BENCH_SCHEDULER_UPLOAD_MS     10000   /*!< Time between two handshakes in the scenario that has them */
+#define BENCH_SCHEDULER_PORTAL_MS     20000   /*!< Time the portal of WiFiManager blocks loop() in the scenario that has it */
+
+/**
+ * \struct BenchSchedulerJob
+ * \brief A job of main.cpp, with its duration on the device and its timing in the staggered schedule
+*/
+struct BenchSchedulerJob
+{
+  const char  *name ;
+  uint32_t    durationUs ;
+  uint32_t    periodMs ;
+  uint32_t    phaseMs ;
+  uint32_t    deadlineMs ;
+} ;
+
+static const BenchSchedulerJob benchJobs[] =
+{
+  { "measure",      20000, 80,   0,  40 },
+  { "updateColor",  200,   1920, 20, 20 },
+  { "animate",      800,   80,   40, 20 },  /*!< show() of 24 pixels, with the interrupts disabled */
+  { "LED",          10,    1920, 60, 80 },
+} ;
+
+#define BENCH_SCHEDULER_NB_JOBS ( sizeof(benchJobs) / sizeof(benchJobs[0]) )
+
+static Ticker         benchTickers[BENCH_SCHEDULER_NB_JOBS] ;
+static Ticker         benchRescue ;
+static SchedulerTask  benchTickerStats[BENCH_SCHEDULER_NB_JOBS] ; /*!< Statistics of the runs from the Tickers */
+static bool           benchFromTickers ;
+static uint32_t       benchLoopMillis ;
+static bool           benchInPortal ;       /*!< inPortal of main.cpp */
+static bool           benchInHandshake ;    /*!< Whether a TLS handshake blocks loop() */
+static uint32_t       benchNbInHandshake ;  /*!< Jobs run while a TLS handshake blocks loop() */
+static uint32_t       benchPortalMeasures ; /*!< Runs of measure while the portal blocks loop() */
+
+/**
+ * \fn void benchJob( void )
+ * \brief Job J : takes its duration on the virtual clock, and when run by a Ticker, records its jitter as the scheduler does
+*/
+template<uint8_t J> static void benchJob( void )
+{
+  SchedulerTask *stats = &benchTickerStats[J] ;
+  uint32_t jitter = micros() - stats->releaseMicros ;
+
+  benchNbInHandshake  += benchInHandshake ? 1 : 0 ;
+  benchPortalMeasures += benchInPortal && J == 0 ? 1 : 0 ;
+  halAdvanceMicros(benchJobs[J].durationUs) ;
+  if ( !benchFromTickers )
+    return ;
+
+  uint8_t bin = 0 ;
+  for ( uint32_t bound = SCHEDULER_JITTER_BIN_US ; jitter >= bound && bin < SCHEDULER_NB_JITTER_BINS - 1 ; bound <<= 1 )
+    bin++ ;
+  stats->nbRuns++ ;
+  stats->jitter[bin]++ ;
+  stats->maxJitterUs    = jitter > stats->maxJitterUs ? jitter : stats->maxJitterUs ;
+  stats->nbMisses      += jitter + benchJobs[J].durationUs > benchJobs[J].deadlineMs * 1000 ? 1 : 0 ;
+  stats->releaseMicros += benchJobs[J].periodMs * 1000 ;
+}
+
+static const SchedulerFunction benchJobFunctions[] = { benchJob<0>, benchJob<1>, benchJob<2>, benchJob<3> } ;
+static_assert( sizeof(benchJobFunctions) / sizeof(benchJobFunctions[0]) == BENCH_SCHEDULER_NB_JOBS, "one function per job" ) ;
+
+static void benchRescueScheduler( void )
+{
+  if ( benchInPortal && millis() - benchLoopMillis >= BENCH_SCHEDULER_STALL_MS )
+    schedulerRun() ;
+}
+
+/**
+ * \fn void benchReport( const char *i_name, const SchedulerTask *i_task )
+ * \brief Print the histogram of the jitter of a task
+*/
+static void benchReport( const char *i_name, const SchedulerTask *i_task )
+{
+  printf("  %-12s %-24s %5u runs %4u misses, max %6.1f ms :", i_name, "", i_task->nbRuns, i_task->nbMisses, i_task->maxJitterUs / 1000.0) ;
+  for ( uint8_t iBin = 0 ; iBin < SCHEDULER_NB_JITTER_BINS ; iBin++ )
+    printf(" %5u", i_task->jitter[iBin]) ;
+  printf("\n") ;
+}
+
+/**
+ * \fn uint32_t benchSimulate( const char *i_name, bool i_fromTickers, bool i_handshakes, bool i_portal )
+ * \param[in] i_fromTickers Whether the jobs are run by one Ticker each, all attached at once, rather than by the scheduler
+ * \param[in] i_handshakes Whether loop() blocks for a TLS handshake every BENCH_SCHEDULER_UPLOAD_MS
+ * \param[in] i_portal Whether the portal of WiFiManager blocks loop() for BENCH_SCHEDULER_PORTAL_MS at the start
+ * \return The number of deadline misses of all the jobs
+ * \brief Run loop() as main.cpp does for BENCH_SCHEDULER_RUN_MS, and report the jitter of each job
+*/
+static uint32_t benchSimulate( const char *i_name, bool i_fromTickers, bool i_handshakes, bool i_portal )
+{
+  uint32_t nbMisses = 0, lastHandshake ;
+
+  halReset() ;
+  benchFromTickers    = i_fromTickers ;
+  benchNbInHandshake  = 0 ;
+  benchPortalMeasures = 0 ;
+  schedulerBegin() ;
+  for ( uint8_t iJob = 0 ; iJob < BENCH_SCHEDULER_NB_JOBS ; iJob++ )
+  {
+    memset(&benchTickerStats[iJob], 0, sizeof(SchedulerTask)) ;
+    benchTickerStats[iJob].releaseMicros = micros() + benchJobs[iJob].periodMs * 1000 ;
+    if ( i_fromTickers )
+      benchTickers[iJob].attach_ms(benchJobs[iJob].periodMs, benchJobFunctions[iJob]) ;
+    else
+      schedulerAdd(benchJobs[iJob].name, benchJobFunctions[iJob], benchJobs[iJob].periodMs, benchJobs[iJob].phaseMs, benchJobs[iJob].deadlineMs) ;
+  }
+  if ( !i_fromTickers )
+    benchRescue.attach_ms(BENCH_SCHEDULER_STALL_MS / 4, benchRescueScheduler) ;
+
+  lastHandshake = millis() ;
+  while ( millis() < BENCH_SCHEDULER_RUN_MS )
+  {
+    benchLoopMillis = millis() ;
+    if ( !i_fromTickers )
+      schedulerRun() ;
+    if ( i_portal && millis() < BENCH_SCHEDULER_PORTAL_MS )
+    {
+      benchInPortal = true ;
+      halAdvanceMicros(BENCH_SCHEDULER_PORTAL_MS * 1000) ;
+      benchInPortal = false ;
+    }
+    if ( i_handshakes && millis() - lastHandshake >= BENCH_SCHEDULER_UPLOAD_MS )
+    {
+      lastHandshake     = millis() ;
+      benchInHandshake  = true ;
+      halAdvanceMicros(BENCH_SCHEDULER_HANDSHAKE_MS * 1000) ;
+      benchInHandshake  = false ;
+    }
+    delay(1) ;
+  }
+
+  printf("%s\n", i_name) ;
+  for ( uint8_t iJob = 0 ; iJob < BENCH_SCHEDULER_NB_JOBS ; iJob++ )
+  {
+    const SchedulerTask *task = i_fromTickers ? &benchTickerStats[iJob] : schedulerTask(iJob) ;
+
+    benchReport(benchJobs[iJob].name, task) ;
+    nbMisses += task->nbMisses ;
+  }
+  halReset() ;
+  schedulerBegin() ;
+  return nbMisses ;
+}
+
+void benchScheduler( void )
+{
+  uint32_t nbMisses, nbInHandshake, nbMeasures ;
+
+  printf("%-40s %-38s", "jitter histogram, bins up to", "") ;
+  for ( uint8_t iBin = 0 ; iBin < SCHEDULER_NB_JITTER_BINS - 1 ; iBin++ )
+    printf(" %5.1f", ( SCHEDULER_JITTER_BIN_US << iBin ) / 1000.0) ;
+  printf("  more ms\n") ;
+
+  benchSimulate("four Tickers, same phase", true, false, false) ;
+  nbMisses = benchSimulate("scheduler, staggered", false, false, false) ;
+  benchSimulate("scheduler, staggered, TLS handshakes", false, true, false) ;
+  nbInHandshake = benchNbInHandshake ;
+  benchSimulate("scheduler, staggered, portal", false, false, true) ;
+  nbMeasures = benchPortalMeasures ;
+  printf("jobs run during the TLS handshakes %u, measures during the portal %u\n", nbInHandshake, nbMeasures) ;
+
+  if ( nbMisses > 0 )
+  {
+    printf("the staggered schedule misses deadlines\n") ;
+    exit(1) ;
+  }
+  if ( nbInHandshake > 0 )
+  {
+    printf("the Ticker runs the jobs from inside a TLS handshake\n") ;
+    exit(1) ;
+  }
+  if ( nbMeasures < BENCH_SCHEDULER_PORTAL_MS / benchJobs[0].periodMs * 9 / 10 )
+  {
+    printf("the jobs stop while the portal blocks loop()\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,219 @@
+/**
+  \file bench_settings.cpp
+  \brief Time for the settings changed on the server to reach the tasks, through the responses to the uploads, and
+         consistency of the settings the Tickers see meanwhile
+
+  The firmware runs from setup() on the virtual clock and registers with the in-process server. The server then changes
+  the offset, the sensitivity, the luminosity and the update rate every BENCH_SETTINGS_CHANGE_MS or so, with a new
+  version, and answers each upload with its current settings : the device must apply each version once, within an
+  upload interval, write the EEPROM once per version, and send no request but its uploads. A Ticker firing every
+  millisecond, as the one of the tasks does while loop() waits, checks that it never sees the settings of two versions
+  at once. Each Serial.printf() of the firmware lets it fire, halSetPreemptMicros() advancing the clock by a period :
+  it then also runs inside updateSettings(), between the write of a version and its commit, and must do so at least
+  once per version for the check to count.
+
+  The server finally sends versions with a setting out of its range, next to others in range : the device must store
+  and apply none of their settings, and remember the version so that the next responses are not parsed again.
+*/
+#include <Arduino.h>
+#include <Ticker.h>
+#include <hal_native.h>
+
+#include "bench.h"
+#include "../src/config.h"
+#include "../src/connection.h"
+#include "../src/probe.h"
+#include "../src/sampler.h"
+#include "../src/uploader.h"
+
+#define BENCH_SETTINGS_NB_CHANGES   24      /*!< Versions the server sets after the registration */
+#define BENCH_SETTINGS_CHANGE_MS    90000   /*!< Mean delay between two changes of the settings, in ms */
+#define BENCH_SETTINGS_TICK_MS      1       /*!< Period of the Ticker checking the settings, in ms */
+#define BENCH_SETTINGS_NB_REJECTED  4
+
+void setup() ;
+void loop() ;
+
+extern bool     registered ;
+extern int8_t   offsetSignal ;
+extern int8_t   sensitivitySignal ;
+extern int8_t   brightness ;
+extern int32_t  delayDataServer ;
+extern int32_t  rejectedSettingsVersion ;
+
+/**
+ * \struct BenchSettings
+ * \brief Settings of a version, as set on the server
+*/
+struct BenchSettings
+{
+  int8_t  offset ;
+  int8_t  sensitivity ;
+  int8_t  luminosity ;
+  int8_t  updateRate ;
+} ;
+
+static BenchSettings  benchServer ;     /*!< Settings of the server, answered with each response */
+static BenchSettings  benchPrevious ;   /*!< Settings of the previous version, which the tasks may still see */
+static uint32_t       benchVersion ;
+static uint32_t       benchNbOtherRequests ;  /*!< Requests after the registration to another end point than /api/data/ */
+static uint32_t       benchNbTicks ;
+static uint32_t       benchNbTorn ;     /*!< Ticks that saw settings of neither version */
+static uint32_t       benchNbApplying ; /*!< Ticks that fired while a version was being applied */
+static uint32_t       benchCommits ;    /*!< EEPROM commits when the server changed its version */
+static Ticker         benchTicker ;
+static const char    *benchRejected ;   /*!< Settings answered instead of benchServer, with a value out of its range */
+
+// A value out of the range of its setting, that would fit it once narrowed to the type of the memory, and in range ones
+static const char *const benchRejectedSettings[BENCH_SETTINGS_NB_REJECTED] =
+{
+  "\"updateRate\":257,\"luminosity\":1",
+  "\"offset\":300,\"sensitivity\":1",
+  "\"sensitivity\":2,\"deadband\":-1",
+  "\"luminosity\":1,\"thresholds\":[600,70000]",
+} ;
+
+/**
+ * \fn bool benchApplied( const BenchSettings *i_settings )
+ * \return True if the globals read by the tasks are the settings of a version
+*/
+static bool benchApplied( const BenchSettings *i_settings )
+{
+  return offsetSignal == i_settings->offset && sensitivitySignal == mapSensitivityServerToValue(i_settings->sensitivity)
+      && brightness == i_settings->luminosity && delayDataServer == configDelayDataServer[i_settings->updateRate] ;
+}
+
+/**
+ * \fn void benchTick( void )
+ * \brief Check, as a Ticker, that the tasks would see the settings of the current version or of the previous one
+*/
+static void benchTick( void )
+{
+  if ( !registered )
+    return ;
+  benchNbTicks++ ;
+  benchNbTorn     += !benchApplied(&benchServer) && !benchApplied(&benchPrevious) ;
+  benchNbApplying += readSettingsVersionFromMemory() == benchVersion && halCountEEPROMCommit() == benchCommits ;
+}
+
+/**
+ * \fn int16_t benchSettingsHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server registering the device and answering each request with its current settings and their version
+*/
+static int16_t benchSettingsHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  char response[160] ;
+  bool registration = strcmp(i_endPoint, "/api/device/") == 0 ;
+
+  (void) i_host ;
+  (void) i_body ;
+  (void) i_length ;
+  benchNbOtherRequests += registered && strcmp(i_endPoint, "/api/data/") != 0 ;
+  if ( benchRejected != NULL && !registration )
+  {
+    snprintf(response, sizeof(response), "{\"config\":{\"version\":%u,%s}}", benchVersion, benchRejected) ;
+    *o_response = response ;
+    return 200 ;
+  }
+  snprintf(response, sizeof(response), "{%s\"config\":{\"version\":%u,\"offset\":%d,\"sensitivity\":%d,\"luminosity\":%d,\"updateRate\":%d}}",
+           registration ? "\"shortID\":\"BENCH1\"," : "", benchVersion, benchServer.offset, benchServer.sensitivity,
+           benchServer.luminosity, benchServer.updateRate) ;
+  *o_response = response ;
+  return 200 ;
+}
+
+/**
+ * \fn void benchSettings( void )
+ * \brief Change the settings on the server, and time how long the firmware takes to apply them
+*/
+void benchSettings( void )
+{
+  uint32_t seed = 2718, commits, requests, sumLatency = 0, maxLatency = 0, nbLate = 0, nbApplied = 0, changeMillis ;
+  bool valid ;
+
+  benchVersion          = 1 ;
+  benchServer           = { 10, 5, 4, 2 } ;
+  benchPrevious         = benchServer ;
+  benchNbOtherRequests  = 0 ;
+  benchNbTicks          = 0 ;
+  benchNbTorn           = 0 ;
+  benchNbApplying       = 0 ;
+  benchCommits          = UINT32_MAX ;
+  benchRejected         = NULL ;
+
+  connectionClose() ;
+  halReset() ;
+  probeClear() ;
+  halSetHTTPHandler(benchSettingsHandler) ;
+  setup() ;
+  while ( !registered )
+    loop() ;
+  halSetPreemptMicros(BENCH_SETTINGS_TICK_MS * 1000) ;
+  benchTicker.attach_ms(BENCH_SETTINGS_TICK_MS, benchTick) ;
+  commits   = halCountEEPROMCommit() ;
+  requests  = halCountHTTPRequest() ;
+
+  for ( uint32_t iChange = 0 ; iChange < BENCH_SETTINGS_NB_CHANGES ; iChange++ )
+  {
+    uint32_t waitMillis, latency, maxMillis = delayDataServer + 2 * CONNECTION_TIMEOUT_MS ;
+
+    seed        = seed * 1103515245 + 12345 ;
+    waitMillis  = BENCH_SETTINGS_CHANGE_MS / 2 + ( seed >> 8 ) % BENCH_SETTINGS_CHANGE_MS ;
+    for ( uint32_t startMillis = millis() ; millis() - startMillis < waitMillis ; )
+      loop() ;
+
+    // Every setting changes, the update rate between 10 s and 60 s
+    benchPrevious           = benchServer ;
+    benchServer.offset      = ( benchServer.offset + 37 ) % ( configOffsetMax + 1 ) ;
+    benchServer.sensitivity = benchServer.sensitivity % configSensitivityServerMax + 1 ;
+    benchServer.luminosity  = ( benchServer.luminosity + 3 ) % ( configBrightnessServerMax + 1 ) ;
+    benchServer.updateRate  = benchServer.updateRate == 2 ? 1 : 2 ;
+    benchVersion++ ;
+    benchCommits = halCountEEPROMCommit() ;
+    changeMillis = millis() ;
+    while ( !benchApplied(&benchServer) && millis() - changeMillis < maxMillis )
+      loop() ;
+
+    latency     = millis() - changeMillis ;
+    sumLatency += latency ;
+    maxLatency  = latency > maxLatency ? latency : maxLatency ;
+    nbLate     += !benchApplied(&benchServer) ;
+  }
+
+  // Each config with a value out of range is ignored as a whole, over two upload intervals
+  for ( uint8_t iRejected = 0 ; iRejected < BENCH_SETTINGS_NB_REJECTED ; iRejected++ )
+  {
+    uint32_t version = readSettingsVersionFromMemory(), changeMillis = millis() ;
+
+    benchRejected = benchRejectedSettings[iRejected] ;
+    benchVersion++ ;
+    while ( millis() - changeMillis < 2 * (uint32_t) delayDataServer )
+      loop() ;
+    nbApplied += readSettingsVersionFromMemory() != version || !benchApplied(&benchServer) || rejectedSettingsVersion != (int32_t) benchVersion ;
+  }
+  benchRejected = NULL ;
+  benchTicker.detach() ;
+  halSetPreemptMicros(0) ;
+  samplerStop() ;
+  commits   = halCountEEPROMCommit() - commits ;
+  requests  = halCountHTTPRequest() - requests ;
+
+  printf("%-40s %3u versions, latency mean %6u ms max %6u ms, %u late\n", "settings from the responses",
+         BENCH_SETTINGS_NB_CHANGES, sumLatency / BENCH_SETTINGS_NB_CHANGES, maxLatency, nbLate) ;
+  printf("%-40s %3u EEPROM commits, %u requests, %u not uploads\n", "", commits, requests, benchNbOtherRequests) ;
+  printf("%-40s %9u ticks, %u while applying a version, %u with the settings of two versions\n", "", benchNbTicks,
+         benchNbApplying, benchNbTorn) ;
+  printf("%-40s %3u versions out of range, %u applied or forgotten\n", "", BENCH_SETTINGS_NB_REJECTED, nbApplied) ;
+  valid = nbLate == 0 && commits == BENCH_SETTINGS_NB_CHANGES && benchNbOtherRequests == 0
+       && benchNbApplying >= BENCH_SETTINGS_NB_CHANGES && benchNbTorn == 0 && nbApplied == 0 ;
+
+  halSetHTTPHandler(NULL) ;
+  connectionClose() ;
+  halReset() ;
+
+  if ( !valid )
+  {
+    printf("settings were applied late, torn or out of range, written more than once, or cost requests\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,302 @@
+/**
+  \file bench_snapshot.cpp
+  \brief Detection latency and false triggers of the snapshots of loud events, on synthetic traces run through the firmware
+
+  The ADC reads a background noise whose level slowly walks by 1 dB, with a slammed door (a burst of noise decaying
+  in 200 ms) or an alarm (a 500 Hz tone for 3 s) every 60 to 90 s. The firmware runs from setup() on the virtual
+  clock and registers with the in-process server, which sets the snapshot level a margin above the loudest window of
+  the background and decodes the snapshots it receives. A snapshot whose trigger is not within
+  BENCH_SNAPSHOT_MAX_LATENCY_MS of the start of an event is a false trigger.
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "../src/connection.h"
+#include "../src/probe.h"
+#include "../src/sampler.h"
+#include "../src/snapshot.h"
+#include "../src/sound_meter.h"
+
+#define BENCH_SNAPSHOT_MID_SCALE        512     /*!< DC offset of the microphone on the ADC */
+#define BENCH_SNAPSHOT_BACKGROUND       40      /*!< Amplitude of the uniform background noise, in ADC counts */
+#define BENCH_SNAPSHOT_WALK             1.12    /*!< Factor of the amplitude at the top of the walk of the background, 1 dB */
+#define BENCH_SNAPSHOT_WALK_MS          420000  /*!< Period of the walk of the background, in ms */
+#define BENCH_SNAPSHOT_DOOR             10      /*!< Amplitude of a door at its start, times the one of the background */
+#define BENCH_SNAPSHOT_DOOR_MS          200     /*!< Length of a door, in ms */
+#define BENCH_SNAPSHOT_ALARM            4       /*!< Amplitude of an alarm, times the one of the background */
+#define BENCH_SNAPSHOT_ALARM_MS         3000    /*!< Length of an alarm, in ms */
+#define BENCH_SNAPSHOT_ALARM_HZ         500     /*!< Frequency of an alarm, in Hz */
+#define BENCH_SNAPSHOT_FIRST_EVENT_MS   30000   /*!< Start of the first event, once the device registered */
+#define BENCH_SNAPSHOT_RUN_MS           1800000 /*!< Length of a scenario, in ms */
+#define BENCH_SNAPSHOT_FLUSH_MS         120000  /*!< Time given after a scenario to the last snapshot to be sent, in ms */
+#define BENCH_SNAPSHOT_WINDOW_MS        80      /*!< Length of a window of measure(), in ms */
+#define BENCH_SNAPSHOT_MAX_LATENCY_MS   ( 3 * BENCH_SNAPSHOT_WINDOW_MS ) /*!< Longest time from an event to its trigger */
+#define BENCH_SNAPSHOT_MIN_DETECTED     0.95    /*!< Share of the events that must send a snapshot */
+#define BENCH_SNAPSHOT_CALIBRATION_MS   BENCH_SNAPSHOT_WALK_MS /*!< Background measured to set the snapshot level */
+#define BENCH_SNAPSHOT_NB_ADDS          1000000
+
+void setup() ;
+void loop() ;
+
+/**
+ * \enum BenchSnapshotEvent
+ * \brief Loud events of a trace
+*/
+enum BenchSnapshotEvent
+{
+  BENCH_EVENT_NONE,
+  BENCH_EVENT_DOOR,
+  BENCH_EVENT_ALARM
+} ;
+
+/**
+ * \struct BenchSnapshotScenario
+ * \brief A trace, and the level of the snapshots above its background
+*/
+struct BenchSnapshotScenario
+{
+  const char          *name ;
+  BenchSnapshotEvent  event ;
+  int16_t             margin ;    /*!< Snapshot level above the loudest window of the background, in tenths of dB */
+  bool                checked ;   /*!< Whether the detection and the false triggers are checked, or only printed */
+} ;
+
+static const BenchSnapshotScenario benchSnapshotScenarios[] =
+{
+  { "doors, 6 dB above the background",     BENCH_EVENT_DOOR,  60, true },
+  { "alarms, 6 dB above the background",    BENCH_EVENT_ALARM, 60, true },
+  { "background only, 6 dB above",          BENCH_EVENT_NONE,  60, true },
+  { "background only, 3 dB above",          BENCH_EVENT_NONE,  30, false },
+} ;
+
+static BenchSnapshotEvent     benchEvent ;
+static std::vector<uint32_t>  benchOnsets ;       /*!< Start of each event, in ms */
+static std::vector<uint32_t>  benchTriggers ;     /*!< Trigger of each snapshot received, in ms */
+static int16_t                benchLevel ;        /*!< Snapshot level set at the registration, in dB(A) */
+static uint32_t               benchNbMalformed ;  /*!< Snapshots whose trigger window is not above the level */
+
+/**
+ * \fn double benchNoise( uint64_t i_index )
+ * \return A uniform value in [-1, 1], the same for the same sample
+*/
+static double benchNoise( uint64_t i_index )
+{
+  uint64_t hash = i_index * 0x9E3779B97F4A7C15ULL ;
+
+  hash ^= hash >> 29 ;
+  hash *= 0xBF58476D1CE4E5B9ULL ;
+  hash ^= hash >> 32 ;
+  return ( hash & 0xFFFF ) / 32767.5 - 1 ;
+}
+
+/**
+ * \fn int16_t benchSignal( uint64_t i_micros )
+ * \param[in] i_micros Current time of the virtual clock, in us
+ * \brief The background, and the event of benchEvent started last
+*/
+static int16_t benchSignal( uint64_t i_micros )
+{
+  uint64_t index = i_micros * SAMPLER_RATE_HZ / 1000000 ;
+  uint32_t now = i_micros / 1000 ;
+  double walk = 1 + ( BENCH_SNAPSHOT_WALK - 1 ) * ( 0.5 + 0.5 * sin(2 * M_PI * now / BENCH_SNAPSHOT_WALK_MS) ) ;
+  double value = BENCH_SNAPSHOT_BACKGROUND * walk * benchNoise(index) ;
+  size_t iEvent = benchOnsets.size() ;
+
+  while ( iEvent > 0 && benchOnsets[iEvent - 1] > now )
+    iEvent-- ;
+  if ( iEvent > 0 && benchEvent == BENCH_EVENT_DOOR && now - benchOnsets[iEvent - 1] < BENCH_SNAPSHOT_DOOR_MS )
+    value += BENCH_SNAPSHOT_BACKGROUND * BENCH_SNAPSHOT_DOOR * benchNoise(index ^ 0x5A5A5A5A)
+           * exp(-5.0 * ( now - benchOnsets[iEvent - 1] ) / BENCH_SNAPSHOT_DOOR_MS) ;
+  else if ( iEvent > 0 && benchEvent == BENCH_EVENT_ALARM && now - benchOnsets[iEvent - 1] < BENCH_SNAPSHOT_ALARM_MS )
+    value += BENCH_SNAPSHOT_BACKGROUND * BENCH_SNAPSHOT_ALARM * sin(2 * M_PI * BENCH_SNAPSHOT_ALARM_HZ * i_micros / 1e6) ;
+  return BENCH_SNAPSHOT_MID_SCALE + (int16_t) lround(value) ;
+}
+
+/**
+ * \fn int16_t benchCalibrate( void )
+ * \return The level of the loudest window of the background, in tenths of dB(A)
+ * \brief Measure the background through the sound meter alone, a window of measure() at a time
+*/
+static int16_t benchCalibrate( void )
+{
+  int16_t samples[SAMPLER_BLOCK_SIZE] ;
+  uint32_t samplesPerWindow = SAMPLER_RATE_HZ * BENCH_SNAPSHOT_WINDOW_MS / 1000 ;
+  uint64_t iSample = 0 ;
+  int16_t loudest = INT16_MIN, level ;
+
+  benchOnsets.clear() ;
+  soundMeterBegin() ;
+  while ( iSample < (uint64_t) SAMPLER_RATE_HZ * BENCH_SNAPSHOT_CALIBRATION_MS / 1000 )
+  {
+    for ( uint32_t iBlock = 0 ; iBlock < samplesPerWindow / SAMPLER_BLOCK_SIZE ; iBlock++ )
+    {
+      for ( uint8_t iInBlock = 0 ; iInBlock < SAMPLER_BLOCK_SIZE ; iInBlock++, iSample++ )
+        samples[iInBlock] = benchSignal(iSample * 1000000 / SAMPLER_RATE_HZ) ;
+      soundMeterProcess(samples, SAMPLER_BLOCK_SIZE) ;
+    }
+    level   = soundMeterLeq() ;
+    // The filter settles during the first second
+    loudest = iSample > SAMPLER_RATE_HZ && level > loudest ? level : loudest ;
+  }
+  return loudest ;
+}
+
+/**
+ * \fn bool benchDecode( const std::string &i_body, const char *i_key, std::vector<int32_t> *o_values )
+ * \return False if the array is missing
+ * \brief Sum the differences of an array of the snapshot back to values
+*/
+static bool benchDecode( const std::string &i_body, const char *i_key, std::vector<int32_t> *o_values )
+{
+  size_t position = i_body.find(std::string("\"") + i_key + "\":[") ;
+  const char *cursor ;
+  char *end ;
+  int32_t value = 0 ;
+
+  o_values->clear() ;
+  if ( position == std::string::npos )
+    return false ;
+  cursor = i_body.c_str() + position + strlen(i_key) + 4 ;
+  while ( *cursor != ']' && *cursor != '\0' )
+  {
+    value += strtol(cursor, &end, 10) ;
+    o_values->push_back(value) ;
+    cursor = *end == ',' ? end + 1 : end ;
+    if ( end == cursor && *end != ']' )
+      return false ;
+  }
+  return true ;
+}
+
+/**
+ * \fn int16_t benchSnapshotHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server registering the device with the snapshot level, and keeping the trigger of each snapshot
+*/
+static int16_t benchSnapshotHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  std::string body((const char *) i_body, i_length) ;
+  std::vector<int32_t> levels, peaks ;
+  char response[96] ;
+  size_t age, trigger ;
+
+  (void) i_host ;
+  *o_response = "{}" ;
+  if ( strcmp(i_endPoint, "/api/device/") == 0 )
+  {
+    snprintf(response, sizeof(response), "{\"shortID\":\"BENCH1\",\"config\":{\"snapshot\":%d}}", benchLevel) ;
+    *o_response = response ;
+  }
+  else if ( strcmp(i_endPoint, "/api/snapshot/") == 0 )
+  {
+    age     = body.find("\"age\":") ;
+    trigger = body.find("\"trigger\":") ;
+    if ( age == std::string::npos || trigger == std::string::npos )
+      return 400 ;
+    age     = atol(body.c_str() + age + 6) ;
+    trigger = atol(body.c_str() + trigger + 10) ;
+    benchTriggers.push_back(millis() - age) ;
+    if ( !benchDecode(body, "level", &levels) || !benchDecode(body, "peak", &peaks) || levels.size() != SNAPSHOT_NB_WINDOWS
+         || peaks.size() != SNAPSHOT_NB_WINDOWS || trigger >= levels.size() || levels[trigger] < benchLevel * 10 )
+      benchNbMalformed++ ;
+  }
+  return 200 ;
+}
+
+/**
+ * \fn bool benchSnapshotRun( const BenchSnapshotScenario *i_scenario, int16_t i_background )
+ * \return False if events were missed, detected late, or if the background triggered a snapshot
+ * \brief Run the firmware on the trace of a scenario, and match the snapshots received with the events
+*/
+static bool benchSnapshotRun( const BenchSnapshotScenario *i_scenario, int16_t i_background )
+{
+  uint32_t seed = 4242, onset, nbDetected = 0, nbFalse = 0, maxLatency = 0, sumLatency = 0 ;
+  std::vector<bool> detected ;
+  bool valid ;
+
+  benchOnsets.clear() ;
+  benchTriggers.clear() ;
+  benchEvent        = i_scenario->event ;
+  benchLevel        = ( i_background + i_scenario->margin + 9 ) / 10 ;
+  benchNbMalformed  = 0 ;
+  for ( onset = BENCH_SNAPSHOT_FIRST_EVENT_MS ; i_scenario->event != BENCH_EVENT_NONE && onset < BENCH_SNAPSHOT_RUN_MS ; )
+  {
+    benchOnsets.push_back(onset) ;
+    seed   = seed * 1103515245 + 12345 ;
+    onset += 60000 + ( seed >> 8 ) % 30000 ;
+  }
+  detected.assign(benchOnsets.size(), false) ;
+
+  connectionClose() ;
+  halReset() ;
+  probeClear() ;
+  halSetHTTPHandler(benchSnapshotHandler) ;
+  halSetAnalogSource(benchSignal) ;
+  setup() ;
+  while ( millis() < BENCH_SNAPSHOT_RUN_MS || ( ( snapshotPending() || snapshotBusy() ) && millis() < BENCH_SNAPSHOT_RUN_MS + BENCH_SNAPSHOT_FLUSH_MS ) )
+    loop() ;
+  samplerStop() ;
+
+  for ( size_t iTrigger = 0 ; iTrigger < benchTriggers.size() ; iTrigger++ )
+  {
+    bool matched = false ;
+
+    for ( size_t iEvent = 0 ; iEvent < benchOnsets.size() && !matched ; iEvent++ )
+      if ( benchTriggers[iTrigger] >= benchOnsets[iEvent] && benchTriggers[iTrigger] - benchOnsets[iEvent] <= BENCH_SNAPSHOT_MAX_LATENCY_MS )
+      {
+        uint32_t latency = benchTriggers[iTrigger] - benchOnsets[iEvent] ;
+
+        matched           = true ;
+        nbDetected       += !detected[iEvent] ;
+        detected[iEvent]  = true ;
+        sumLatency       += latency ;
+        maxLatency        = latency > maxLatency ? latency : maxLatency ;
+      }
+    nbFalse += !matched ;
+  }
+
+  printf("%-40s %3u dB(A), %3u/%-3u events, latency mean %3u ms max %3u ms, %3u false, %u missed, %u dropped, %u malformed\n",
+         i_scenario->name, benchLevel, nbDetected, (unsigned) benchOnsets.size(), nbDetected > 0 ? sumLatency / nbDetected : 0, maxLatency,
+         nbFalse, snapshotMissed(), snapshotDropped(), benchNbMalformed) ;
+  valid = !i_scenario->checked || ( nbDetected >= BENCH_SNAPSHOT_MIN_DETECTED * benchOnsets.size() && nbFalse == 0 && benchNbMalformed == 0 ) ;
+  if ( !valid )
+    printf("%-40s INVALID\n", "") ;
+  return valid ;
+}
+
+static void benchAddQuiet( void )
+{
+  snapshotAdd(450, 30) ;
+}
+
+/**
+ * \fn void benchSnapshot( void )
+ * \brief Cost of a window while nothing happens, then the scenarios through the firmware
+*/
+void benchSnapshot( void )
+{
+  int16_t background = benchCalibrate() ;
+  bool valid = true ;
+
+  snapshotBegin() ;
+  snapshotConfigure(700) ;
+  benchRun("snapshotAdd, below the threshold", BENCH_SNAPSHOT_NB_ADDS, benchAddQuiet) ;
+  printf("%-40s %12u bytes of ring, loudest window of the background %d.%d dB(A)\n", "snapshot",
+         (unsigned) ( SNAPSHOT_NB_WINDOWS * sizeof(SnapshotWindow) ), background / 10, background % 10) ;
+
+  for ( uint8_t iScenario = 0 ; iScenario < sizeof(benchSnapshotScenarios) / sizeof(benchSnapshotScenarios[0]) ; iScenario++ )
+    valid &= benchSnapshotRun(&benchSnapshotScenarios[iScenario], background) ;
+  halSetAnalogSource(NULL) ;
+  halSetHTTPHandler(NULL) ;
+  connectionClose() ;
+  halReset() ;
+
+  if ( !valid )
+  {
+    printf("loud events were missed or detected late, or the background triggered snapshots\n") ;
+    exit(1) ;
+  }
+}
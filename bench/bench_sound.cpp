@@ -0,0 +1,223 @@
+/**
+  \file bench_sound.cpp
+  \brief Samples per second of the sound meter, and its accuracy against the same filter and logarithm in double precision
+*/
+#include <Arduino.h>
+#include <math.h>
+#include <algorithm>
+
+#include "bench.h"
+#include "../src/sampler.h"
+#include "../src/sound_meter.h"
+
+#define BENCH_SOUND_MID_SCALE     512   /*!< DC offset of the microphone on the ADC */
+#define BENCH_SOUND_NB_SAMPLES    SAMPLER_RATE_HZ /*!< One second of samples per level, after as many to settle the filter */
+#define BENCH_SOUND_MAX_ERROR_DB  0.2   /*!< Largest difference allowed with the reference, in dB */
+
+/**
+ * \struct BenchSoundReference
+ * \brief The A-weighting filter of the sound meter in double precision
+*/
+struct BenchSoundReference
+{
+  double a[2][2] ;
+  double x1, x2, y1a, y2a, y1b, y2b ;
+  double sumSquares ;
+  uint32_t nbSquares ;
+} ;
+
+static int16_t benchSoundBlock[SAMPLER_BLOCK_SIZE] ;
+static int16_t benchSoundSamples[2 * BENCH_SOUND_NB_SAMPLES] ;
+static BenchSoundReference benchSoundReference ;
+
+/**
+ * \fn void benchReferenceBegin( BenchSoundReference *o_reference )
+ * \brief Poles of the analog A-weighting curve under 1 kHz, mapped with the matched-z transform
+*/
+static void benchReferenceBegin( BenchSoundReference *o_reference )
+{
+  double p1 = exp(-2.0 * M_PI * 20.598997 / SAMPLER_RATE_HZ) ;
+  double p2 = exp(-2.0 * M_PI * 107.65265 / SAMPLER_RATE_HZ) ;
+  double p3 = exp(-2.0 * M_PI * 737.86223 / SAMPLER_RATE_HZ) ;
+
+  memset(o_reference, 0, sizeof(BenchSoundReference)) ;
+  o_reference->a[0][0] = 2 * p1 ;
+  o_reference->a[0][1] = -p1 * p1 ;
+  o_reference->a[1][0] = p2 + p3 ;
+  o_reference->a[1][1] = -p2 * p3 ;
+  o_reference->nbSquares = UINT32_MAX ;
+}
+
+/**
+ * \fn void benchReferenceProcess( BenchSoundReference *io_reference, const int16_t *i_samples, uint32_t i_nbSamples )
+ * \brief soundMeterProcess() in double precision
+*/
+static void benchReferenceProcess( BenchSoundReference *io_reference, const int16_t *i_samples, uint32_t i_nbSamples )
+{
+  BenchSoundReference *r = io_reference ;
+
+  for ( uint32_t iSample = 0 ; iSample < i_nbSamples ; iSample++ )
+  {
+    double x = i_samples[iSample], ya, yb ;
+
+    if ( r->nbSquares == UINT32_MAX )
+    {
+      r->x1 = r->x2 = x ;
+      r->nbSquares = 0 ;
+    }
+    ya = x - 2 * r->x1 + r->x2 + r->a[0][0] * r->y1a + r->a[0][1] * r->y2a ;
+    yb = ya - 2 * r->y1a + r->y2a + r->a[1][0] * r->y1b + r->a[1][1] * r->y2b ;
+    r->x2  = r->x1 ;
+    r->x1  = x ;
+    r->y2a = r->y1a ;
+    r->y1a = ya ;
+    r->y2b = r->y1b ;
+    r->y1b = yb ;
+    r->sumSquares += yb * yb ;
+    r->nbSquares++ ;
+  }
+}
+
+/**
+ * \fn double benchReferenceLeq( BenchSoundReference *io_reference )
+ * \return The level of the samples processed since the last call, in dB(A), and empty the accumulator
+*/
+static double benchReferenceLeq( BenchSoundReference *io_reference )
+{
+  double meanSquare = io_reference->sumSquares / io_reference->nbSquares ;
+
+  io_reference->sumSquares = 0 ;
+  io_reference->nbSquares  = 0 ;
+  return 10 * log10(meanSquare) + SOUND_METER_GAIN_DB - 20 * log10(SOUND_METER_REF_RMS) + SOUND_METER_REF_DB ;
+}
+
+/**
+ * \fn double benchAWeighting( double i_frequency )
+ * \return The analog A-weighting curve at i_frequency, in dB
+*/
+static double benchAWeighting( double i_frequency )
+{
+  double f2 = i_frequency * i_frequency ;
+  double rA = 12194.0 * 12194.0 * f2 * f2 / ( ( f2 + 20.6 * 20.6 ) * sqrt(( f2 + 107.7 * 107.7 ) * ( f2 + 737.9 * 737.9 )) * ( f2 + 12194.0 * 12194.0 ) ) ;
+
+  return 20 * log10(rA) + 2.0 ;
+}
+
+/**
+ * \fn void benchSoundSignal( double i_frequency, double i_amplitude, uint32_t i_seed )
+ * \param[in] i_frequency Frequency of the tone, 0 for white noise
+ * \param[in] i_amplitude Peak amplitude, in ADC counts
+ * \brief Fill benchSoundSamples as the ADC would read them
+*/
+static void benchSoundSignal( double i_frequency, double i_amplitude, uint32_t i_seed )
+{
+  uint32_t random = i_seed ;
+
+  for ( uint32_t iSample = 0 ; iSample < 2 * BENCH_SOUND_NB_SAMPLES ; iSample++ )
+  {
+    double value ;
+
+    random = random * 1103515245 + 12345 ;
+    if ( i_frequency > 0 )
+      value = i_amplitude * sin(2 * M_PI * i_frequency * iSample / SAMPLER_RATE_HZ) ;
+    else
+      value = i_amplitude * ( ( random >> 8 ) / (double) ( 1 << 24 ) * 2 - 1 ) ;
+    value = floor(BENCH_SOUND_MID_SCALE + value + 0.5) ;
+    benchSoundSamples[iSample] = value < 0 ? 0 : value > 1023 ? 1023 : value ;
+  }
+}
+
+/**
+ * \fn double benchSoundError( double i_frequency, double i_amplitude )
+ * \return The difference between the level of the sound meter and the reference one, in dB
+ * \brief Settle both filters for one second, then compare the levels of the next second as measure() feeds them
+*/
+static double benchSoundError( double i_frequency, double i_amplitude )
+{
+  BenchSoundReference reference ;
+  double level, referenceLevel ;
+
+  benchSoundSignal(i_frequency, i_amplitude, 1) ;
+  soundMeterBegin() ;
+  benchReferenceBegin(&reference) ;
+  for ( uint32_t iBlock = 0 ; iBlock < 2 * BENCH_SOUND_NB_SAMPLES / SAMPLER_BLOCK_SIZE ; iBlock++ )
+  {
+    if ( iBlock == BENCH_SOUND_NB_SAMPLES / SAMPLER_BLOCK_SIZE )
+    {
+      soundMeterLeq() ;
+      benchReferenceLeq(&reference) ;
+    }
+    soundMeterProcess(benchSoundSamples + iBlock * SAMPLER_BLOCK_SIZE, SAMPLER_BLOCK_SIZE) ;
+    benchReferenceProcess(&reference, benchSoundSamples + iBlock * SAMPLER_BLOCK_SIZE, SAMPLER_BLOCK_SIZE) ;
+  }
+  level           = soundMeterLeq() / 10.0 ;
+  referenceLevel  = benchReferenceLeq(&reference) ;
+
+  if ( i_frequency > 0 )
+  {
+    // Level of the tone through the analog curve, to show what the sampling rate costs
+    double curveLevel = 20 * log10(i_amplitude / sqrt(2.0) / SOUND_METER_REF_RMS) + SOUND_METER_REF_DB + benchAWeighting(i_frequency) ;
+    printf("%6.1f Hz, %5.0f counts%22s %7.1f dB(A) reference %7.2f dB(A) curve %7.2f dB(A)\n",
+           i_frequency, i_amplitude, "", level, referenceLevel, curveLevel) ;
+  }
+  else
+    printf("white noise, %5.0f counts%19s %7.1f dB(A) reference %7.2f dB(A)\n", i_amplitude, "", level, referenceLevel) ;
+  return fabs(level - referenceLevel) ;
+}
+
+static void benchSoundProcess( void )
+{
+  soundMeterProcess(benchSoundBlock, SAMPLER_BLOCK_SIZE) ;
+}
+
+/**
+ * \fn double benchLog2Error( void )
+ * \return The largest error of soundMeterLog2() over values spread on the whole range
+*/
+static double benchLog2Error( void )
+{
+  double maxError = 0 ;
+
+  for ( uint64_t value = 1 ; value < ( 1ULL << 62 ) ; value += value / 997 + 1 )
+  {
+    double error = fabs(soundMeterLog2(value) / 65536.0 - log2((double) value)) ;
+    maxError = error > maxError ? error : maxError ;
+  }
+  return maxError ;
+}
+
+void benchSound( void )
+{
+  static const double frequencies[] = { 31.5, 63, 125, 250, 500, 800 } ;
+  static const double amplitudes[]  = { 4, 60, 400 } ;
+  BenchResult result ;
+  double maxError = 0, log2Error ;
+  uint64_t start ;
+
+  for ( uint8_t iFrequency = 0 ; iFrequency < sizeof(frequencies) / sizeof(frequencies[0]) ; iFrequency++ )
+    for ( uint8_t iAmplitude = 0 ; iAmplitude < sizeof(amplitudes) / sizeof(amplitudes[0]) ; iAmplitude++ )
+      maxError = std::max(maxError, benchSoundError(frequencies[iFrequency], amplitudes[iAmplitude])) ;
+  for ( uint8_t iAmplitude = 0 ; iAmplitude < sizeof(amplitudes) / sizeof(amplitudes[0]) ; iAmplitude++ )
+    maxError = std::max(maxError, benchSoundError(0, amplitudes[iAmplitude])) ;
+  log2Error = benchLog2Error() ;
+  printf("%-40s %9.3f dB largest error against the reference\n", "soundMeterLeq", maxError) ;
+  printf("%-40s %9.6f largest error\n", "soundMeterLog2", log2Error) ;
+
+  benchSoundSignal(250, 60, 1) ;
+  memcpy(benchSoundBlock, benchSoundSamples, sizeof(benchSoundBlock)) ;
+  soundMeterBegin() ;
+  result = benchRun("soundMeterProcess, block of 32", 200000, benchSoundProcess) ;
+  printf("%-40s %9.2f Msamples/s\n", "soundMeterProcess", SAMPLER_BLOCK_SIZE * 1000.0 / result.nsPerCall) ;
+
+  benchReferenceBegin(&benchSoundReference) ;
+  start = benchNowNanos() ;
+  for ( uint32_t iBlock = 0 ; iBlock < 200000 ; iBlock++ )
+    benchReferenceProcess(&benchSoundReference, benchSoundBlock, SAMPLER_BLOCK_SIZE) ;
+  printf("%-40s %9.2f Msamples/s\n", "reference, double", 200000.0 * SAMPLER_BLOCK_SIZE * 1000.0 / ( benchNowNanos() - start )) ;
+
+  if ( maxError > BENCH_SOUND_MAX_ERROR_DB || log2Error > 0.0005 )
+  {
+    printf("the sound meter drifted from the reference\n") ;
+    exit(1) ;
+  }
+}
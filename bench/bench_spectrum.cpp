@@ -0,0 +1,163 @@
+/**
+  \file bench_spectrum.cpp
+  \brief Time of the fixed-point FFT for each size, and its band levels against a DFT of the same windowed samples in double precision
+*/
+#include <Arduino.h>
+#include <math.h>
+#include <algorithm>
+
+#include "bench.h"
+#include "../src/sampler.h"
+#include "../src/sound_meter.h"
+#include "../src/spectrum.h"
+
+#define BENCH_SPECTRUM_MID_SCALE    512   /*!< DC offset of the microphone on the ADC */
+#define BENCH_SPECTRUM_RANGE_DB     40    /*!< Bands quieter than the loudest one by more than this are not compared */
+#define BENCH_SPECTRUM_FLOOR_DB     15    /*!< Level of one ADC count RMS, under which the bands are not compared either */
+#define BENCH_SPECTRUM_MAX_ERROR_DB 1.0   /*!< Largest difference allowed with the reference, in dB */
+#define BENCH_SPECTRUM_TICK_MS      80    /*!< Period of measure(), which runs spectrumUpdate() */
+
+static int16_t  benchSpectrumSamples[SPECTRUM_MAX_SIZE] ;
+static uint32_t benchSpectrumPower[SPECTRUM_MAX_SIZE / 2 + 1] ;
+static uint16_t benchSpectrumSize ;
+
+/**
+ * \fn void benchSpectrumSignal( uint16_t i_size, double i_frequency, double i_amplitude, double i_noise, uint32_t i_seed )
+ * \param[in] i_frequency Frequency of the tone, 0 for none
+ * \param[in] i_amplitude Peak amplitude of the tone, in ADC counts
+ * \param[in] i_noise Peak amplitude of the white noise added to it, in ADC counts
+ * \brief Fill benchSpectrumSamples as the ADC would read them
+*/
+static void benchSpectrumSignal( uint16_t i_size, double i_frequency, double i_amplitude, double i_noise, uint32_t i_seed )
+{
+  uint32_t random = i_seed ;
+
+  for ( uint16_t iSample = 0 ; iSample < i_size ; iSample++ )
+  {
+    double value ;
+
+    random = random * 1103515245 + 12345 ;
+    value  = i_amplitude * sin(2 * M_PI * i_frequency * iSample / SAMPLER_RATE_HZ) ;
+    value += i_noise * ( ( random >> 8 ) / (double) ( 1 << 24 ) * 2 - 1 ) ;
+    value  = floor(BENCH_SPECTRUM_MID_SCALE + value + 0.5) ;
+    benchSpectrumSamples[iSample] = value < 0 ? 0 : value > 1023 ? 1023 : value ;
+  }
+}
+
+/**
+ * \fn void benchReferenceBands( uint16_t i_size, double *o_levels )
+ * \param[out] o_levels Level of each band, in dB calibrated as spectrumDecibels()
+ * \brief spectrumFFT() and spectrumBandEnergies() in double precision, with a DFT
+*/
+static void benchReferenceBands( uint16_t i_size, double *o_levels )
+{
+  static double windowed[SPECTRUM_MAX_SIZE], power[SPECTRUM_MAX_SIZE / 2 + 1] ;
+  double mean = 0 ;
+
+  for ( uint16_t iSample = 0 ; iSample < i_size ; iSample++ )
+    mean += benchSpectrumSamples[iSample] / (double) i_size ;
+  for ( uint16_t iSample = 0 ; iSample < i_size ; iSample++ )
+    windowed[iSample] = ( benchSpectrumSamples[iSample] - mean ) * 16 * pow(sin(M_PI * iSample / i_size), 2) ;
+
+  for ( uint16_t k = 0 ; k <= i_size / 2 ; k++ )
+  {
+    double re = 0, im = 0 ;
+
+    for ( uint16_t iSample = 0 ; iSample < i_size ; iSample++ )
+    {
+      re += windowed[iSample] * cos(2 * M_PI * k * iSample / i_size) ;
+      im -= windowed[iSample] * sin(2 * M_PI * k * iSample / i_size) ;
+    }
+    power[k] = ( re * re + im * im ) / ( (double) i_size * i_size ) ;
+  }
+
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+  {
+    uint32_t first  = ( (uint32_t) spectrumBandEdges[iBand] * i_size + SAMPLER_RATE_HZ - 1 ) / SAMPLER_RATE_HZ ;
+    uint32_t last   = iBand == SPECTRUM_NB_BANDS - 1 ? i_size / 2 + 1 : ( (uint32_t) spectrumBandEdges[iBand + 1] * i_size + SAMPLER_RATE_HZ - 1 ) / SAMPLER_RATE_HZ ;
+    double energy = 0 ;
+
+    for ( uint32_t k = first ; k < last ; k++ )
+      energy += power[k] ;
+    o_levels[iBand] = SOUND_METER_REF_DB + 10 * log10(energy * 16 / ( 3.0 * 256 * SOUND_METER_REF_RMS * SOUND_METER_REF_RMS ) + 1e-30) ;
+  }
+}
+
+/**
+ * \fn double benchSpectrumError( uint16_t i_size, double i_frequency, double i_amplitude, double i_noise )
+ * \return The largest difference between the band levels of spectrumFFT() and the reference ones, in dB
+*/
+static double benchSpectrumError( uint16_t i_size, double i_frequency, double i_amplitude, double i_noise )
+{
+  uint64_t energies[SPECTRUM_NB_BANDS] ;
+  double reference[SPECTRUM_NB_BANDS], loudest = -1000, error = 0 ;
+  int16_t levels[SPECTRUM_NB_BANDS] ;
+
+  benchSpectrumSignal(i_size, i_frequency, i_amplitude, i_noise, 1) ;
+  spectrumFFT(benchSpectrumSamples, i_size, benchSpectrumPower) ;
+  spectrumBandEnergies(benchSpectrumPower, i_size, SAMPLER_RATE_HZ, energies) ;
+  benchReferenceBands(i_size, reference) ;
+
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+  {
+    levels[iBand] = spectrumDecibels(energies[iBand]) ;
+    loudest = std::max(loudest, reference[iBand]) ;
+  }
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+    if ( reference[iBand] > loudest - BENCH_SPECTRUM_RANGE_DB && reference[iBand] > BENCH_SPECTRUM_FLOOR_DB )
+      error = std::max(error, fabs(levels[iBand] / 10.0 - reference[iBand])) ;
+
+  printf("%3u, %6.1f Hz %4.0f counts, noise %3.0f  ", i_size, i_frequency, i_amplitude, i_noise) ;
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+    printf(" %5.1f/%5.1f", levels[iBand] / 10.0, reference[iBand]) ;
+  printf(" dB\n") ;
+  return error ;
+}
+
+static void benchSpectrumFFT( void )
+{
+  spectrumFFT(benchSpectrumSamples, benchSpectrumSize, benchSpectrumPower) ;
+}
+
+void benchSpectrum( void )
+{
+  static const double frequencies[] = { 63, 125, 250, 500, 900 } ;
+  static const double amplitudes[]  = { 8, 85, 400 } ;
+  double maxError = 0, calibration ;
+  uint64_t energies[SPECTRUM_NB_BANDS] ;
+
+  printf("%-40s fixed/double for each octave band from %u Hz\n", "size, signal", spectrumBandEdges[0]) ;
+  for ( uint16_t size = 64 ; size <= SPECTRUM_MAX_SIZE ; size <<= 1 )
+  {
+    for ( uint8_t iFrequency = 0 ; iFrequency < sizeof(frequencies) / sizeof(frequencies[0]) ; iFrequency++ )
+      for ( uint8_t iAmplitude = 0 ; iAmplitude < sizeof(amplitudes) / sizeof(amplitudes[0]) ; iAmplitude++ )
+        maxError = std::max(maxError, benchSpectrumError(size, frequencies[iFrequency], amplitudes[iAmplitude], 0)) ;
+    maxError = std::max(maxError, benchSpectrumError(size, 0, 0, 100)) ;
+    maxError = std::max(maxError, benchSpectrumError(size, 250, 85, 20)) ;
+  }
+  printf("%-40s %9.3f dB largest error against the reference\n", "spectrumFFT", maxError) ;
+
+  // A tone of SOUND_METER_REF_RMS counts reads SOUND_METER_REF_DB in its band
+  benchSpectrumSignal(SPECTRUM_SIZE, 250, SOUND_METER_REF_RMS * sqrt(2.0), 0, 1) ;
+  spectrumFFT(benchSpectrumSamples, SPECTRUM_SIZE, benchSpectrumPower) ;
+  spectrumBandEnergies(benchSpectrumPower, SPECTRUM_SIZE, SAMPLER_RATE_HZ, energies) ;
+  calibration = spectrumDecibels(energies[3]) / 10.0 ;
+  printf("%-40s %9.1f dB for %d dB\n", "250 Hz tone of the reference RMS", calibration, SOUND_METER_REF_DB) ;
+
+  benchSpectrumSignal(SPECTRUM_MAX_SIZE, 250, 85, 20, 1) ;
+  for ( benchSpectrumSize = 64 ; benchSpectrumSize <= SPECTRUM_MAX_SIZE ; benchSpectrumSize <<= 1 )
+  {
+    char name[40] ;
+    BenchResult result ;
+
+    snprintf(name, sizeof(name), "spectrumFFT, %u samples", benchSpectrumSize) ;
+    result = benchRun(name, 2000000 / benchSpectrumSize, benchSpectrumFFT) ;
+    printf("%-40s %9.4f%% of the %u ms tick on this host\n", name, result.nsPerCall / ( BENCH_SPECTRUM_TICK_MS * 10000.0 ), BENCH_SPECTRUM_TICK_MS) ;
+  }
+
+  if ( maxError > BENCH_SPECTRUM_MAX_ERROR_DB || fabs(calibration - SOUND_METER_REF_DB) > 0.5 )
+  {
+    printf("the band levels drifted from the reference\n") ;
+    exit(1) ;
+  }
+}
@@ -0,0 +1,225 @@
+/**
+  \file bench_stats.cpp
+  \brief Percentile levels of the histogram against an exact sort, their cost, and the bytes of an upload interval with and without the series
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <algorithm>
+
+#include "bench.h"
+#include "../src/connection.h"
+#include "../src/level_stats.h"
+#include "../src/noise_codec.h"
+#include "../src/server.h"
+#include "../src/uploader.h"
+
+#define BENCH_STATS_NB_LEVELS   3750  /*!< Levels of a 300 s interval, one per window of measure() */
+#define BENCH_STATS_INTERVAL_MS 300000
+#define BENCH_STATS_VALUE_MS    1920  /*!< Delay between two values of the series */
+
+/**
+ * \struct BenchDistribution
+ * \brief Levels of an interval, in tenths of dB(A)
+*/
+struct BenchDistribution
+{
+  const char  *name ;
+  int16_t     quiet ;       /*!< Level around which the levels are spread */
+  int16_t     spread ;      /*!< Width of the spread */
+  int16_t     loud ;        /*!< Level of the loud events, 0 for none */
+  uint8_t     loudPercent ; /*!< Share of the loud events */
+} ;
+
+static const BenchDistribution benchDistributions[] =
+{
+  { "constant 50.0 dB",             500, 0,   0,   0 },
+  { "uniform 30..80 dB",            300, 500, 0,   0 },
+  { "around 55 dB, +/- 3 dB",       520, 60,  0,   0 },
+  { "quiet 35 dB, 20% at 75 dB",    340, 20,  740, 20 },
+  { "quiet 40 dB, 5% at 90 dB",     390, 20,  890, 5 },
+  { "out of range",                 -50, 1500, 0,  0 },
+} ;
+
+static LevelHistogram benchHistogram ;
+static LevelSummary   benchSummary ;
+static int16_t        benchLevels[BENCH_STATS_NB_LEVELS] ;
+static uint32_t       benchRandom = 1 ;
+static uint32_t       benchNbSummaries ;
+static int16_t        benchReceivedL50[LEVEL_STATS_NB_SUMMARIES] ;
+
+static int16_t benchNextRandom( int16_t i_range )
+{
+  benchRandom = benchRandom * 1103515245 + 12345 ;
+  return i_range > 0 ? ( benchRandom >> 8 ) % i_range : 0 ;
+}
+
+/**
+ * \fn int16_t benchExactPercentile( const int16_t *i_sorted, uint16_t i_nbLevels, uint8_t i_percent )
+ * \return The level of rank ceil(i_percent * i_nbLevels / 100) of the sorted levels
+*/
+static int16_t benchExactPercentile( const int16_t *i_sorted, uint16_t i_nbLevels, uint8_t i_percent )
+{
+  uint32_t rank = ( (uint32_t) i_percent * i_nbLevels + 99 ) / 100 ;
+
+  return i_sorted[( rank > 0 ? rank : 1 ) - 1] ;
+}
+
+/**
+ * \fn int16_t benchAccuracy( const BenchDistribution *i_distribution )
+ * \return The largest difference between the summary of the histogram and the exact one, in tenths of dB
+*/
+static int16_t benchAccuracy( const BenchDistribution *i_distribution )
+{
+  static int16_t sorted[BENCH_STATS_NB_LEVELS] ;
+  int16_t l90, l50, l10, error = 0 ;
+
+  levelHistogramClear(&benchHistogram) ;
+  for ( uint16_t iLevel = 0 ; iLevel < BENCH_STATS_NB_LEVELS ; iLevel++ )
+  {
+    bool loud = benchNextRandom(100) < i_distribution->loudPercent ;
+
+    benchLevels[iLevel] = ( loud ? i_distribution->loud : i_distribution->quiet ) + benchNextRandom(i_distribution->spread + 1) ;
+    levelHistogramAdd(&benchHistogram, benchLevels[iLevel]) ;
+  }
+  levelHistogramSummary(&benchHistogram, &benchSummary) ;
+
+  memcpy(sorted, benchLevels, sizeof(sorted)) ;
+  std::sort(sorted, sorted + BENCH_STATS_NB_LEVELS) ;
+  l90 = benchExactPercentile(sorted, BENCH_STATS_NB_LEVELS, 10) ;
+  l50 = benchExactPercentile(sorted, BENCH_STATS_NB_LEVELS, 50) ;
+  l10 = benchExactPercentile(sorted, BENCH_STATS_NB_LEVELS, 90) ;
+
+  // Levels beyond the range of the histogram only keep their extremes exact
+  if ( i_distribution->quiet >= 0 )
+  {
+    error = std::max<int16_t>(error, abs(benchSummary.l90 - l90)) ;
+    error = std::max<int16_t>(error, abs(benchSummary.l50 - l50)) ;
+    error = std::max<int16_t>(error, abs(benchSummary.l10 - l10)) ;
+  }
+  error = std::max<int16_t>(error, abs(benchSummary.min - sorted[0])) ;
+  error = std::max<int16_t>(error, abs(benchSummary.max - sorted[BENCH_STATS_NB_LEVELS - 1])) ;
+  error = std::max<int16_t>(error, benchSummary.nbLevels == BENCH_STATS_NB_LEVELS ? 0 : INT16_MAX) ;
+
+  printf("%-40s L90 %5.1f/%5.1f L50 %5.1f/%5.1f L10 %5.1f/%5.1f dB, histogram/exact\n", i_distribution->name,
+         benchSummary.l90 / 10.0, l90 / 10.0, benchSummary.l50 / 10.0, l50 / 10.0, benchSummary.l10 / 10.0, l10 / 10.0) ;
+  return error ;
+}
+
+static void benchAdd( void )
+{
+  if ( benchHistogram.nbLevels == UINT16_MAX )
+    levelHistogramClear(&benchHistogram) ;
+  levelHistogramAdd(&benchHistogram, benchLevels[benchHistogram.nbLevels % BENCH_STATS_NB_LEVELS]) ;
+}
+
+static void benchClear( void )
+{
+  levelHistogramClear(&benchHistogram) ;
+}
+
+static void benchSummarize( void )
+{
+  levelHistogramSummary(&benchHistogram, &benchSummary) ;
+}
+
+/**
+ * \fn void benchBytes( void )
+ * \brief Bytes of the messages of one interval at the 300 s rate, with the series and the summary, and with the summary alone
+*/
+static void benchBytes( void )
+{
+  static const uint16_t nbValues = BENCH_STATS_INTERVAL_MS / BENCH_STATS_VALUE_MS ;
+  uint8_t binary[NOISE_CODEC_SIZE_MAX(nbValues)] ;
+  char message[SERVER_SIZE_MESSAGE_JSON] ;
+  size_t seriesJSON = 0, seriesBinary, summaryJSON, summaryBinary ;
+
+  for ( uint16_t iValue = 0 ; iValue < nbValues ; iValue += SERVER_SIZE_MESSAGE_DATA )
+  {
+    uint8_t nbData = std::min<uint16_t>(SERVER_SIZE_MESSAGE_DATA, nbValues - iValue) ;
+    seriesJSON += buildDataMessageJSON(message, sizeof(message), "AbC123", BENCH_STATS_VALUE_MS, nbValues, iValue == 0, benchLevels + iValue, nbData,
+                                       iValue == 0 ? &benchSummary : NULL, 1200) ;
+  }
+  seriesBinary  = noiseCodecEncode(binary, sizeof(binary), "AbC123", BENCH_STATS_VALUE_MS, nbValues, true, benchLevels, nbValues, &benchSummary, 1200) ;
+  summaryJSON   = buildDataMessageJSON(message, sizeof(message), "AbC123", BENCH_STATS_VALUE_MS, 0, true, NULL, 0, &benchSummary, 1200) ;
+  summaryBinary = noiseCodecEncode(binary, sizeof(binary), "AbC123", BENCH_STATS_VALUE_MS, 0, true, NULL, 0, &benchSummary, 1200) ;
+
+  printf("%-40s %5u bytes JSON %5u bytes binary\n", "300 s interval, series and summary", (unsigned) seriesJSON, (unsigned) seriesBinary) ;
+  printf("%-40s %5u bytes JSON %5u bytes binary\n", "300 s interval, summary alone", (unsigned) summaryJSON, (unsigned) summaryBinary) ;
+}
+
+/**
+ * \fn int16_t benchStatsHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server recording the L50 of the summaries it receives
+*/
+static int16_t benchStatsHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  std::string body((const char *) i_body, i_length) ;
+  size_t position = body.find("\"l50\":") ;
+
+  (void) i_host ;
+  (void) i_endPoint ;
+  *o_response = "{}" ;
+  if ( position != std::string::npos && benchNbSummaries < LEVEL_STATS_NB_SUMMARIES )
+    benchReceivedL50[benchNbSummaries++] = atoi(body.c_str() + position + 6) ;
+  return 200 ;
+}
+
+/**
+ * \fn bool benchDelivery( void )
+ * \return False if the queued summaries were not uploaded once each, in order, without values to go with them
+*/
+static bool benchDelivery( void )
+{
+  uint32_t startMillis ;
+  bool valid = true ;
+
+  connectionClose() ;
+  halSetHTTPHandler(benchStatsHandler) ;
+  noiseBufferServer.consume(noiseBufferServer.back()) ;
+  levelSummaries.consume(levelSummaries.back()) ;
+  benchNbSummaries = 0 ;
+
+  for ( uint8_t iSummary = 0 ; iSummary < 3 ; iSummary++ )
+  {
+    benchSummary.l50        = 400 + iSummary ;
+    benchSummary.endMillis  = millis() ;
+    levelSummaries.push(benchSummary) ;
+  }
+
+  startMillis = millis() ;
+  uploaderStart("noisey", "HOST01", BENCH_STATS_VALUE_MS) ;
+  while ( uploaderStep() != UPLOADER_IDLE && millis() - startMillis < 60000 )
+    delay(1) ;
+  halSetHTTPHandler(NULL) ;
+
+  valid = benchNbSummaries == 3 && levelSummaries.size() == 0 ;
+  for ( uint8_t iSummary = 0 ; iSummary < benchNbSummaries ; iSummary++ )
+    valid &= benchReceivedL50[iSummary] == 400 + iSummary ;
+  printf("%-40s %5u/3 received %s\n", "summaries without values", benchNbSummaries, valid ? "" : "INVALID") ;
+  return valid ;
+}
+
+void benchStats( void )
+{
+  int16_t maxError = 0 ;
+  bool valid ;
+
+  for ( uint8_t iDistribution = 0 ; iDistribution < sizeof(benchDistributions) / sizeof(benchDistributions[0]) ; iDistribution++ )
+    maxError = std::max(maxError, benchAccuracy(&benchDistributions[iDistribution])) ;
+  printf("%-40s %5.1f dB largest error, bins of %.1f dB\n", "percentiles against an exact sort", maxError / 10.0, LEVEL_STATS_BIN_WIDTH / 10.0) ;
+  printf("%-40s %5u bytes histogram %5u bytes queue of summaries\n", "memory", (unsigned) sizeof(LevelHistogram), (unsigned) sizeof(levelSummaries)) ;
+
+  benchBytes() ;
+  benchRun("levelHistogramAdd", 1000000, benchAdd) ;
+  benchRun("levelHistogramClear", 100000, benchClear) ;
+  for ( uint16_t iLevel = 0 ; iLevel < BENCH_STATS_NB_LEVELS ; iLevel++ )
+    levelHistogramAdd(&benchHistogram, benchLevels[iLevel]) ;
+  benchRun("levelHistogramSummary, 3750 levels", 100000, benchSummarize) ;
+  valid = benchDelivery() ;
+
+  if ( maxError > LEVEL_STATS_BIN_WIDTH || !valid )
+  {
+    printf("the percentile levels are wrong or were not uploaded\n") ;
+    exit(1) ;
+  }
+}
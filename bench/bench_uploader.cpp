@@ -0,0 +1,219 @@
+/**
+  \file bench_uploader.cpp
+  \brief Worst-case duration of loop() while uploading to slow, failing, dropping and rejecting servers, and data
+         delivered
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <vector>
+
+#include "bench.h"
+#include "../src/connection.h"
+#include "../src/flash_log.h"
+#include "../src/server.h"
+#include "../src/uploader.h"
+
+#define BENCH_UPLOADER_RUN_MS       600000 /*!< Duration of the run of each scenario once the server is up, on the virtual clock, in ms */
+#define BENCH_UPLOADER_MAX_DOWN_MS  3600000 /*!< Longest time the server is down in a scenario, in ms */
+#define BENCH_UPLOADER_RECOVERY_MS  1800000 /*!< Maximum time given to the uploader to catch up once the server is healthy, in ms */
+#define BENCH_UPLOADER_VALUE_MS     1920   /*!< Delay between two values added to the buffer, in ms */
+#define BENCH_UPLOADER_PERIOD_MS    60000  /*!< Delay between two uploads, in ms */
+#define BENCH_UPLOADER_NB_VALUES    ( ( BENCH_UPLOADER_MAX_DOWN_MS + BENCH_UPLOADER_RUN_MS ) / BENCH_UPLOADER_VALUE_MS + 1 ) /*!< Maximum number of values added during a run */
+
+/**
+ * \struct BenchScenario
+ * \brief Behaviour of the server during a run
+*/
+struct BenchScenario
+{
+  const char  *name ;
+  uint32_t    handshakeMicros ;
+  uint32_t    roundTripMicros ;
+  uint8_t     errorEvery ;  /*!< Answer every n-th request with a 500, 0 never */
+  uint8_t     dropEvery ;   /*!< Drop the connection on every n-th request, 0 never */
+  uint32_t    downMillis ;  /*!< Drop every request during the first ms of the run */
+  uint8_t     rejectEvery ; /*!< Answer with a 400 the requests holding a multiple of n, whatever their attempt, 0 never */
+} ;
+
+static const BenchScenario benchScenarios[] =
+{
+  { "healthy",               HAL_HANDSHAKE_US_DEFAULT, HAL_ROUND_TRIP_US_DEFAULT, 0, 0, 0, 0 },
+  { "slow (2 s round trip)",  1500000,                  2000000,                   0, 0, 0, 0 },
+  { "500 on 1 request in 2",  HAL_HANDSHAKE_US_DEFAULT, HAL_ROUND_TRIP_US_DEFAULT, 2, 0, 0, 0 },
+  { "drop 1 request in 3",    HAL_HANDSHAKE_US_DEFAULT, HAL_ROUND_TRIP_US_DEFAULT, 0, 3, 0, 0 },
+  { "down 5 min, 400 on n*100", HAL_HANDSHAKE_US_DEFAULT, HAL_ROUND_TRIP_US_DEFAULT, 0, 0, 300000, 100 },
+  { "down for 5 minutes",     HAL_HANDSHAKE_US_DEFAULT, HAL_ROUND_TRIP_US_DEFAULT, 0, 0, 300000, 0 },
+  { "down for 1 hour",        HAL_HANDSHAKE_US_DEFAULT, HAL_ROUND_TRIP_US_DEFAULT, 0, 0, BENCH_UPLOADER_MAX_DOWN_MS, 0 },
+} ;
+
+static const BenchScenario  *benchScenario = NULL ;   /*!< Behaviour of the server, NULL when healthy */
+static uint64_t             benchStartMicros ;
+static uint32_t             benchRequests ;
+static int16_t              benchNextValue ;          /*!< Next value added to the buffer */
+static uint8_t              benchReceived[BENCH_UPLOADER_NB_VALUES] ; /*!< Times the server accepted each value */
+static uint8_t              benchRejected[BENCH_UPLOADER_NB_VALUES] ; /*!< Times the server rejected each value */
+
+/**
+ * \fn int16_t benchHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server failing as set by the scenario, and counting the values it accepts
+*/
+static int16_t benchHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  std::string body((const char *) i_body, i_length) ;
+  size_t position = body.find("\"noise\":[") ;
+  std::vector<long> values ;
+  bool rejected = false ;
+
+  (void) i_host ;
+  (void) i_endPoint ;
+  *o_response = "{}" ;
+  benchRequests++ ;
+
+  if ( benchScenario != NULL )
+  {
+    if ( halMicros() - benchStartMicros < benchScenario->downMillis * 1000ULL )
+      return -1 ;
+    if ( benchScenario->dropEvery > 0 && benchRequests % benchScenario->dropEvery == 0 )
+      return -1 ;
+    if ( benchScenario->errorEvery > 0 && benchRequests % benchScenario->errorEvery == 0 )
+      return 500 ;
+  }
+
+  for ( const char *value = position != std::string::npos ? body.c_str() + position + 9 : "]" ; *value != ']' ; )
+  {
+    char *end ;
+    long data = strtol(value, &end, 10) ;
+
+    if ( data >= 0 && data < BENCH_UPLOADER_NB_VALUES )
+      values.push_back(data) ;
+    rejected |= benchScenario != NULL && benchScenario->rejectEvery > 0 && data % benchScenario->rejectEvery == 0 ;
+    value = *end == ',' ? end + 1 : end ;
+  }
+  for ( size_t iValue = 0 ; iValue < values.size() ; iValue++ )
+    ( rejected ? benchRejected : benchReceived )[values[iValue]]++ ;
+  return rejected ? 400 : 200 ;
+}
+
+/**
+ * \fn uint32_t benchLoop( bool i_blocking, uint32_t i_durationMillis, uint32_t *o_maxConnectMicros, uint64_t *o_maxStepNanos )
+ * \param[in] i_blocking Whether to upload with sendDataServer(), as loop() did before the uploader
+ * \param[in] i_durationMillis Duration of the run, on the virtual clock
+ * \param[out] o_maxConnectMicros Longest step opening the connection, on the virtual clock
+ * \param[out] o_maxStepNanos Longest step apart from the ones opening the connection, on the wall clock
+ * \return The longest loop() apart from the ones opening the connection, on the virtual clock, in us
+ * \brief Run the loop() of the firmware, adding values to the buffer as measure() does
+*/
+static uint32_t benchLoop( bool i_blocking, uint32_t i_durationMillis, uint32_t *o_maxConnectMicros, uint64_t *o_maxStepNanos )
+{
+  uint32_t startMillis = millis(), lastValueMillis = startMillis, lastUploadMillis = startMillis ;
+  uint32_t maxMicros = 0 ;
+
+  while ( millis() - startMillis < i_durationMillis )
+  {
+    uint64_t startLoop = halMicros(), startStep = benchNowNanos() ;
+    bool connecting = false ;
+    uint32_t duration ;
+
+    if ( millis() - lastValueMillis >= BENCH_UPLOADER_VALUE_MS )
+    {
+      lastValueMillis = millis() ;
+      addDataSendServer(benchNextValue++) ;
+    }
+    if ( millis() - lastUploadMillis >= BENCH_UPLOADER_PERIOD_MS )
+    {
+      lastUploadMillis = millis() ;
+      if ( i_blocking )
+        sendDataServer("noisey", "HOST01", 1920) ;
+      else
+        uploaderStart("noisey", "HOST01", 1920) ;
+    }
+    if ( !i_blocking )
+    {
+      connecting  = uploaderState() == UPLOADER_CONNECT ;
+      startStep   = benchNowNanos() ;
+      uploaderStep() ;
+    }
+
+    duration = halMicros() - startLoop ;
+    if ( connecting )
+      *o_maxConnectMicros = std::max(*o_maxConnectMicros, duration) ;
+    else
+    {
+      maxMicros       = std::max(maxMicros, duration) ;
+      *o_maxStepNanos = std::max(*o_maxStepNanos, benchNowNanos() - startStep) ;
+    }
+    delay(1) ;
+  }
+  return maxMicros ;
+}
+
+/**
+ * \fn bool benchRunScenario( const BenchScenario *i_scenario, bool i_blocking )
+ * \return False if values were never delivered although the server recovered
+ * \brief Run a scenario, then let the uploader catch up with a healthy server and report what the server got
+*/
+static bool benchRunScenario( const BenchScenario *i_scenario, bool i_blocking )
+{
+  uint32_t maxConnectMicros = 0, maxMicros, failures = uploaderFailures(), rejected = uploaderRejected(), flashBytes = halCountFlashBytes(), recoveryMillis ;
+  uint64_t maxStepNanos = 0 ;
+  int16_t nbDelivered = 0, nbDuplicates = 0, nbRejected = 0 ;
+
+  connectionClose() ;
+  halSetNetworkLatency(i_scenario->handshakeMicros, i_scenario->roundTripMicros) ;
+  benchScenario       = i_scenario ;
+  benchStartMicros    = halMicros() ;
+  benchRequests       = 0 ;
+  benchNextValue      = 0 ;
+  memset(benchReceived, 0, sizeof(benchReceived)) ;
+  memset(benchRejected, 0, sizeof(benchRejected)) ;
+
+  maxMicros = benchLoop(i_blocking, i_scenario->downMillis + BENCH_UPLOADER_RUN_MS, &maxConnectMicros, &maxStepNanos) ;
+
+  // The server is healthy again : every value left in the buffer must get through, but the ones it rejected
+  benchScenario   = i_scenario->rejectEvery > 0 ? i_scenario : NULL ;
+  recoveryMillis  = millis() ;
+  while ( ( noiseBufferServer.size() > 0 || !flashLogEmpty() || uploaderState() != UPLOADER_IDLE ) && millis() - recoveryMillis < BENCH_UPLOADER_RECOVERY_MS )
+  {
+    if ( uploaderState() == UPLOADER_IDLE )
+      uploaderStart("noisey", "HOST01", 1920) ;
+    uploaderStep() ;
+    delay(1) ;
+  }
+
+  for ( int16_t iValue = 0 ; iValue < benchNextValue ; iValue++ )
+  {
+    nbDelivered  += benchReceived[iValue] > 0 ;
+    nbDuplicates += benchReceived[iValue] > 1 ? benchReceived[iValue] - 1 : 0 ;
+    nbRejected   += benchReceived[iValue] == 0 && benchRejected[iValue] > 0 ;
+  }
+
+  printf("  %-24s %-8s loop() max %7.1f ms (connect %6.1f ms, step %5.1f us), %2u failures, %4d/%4d delivered, %3d duplicates, "
+         "%3d rejected in %2u messages, %3u kB to flash\n", i_scenario->name, i_blocking ? "blocking" : "uploader", maxMicros / 1000.0,
+         maxConnectMicros / 1000.0, maxStepNanos / 1000.0, uploaderFailures() - failures, nbDelivered, benchNextValue, nbDuplicates,
+         nbRejected, uploaderRejected() - rejected, ( halCountFlashBytes() - flashBytes ) / 1024) ;
+
+  // A rejected message costs its values only : the uploader goes on, and does not send the next ones again
+  if ( i_scenario->rejectEvery > 0 )
+    return nbDelivered + nbRejected == benchNextValue && nbDuplicates == 0 && nbRejected > 0 ;
+  return nbDelivered == benchNextValue ;
+}
+
+void benchUploader( void )
+{
+  bool valid = true ;
+
+  halSetHTTPHandler(benchHandler) ;
+  flashLogBegin() ;
+  for ( uint8_t iScenario = 0 ; iScenario < sizeof(benchScenarios) / sizeof(benchScenarios[0]) ; iScenario++ )
+  {
+    valid &= benchRunScenario(&benchScenarios[iScenario], true) ;
+    valid &= benchRunScenario(&benchScenarios[iScenario], false) ;
+  }
+  halSetHTTPHandler(NULL) ;
+
+  if ( !valid )
+  {
+    printf("values were not delivered, or delivered again after a rejected message\n") ;
+    exit(1) ;
+  }
+}
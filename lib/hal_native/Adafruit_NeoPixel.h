@@ -0,0 +1,41 @@
+/**
+  \file Adafruit_NeoPixel.h
+  \brief Host stand-in for the Adafruit NeoPixel driver
+*/
+#ifndef HAL_ADAFRUIT_NEOPIXEL_H
+#define HAL_ADAFRUIT_NEOPIXEL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define NEO_GRB    ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_RGB    ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_KHZ800 0x0000
+
+/**
+ * \class Adafruit_NeoPixel
+ * \brief Pixel buffer whose show() only counts the frames that would be sent to the strip
+*/
+class Adafruit_NeoPixel
+{
+  public:
+    Adafruit_NeoPixel( uint16_t i_numPixels, uint8_t i_pin, uint16_t i_type ) ;
+    ~Adafruit_NeoPixel() ;
+
+    void begin( void ) {}
+    void show( void ) ;
+    void clear( void ) { memset(m_pixels, 0, m_numPixels * sizeof(uint32_t)) ; }
+    void setPixelColor( uint16_t i_pixel, uint32_t i_color ) { if ( i_pixel < m_numPixels ) m_pixels[i_pixel] = i_color ; }
+    void setPixelColor( uint16_t i_pixel, uint8_t i_red, uint8_t i_green, uint8_t i_blue ) { setPixelColor(i_pixel, Color(i_red, i_green, i_blue)) ; }
+    void setBrightness( uint8_t i_brightness ) { m_brightness = i_brightness ; }
+    uint32_t getPixelColor( uint16_t i_pixel ) const { return i_pixel < m_numPixels ? m_pixels[i_pixel] : 0 ; }
+    uint16_t numPixels( void ) const { return m_numPixels ; }
+    static uint32_t Color( uint8_t i_red, uint8_t i_green, uint8_t i_blue ) { return ((uint32_t) i_red << 16) | ((uint32_t) i_green << 8) | i_blue ; }
+
+  private:
+    uint16_t  m_numPixels ;
+    uint8_t   m_brightness ;
+    uint32_t *m_pixels ;
+} ;
+
+#endif
@@ -0,0 +1,134 @@
+/**
+  \file Arduino.h
+  \brief Host stand-in for the subset of the ESP8266 Arduino core used by the firmware
+*/
+#ifndef HAL_ARDUINO_H
+#define HAL_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+#include "hal_native.h"
+
+#define HIGH        0x1
+#define LOW         0x0
+#define INPUT       0x00
+#define OUTPUT      0x01
+#define A0          17
+#define BUILTIN_LED 2
+
+#define PROGMEM
+#define ICACHE_RAM_ATTR
+#define ICACHE_FLASH_ATTR
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define strncpy_P(dest, src, size) strncpy((dest), (src), (size))
+
+typedef uint8_t byte ;
+typedef bool    boolean ;
+
+class __FlashStringHelper ;
+#define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
+#define F(string_literal)   (FPSTR(string_literal))
+
+#define TIM_DIV1    0
+#define TIM_DIV16   1
+#define TIM_DIV256  3
+#define TIM_EDGE    0
+#define TIM_LOOP    1
+#define TIM_SINGLE  0
+
+typedef void (*timercallback)( void ) ;
+
+unsigned long millis( void ) ;
+unsigned long micros( void ) ;
+void delay( unsigned long i_ms ) ;
+void delayMicroseconds( unsigned int i_us ) ;
+void yield( void ) ;
+int  analogRead( uint8_t i_pin ) ;
+void pinMode( uint8_t i_pin, uint8_t i_mode ) ;
+int  digitalRead( uint8_t i_pin ) ;
+void digitalWrite( uint8_t i_pin, uint8_t i_value ) ;
+long map( long i_x, long i_inMin, long i_inMax, long i_outMin, long i_outMax ) ;
+void noInterrupts( void ) ;
+void interrupts( void ) ;
+void timer1_isr_init( void ) ;
+void timer1_attachInterrupt( timercallback i_callback ) ;
+void timer1_detachInterrupt( void ) ;
+void timer1_enable( uint8_t i_divider, uint8_t i_edge, uint8_t i_reload ) ;
+void timer1_disable( void ) ;
+void timer1_write( uint32_t i_ticks ) ;
+
+/**
+ * \class String
+ * \brief Minimal Arduino String backed by std::string, so that its heap usage shows up in the allocation counters
+*/
+class String
+{
+  public:
+    String() {}
+    String( const char *i_str ) : m_str(i_str ? i_str : "") {}
+    String( const __FlashStringHelper *i_str ) : m_str(reinterpret_cast<const char *>(i_str)) {}
+    explicit String( int i_value ) : m_str(std::to_string(i_value)) {}
+
+    String & operator=( const char *i_str ) { m_str = i_str ? i_str : "" ; return *this ; }
+    String & operator=( const __FlashStringHelper *i_str ) { m_str = reinterpret_cast<const char *>(i_str) ; return *this ; }
+    String & operator+=( char i_char ) { m_str += i_char ; return *this ; }
+    String & operator+=( const char *i_str ) { m_str += i_str ; return *this ; }
+    String & operator+=( const String &i_str ) { m_str += i_str.m_str ; return *this ; }
+    bool operator==( const char *i_str ) const { return m_str == i_str ; }
+
+    const char * c_str() const { return m_str.c_str() ; }
+    unsigned int length() const { return m_str.length() ; }
+    void reserve( unsigned int i_size ) { m_str.reserve(i_size) ; }
+
+  private:
+    std::string m_str ;
+} ;
+
+/**
+ * \class HardwareSerial
+ * \brief Serial port printing to the standard output
+*/
+class HardwareSerial
+{
+  public:
+    void begin( unsigned long i_baud ) { (void) i_baud ; }
+    void print( const char *i_str ) { fputs(i_str, stdout) ; }
+    void print( const String &i_str ) { print(i_str.c_str()) ; }
+    void print( const __FlashStringHelper *i_str ) { print(reinterpret_cast<const char *>(i_str)) ; }
+    void print( long i_value ) { printf("%ld", i_value) ; }
+    void println( void ) { fputc('\n', stdout) ; }
+    template <typename T> void println( const T &i_value ) { print(i_value) ; println() ; }
+    int  printf( const char *i_format, ... ) __attribute__((format(printf, 2, 3))) ;
+} ;
+
+/**
+ * \class EspClass
+ * \brief Chip-level functions of the ESP8266
+*/
+class EspClass
+{
+  public:
+    uint32_t getChipId( void ) { return 0x00C0FFEE ; }
+    uint32_t getCycleCount( void ) ;
+    uint8_t  getCpuFreqMHz( void ) { return HAL_CPU_FREQ_MHZ ; }
+    uint32_t getFreeHeap( void ) { return 40960 ; }
+    void reset( void ) { exit(1) ; }
+    void restart( void ) { exit(1) ; }
+} ;
+
+extern HardwareSerial Serial ;
+extern EspClass       ESP ;
+
+void setup( void ) ;
+void loop( void ) ;
+
+#endif
@@ -0,0 +1,10 @@
+/**
+  \file DNSServer.h
+  \brief Host stand-in for the DNS server used by WiFiManager
+*/
+#ifndef HAL_DNSSERVER_H
+#define HAL_DNSSERVER_H
+
+class DNSServer {} ;
+
+#endif
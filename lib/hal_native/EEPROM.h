@@ -0,0 +1,56 @@
+/**
+  \file EEPROM.h
+  \brief Host stand-in for the ESP8266 EEPROM emulation
+*/
+#ifndef HAL_EEPROM_H
+#define HAL_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+#include "hal_native.h"
+
+/**
+ * \class EEPROMClass
+ * \brief RAM-backed EEPROM that counts commits, each commit standing for one flash sector erase on the device
+*/
+class EEPROMClass
+{
+  public:
+    void begin( size_t i_size ) { m_size = i_size <= HAL_EEPROM_SIZE ? i_size : HAL_EEPROM_SIZE ; }
+    uint8_t read( int i_address ) { return ( i_address >= 0 && (size_t) i_address < m_size ) ? m_data[i_address] : 0 ; }
+    void write( int i_address, uint8_t i_value ) ;
+    bool commit( void ) ;
+    void end( void ) { commit() ; m_size = 0 ; }
+    uint8_t * getDataPtr( void ) { m_dirty = true ; return m_data ; }
+
+    template<typename T> T & get( int i_address, T &o_value )
+    {
+      if ( i_address >= 0 && i_address + sizeof(T) <= m_size )
+        memcpy(&o_value, m_data + i_address, sizeof(T)) ;
+      return o_value ;
+    }
+
+    template<typename T> const T & put( int i_address, const T &i_value )
+    {
+      if ( i_address >= 0 && i_address + sizeof(T) <= m_size )
+      {
+        memcpy(m_data + i_address, &i_value, sizeof(T)) ;
+        m_dirty = true ;
+      }
+      return i_value ;
+    }
+
+    // Used by the harness
+    void clear( void ) { memset(m_data, 0xFF, sizeof(m_data)) ; m_dirty = false ; }
+
+    EEPROMClass() : m_size(0), m_dirty(false) { clear() ; }
+
+  private:
+    uint8_t m_data[HAL_EEPROM_SIZE] ;
+    size_t  m_size ;
+    bool    m_dirty ;
+} ;
+
+extern EEPROMClass EEPROM ;
+
+#endif
@@ -0,0 +1,10 @@
+/**
+  \file ESP8266WebServer.h
+  \brief Host stand-in for the web server used by WiFiManager
+*/
+#ifndef HAL_ESP8266WEBSERVER_H
+#define HAL_ESP8266WEBSERVER_H
+
+class ESP8266WebServer {} ;
+
+#endif
@@ -0,0 +1,41 @@
+/**
+  \file ESP8266WiFi.h
+  \brief Host stand-in for the ESP8266 WiFi stack, connected from the start or after halSetWiFiAssociation() ms
+*/
+#ifndef HAL_ESP8266WIFI_H
+#define HAL_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <WiFiServer.h>
+
+#define WL_IDLE_STATUS  0
+#define WL_CONNECTED    3
+#define WL_DISCONNECTED 6
+
+enum WiFiMode
+{
+  WIFI_OFF    = 0,
+  WIFI_STA    = 1,
+  WIFI_AP     = 2,
+  WIFI_AP_STA = 3
+} ;
+
+/**
+ * \class ESP8266WiFiClass
+ * \brief WiFi station whose saved network is called "host", connected until begin() starts a new association
+*/
+class ESP8266WiFiClass
+{
+  public:
+    bool mode( WiFiMode i_mode ) ;
+    uint8_t begin( void ) ;
+    uint8_t status( void ) ;
+    String SSID( void ) { return String("host") ; }
+    String softAPIP( void ) { return String("192.168.4.1") ; }
+} ;
+
+extern ESP8266WiFiClass WiFi ;
+
+#endif
@@ -0,0 +1,82 @@
+/**
+  \file FS.h
+  \brief Host stand-in for the SPIFFS file system of the ESP8266, over the files of a host directory
+*/
+#ifndef HAL_FS_H
+#define HAL_FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+
+struct HalFile ;
+
+enum SeekMode
+{
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+} ;
+
+/**
+ * \class File
+ * \brief Open file, shared by its copies as on the device
+*/
+class File
+{
+  public:
+    File() {}
+    explicit File( std::shared_ptr<HalFile> i_file ) : m_file(i_file) {}
+
+    size_t write( const uint8_t *i_buffer, size_t i_size ) ;
+    size_t read( uint8_t *o_buffer, size_t i_size ) ;
+    bool seek( uint32_t i_position, SeekMode i_mode = SeekSet ) ;
+    size_t position( void ) const ;
+    size_t size( void ) const ;
+    void flush( void ) ;
+    void close( void ) { m_file.reset() ; }
+    operator bool() const { return (bool) m_file ; }
+
+  private:
+    std::shared_ptr<HalFile> m_file ;
+} ;
+
+/**
+ * \class Dir
+ * \brief Iterator over the files whose path starts with a prefix
+*/
+class Dir
+{
+  public:
+    Dir() : m_index(-1) {}
+    explicit Dir( const std::vector<String> &i_names ) : m_names(i_names), m_index(-1) {}
+
+    bool next( void ) { return ++m_index < (int) m_names.size() ; }
+    String fileName( void ) const { return m_names[m_index] ; }
+
+  private:
+    std::vector<String> m_names ;
+    int                 m_index ;
+} ;
+
+/**
+ * \class FS
+ * \brief File system whose files are stored in the directory set by halSetFlashDirectory()
+*/
+class FS
+{
+  public:
+    bool begin( void ) ;
+    void end( void ) {}
+    bool format( void ) ;
+    File open( const char *i_path, const char *i_mode ) ;
+    File open( const String &i_path, const char *i_mode ) { return open(i_path.c_str(), i_mode) ; }
+    bool exists( const char *i_path ) ;
+    bool remove( const char *i_path ) ;
+    bool rename( const char *i_from, const char *i_to ) ;
+    Dir openDir( const char *i_prefix ) ;
+} ;
+
+extern FS SPIFFS ;
+
+#endif
@@ -0,0 +1,45 @@
+/**
+  \file Ticker.h
+  \brief Host stand-in for the ESP8266 Ticker, fired by the virtual clock
+*/
+#ifndef HAL_TICKER_H
+#define HAL_TICKER_H
+
+#include <stdint.h>
+
+/**
+ * \class Ticker
+ * \brief Periodic or one-shot callback scheduled on the virtual clock
+ *
+ * Tickers are fired in deadline order whenever the virtual clock advances through delay() or halAdvanceMicros(). As on
+ * the device, a callback is never preempted by another Ticker.
+*/
+class Ticker
+{
+  public:
+    typedef void (*callback_t)( void ) ;
+
+    Ticker() ;
+    ~Ticker() ;
+
+    void attach( float i_seconds, callback_t i_callback ) { attachMicros((uint64_t) (i_seconds * 1e6), i_callback, true) ; }
+    void attach_ms( uint32_t i_ms, callback_t i_callback ) { attachMicros((uint64_t) i_ms * 1000, i_callback, true) ; }
+    void once( float i_seconds, callback_t i_callback ) { attachMicros((uint64_t) (i_seconds * 1e6), i_callback, false) ; }
+    void once_ms( uint32_t i_ms, callback_t i_callback ) { attachMicros((uint64_t) i_ms * 1000, i_callback, false) ; }
+    void detach( void ) ;
+    bool active( void ) const { return m_callback != 0 ; }
+
+    // Used by the virtual clock
+    uint64_t deadline( void ) const { return m_deadline ; }
+    void fire( void ) ;
+
+  private:
+    void attachMicros( uint64_t i_period, callback_t i_callback, bool i_repeat ) ;
+
+    callback_t m_callback ;
+    uint64_t   m_period ;
+    uint64_t   m_deadline ;
+    bool       m_repeat ;
+} ;
+
+#endif
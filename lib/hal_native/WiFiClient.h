@@ -0,0 +1,46 @@
+/**
+  \file WiFiClient.h
+  \brief Host stand-in for the ESP8266 TCP client
+*/
+#ifndef HAL_WIFICLIENT_H
+#define HAL_WIFICLIENT_H
+
+#include <Arduino.h>
+#include <memory>
+
+struct HalConnection ;
+
+/**
+ * \class WiFiClient
+ * \brief TCP client connected either to the in-process HTTP server or to a real socket, see hal_native.h
+ *
+ * As on the device, copies of a client share the same connection.
+*/
+class WiFiClient
+{
+  public:
+    WiFiClient() : m_timeout(1000) {}
+    explicit WiFiClient( std::shared_ptr<HalConnection> i_connection ) : m_connection(i_connection), m_timeout(1000) {}
+    virtual ~WiFiClient() {}
+
+    virtual int connect( const char *i_host, uint16_t i_port ) ;
+    uint8_t connected( void ) ;
+    size_t write( const uint8_t *i_buffer, size_t i_size ) ;
+    size_t write( uint8_t i_byte ) { return write(&i_byte, 1) ; }
+    size_t print( const char *i_str ) { return write((const uint8_t *) i_str, strlen(i_str)) ; }
+    int available( void ) ;
+    int read( void ) ;
+    int read( uint8_t *o_buffer, size_t i_size ) ;
+    int peek( void ) ;
+    void flush( void ) {}
+    void stop( void ) ;
+    void setTimeout( unsigned long i_timeout ) { m_timeout = i_timeout ; }
+    void setNoDelay( bool i_noDelay ) { (void) i_noDelay ; }
+    operator bool() { return connected() ; }
+
+  protected:
+    std::shared_ptr<HalConnection> m_connection ;
+    unsigned long m_timeout ;
+} ;
+
+#endif
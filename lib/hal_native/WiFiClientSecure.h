@@ -0,0 +1,21 @@
+/**
+  \file WiFiClientSecure.h
+  \brief Host stand-in for the ESP8266 TLS client
+*/
+#ifndef HAL_WIFICLIENTSECURE_H
+#define HAL_WIFICLIENTSECURE_H
+
+#include <WiFiClient.h>
+
+/**
+ * \class WiFiClientSecure
+ * \brief TLS client : each connection costs one handshake, whose duration is set by halSetNetworkLatency()
+*/
+class WiFiClientSecure : public WiFiClient
+{
+  public:
+    int connect( const char *i_host, uint16_t i_port ) ;
+    bool verify( const char *i_fingerprint, const char *i_host ) { (void) i_fingerprint ; (void) i_host ; return connected() ; }
+} ;
+
+#endif
@@ -0,0 +1,23 @@
+/**
+  \file WiFiManager.h
+  \brief Host stand-in for WiFiManager, which connects to the saved network without opening its portal
+*/
+#ifndef HAL_WIFIMANAGER_H
+#define HAL_WIFIMANAGER_H
+
+#include <ESP8266WiFi.h>
+
+/**
+ * \class WiFiManager
+ * \brief Connection manager that never needs to open its configuration portal
+*/
+class WiFiManager
+{
+  public:
+    void setAPCallback( void (*i_callback)(WiFiManager *) ) { (void) i_callback ; }
+    void setDebugOutput( bool i_debug ) { (void) i_debug ; }
+    bool autoConnect( const char *i_ssid, const char *i_password ) ;
+    String getConfigPortalSSID( void ) { return String("Noisey") ; }
+} ;
+
+#endif
@@ -0,0 +1,35 @@
+/**
+  \file WiFiServer.h
+  \brief Host stand-in for the ESP8266 TCP server
+*/
+#ifndef HAL_WIFISERVER_H
+#define HAL_WIFISERVER_H
+
+#include <WiFiClient.h>
+
+/**
+ * \class WiFiServer
+ * \brief TCP server listening on a real socket of the loopback interface
+ *
+ * The port of the device is usually out of reach on the host : the server listens on the port set by
+ * halSetListenPort() instead, any free one by default, which halListenPort() gives once begin() was called.
+*/
+class WiFiServer
+{
+  public:
+    WiFiServer( uint16_t i_port ) : m_port(i_port), m_fd(-1), m_listening(false) {}
+    ~WiFiServer() { close() ; }
+
+    void begin( void ) ;
+    WiFiClient available( void ) ;
+    void close( void ) ;
+    void stop( void ) { close() ; }
+    void setNoDelay( bool i_noDelay ) { (void) i_noDelay ; }
+
+  private:
+    uint16_t  m_port ;
+    int       m_fd ;
+    bool      m_listening ; /*!< Whether the port of the device is taken, even if the host socket failed or was not asked for */
+} ;
+
+#endif
@@ -0,0 +1,219 @@
+/**
+  \file hal_flash.cpp
+  \brief Host SPIFFS over the files of a directory, with a write budget to simulate a power loss in the middle of a write
+*/
+#include <FS.h>
+#include <hal_native.h>
+#include <algorithm>
+#include <dirent.h>
+#include <unistd.h>
+
+FS SPIFFS ;
+
+/**
+ * \struct HalFile
+ * \brief Host file behind a File
+*/
+struct HalFile
+{
+  FILE *file ;
+
+  HalFile( FILE *i_file ) : file(i_file) {}
+  ~HalFile() { fclose(file) ; }
+} ;
+
+static std::string halFlashDirectory ;
+static uint32_t    halFlashWriteBudget  = UINT32_MAX ;
+static uint32_t    halFlashBytesCount   = 0 ;
+
+
+static void halRemoveFlashDirectory( void )
+{
+  halResetFlash() ;
+  rmdir(halFlashDirectory.c_str()) ;
+}
+
+/**
+ * \fn const std::string & halFlashPath( void )
+ * \return The directory holding the files, a new temporary one removed at exit if none was set
+*/
+static const std::string & halFlashPath( void )
+{
+  if ( halFlashDirectory.empty() )
+  {
+    char path[] = "/tmp/noisey_flash_XXXXXX" ;
+    if ( mkdtemp(path) != NULL )
+    {
+      halFlashDirectory = path ;
+      atexit(halRemoveFlashDirectory) ;
+    }
+  }
+  return halFlashDirectory ;
+}
+
+/**
+ * \fn std::string halHostPath( const char *i_path )
+ * \return The host file of a SPIFFS path, whose slashes are escaped since SPIFFS has no directories
+*/
+static std::string halHostPath( const char *i_path )
+{
+  std::string name(i_path) ;
+
+  std::replace(name.begin(), name.end(), '/', '%') ;
+  return halFlashPath() + "/" + name ;
+}
+
+/**
+ * \fn void halSetFlashDirectory( const char *i_directory )
+ * \param[in] i_directory Existing directory to keep the files in, so that they survive the process
+*/
+void halSetFlashDirectory( const char *i_directory )
+{
+  halFlashDirectory = i_directory ;
+}
+
+/**
+ * \fn void halSetFlashWriteBudget( uint32_t i_bytes )
+ * \param[in] i_bytes Number of bytes that can still be written, UINT32_MAX for no limit
+ * \brief Simulate a power loss : the write crossing the budget is cut there, and the following writes and removals do nothing
+*/
+void halSetFlashWriteBudget( uint32_t i_bytes )
+{
+  halFlashWriteBudget = i_bytes ;
+}
+
+/**
+ * \fn void halResetFlash( void )
+ * \brief Remove all the files, the write budget and the counter
+*/
+void halResetFlash( void )
+{
+  halFlashWriteBudget = UINT32_MAX ;
+  halFlashBytesCount  = 0 ;
+  SPIFFS.format() ;
+}
+
+uint32_t halCountFlashBytes( void ) { return halFlashBytesCount ; }
+
+
+bool FS::begin( void )
+{
+  halFlashAccess() ;
+  return !halFlashPath().empty() ;
+}
+
+bool FS::format( void )
+{
+  Dir dir = openDir("") ;
+
+  while ( dir.next() )
+    remove(dir.fileName().c_str()) ;
+  return true ;
+}
+
+File FS::open( const char *i_path, const char *i_mode )
+{
+  FILE *file = fopen(halHostPath(i_path).c_str(), i_mode) ;
+
+  halFlashAccess() ;
+  return file != NULL ? File(std::make_shared<HalFile>(file)) : File() ;
+}
+
+bool FS::exists( const char *i_path )
+{
+  return access(halHostPath(i_path).c_str(), F_OK) == 0 ;
+}
+
+bool FS::remove( const char *i_path )
+{
+  halFlashAccess() ;
+  if ( halFlashWriteBudget == 0 )
+    return false ;
+  return unlink(halHostPath(i_path).c_str()) == 0 ;
+}
+
+bool FS::rename( const char *i_from, const char *i_to )
+{
+  halFlashAccess() ;
+  if ( halFlashWriteBudget == 0 )
+    return false ;
+  return ::rename(halHostPath(i_from).c_str(), halHostPath(i_to).c_str()) == 0 ;
+}
+
+/**
+ * \fn Dir FS::openDir( const char *i_prefix )
+ * \brief List the files whose path starts with i_prefix, in the order of their paths
+*/
+Dir FS::openDir( const char *i_prefix )
+{
+  std::vector<std::string> names ;
+  std::vector<String> paths ;
+  DIR *directory = opendir(halFlashPath().c_str()) ;
+  struct dirent *entry ;
+
+  while ( directory != NULL && ( entry = readdir(directory) ) != NULL )
+  {
+    std::string name(entry->d_name) ;
+
+    std::replace(name.begin(), name.end(), '%', '/') ;
+    if ( entry->d_name[0] != '.' && name.compare(0, strlen(i_prefix), i_prefix) == 0 )
+      names.push_back(name) ;
+  }
+  if ( directory != NULL )
+    closedir(directory) ;
+
+  std::sort(names.begin(), names.end()) ;
+  for ( size_t iName = 0 ; iName < names.size() ; iName++ )
+    paths.push_back(String(names[iName].c_str())) ;
+  return Dir(paths) ;
+}
+
+
+size_t File::write( const uint8_t *i_buffer, size_t i_size )
+{
+  size_t size = i_size < halFlashWriteBudget ? i_size : halFlashWriteBudget ;
+
+  if ( !m_file )
+    return 0 ;
+  halFlashAccess() ;
+  size = fwrite(i_buffer, 1, size, m_file->file) ;
+  fflush(m_file->file) ;
+  if ( halFlashWriteBudget != UINT32_MAX )
+    halFlashWriteBudget -= size ;
+  halFlashBytesCount += size ;
+  return size ;
+}
+
+size_t File::read( uint8_t *o_buffer, size_t i_size )
+{
+  return m_file ? fread(o_buffer, 1, i_size, m_file->file) : 0 ;
+}
+
+bool File::seek( uint32_t i_position, SeekMode i_mode )
+{
+  return m_file && fseek(m_file->file, i_position, i_mode == SeekSet ? SEEK_SET : i_mode == SeekCur ? SEEK_CUR : SEEK_END) == 0 ;
+}
+
+size_t File::position( void ) const
+{
+  return m_file ? ftell(m_file->file) : 0 ;
+}
+
+size_t File::size( void ) const
+{
+  long position, size ;
+
+  if ( !m_file )
+    return 0 ;
+  position  = ftell(m_file->file) ;
+  fseek(m_file->file, 0, SEEK_END) ;
+  size      = ftell(m_file->file) ;
+  fseek(m_file->file, position, SEEK_SET) ;
+  return size ;
+}
+
+void File::flush( void )
+{
+  if ( m_file )
+    fflush(m_file->file) ;
+}
@@ -0,0 +1,447 @@
+/**
+  \file hal_native.cpp
+  \brief Virtual clock and host implementations of the Arduino/ESP8266 stand-ins
+*/
+#include <Arduino.h>
+#include <Ticker.h>
+#include <EEPROM.h>
+#include <Adafruit_NeoPixel.h>
+#include <ESP8266WiFi.h>
+#include <umm_malloc/umm_malloc.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+HardwareSerial    Serial ;
+EspClass          ESP ;
+EEPROMClass       EEPROM ;
+ESP8266WiFiClass  WiFi ;
+
+static uint64_t        halNowMicros        = 0 ;
+static uint32_t        halAnalogReadMicros = HAL_ANALOG_READ_US_DEFAULT ;
+static HalAnalogSource halAnalogSource     = NULL ;
+static Ticker         *halTickers[HAL_TICKER_MAX] ;
+static bool            halInTicker         = false ;
+static bool            halInISR            = false ;
+static bool            halInterruptsOff    = false ;
+static bool            halRealTime         = false ;
+static uint32_t        halPreemptMicros    = 0 ;
+static uint8_t         halPinState         = 0 ;
+static timercallback   halTimer1Callback   = NULL ;
+static bool            halTimer1Enabled    = false ;
+static bool            halTimer1Reload     = false ;
+static uint8_t         halTimer1Divider    = TIM_DIV1 ;
+static uint64_t        halTimer1Period     = 0 ;
+static uint64_t        halTimer1Deadline   = 0 ;
+
+static uint32_t halAnalogReadCount    = 0 ;
+static uint32_t halShowCount          = 0 ;
+static HalShowHandler halShowHandler  = NULL ;
+static uint32_t halEEPROMCommitCount  = 0 ;
+static uint32_t halFlashSamplingCount = 0 ;   /*!< Accesses to the flash while the timer1 interrupt was armed */
+
+
+/**
+ * \fn void halAdvanceMicros( uint64_t i_micros )
+ * \param[in] i_micros Duration to advance the virtual clock by, in us
+ * \brief Advance the virtual clock, firing the timer1 interrupt and the Tickers that fall due in deadline order
+ *
+ * Time spent inside a callback (for instance in analogRead) is added on top, as it would be on the device. The timer1
+ * interrupt preempts everything but itself and noInterrupts(), Tickers are never fired from inside a Ticker callback.
+*/
+void halAdvanceMicros( uint64_t i_micros )
+{
+  uint64_t target = halNowMicros + i_micros ;
+
+  if ( halRealTime && !halInTicker && !halInISR )
+    usleep(i_micros) ;
+
+  for ( ;; )
+  {
+    Ticker *next = NULL ;
+    bool timer1Due = halTimer1Enabled && halTimer1Callback != NULL && !halInISR && !halInterruptsOff && halTimer1Deadline <= target ;
+
+    for ( uint8_t iTicker = 0 ; iTicker < HAL_TICKER_MAX && !halInTicker && !halInISR ; iTicker++ )
+    {
+      Ticker *ticker = halTickers[iTicker] ;
+      if ( ticker != NULL && ticker->active() && ticker->deadline() <= target && ( next == NULL || ticker->deadline() < next->deadline() ) )
+        next = ticker ;
+    }
+
+    if ( timer1Due && ( next == NULL || halTimer1Deadline <= next->deadline() ) )
+    {
+      if ( halTimer1Deadline > halNowMicros )
+        halNowMicros = halTimer1Deadline ;
+      if ( halTimer1Reload )
+        halTimer1Deadline += halTimer1Period ;
+      else
+        halTimer1Enabled = false ;
+      halInISR = true ;
+      halTimer1Callback() ;
+      halInISR = false ;
+    }
+    else if ( next != NULL )
+    {
+      if ( next->deadline() > halNowMicros )
+        halNowMicros = next->deadline() ;
+      halInTicker = true ;
+      next->fire() ;
+      halInTicker = false ;
+    }
+    else
+      break ;
+  }
+
+  if ( target > halNowMicros )
+    halNowMicros = target ;
+}
+
+uint64_t halMicros( void )
+{
+  return halNowMicros ;
+}
+
+void halSetAnalogSource( HalAnalogSource i_source )
+{
+  halAnalogSource = i_source ;
+}
+
+void halSetShowHandler( HalShowHandler i_handler )
+{
+  halShowHandler = i_handler ;
+}
+
+void halSetAnalogReadMicros( uint32_t i_micros )
+{
+  halAnalogReadMicros = i_micros ;
+}
+
+void halSetRealTime( bool i_realTime )
+{
+  halRealTime = i_realTime ;
+}
+
+void halSetPreemptMicros( uint32_t i_micros )
+{
+  halPreemptMicros = i_micros ;
+}
+
+/**
+ * \fn void halFlashAccess( void )
+ * \brief Count an access to the flash, by a stand-in, that the timer1 interrupt could preempt
+*/
+void halFlashAccess( void )
+{
+  halFlashSamplingCount += halTimer1Enabled && halTimer1Callback != NULL && !halInterruptsOff ;
+}
+
+/**
+ * \fn void halReset( void )
+ * \brief Rewind the virtual clock, detach all Tickers, clear the EEPROM, the flash, the network settings and the counters
+*/
+void halReset( void )
+{
+  for ( uint8_t iTicker = 0 ; iTicker < HAL_TICKER_MAX ; iTicker++ )
+    if ( halTickers[iTicker] != NULL )
+      halTickers[iTicker]->detach() ;
+  halTimer1Enabled      = false ;
+  halTimer1Callback     = NULL ;
+  halInterruptsOff      = false ;
+  halNowMicros          = 0 ;
+  halAnalogReadMicros   = HAL_ANALOG_READ_US_DEFAULT ;
+  halAnalogSource       = NULL ;
+  halRealTime           = false ;
+  halPreemptMicros      = 0 ;
+  halAnalogReadCount    = 0 ;
+  halShowCount          = 0 ;
+  halShowHandler        = NULL ;
+  halEEPROMCommitCount  = 0 ;
+  halFlashSamplingCount = 0 ;
+  EEPROM.clear() ;
+  halResetNetwork() ;
+  halResetFlash() ;
+}
+
+uint32_t halCountAnalogRead( void ) { return halAnalogReadCount ; }
+uint32_t halCountShow( void ) { return halShowCount ; }
+uint32_t halCountEEPROMCommit( void ) { return halEEPROMCommitCount ; }
+uint32_t halCountFlashWhileSampling( void ) { return halFlashSamplingCount ; }
+
+
+// Arduino core
+unsigned long millis( void )
+{
+  return (unsigned long) ( halNowMicros / 1000 ) ;
+}
+
+unsigned long micros( void )
+{
+  return (unsigned long) halNowMicros ;
+}
+
+void delay( unsigned long i_ms )
+{
+  halAdvanceMicros((uint64_t) i_ms * 1000) ;
+}
+
+void delayMicroseconds( unsigned int i_us )
+{
+  halAdvanceMicros(i_us) ;
+}
+
+void yield( void )
+{
+}
+
+/**
+ * \fn int analogRead( uint8_t i_pin )
+ * \param[in] i_pin Analog pin to read, only A0 exists
+ * \brief Read the analog source set by the harness (a constant mid-scale value by default) and advance the clock by one conversion
+*/
+int analogRead( uint8_t i_pin )
+{
+  int16_t value ;
+
+  (void) i_pin ;
+  value = halAnalogSource != NULL ? halAnalogSource(halNowMicros) : 512 ;
+  halAnalogReadCount++ ;
+  halAdvanceMicros(halAnalogReadMicros) ;
+  return value ;
+}
+
+void pinMode( uint8_t i_pin, uint8_t i_mode )
+{
+  (void) i_pin ;
+  (void) i_mode ;
+}
+
+int digitalRead( uint8_t i_pin )
+{
+  return ( halPinState >> ( i_pin & 7 ) ) & 1 ;
+}
+
+void digitalWrite( uint8_t i_pin, uint8_t i_value )
+{
+  if ( i_value )
+    halPinState |= 1 << ( i_pin & 7 ) ;
+  else
+    halPinState &= ~( 1 << ( i_pin & 7 ) ) ;
+}
+
+long map( long i_x, long i_inMin, long i_inMax, long i_outMin, long i_outMax )
+{
+  return ( i_x - i_inMin ) * ( i_outMax - i_outMin ) / ( i_inMax - i_inMin ) + i_outMin ;
+}
+
+void noInterrupts( void )
+{
+  halInterruptsOff = true ;
+}
+
+void interrupts( void )
+{
+  halInterruptsOff = false ;
+}
+
+void timer1_isr_init( void )
+{
+}
+
+void timer1_attachInterrupt( timercallback i_callback )
+{
+  halTimer1Callback = i_callback ;
+}
+
+void timer1_detachInterrupt( void )
+{
+  halTimer1Callback = NULL ;
+  halTimer1Enabled  = false ;
+}
+
+void timer1_enable( uint8_t i_divider, uint8_t i_edge, uint8_t i_reload )
+{
+  (void) i_edge ;
+  halTimer1Divider  = i_divider ;
+  halTimer1Reload   = i_reload == TIM_LOOP ;
+  halTimer1Enabled  = true ;
+}
+
+void timer1_disable( void )
+{
+  halTimer1Enabled = false ;
+}
+
+/**
+ * \fn void timer1_write( uint32_t i_ticks )
+ * \param[in] i_ticks Number of ticks of the 80 MHz clock, after the divider, before the interrupt fires
+ * \brief Arm timer1
+*/
+void timer1_write( uint32_t i_ticks )
+{
+  static const uint16_t dividers[4] = { 1, 16, 16, 256 } ;
+
+  halTimer1Period   = (uint64_t) i_ticks * dividers[halTimer1Divider & 3] / 80 ;
+  halTimer1Period   = halTimer1Period > 0 ? halTimer1Period : 1 ;
+  halTimer1Deadline = halNowMicros + halTimer1Period ;
+}
+
+int HardwareSerial::printf( const char *i_format, ... )
+{
+  va_list args ;
+  int     length ;
+
+  va_start(args, i_format) ;
+  length = vprintf(i_format, args) ;
+  va_end(args) ;
+  if ( halPreemptMicros > 0 && !halInTicker && !halInISR )
+    halAdvanceMicros(halPreemptMicros) ;
+  return length ;
+}
+
+uint32_t EspClass::getCycleCount( void )
+{
+  struct timespec now ;
+
+  clock_gettime(CLOCK_MONOTONIC, &now) ;
+  return (uint32_t) ( ( now.tv_sec * 1000000000ULL + now.tv_nsec ) * HAL_CPU_FREQ_MHZ / 1000 ) ;
+}
+
+UMM_HEAP_INFO ummHeapInfo ;
+
+// The heap of the host is not the one of the device : it is reported as ESP.getFreeHeap() in a single free block
+void *umm_info( void *ptr, int force )
+{
+  (void) ptr ;
+  (void) force ;
+  memset(&ummHeapInfo, 0, sizeof(ummHeapInfo)) ;
+  ummHeapInfo.freeBlocks              = ESP.getFreeHeap() / 8 ;
+  ummHeapInfo.maxFreeContiguousBlocks = ummHeapInfo.freeBlocks ;
+  ummHeapInfo.freeEntries             = 1 ;
+  return NULL ;
+}
+
+
+// Ticker
+Ticker::Ticker() : m_callback(NULL), m_period(0), m_deadline(0), m_repeat(false)
+{
+  for ( uint8_t iTicker = 0 ; iTicker < HAL_TICKER_MAX ; iTicker++ )
+  {
+    if ( halTickers[iTicker] == NULL )
+    {
+      halTickers[iTicker] = this ;
+      break ;
+    }
+  }
+}
+
+Ticker::~Ticker()
+{
+  for ( uint8_t iTicker = 0 ; iTicker < HAL_TICKER_MAX ; iTicker++ )
+    if ( halTickers[iTicker] == this )
+      halTickers[iTicker] = NULL ;
+}
+
+void Ticker::attachMicros( uint64_t i_period, callback_t i_callback, bool i_repeat )
+{
+  m_callback  = i_callback ;
+  m_period    = i_period > 0 ? i_period : 1 ;
+  m_deadline  = halNowMicros + m_period ;
+  m_repeat    = i_repeat ;
+}
+
+void Ticker::detach( void )
+{
+  m_callback = NULL ;
+}
+
+void Ticker::fire( void )
+{
+  callback_t callback = m_callback ;
+
+  if ( m_repeat )
+    m_deadline += m_period ;
+  else
+    m_callback = NULL ;
+  callback() ;
+}
+
+
+// EEPROM
+void EEPROMClass::write( int i_address, uint8_t i_value )
+{
+  if ( i_address >= 0 && (size_t) i_address < m_size && m_data[i_address] != i_value )
+  {
+    m_data[i_address] = i_value ;
+    m_dirty = true ;
+  }
+}
+
+bool EEPROMClass::commit( void )
+{
+  if ( m_dirty )
+  {
+    halEEPROMCommitCount++ ;
+    m_dirty = false ;
+  }
+  return true ;
+}
+
+
+// NeoPixel
+Adafruit_NeoPixel::Adafruit_NeoPixel( uint16_t i_numPixels, uint8_t i_pin, uint16_t i_type ) : m_numPixels(i_numPixels), m_brightness(0)
+{
+  (void) i_pin ;
+  (void) i_type ;
+  m_pixels = (uint32_t *) calloc(i_numPixels, sizeof(uint32_t)) ;
+}
+
+Adafruit_NeoPixel::~Adafruit_NeoPixel()
+{
+  free(m_pixels) ;
+}
+
+void Adafruit_NeoPixel::show( void )
+{
+  halShowCount++ ;
+  if ( halShowHandler != NULL )
+    halShowHandler(m_pixels, m_numPixels) ;
+}
+
+
+#ifndef HAL_NO_MAIN
+/**
+ * \fn int main()
+ * \brief Run the firmware as the Arduino core would, on the virtual clock unless NOISEY_SERVER or NOISEY_LOCAL_PORT is set
+*/
+int main()
+{
+  const char *server = getenv("NOISEY_SERVER") ;
+  const char *flash  = getenv("NOISEY_FLASH") ;
+  const char *local  = getenv("NOISEY_LOCAL_PORT") ;
+
+  setvbuf(stdout, NULL, _IOLBF, 0) ;
+
+  // NOISEY_FLASH=directory keeps the SPIFFS files across runs, to test what the firmware finds after a reset
+  if ( flash != NULL )
+    halSetFlashDirectory(flash) ;
+
+  // NOISEY_SERVER=address:port sends the requests to a real server, in real time
+  if ( server != NULL && strchr(server, ':') != NULL )
+  {
+    char address[64] ;
+    snprintf(address, sizeof(address), "%.*s", (int) ( strchr(server, ':') - server ), server) ;
+    halSetServerAddress(address, atoi(strchr(server, ':') + 1)) ;
+  }
+
+  // NOISEY_LOCAL_PORT=port serves the local HTTP server of the board on this port of 127.0.0.1, in real time
+  if ( local != NULL )
+  {
+    halSetListenPort(atoi(local)) ;
+    halSetRealTime(true) ;
+  }
+
+  setup() ;
+  for ( ;; )
+    loop() ;
+}
+#endif
@@ -0,0 +1,79 @@
+/**
+  \file hal_native.h
+  \brief Control interface of the host stand-ins for the Arduino/ESP8266 APIs
+
+  On the host, time does not flow by itself : millis(), micros() and the Tickers are driven by a virtual clock that
+  advances when the firmware calls delay() or analogRead(), or when the harness calls halAdvanceMicros(). This makes
+  runs deterministic and much faster than real time. analogRead() returns the samples of the source set by
+  halSetAnalogSource(), and show() hands the pixels of a strip to the handler set by halSetShowHandler().
+
+  Network clients connect to an in-process HTTP server answering with the handler set by halSetHTTPHandler(), with
+  the latencies set by halSetNetworkLatency() applied on the virtual clock. After halSetServerAddress(), they connect
+  to a real TCP server instead (without TLS), and the virtual clock follows the real one. A WiFiServer listens on a real
+  socket of the loopback interface, on the port set by halSetListenPort(). WiFiManager opens no portal, but
+  halCountPortalBlocked() counts the calls to autoConnect() while a WiFiServer listened, which would keep the portal
+  of the device from serving its page.
+
+  SPIFFS keeps its files in a temporary directory removed at exit, or in the one set by halSetFlashDirectory().
+  halSetFlashWriteBudget() cuts the writes after a number of bytes, as a power loss would. The stand-ins that reach the
+  flash, SPIFFS and the saving of the network settings by WiFi.mode() and WiFiManager, call halFlashAccess() :
+  halCountFlashWhileSampling() counts the accesses made while the timer1 interrupt was armed, which would crash the
+  device, the interrupt of the sampler running analogRead() from flash.
+
+  The Tickers only fire where the firmware waits. halSetPreemptMicros() makes each Serial.printf() outside a callback
+  advance the virtual clock as well, so that the Tickers due fire from inside the code under test, as if they
+  preempted it there.
+*/
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HAL_ANALOG_READ_US_DEFAULT 100  /*!< Default duration of one analogRead() on the virtual clock, in us */
+#define HAL_EEPROM_SIZE            4096 /*!< Size of the emulated EEPROM, in bytes */
+#define HAL_TICKER_MAX             16   /*!< Maximum number of Tickers attached at the same time */
+#define HAL_HANDSHAKE_US_DEFAULT   800000 /*!< Default duration of a TLS handshake on the virtual clock, in us */
+#define HAL_ROUND_TRIP_US_DEFAULT  60000  /*!< Default delay between a request and its response on the virtual clock, in us */
+#define HAL_ASSOCIATION_MS_DEFAULT 2500   /*!< Default duration of the association with the access point after WiFi.begin(), in ms */
+#define HAL_LISTEN_PORT_NONE       0xFFFF /*!< halSetListenPort() value keeping the WiFiServers from listening, for the runs without clients */
+#define HAL_CPU_FREQ_MHZ           250    /*!< Rate of ESP.getCycleCount(), which follows the real clock of the host, not the virtual one */
+
+class String ;
+
+typedef int16_t (*HalAnalogSource)(uint64_t i_micros) ;
+typedef void (*HalShowHandler)(const uint32_t *i_pixels, uint16_t i_numPixels) ;
+typedef int16_t (*HalHTTPHandler)(const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response) ;
+
+uint64_t halMicros( void ) ;
+void halAdvanceMicros( uint64_t i_micros ) ;
+void halSetAnalogSource( HalAnalogSource i_source ) ;
+void halSetAnalogReadMicros( uint32_t i_micros ) ;
+void halSetShowHandler( HalShowHandler i_handler ) ;
+void halSetHTTPHandler( HalHTTPHandler i_handler ) ;
+void halSetNetworkLatency( uint32_t i_handshakeMicros, uint32_t i_roundTripMicros ) ;
+void halSetServerAddress( const char *i_address, uint16_t i_port ) ;
+void halSetListenPort( uint16_t i_port ) ;
+uint16_t halListenPort( void ) ;
+void halSetWiFiAssociation( uint32_t i_millis ) ;
+void halSetRealTime( bool i_realTime ) ;
+void halSetPreemptMicros( uint32_t i_micros ) ;
+void halSetFlashDirectory( const char *i_directory ) ;
+void halSetFlashWriteBudget( uint32_t i_bytes ) ;
+void halFlashAccess( void ) ;
+void halReset( void ) ;
+void halResetNetwork( void ) ;
+void halResetFlash( void ) ;
+
+uint32_t halCountAnalogRead( void ) ;
+uint32_t halCountShow( void ) ;
+uint32_t halCountEEPROMCommit( void ) ;
+uint32_t halCountHTTPRequest( void ) ;
+uint32_t halCountHTTPBytes( void ) ;
+uint32_t halCountWireBytes( void ) ;
+uint32_t halCountHandshake( void ) ;
+uint32_t halCountPortalBlocked( void ) ;
+uint32_t halCountFlashBytes( void ) ;
+uint32_t halCountFlashWhileSampling( void ) ;
+
+#endif
@@ -0,0 +1,452 @@
+/**
+  \file hal_network.cpp
+  \brief Host TCP/TLS clients, connected to an in-process HTTP server or to a real socket
+*/
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <WiFiServer.h>
+#include <WiFiManager.h>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * \struct HalConnection
+ * \brief State of one connection : a socket, or a session with the in-process server
+*/
+struct HalConnection
+{
+  int         fd ;        /*!< Socket, -1 for the in-process server */
+  bool        open ;
+  std::string request ;   /*!< Bytes written to the in-process server and not handled yet */
+  std::string received ;  /*!< Bytes ready to be read */
+  std::deque< std::pair<uint64_t, std::string> > pending ; /*!< Responses of the in-process server, with the time they arrive */
+
+  HalConnection( int i_fd ) : fd(i_fd), open(true) {}
+  ~HalConnection() { if ( fd >= 0 ) close(fd) ; }
+} ;
+
+static HalHTTPHandler halHTTPHandler        = NULL ;
+static uint32_t       halHandshakeMicros    = HAL_HANDSHAKE_US_DEFAULT ;
+static uint32_t       halRoundTripMicros    = HAL_ROUND_TRIP_US_DEFAULT ;
+static char           halServerAddress[64]  = { '\0' } ;
+static uint16_t       halServerPort         = 0 ;
+static uint32_t       halHTTPRequestCount   = 0 ;
+static uint32_t       halHTTPBytesCount     = 0 ;
+static uint32_t       halWireBytesCount     = 0 ;     /*!< Bytes of the requests and responses, headers included */
+static uint32_t       halHandshakeCount     = 0 ;
+static uint32_t       halAssociationMillis  = HAL_ASSOCIATION_MS_DEFAULT ;
+static uint64_t       halAssociatedMicros   = 0 ;     /*!< When the station is connected, UINT64_MAX never */
+static uint16_t       halRequestedPort      = 0 ;     /*!< Port the next WiFiServer listens on, 0 for any free one */
+static uint16_t       halBoundPort          = 0 ;     /*!< Port the last WiFiServer started listens on */
+static uint32_t       halListeningCount     = 0 ;     /*!< WiFiServers started and not stopped */
+static uint32_t       halPortalBlockedCount = 0 ;     /*!< Calls to WiFiManager::autoConnect() while a WiFiServer listened */
+
+
+void halSetHTTPHandler( HalHTTPHandler i_handler )
+{
+  halHTTPHandler = i_handler ;
+}
+
+void halSetNetworkLatency( uint32_t i_handshakeMicros, uint32_t i_roundTripMicros )
+{
+  halHandshakeMicros  = i_handshakeMicros ;
+  halRoundTripMicros  = i_roundTripMicros ;
+}
+
+/**
+ * \fn void halSetServerAddress( const char *i_address, uint16_t i_port )
+ * \param[in] i_address IPv4 address of the server, NULL to go back to the in-process server
+ * \param[in] i_port TCP port of the server
+ * \brief Connect the clients to a real server, whatever the host they ask for, and run the virtual clock in real time
+*/
+void halSetServerAddress( const char *i_address, uint16_t i_port )
+{
+  snprintf(halServerAddress, sizeof(halServerAddress), "%s", i_address != NULL ? i_address : "") ;
+  halServerPort = i_port ;
+  halSetRealTime(i_address != NULL) ;
+}
+
+void halSetListenPort( uint16_t i_port )
+{
+  halRequestedPort = i_port ;
+}
+
+uint16_t halListenPort( void )
+{
+  return halBoundPort ;
+}
+
+/**
+ * \fn void halSetWiFiAssociation( uint32_t i_millis )
+ * \param[in] i_millis Duration of the next associations started by WiFi.begin(), UINT32_MAX for a network out of reach
+*/
+void halSetWiFiAssociation( uint32_t i_millis )
+{
+  halAssociationMillis = i_millis ;
+}
+
+void halResetNetwork( void )
+{
+  halHTTPHandler        = NULL ;
+  halHandshakeMicros    = HAL_HANDSHAKE_US_DEFAULT ;
+  halRoundTripMicros    = HAL_ROUND_TRIP_US_DEFAULT ;
+  halServerAddress[0]   = '\0' ;
+  halServerPort         = 0 ;
+  halHTTPRequestCount   = 0 ;
+  halHTTPBytesCount     = 0 ;
+  halWireBytesCount     = 0 ;
+  halHandshakeCount     = 0 ;
+  halPortalBlockedCount = 0 ;
+  halAssociationMillis  = HAL_ASSOCIATION_MS_DEFAULT ;
+  halAssociatedMicros   = 0 ;
+  halRequestedPort      = 0 ;
+}
+
+uint32_t halCountHTTPRequest( void ) { return halHTTPRequestCount ; }
+uint32_t halCountHTTPBytes( void ) { return halHTTPBytesCount ; }
+uint32_t halCountWireBytes( void ) { return halWireBytesCount ; }
+uint32_t halCountHandshake( void ) { return halHandshakeCount ; }
+uint32_t halCountPortalBlocked( void ) { return halPortalBlockedCount ; }
+
+
+/**
+ * \fn int16_t halDefaultHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Answer as the Noisey API would when the harness did not set a handler
+*/
+static int16_t halDefaultHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  (void) i_host ;
+  (void) i_body ;
+  (void) i_length ;
+  if ( strcmp(i_endPoint, "/api/device/") == 0 )
+    *o_response = "{\"shortID\":\"HOST01\"}" ;
+  else
+    *o_response = "{}" ;
+  return 200 ;
+}
+
+/**
+ * \fn void halServeRequests( HalConnection *io_connection )
+ * \param[in,out] io_connection Connection to the in-process server
+ * \brief Handle the complete HTTP requests written to the in-process server, in order
+ *
+ * Each response becomes readable one round trip after its request. A handler returning a negative code makes the
+ * server drop the connection without answering.
+*/
+static void halServeRequests( HalConnection *io_connection )
+{
+  for ( ;; )
+  {
+    std::string &request = io_connection->request ;
+    size_t endHeaders = request.find("\r\n\r\n") ;
+    size_t contentLength = 0, position ;
+    char method[8], endPoint[128], host[128] = "" ;
+    String response ;
+    int16_t code ;
+
+    if ( endHeaders == std::string::npos )
+      return ;
+    if ( ( position = request.find("Content-Length:") ) < endHeaders )
+      contentLength = strtoul(request.c_str() + position + 15, NULL, 10) ;
+    if ( ( position = request.find("Host:") ) < endHeaders )
+      sscanf(request.c_str() + position + 5, " %127[^\r\n:]", host) ;
+    if ( request.size() < endHeaders + 4 + contentLength )
+      return ;
+    if ( sscanf(request.c_str(), "%7s %127s", method, endPoint) != 2 )
+      endPoint[0] = '\0' ;
+
+    halHTTPRequestCount++ ;
+    halHTTPBytesCount += contentLength ;
+    halWireBytesCount += endHeaders + 4 + contentLength ;
+    code = ( halHTTPHandler != NULL ? halHTTPHandler : halDefaultHandler )(host, endPoint, (const uint8_t *) request.c_str() + endHeaders + 4, contentLength, &response) ;
+    request.erase(0, endHeaders + 4 + contentLength) ;
+
+    if ( code < 0 )
+    {
+      io_connection->open = false ;
+      return ;
+    }
+
+    char headers[160] ;
+    snprintf(headers, sizeof(headers), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: keep-alive\r\n\r\n",
+             code, code == 200 ? "OK" : "Error", response.length()) ;
+    halWireBytesCount += strlen(headers) + response.length() ;
+    io_connection->pending.push_back(std::make_pair(halMicros() + halRoundTripMicros, std::string(headers) + response.c_str())) ;
+  }
+}
+
+/**
+ * \fn void halReceive( HalConnection *io_connection )
+ * \param[in,out] io_connection Connection to receive from
+ * \brief Move the bytes that arrived by now to the buffer of bytes ready to be read
+*/
+static void halReceive( HalConnection *io_connection )
+{
+  if ( io_connection->fd < 0 )
+  {
+    while ( !io_connection->pending.empty() && io_connection->pending.front().first <= halMicros() )
+    {
+      io_connection->received += io_connection->pending.front().second ;
+      io_connection->pending.pop_front() ;
+    }
+    return ;
+  }
+
+  for ( ;; )
+  {
+    char buffer[1024] ;
+    ssize_t length = recv(io_connection->fd, buffer, sizeof(buffer), MSG_DONTWAIT) ;
+
+    if ( length > 0 )
+      io_connection->received.append(buffer, length) ;
+    else
+    {
+      if ( length == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+        io_connection->open = false ;
+      return ;
+    }
+  }
+}
+
+/**
+ * \fn int halConnectSocket( void )
+ * \return A socket connected to the address set by halSetServerAddress(), or -1
+*/
+static int halConnectSocket( void )
+{
+  struct sockaddr_in address ;
+  int fd = socket(AF_INET, SOCK_STREAM, 0), noDelay = 1 ;
+
+  memset(&address, 0, sizeof(address)) ;
+  address.sin_family  = AF_INET ;
+  address.sin_port    = htons(halServerPort) ;
+  if ( fd < 0 || inet_pton(AF_INET, halServerAddress, &address.sin_addr) != 1 || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0 )
+  {
+    if ( fd >= 0 )
+      close(fd) ;
+    return -1 ;
+  }
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) ;
+  return fd ;
+}
+
+
+int WiFiClient::connect( const char *i_host, uint16_t i_port )
+{
+  (void) i_host ;
+  (void) i_port ;
+
+  stop() ;
+  if ( WiFi.status() != WL_CONNECTED )
+    return 0 ;
+  if ( halServerAddress[0] != '\0' )
+  {
+    int fd = halConnectSocket() ;
+    if ( fd < 0 )
+      return 0 ;
+    m_connection = std::make_shared<HalConnection>(fd) ;
+  }
+  else
+    m_connection = std::make_shared<HalConnection>(-1) ;
+  return 1 ;
+}
+
+/**
+ * \fn bool ESP8266WiFiClass::mode( WiFiMode i_mode )
+ * \brief Set the mode, which the SDK saves to the flash
+*/
+bool ESP8266WiFiClass::mode( WiFiMode i_mode )
+{
+  (void) i_mode ;
+  halFlashAccess() ;
+  return true ;
+}
+
+/**
+ * \fn uint8_t ESP8266WiFiClass::begin( void )
+ * \brief Start associating with the saved network, which takes the time set by halSetWiFiAssociation()
+*/
+uint8_t ESP8266WiFiClass::begin( void )
+{
+  halAssociatedMicros = halAssociationMillis == UINT32_MAX ? UINT64_MAX : halMicros() + halAssociationMillis * 1000ULL ;
+  return status() ;
+}
+
+uint8_t ESP8266WiFiClass::status( void )
+{
+  return halMicros() >= halAssociatedMicros ? WL_CONNECTED : WL_DISCONNECTED ;
+}
+
+/**
+ * \fn bool WiFiManager::autoConnect( const char *i_ssid, const char *i_password )
+ * \return False if the saved network is out of reach, as when the portal times out
+ * \brief Wait for the association with the saved network, starting one if none is in progress
+*/
+bool WiFiManager::autoConnect( const char *i_ssid, const char *i_password )
+{
+  (void) i_ssid ;
+  (void) i_password ;
+
+  // The network settings entered in the portal are saved to the flash
+  halFlashAccess() ;
+
+  // The portal of the device serves its page on port 80, which a WiFiServer listening would keep it from
+  halPortalBlockedCount += halListeningCount > 0 ;
+  if ( halAssociatedMicros == UINT64_MAX )
+    WiFi.begin() ;
+  if ( halAssociatedMicros == UINT64_MAX )
+    return false ;
+  if ( halAssociatedMicros > halMicros() )
+    delay(( halAssociatedMicros - halMicros() + 999 ) / 1000) ;
+  return true ;
+}
+
+/**
+ * \fn int WiFiClientSecure::connect( const char *i_host, uint16_t i_port )
+ * \brief Connect, then spend the duration of a TLS handshake, on the virtual clock for the in-process server
+*/
+int WiFiClientSecure::connect( const char *i_host, uint16_t i_port )
+{
+  if ( !WiFiClient::connect(i_host, i_port) )
+    return 0 ;
+  halHandshakeCount++ ;
+  if ( m_connection->fd < 0 )
+    delay(halHandshakeMicros / 1000) ;
+  return 1 ;
+}
+
+uint8_t WiFiClient::connected( void )
+{
+  if ( !m_connection )
+    return 0 ;
+  halReceive(m_connection.get()) ;
+  return m_connection->open || !m_connection->received.empty() ;
+}
+
+size_t WiFiClient::write( const uint8_t *i_buffer, size_t i_size )
+{
+  if ( !m_connection || !m_connection->open )
+    return 0 ;
+
+  if ( m_connection->fd < 0 )
+  {
+    m_connection->request.append((const char *) i_buffer, i_size) ;
+    halServeRequests(m_connection.get()) ;
+    return i_size ;
+  }
+
+  size_t written = 0 ;
+  while ( written < i_size )
+  {
+    ssize_t length = send(m_connection->fd, i_buffer + written, i_size - written, MSG_NOSIGNAL) ;
+    if ( length <= 0 )
+    {
+      m_connection->open = false ;
+      break ;
+    }
+    written += length ;
+  }
+  return written ;
+}
+
+int WiFiClient::available( void )
+{
+  if ( !m_connection )
+    return 0 ;
+  halReceive(m_connection.get()) ;
+  return m_connection->received.size() ;
+}
+
+int WiFiClient::read( void )
+{
+  uint8_t byte ;
+  return read(&byte, 1) == 1 ? byte : -1 ;
+}
+
+int WiFiClient::read( uint8_t *o_buffer, size_t i_size )
+{
+  size_t length = available() ;
+
+  length = length < i_size ? length : i_size ;
+  if ( length > 0 )
+  {
+    memcpy(o_buffer, m_connection->received.data(), length) ;
+    m_connection->received.erase(0, length) ;
+  }
+  return length ;
+}
+
+int WiFiClient::peek( void )
+{
+  return available() > 0 ? (uint8_t) m_connection->received[0] : -1 ;
+}
+
+void WiFiClient::stop( void )
+{
+  m_connection.reset() ;
+}
+
+/**
+ * \fn void WiFiServer::begin( void )
+ * \brief Listen on the port set by halSetListenPort() of the loopback interface, rather than on the one of the device,
+ *        or not at all after halSetListenPort(HAL_LISTEN_PORT_NONE)
+*/
+void WiFiServer::begin( void )
+{
+  struct sockaddr_in address ;
+  socklen_t length = sizeof(address) ;
+  int reuse = 1 ;
+
+  close() ;
+  m_listening = true ;
+  halListeningCount++ ;
+  if ( halRequestedPort == HAL_LISTEN_PORT_NONE )
+    return ;
+  memset(&address, 0, sizeof(address)) ;
+  address.sin_family      = AF_INET ;
+  address.sin_port        = htons(halRequestedPort) ;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK) ;
+  m_fd = socket(AF_INET, SOCK_STREAM, 0) ;
+  if ( m_fd < 0 )
+    return ;
+  setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) ;
+  if ( bind(m_fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(m_fd, 16) != 0 ||
+       getsockname(m_fd, (struct sockaddr *) &address, &length) != 0 )
+  {
+    ::close(m_fd) ;
+    m_fd = -1 ;
+    return ;
+  }
+  fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK) ;
+  halBoundPort = ntohs(address.sin_port) ;
+}
+
+/**
+ * \fn WiFiClient WiFiServer::available( void )
+ * \return A client connected to the next pending connection, or one that is not connected if there is none
+*/
+WiFiClient WiFiServer::available( void )
+{
+  int fd = m_fd < 0 ? -1 : accept(m_fd, NULL, NULL), noDelay = 1 ;
+
+  if ( fd < 0 )
+    return WiFiClient() ;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) ;
+  return WiFiClient(std::make_shared<HalConnection>(fd)) ;
+}
+
+void WiFiServer::close( void )
+{
+  if ( m_fd >= 0 )
+    ::close(m_fd) ;
+  m_fd = -1 ;
+  halListeningCount -= m_listening ;
+  m_listening = false ;
+}
@@ -0,0 +1,35 @@
+/**
+  \file umm_malloc.h
+  \brief Host stand-in for the heap walk of the allocator of the ESP8266 Arduino core
+*/
+#ifndef HAL_UMM_MALLOC_H
+#define HAL_UMM_MALLOC_H
+
+/**
+ * \struct UMM_HEAP_INFO
+ * \brief Counts of the heap filled by umm_info(), in blocks of 8 bytes
+*/
+typedef struct UMM_HEAP_INFO_t
+{
+  unsigned short int totalEntries ;
+  unsigned short int usedEntries ;
+  unsigned short int freeEntries ;
+  unsigned short int totalBlocks ;
+  unsigned short int usedBlocks ;
+  unsigned short int freeBlocks ;
+  unsigned short int maxFreeContiguousBlocks ;
+} UMM_HEAP_INFO ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern UMM_HEAP_INFO ummHeapInfo ;
+
+void *umm_info( void *ptr, int force ) ;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
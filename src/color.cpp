@@ -1,4 +1,150 @@
 #include "color.h"
+#include "config.h"
+
+/**
+ * Compile-time table of the gamma-corrected colors displayed by the board, for a saturation of 255, indexed by
+ * brightness level (as set on the server) then by hue between 0 and COLOR_HUE_MAX. Each entry is packed as
+ * Adafruit_NeoPixel::Color() would pack it.
+*/
+#define HUE_TABLE_NB_HUES  ( COLOR_HUE_MAX + 1 )
+#define HUE_TABLE_SIZE     ( ( configBrightnessServerMax + 1 ) * HUE_TABLE_NB_HUES )
+
+template<uint16_t... I> struct IndexList {} ;
+
+template<class A, class B> struct ConcatIndexList ;
+template<uint16_t... I, uint16_t... J> struct ConcatIndexList< IndexList<I...>, IndexList<J...> >
+{
+  typedef IndexList<I..., ( sizeof...(I) + J )...> type ;
+} ;
+
+// Built by halves to keep the template recursion depth logarithmic
+template<uint16_t N> struct MakeIndexList
+{
+  typedef typename ConcatIndexList< typename MakeIndexList<N / 2>::type, typename MakeIndexList<N - N / 2>::type >::type type ;
+} ;
+template<> struct MakeIndexList<0> { typedef IndexList<> type ; } ;
+template<> struct MakeIndexList<1> { typedef IndexList<0> type ; } ;
+
+struct HueTable
+{
+  uint32_t colors[HUE_TABLE_SIZE] ;
+} ;
+
+constexpr uint32_t packColor( uint8_t i_red, uint8_t i_green, uint8_t i_blue )
+{
+  return ( (uint32_t) gamma8[i_red] << 16 ) | ( (uint32_t) gamma8[i_green] << 8 ) | gamma8[i_blue] ;
+}
+
+// With a saturation of 255 : p = 0, q = b * (60 - f) / 60 and t = b * f / 60, f being the position of the hue in its sector
+constexpr uint32_t hueTableColor( uint16_t i_hue, uint8_t i_brightness )
+{
+  return i_hue < 60  ? packColor(i_brightness, i_brightness * i_hue / 60, 0) :
+         i_hue < 120 ? packColor(i_brightness * ( 120 - i_hue ) / 60, i_brightness, 0) :
+                       packColor(0, i_brightness, i_brightness * ( i_hue - 120 ) / 60) ;
+}
+
+constexpr uint32_t hueTableEntry( uint16_t i_index )
+{
+  return hueTableColor(i_index % HUE_TABLE_NB_HUES, mapBrightnessServerToValue(i_index / HUE_TABLE_NB_HUES)) ;
+}
+
+template<uint16_t... I> constexpr HueTable makeHueTable( IndexList<I...> )
+{
+  return HueTable { { hueTableEntry(I)... } } ;
+}
+
+static constexpr HueTable hueTable PROGMEM = makeHueTable( MakeIndexList<HUE_TABLE_SIZE>::type() ) ;
+
+
+/**
+ * \fn uint32_t hueToColor( int16_t i_hue, int8_t i_brightnessServer )
+ * \param[in] i_hue Hue, clamped between 0 and COLOR_HUE_MAX
+ * \param[in] i_brightnessServer Brightness level as set on the server
+ * \return The gamma-corrected color for a saturation of 255, packed as by Adafruit_NeoPixel::Color()
+ * \brief Look up the color to display, equivalent to HSBToRGBFixed() with a saturation of 255 but with no arithmetic
+*/
+uint32_t hueToColor( int16_t i_hue, int8_t i_brightnessServer )
+{
+  i_hue               = i_hue < 0 ? 0 : ( i_hue > COLOR_HUE_MAX ? COLOR_HUE_MAX : i_hue ) ;
+  i_brightnessServer  = i_brightnessServer < configBrightnessServerMin ? configBrightnessServerMin : ( i_brightnessServer > configBrightnessServerMax ? configBrightnessServerMax : i_brightnessServer ) ;
+  return pgm_read_dword(&hueTable.colors[i_brightnessServer * HUE_TABLE_NB_HUES + i_hue]) ;
+}
+
+/**
+ * \fn void HSBToRGBFixed( int16_t i_hue, uint8_t i_saturation, uint8_t i_brightness, uint8_t *o_red, uint8_t *o_green, uint8_t *o_blue )
+ * \param[in] i_hue Hue, between 0 and 359
+ * \param[in] i_saturation Saturation, between 0 and 255
+ * \param[in] i_brightness Brightness, between 0 and 255
+ * \param[out] o_red Gamma-corrected red component
+ * \param[out] o_green Gamma-corrected green component
+ * \param[out] o_blue Gamma-corrected blue component
+ * \brief Integer-only version of HSBToRGB(), the fractional part of the hue in its sector being kept in 1/60th
+*/
+void HSBToRGBFixed( int16_t i_hue, uint8_t i_saturation, uint8_t i_brightness, uint8_t *o_red, uint8_t *o_green, uint8_t *o_blue )
+{
+  if( i_saturation == 0 )
+  {
+    *o_red    = i_brightness ;
+    *o_green  = i_brightness ;
+    *o_blue   = i_brightness ;
+  }
+  else
+  {
+    int16_t  sector   = i_hue / 60 ;
+    int32_t  fraction = i_hue - sector * 60 ;
+    uint8_t  v, p, q, t ;
+
+    v = i_brightness ;
+    p = i_brightness * ( 255 - i_saturation ) / 255 ;
+    q = i_brightness * ( 255 * 60 - i_saturation * fraction ) / ( 255 * 60 ) ;
+    t = i_brightness * ( 255 * 60 - i_saturation * ( 60 - fraction ) ) / ( 255 * 60 ) ;
+
+    switch(sector)
+    {
+      case 0:
+        *o_red    = gamma8[v] ;
+        *o_green  = gamma8[t] ;
+        *o_blue   = gamma8[p] ;
+      break;
+
+      case 1:
+        *o_red    = gamma8[q] ;
+        *o_green  = gamma8[v] ;
+        *o_blue   = gamma8[p] ;
+      break;
+
+      case 2:
+        *o_red    = gamma8[p] ;
+        *o_green  = gamma8[v] ;
+        *o_blue   = gamma8[t] ;
+      break;
+
+      case 3:
+        *o_red    = gamma8[p] ;
+        *o_green  = gamma8[q] ;
+        *o_blue   = gamma8[v] ;
+      break;
+
+      case 4:
+        *o_red    = gamma8[t] ;
+        *o_green  = gamma8[p] ;
+        *o_blue   = gamma8[v] ;
+      break;
+
+      case 5:
+      default:
+        *o_red    = gamma8[v] ;
+        *o_green  = gamma8[p] ;
+        *o_blue   = gamma8[q] ;
+      break;
+    }
+  }
+}
+
+/**
+ * \fn void HSBToRGB( int16_t i_hue, uint8_t i_saturation, uint8_t i_brightness, uint8_t *o_red, uint8_t *o_green, uint8_t *o_blue )
+ * \brief Floating-point reference of HSBToRGBFixed(), kept to check the integer version against it
+*/
 
 void HSBToRGB( int16_t i_hue, uint8_t i_saturation, uint8_t i_brightness, uint8_t *o_red, uint8_t *o_green, uint8_t *o_blue )
 {
@@ -3,9 +3,13 @@
 
 #include <stdint.h>
 
+#define COLOR_HUE_MAX 120 /*!< Maximum hue displayed by the board (green), the minimum being 0 (red) */
+
 void HSBToRGB( int16_t i_hue, uint8_t i_saturation, uint8_t i_brightness, uint8_t *o_red, uint8_t *o_green, uint8_t *o_blue ) ;
+void HSBToRGBFixed( int16_t i_hue, uint8_t i_saturation, uint8_t i_brightness, uint8_t *o_red, uint8_t *o_green, uint8_t *o_blue ) ;
+uint32_t hueToColor( int16_t i_hue, int8_t i_brightnessServer ) ;
 
-const uint8_t gamma8[] = {
+constexpr uint8_t gamma8[] = {
     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 16
     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  // 32
     1,  1,  1,  1,  1,  1,  1,  1,  1,  2,  2,  2,  2,  2,  2,  2,  // 48
@@ -1,12 +1,171 @@
+/**
+  \file config.cpp
+  \brief Settings of the device, kept in RAM and stored in EEPROM as one block protected by a CRC
+
+  The block is read once by configBegin(), the write*ToMemory() functions only change the copy in RAM, and
+  configCommit() writes it back with a single EEPROM commit, only if a setting changed. On the ESP8266, each commit
+  erases and rewrites the whole flash sector of the EEPROM emulation, so not committing unchanged settings is what
+  saves erase cycles.
+
+  Before the block, each setting had its own byte at the start of the EEPROM : configBegin() migrates them to the block
+  when it finds no valid one, and leaves them in place.
+*/
 #include "config.h"
+#include "crc32.h"
 #include <EEPROM.h>
 #include <Arduino.h>
 
+// Addresses of the settings before the config block
+static const int32_t legacyAddrOffset           = 0 ;
+static const int32_t legacyAddrSensitivity      = 1 ;
+static const int32_t legacyAddrPasswordLength   = 2 ;
+static const int32_t legacyAddrPasswordValue    = 3 ;
+static const int32_t legacyAddrDelayDataServer  = legacyAddrPasswordValue + configPasswordMaxLength ;
+static const int32_t legacyAddrBrightness       = legacyAddrDelayDataServer + 1 ;
+
+#define CONFIG_END(field) ( offsetof(ConfigBlock, field) + sizeof(((ConfigBlock *) 0)->field) ) /*!< Offset following a setting in the block */
+
+// End of the last setting of each version. The size of a block also counts the padding that follows, where a later
+// version put its first settings : only the bytes up to this end are the ones of the settings of the version.
+static const uint8_t versionEnds[] =
+{
+  0,
+  CONFIG_END(password),
+  CONFIG_END(shortID),
+  CONFIG_END(display),
+  CONFIG_END(thresholds),
+  CONFIG_END(snapshotLevel),
+  CONFIG_END(settingsVersion)
+} ;
+
+static_assert( sizeof(versionEnds) == CONFIG_VERSION + 1, "each version needs the end of its last setting" ) ;
+
+static ConfigBlock  config ;
+static bool         configDirty = false ;
+
+
+/**
+ * \fn uint32_t blockCRC( const ConfigBlock *i_block, uint8_t i_size )
+ * \param[in] i_block Block to compute the CRC of
+ * \param[in] i_size Size of the block as written
+ * \return The CRC-32 of the bytes of the block following its crc field
+*/
+static uint32_t blockCRC( const ConfigBlock *i_block, uint8_t i_size )
+{
+  const uint8_t *start = (const uint8_t *) &i_block->crc + sizeof(i_block->crc) ;
+
+  return crc32(start, (const uint8_t *) i_block + i_size - start) ;
+}
+
+/**
+ * \fn void setDefaults( ConfigBlock *o_block )
+ * \brief Settings of a board that was never configured
+*/
+static void setDefaults( ConfigBlock *o_block )
+{
+  memset(o_block, 0, sizeof(ConfigBlock)) ;
+  o_block->magic            = CONFIG_MAGIC ;
+  o_block->version          = CONFIG_VERSION ;
+  o_block->size             = sizeof(ConfigBlock) ;
+  o_block->offset           = configOffsetMin ;
+  o_block->sensitivity      = configSensitivityServerMax ;
+  o_block->iDelayDataServer = configDelayDataServerMin ;
+  o_block->brightness       = configBrightnessServerMin + 1 ;
+  o_block->display          = configDisplayWheel ;
+  o_block->deadband         = configDeadbandDefault ;
+  for ( uint8_t iThreshold = 0 ; iThreshold < CONFIG_NB_THRESHOLDS ; iThreshold++ )
+    o_block->thresholds[iThreshold] = configThresholdNone ;
+  o_block->snapshotLevel    = configSnapshotOff ;
+  o_block->settingsVersion  = 0 ;
+}
+
+/**
+ * \fn void migrateLegacy( ConfigBlock *o_block )
+ * \brief Read the settings stored one byte each by the firmwares without the config block, keeping the defaults of the invalid ones
+*/
+static void migrateLegacy( ConfigBlock *o_block )
+{
+  int8_t offset       = EEPROM.read(legacyAddrOffset) ;
+  int8_t sensitivity  = EEPROM.read(legacyAddrSensitivity) ;
+  int8_t iDelay       = EEPROM.read(legacyAddrDelayDataServer) ;
+  int8_t brightness   = EEPROM.read(legacyAddrBrightness) ;
+  int8_t lengthPassword = EEPROM.read(legacyAddrPasswordLength) ;
+
+  if ( offset >= configOffsetMin && offset <= configOffsetMax )
+    o_block->offset = offset ;
+  if ( sensitivity >= configSensitivityServerMin && sensitivity <= configSensitivityServerMax )
+    o_block->sensitivity = sensitivity ;
+  if ( iDelay >= configDelayDataServerMin && iDelay < configDelayDataServerAdaptive )
+    o_block->iDelayDataServer = iDelay ;
+  if ( brightness >= configBrightnessServerMin && brightness <= configBrightnessServerMax )
+    o_block->brightness = brightness ;
+
+  for ( int8_t iPasswordChar = 0 ; lengthPassword > 0 && iPasswordChar < configPasswordMaxLength ; iPasswordChar++ )
+  {
+    o_block->password[iPasswordChar] = EEPROM.read(legacyAddrPasswordValue + iPasswordChar) ;
+    if ( o_block->password[iPasswordChar] == '\0' )
+      break ;
+  }
+}
+
+/**
+ * \fn bool configBegin( void )
+ * \return False if no valid config block was found, the settings are then migrated from the legacy layout
+ * \brief Start the EEPROM and read the settings
+*/
+bool configBegin( void )
+{
+  ConfigBlock stored ;
+  bool valid ;
+
+  EEPROM.begin(CONFIG_EEPROM_SIZE) ;
+  EEPROM.get(CONFIG_BLOCK_ADDRESS, stored) ;
+  setDefaults(&config) ;
+
+  valid = stored.magic == CONFIG_MAGIC && stored.size > offsetof(ConfigBlock, crc) + sizeof(stored.crc) && stored.size <= sizeof(ConfigBlock) ;
+  valid = valid && stored.crc == blockCRC(&stored, stored.size) ;
+  if ( valid )
+  {
+    // The settings following the ones of the stored version keep their default value
+    uint8_t end = versionEnds[stored.version >= 1 && stored.version <= CONFIG_VERSION ? stored.version : CONFIG_VERSION] ;
+
+    memcpy(&config, &stored, stored.size < end ? stored.size : end) ;
+    config.version  = CONFIG_VERSION ;
+    config.size     = sizeof(ConfigBlock) ;
+    config.password[configPasswordMaxLength] = '\0' ;
+    config.shortID[configShortIDLength]       = '\0' ;
+  }
+  else
+    migrateLegacy(&config) ;
+
+  configDirty = !valid || stored.version != CONFIG_VERSION ;
+  return valid ;
+}
+
+/**
+ * \fn bool configCommit( void )
+ * \return True if the settings changed and were written
+ * \brief Write the settings to the EEPROM in one commit, if they changed since configBegin() or the last commit
+*/
+bool configCommit( void )
+{
+  if ( !configDirty )
+    return false ;
+
+  config.crc = blockCRC(&config, sizeof(config)) ;
+  EEPROM.put(CONFIG_BLOCK_ADDRESS, config) ;
+  EEPROM.commit() ;
+  configDirty = false ;
+  return true ;
+}
+
+
 bool writeOffsetToMemory( int8_t i_offset )
 {
-  if ( i_offset >= configOffsetMin && i_offset <= configOffsetMax && EEPROM.read(addrOffset) != i_offset )
+  if ( i_offset >= configOffsetMin && i_offset <= configOffsetMax && config.offset != i_offset )
   {
-    EEPROM.write(addrOffset, i_offset) ;
+    config.offset = i_offset ;
+    configDirty   = true ;
     return true ;
   }
   return false ;
@@ -15,9 +174,10 @@ bool writeOffsetToMemory( int8_t i_offset )
 
 bool writeSensitivityToMemory( int8_t i_sensitivity )
 {
-  if ( i_sensitivity >= configSensitivityServerMin && i_sensitivity <= configSensitivityServerMax && EEPROM.read(addrSensitivity) != i_sensitivity )
+  if ( i_sensitivity >= configSensitivityServerMin && i_sensitivity <= configSensitivityServerMax && config.sensitivity != i_sensitivity )
   {
-    EEPROM.write(addrSensitivity, i_sensitivity) ;
+    config.sensitivity  = i_sensitivity ;
+    configDirty         = true ;
     return true ;
   }
   return false ;
@@ -26,9 +186,10 @@ bool writeSensitivityToMemory( int8_t i_sensitivity )
 
 bool writeDelayDataServerToMemory( int8_t i_iDelayDataServer )
 {
-  if ( i_iDelayDataServer >= configDelayDataServerMin && i_iDelayDataServer <= configDelayDataServerMax && readDelayDataServerFromMemory() != configDelayDataServer[i_iDelayDataServer] )
+  if ( i_iDelayDataServer >= configDelayDataServerMin && i_iDelayDataServer <= configDelayDataServerMax && config.iDelayDataServer != i_iDelayDataServer )
   {
-    EEPROM.write(addrDelayDataServer, i_iDelayDataServer) ;
+    config.iDelayDataServer = i_iDelayDataServer ;
+    configDirty             = true ;
     return true ;
   }
   return false ;
@@ -37,9 +198,92 @@ bool writeDelayDataServerToMemory( int8_t i_iDelayDataServer )
 
 bool writeBrightnessToMemory( int8_t i_brightness )
 {
-  if ( i_brightness >= configBrightnessServerMin && i_brightness <= configBrightnessServerMax && EEPROM.read(addrBrightness) != i_brightness )
+  if ( i_brightness >= configBrightnessServerMin && i_brightness <= configBrightnessServerMax && config.brightness != i_brightness )
+  {
+    config.brightness = i_brightness ;
+    configDirty       = true ;
+    return true ;
+  }
+  return false ;
+}
+
+
+bool writeShortIDToMemory( const char *i_shortID )
+{
+  if ( strlen(i_shortID) <= (size_t) configShortIDLength && strcmp(config.shortID, i_shortID) != 0 )
+  {
+    strcpy(config.shortID, i_shortID) ;
+    configDirty = true ;
+    return true ;
+  }
+  return false ;
+}
+
+
+bool writeDisplayToMemory( int8_t i_display )
+{
+  if ( ( i_display == configDisplayWheel || i_display == configDisplaySpectrum ) && config.display != i_display )
+  {
+    config.display  = i_display ;
+    configDirty     = true ;
+    return true ;
+  }
+  return false ;
+}
+
+
+bool writeDeadbandToMemory( uint8_t i_deadband )
+{
+  if ( config.deadband != i_deadband )
+  {
+    config.deadband = i_deadband ;
+    configDirty     = true ;
+    return true ;
+  }
+  return false ;
+}
+
+
+/**
+ * \fn bool writeThresholdsToMemory( const int16_t *i_thresholds, uint8_t i_nbThresholds )
+ * \param[in] i_thresholds Thresholds of the adaptive reporting, in any order
+ * \param[in] i_nbThresholds Number of thresholds, the ones beyond CONFIG_NB_THRESHOLDS are ignored
+ * \return True if the thresholds changed
+*/
+bool writeThresholdsToMemory( const int16_t *i_thresholds, uint8_t i_nbThresholds )
+{
+  bool changed = false ;
+
+  for ( uint8_t iThreshold = 0 ; iThreshold < CONFIG_NB_THRESHOLDS ; iThreshold++ )
+  {
+    int16_t threshold = iThreshold < i_nbThresholds ? i_thresholds[iThreshold] : configThresholdNone ;
+
+    changed |= config.thresholds[iThreshold] != threshold ;
+    config.thresholds[iThreshold] = threshold ;
+  }
+  configDirty |= changed ;
+  return changed ;
+}
+
+
+bool writeSnapshotLevelToMemory( uint8_t i_snapshotLevel )
+{
+  if ( config.snapshotLevel != i_snapshotLevel )
+  {
+    config.snapshotLevel  = i_snapshotLevel ;
+    configDirty           = true ;
+    return true ;
+  }
+  return false ;
+}
+
+
+bool writeSettingsVersionToMemory( uint32_t i_settingsVersion )
+{
+  if ( config.settingsVersion != i_settingsVersion )
   {
-    EEPROM.write(addrBrightness, i_brightness) ;
+    config.settingsVersion  = i_settingsVersion ;
+    configDirty             = true ;
     return true ;
   }
   return false ;
@@ -48,7 +292,7 @@ bool writeBrightnessToMemory( int8_t i_brightness )
 
 int8_t readOffsetFromMemory( void )
 {
-  int8_t offset = EEPROM.read(addrOffset) ;
+  int8_t offset = config.offset ;
   if ( offset >= configOffsetMin && offset <= configOffsetMax )
     return offset ;
   else
@@ -58,7 +302,7 @@ int8_t readOffsetFromMemory( void )
 
 int8_t readSensitivityFromMemory( void )
 {
-  int8_t sensitivity = EEPROM.read(addrSensitivity) ;
+  int8_t sensitivity = config.sensitivity ;
   if ( sensitivity >= configSensitivityServerMin && sensitivity <= configSensitivityServerMax )
     return mapSensitivityServerToValue(sensitivity) ;
   else
@@ -68,7 +312,7 @@ int8_t readSensitivityFromMemory( void )
 
 int32_t readDelayDataServerFromMemory( void )
 {
-  int8_t iDelayDataServer = EEPROM.read(addrDelayDataServer) ;
+  int8_t iDelayDataServer = config.iDelayDataServer ;
 
   if ( iDelayDataServer >= configDelayDataServerMin && iDelayDataServer <= configDelayDataServerMax )
   {
@@ -83,45 +327,99 @@ int32_t readDelayDataServerFromMemory( void )
 
 uint8_t readBrightnessFromMemory( void )
 {
-  int8_t brightness = EEPROM.read(addrBrightness) ;
+  return mapBrightnessServerToValue(readBrightnessServerFromMemory()) ;
+}
+
+
+int8_t readBrightnessServerFromMemory( void )
+{
+  int8_t brightness = config.brightness ;
   if ( brightness >= configBrightnessServerMin && brightness <= configBrightnessServerMax )
-    return mapBrightnessServerToValue(brightness) ;
+    return brightness ;
   else
-    return mapBrightnessServerToValue(configBrightnessServerMin + 1) ;
+    return configBrightnessServerMin + 1 ;
 }
 
 
-int8_t  mapSensitivityServerToValue ( int8_t i_sensitivityServer )
+/**
+ * \fn const char * readShortIDFromMemory( void )
+ * \return The short ID given by the server at the last registration, empty if the device never registered
+*/
+const char * readShortIDFromMemory( void )
 {
-  return (i_sensitivityServer * -1) + 11 ;
+  return config.shortID ;
 }
 
-uint8_t  mapBrightnessServerToValue ( int8_t i_brightnessServer )
+
+int8_t readDisplayFromMemory( void )
 {
-  if( i_brightnessServer == 0 )
-    return 0 ;
-  else
-    return 48 + 16 * i_brightnessServer ;
+  return config.display == configDisplaySpectrum ? configDisplaySpectrum : configDisplayWheel ;
 }
 
-String getAPPassword()
+
+/**
+ * \fn bool readAdaptiveFromMemory( void )
+ * \return True if the server chose the adaptive reporting, readDelayDataServerFromMemory() is then its heartbeat
+*/
+bool readAdaptiveFromMemory( void )
 {
-  String password = "" ;
-  int8_t lengthPasswordEEPROM = EEPROM.read(addrPasswordLength), iPasswordChar ;
+  return config.iDelayDataServer == configDelayDataServerAdaptive ;
+}
+
+
+uint8_t readDeadbandFromMemory( void )
+{
+  return config.deadband ;
+}
+
+
+/**
+ * \fn uint8_t readThresholdsFromMemory( int16_t *o_thresholds )
+ * \param[out] o_thresholds Thresholds of the adaptive reporting, CONFIG_NB_THRESHOLDS values at most
+ * \return The number of thresholds set
+*/
+uint8_t readThresholdsFromMemory( int16_t *o_thresholds )
+{
+  uint8_t nbThresholds = 0 ;
+
+  for ( uint8_t iThreshold = 0 ; iThreshold < CONFIG_NB_THRESHOLDS ; iThreshold++ )
+    if ( config.thresholds[iThreshold] != configThresholdNone )
+      o_thresholds[nbThresholds++] = config.thresholds[iThreshold] ;
+  return nbThresholds ;
+}
 
-  if ( lengthPasswordEEPROM > 0 )
-  {
-    for ( iPasswordChar = 0 ; iPasswordChar < configPasswordMaxLength ; iPasswordChar++ )
-    {
-      char passwordChar = EEPROM.read(addrPasswordValue + iPasswordChar) ;
-      if ( passwordChar != '\0' )
-        password += passwordChar ;
-      else
-        break ;
-    }
-  }
-  else
-    password = FPSTR(configPasswordAP) ;
 
-  return password ;
+uint8_t readSnapshotLevelFromMemory( void )
+{
+  return config.snapshotLevel ;
+}
+
+
+/**
+ * \fn uint32_t readSettingsVersionFromMemory( void )
+ * \return The version of the settings given with them by the server, 0 if it never gave one
+*/
+uint32_t readSettingsVersionFromMemory( void )
+{
+  return config.settingsVersion ;
+}
+
+
+int8_t  mapSensitivityServerToValue ( int8_t i_sensitivityServer )
+{
+  return (i_sensitivityServer * -1) + 11 ;
+}
+
+/**
+ * \fn void getAPPassword( char *o_password )
+ * \param[out] o_password Buffer of configPasswordMaxLength + 1 characters
+ * \brief Copy the password of the access point, configPasswordAP from the flash if none was set
+*/
+void getAPPassword( char *o_password )
+{
+  if ( config.password[0] != '\0' )
+    memcpy(o_password, config.password, sizeof(config.password)) ;
+  else
+    strncpy_P(o_password, configPasswordAP, configPasswordMaxLength + 1) ;
+  o_password[configPasswordMaxLength] = '\0' ;
 }
@@ -5,13 +5,42 @@
 #include <Arduino.h>
 
 const int8_t configPasswordMaxLength = 20 ;
+const int8_t configShortIDLength = 6 ;
 
-const int32_t addrOffset            = 0 ;
-const int32_t addrSensitivity       = 1 ;
-const int32_t addrPasswordLength    = 2 ;
-const int32_t addrPasswordValue     = 3 ;
-const int32_t addrDelayDataServer   = addrPasswordValue + configPasswordMaxLength ;
-const int32_t addrBrightness        = addrDelayDataServer + 1 ;
+#define CONFIG_EEPROM_SIZE    128     /*!< Bytes of EEPROM used, the legacy layout and the config block */
+#define CONFIG_BLOCK_ADDRESS  64      /*!< After the legacy layout, which is left as is for older firmwares */
+#define CONFIG_MAGIC          0x434E  /*!< First bytes of the config block, "NC" */
+#define CONFIG_VERSION        6
+#define CONFIG_NB_THRESHOLDS  3       /*!< Thresholds of the adaptive reporting */
+
+/**
+ * \struct ConfigBlock
+ * \brief Settings stored in EEPROM
+ *
+ * New settings are added at the end, with a new CONFIG_VERSION and the end of its last setting in versionEnds of
+ * config.cpp : a block written by an older version is shorter, and the settings it does not have keep their default
+ * value.
+*/
+struct ConfigBlock
+{
+  uint16_t magic ;
+  uint8_t  version ;
+  uint8_t  size ;           /*!< sizeof(ConfigBlock) for the version that wrote the block */
+  uint32_t crc ;            /*!< CRC-32 of the block after this field, up to size */
+  int8_t   offset ;
+  int8_t   sensitivity ;    /*!< As set on the server, see mapSensitivityServerToValue() */
+  int8_t   iDelayDataServer ;
+  int8_t   brightness ;     /*!< As set on the server, see mapBrightnessServerToValue() */
+  char     password[configPasswordMaxLength + 1] ; /*!< Password of the access point, empty for configPasswordAP */
+  char     shortID[configShortIDLength + 1] ;       /*!< Given by the server at the last registration, empty before, since version 2 */
+  int8_t   display ;        /*!< configDisplayWheel or configDisplaySpectrum, since version 3 */
+  uint8_t  deadband ;       /*!< Change of the value that triggers an upload in the adaptive mode, since version 4 */
+  int16_t  thresholds[CONFIG_NB_THRESHOLDS] ; /*!< Values whose crossing triggers an upload in the adaptive mode, configThresholdNone if unused, since version 4 */
+  uint8_t  snapshotLevel ;  /*!< Level that triggers a snapshot, in dB(A), configSnapshotOff for none, since version 5 */
+  uint32_t settingsVersion ; /*!< Version of the settings on the server, 0 if it gave none, since version 6 */
+} ;
+
+static_assert( sizeof(ConfigBlock) <= CONFIG_EEPROM_SIZE - CONFIG_BLOCK_ADDRESS, "the config block does not fit in the EEPROM" ) ;
 
 
 const int8_t  configOffsetMin = 0 ;
@@ -19,24 +48,56 @@ const int8_t  configOffsetMax = 100 ;
 const int8_t  configSensitivityServerMin = 1 ;
 const int8_t  configSensitivityServerMax = 10 ;
 const int8_t  configDelayDataServerMin = 0 ;
-const int8_t  configDelayDataServerMax = 2 ;
+const int8_t  configDelayDataServerMax = 3 ;
+const int8_t  configDelayDataServerAdaptive = 3 ; /*!< Upload on change, with a heartbeat at the slowest rate, see report.cpp */
 const int8_t  configBrightnessServerMin = 0 ;
 const int8_t  configBrightnessServerMax = 10 ;
+const int8_t  configDisplayWheel = 0 ;        /*!< The strip shows the level as the color of a turning wheel */
+const int8_t  configDisplaySpectrum = 1 ;     /*!< The strip shows the octave bands of spectrum.h */
+const uint8_t configDeadbandDefault = 5 ;
+const int16_t configThresholdNone = INT16_MAX ;
+const uint8_t configSnapshotOff = 0 ;         /*!< No snapshot of loud events, see snapshot.h */
 static const char configPasswordAP[] PROGMEM = "iot-makers";
 
-const int32_t configDelayDataServer[3] = {300000, 60000, 10000} ;
+const int32_t configDelayDataServer[4] = {300000, 60000, 10000, 300000} ; /*!< The adaptive mode uploads at least at the slowest rate */
 
 
+bool configBegin( void ) ;
+bool configCommit( void ) ;
 bool writeOffsetToMemory( int8_t i_offset ) ;
 bool writeSensitivityToMemory( int8_t i_sensitivity ) ;
 bool writeDelayDataServerToMemory( int8_t i_iDelayDataServer ) ;
 bool writeBrightnessToMemory( int8_t i_brightness ) ;
+bool writeShortIDToMemory( const char *i_shortID ) ;
+bool writeDisplayToMemory( int8_t i_display ) ;
+bool writeDeadbandToMemory( uint8_t i_deadband ) ;
+bool writeThresholdsToMemory( const int16_t *i_thresholds, uint8_t i_nbThresholds ) ;
+bool writeSnapshotLevelToMemory( uint8_t i_snapshotLevel ) ;
+bool writeSettingsVersionToMemory( uint32_t i_settingsVersion ) ;
 int8_t readOffsetFromMemory( void ) ;
 int8_t readSensitivityFromMemory( void ) ;
 int32_t readDelayDataServerFromMemory( void ) ;
 uint8_t readBrightnessFromMemory( void ) ;
+int8_t readBrightnessServerFromMemory( void ) ;
+const char * readShortIDFromMemory( void ) ;
+int8_t readDisplayFromMemory( void ) ;
+bool readAdaptiveFromMemory( void ) ;
+uint8_t readDeadbandFromMemory( void ) ;
+uint8_t readThresholdsFromMemory( int16_t *o_thresholds ) ;
+uint8_t readSnapshotLevelFromMemory( void ) ;
+uint32_t readSettingsVersionFromMemory( void ) ;
 int8_t  mapSensitivityServerToValue ( int8_t i_sensitivityServer ) ;
-uint8_t  mapBrightnessServerToValue ( int8_t i_brightnessServer ) ;
-String getAPPassword() ;
+void getAPPassword( char *o_password ) ;
+
+/**
+ * \fn uint8_t mapBrightnessServerToValue ( int8_t i_brightnessServer )
+ * \param[in] i_brightnessServer Brightness level as set on the server
+ * \return The brightness to give to HSBToRGB
+ * \brief Map a brightness level to a brightness, at compile time when possible so that color.cpp can tabulate it
+*/
+constexpr uint8_t  mapBrightnessServerToValue ( int8_t i_brightnessServer )
+{
+  return i_brightnessServer == 0 ? 0 : 48 + 16 * i_brightnessServer ;
+}
 
 #endif
@@ -0,0 +1,383 @@
+/**
+  \file connection.cpp
+  \brief Persistent HTTPS connection to the server, shared by all the requests of the board
+
+  A TLS handshake takes the ESP8266 around a second and a lot of heap, so the connection is kept open (HTTP/1.1
+  keep-alive) across requests and across upload cycles, and only reopened when the server closed it or a request
+  failed. Requests can be pipelined : several can be written before their responses are read, in order. Responses
+  can be parsed as their bytes arrive, so that the caller never has to wait for the network.
+*/
+#include "connection.h"
+#include <ESP8266WiFi.h>
+#include <WiFiClientSecure.h>
+
+static const char* fingerprint = "FB:AD:09:02:B3:19:A5:F7:5F:27:A8:93:16:98:D7:A0:9C:27:D9:AE";
+
+static WiFiClientSecure client ;
+static char     connectedHost[CONNECTION_SIZE_HOST] = { '\0' } ;
+static bool     closeAfterResponse  = false ;
+static uint32_t handshakeCount      = 0 ;
+static uint32_t receivedCount       = 0 ;  /*!< Bytes of responses read since the board started */
+
+/**
+ * \enum ResponsePhase
+ * \brief Part of the HTTP response being parsed
+*/
+enum ResponsePhase
+{
+  PHASE_STATUS,
+  PHASE_HEADERS,
+  PHASE_BODY,
+  PHASE_CHUNK_SIZE,
+  PHASE_CHUNK_DATA,
+  PHASE_CHUNK_END,
+  PHASE_TRAILER
+} ;
+
+/**
+ * \struct ResponseParser
+ * \brief State of the parsing of the response being received, so that it can go on as bytes arrive
+*/
+struct ResponseParser
+{
+  ResponsePhase phase ;
+  bool          started ;     /*!< Whether the payload was cleared for this response */
+  bool          chunked ;
+  int16_t       HTTPCode ;
+  int32_t       remaining ;   /*!< Bytes left in the body or the chunk, -1 if not known */
+  char          line[128] ;
+  uint8_t       lengthLine ;
+
+  ResponseParser() : phase(PHASE_STATUS), started(false), chunked(false), HTTPCode(-1), remaining(-1), lengthLine(0) {}
+} ;
+
+static ResponseParser response ;
+
+
+/**
+ * \fn bool connectionOpen( const char *i_host )
+ * \param[in] i_host Host name of the server
+ * \return True if the connection is open and the certificate of the server matches the fingerprint
+ * \brief Reuse the connection to the server if it is still open, open a new one otherwise
+*/
+bool connectionOpen( const char *i_host )
+{
+  if ( client.connected() && !closeAfterResponse && strcmp(connectedHost, i_host) == 0 )
+    return true ;
+
+  connectionClose() ;
+  handshakeCount++ ;
+  if ( !client.connect(i_host, CONNECTION_PORT) || !client.verify(fingerprint, i_host) )
+  {
+    client.stop() ;
+    return false ;
+  }
+  client.setNoDelay(true) ;
+  strncpy(connectedHost, i_host, sizeof(connectedHost) - 1) ;
+  return true ;
+}
+
+/**
+ * \fn void connectionClose( void )
+ * \brief Close the connection to the server, if any
+*/
+void connectionClose( void )
+{
+  client.stop() ;
+  connectedHost[0]    = '\0' ;
+  closeAfterResponse  = false ;
+  response            = ResponseParser() ;
+}
+
+/**
+ * \fn bool connectionWriteRequest( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length )
+ * \param[in] i_host Host name of the server
+ * \param[in] i_endPoint End point to send the request to
+ * \param[in] i_contentType Content type of the body
+ * \param[in] i_body Body of the request
+ * \param[in] i_length Size of the body, in bytes
+ * \return True if the whole request was written
+ * \brief Write a POST request on the open connection, without waiting for its response
+*/
+bool connectionWriteRequest( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length )
+{
+  char headers[256] ;
+  int lengthHeaders ;
+
+  lengthHeaders = snprintf(headers, sizeof(headers), "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: keep-alive\r\n\r\n",
+                           i_endPoint, i_host, i_contentType, (unsigned int) i_length) ;
+  if ( lengthHeaders <= 0 || lengthHeaders >= (int) sizeof(headers) )
+    return false ;
+
+  return client.write((const uint8_t *) headers, lengthHeaders) == (size_t) lengthHeaders && client.write(i_body, i_length) == i_length ;
+}
+
+/**
+ * \fn bool appendLine( int c )
+ * \param[in] c Character received
+ * \return True if c ended a line, which is then in response.line without its end of line, truncated if too long
+*/
+static bool appendLine( int c )
+{
+  if ( c == '\n' )
+  {
+    if ( response.lengthLine > 0 && response.line[response.lengthLine - 1] == '\r' )
+      response.lengthLine-- ;
+    response.line[response.lengthLine] = '\0' ;
+    response.lengthLine = 0 ;
+    return true ;
+  }
+  if ( response.lengthLine < sizeof(response.line) - 1 )
+    response.line[response.lengthLine++] = c ;
+  return false ;
+}
+
+/**
+ * \fn int16_t endResponse( void )
+ * \return The HTTP code of the response
+ * \brief Get ready for the next response, closing the connection if the server asked to
+*/
+static int16_t endResponse( void )
+{
+  int16_t HTTPCode = response.HTTPCode ;
+
+  response = ResponseParser() ;
+  if ( closeAfterResponse )
+    connectionClose() ;
+  return HTTPCode ;
+}
+
+/**
+ * \fn int16_t pollResponse( String *o_payload, ConnectionBodyHandler i_handler )
+ * \param[out] o_payload Body of the response, may be NULL to discard it
+ * \param[in] i_handler Function given the bytes of the body instead of o_payload, may be NULL
+ * \return The HTTP code of the response, CONNECTION_PENDING if it is not complete yet, or -1 if it failed
+ * \brief Parse the bytes of the next response received so far, without waiting for more
+*/
+static int16_t pollResponse( String *o_payload, ConnectionBodyHandler i_handler )
+{
+  if ( !response.started )
+  {
+    if ( o_payload != NULL )
+      *o_payload = "" ;
+    if ( i_handler != NULL )
+      i_handler(-1) ;
+    response.started = true ;
+  }
+
+  while ( client.available() > 0 )
+  {
+    int c = client.read() ;
+
+    receivedCount++ ;
+
+    switch ( response.phase )
+    {
+      case PHASE_STATUS:
+        if ( !appendLine(c) )
+          break ;
+        if ( sscanf(response.line, "HTTP/1.%*d %hd", &response.HTTPCode) != 1 )
+        {
+          connectionClose() ;
+          return -1 ;
+        }
+        response.phase = PHASE_HEADERS ;
+        break ;
+
+      case PHASE_HEADERS:
+        if ( !appendLine(c) )
+          break ;
+        if ( strncasecmp(response.line, "Content-Length:", 15) == 0 )
+          response.remaining = atol(response.line + 15) ;
+        else if ( strncasecmp(response.line, "Transfer-Encoding:", 18) == 0 && strstr(response.line, "chunked") != NULL )
+          response.chunked = true ;
+        else if ( strncasecmp(response.line, "Connection:", 11) == 0 && strstr(response.line, "close") != NULL )
+          closeAfterResponse = true ;
+        else if ( response.line[0] == '\0' )
+        {
+          // End of the headers : without a length, the body lasts until the server closes the connection
+          if ( response.chunked )
+            response.phase = PHASE_CHUNK_SIZE ;
+          else if ( response.remaining == 0 )
+            return endResponse() ;
+          else
+          {
+            closeAfterResponse |= response.remaining < 0 ;
+            response.phase = PHASE_BODY ;
+          }
+        }
+        break ;
+
+      case PHASE_BODY:
+      case PHASE_CHUNK_DATA:
+        if ( i_handler != NULL )
+          i_handler(c) ;
+        else if ( o_payload != NULL )
+          *o_payload += (char) c ;
+        if ( response.remaining > 0 && --response.remaining == 0 )
+        {
+          if ( response.phase == PHASE_BODY )
+            return endResponse() ;
+          response.phase = PHASE_CHUNK_END ;
+        }
+        break ;
+
+      case PHASE_CHUNK_SIZE:
+        if ( !appendLine(c) )
+          break ;
+        response.remaining  = strtol(response.line, NULL, 16) ;
+        response.phase      = response.remaining > 0 ? PHASE_CHUNK_DATA : PHASE_TRAILER ;
+        break ;
+
+      case PHASE_CHUNK_END:
+        if ( appendLine(c) )
+          response.phase = PHASE_CHUNK_SIZE ;
+        break ;
+
+      case PHASE_TRAILER:
+        if ( appendLine(c) && response.line[0] == '\0' )
+          return endResponse() ;
+        break ;
+    }
+  }
+
+  if ( !client.connected() )
+  {
+    if ( response.phase == PHASE_BODY && response.remaining < 0 )
+      return endResponse() ;
+    connectionClose() ;
+    return -1 ;
+  }
+  return CONNECTION_PENDING ;
+}
+
+/**
+ * \fn int16_t connectionPollResponse( String *o_payload )
+ * \param[out] o_payload Body of the response, may be NULL to discard it
+ * \return The HTTP code of the response, CONNECTION_PENDING if it is not complete yet, or -1 if it failed
+ * \brief Parse the bytes of the next response received so far, without waiting for more
+ *
+ * The body is appended to o_payload as it arrives, so the same payload must be passed until the response is complete.
+ * Only the bytes of this response are consumed, those of the next pipelined one are left on the connection.
+*/
+int16_t connectionPollResponse( String *o_payload )
+{
+  return pollResponse(o_payload, NULL) ;
+}
+
+/**
+ * \fn int16_t connectionPollResponseStream( ConnectionBodyHandler i_handler )
+ * \param[in] i_handler Function given each byte of the body of the response as it is read, and -1 before the first one
+ * \return The HTTP code of the response, CONNECTION_PENDING if it is not complete yet, or -1 if it failed
+ * \brief Same as connectionPollResponse(), the body being parsed as it arrives rather than stored on the heap
+*/
+int16_t connectionPollResponseStream( ConnectionBodyHandler i_handler )
+{
+  return pollResponse(NULL, i_handler) ;
+}
+
+/**
+ * \fn int16_t readResponse( String *o_payload, ConnectionBodyHandler i_handler )
+ * \param[out] o_payload Body of the response, may be NULL to discard it
+ * \param[in] i_handler Function given the bytes of the body instead of o_payload, may be NULL
+ * \return The HTTP code of the response, or -1 if none could be read
+ * \brief Wait for the next response on the connection, which is closed if it can not be reused afterwards
+*/
+static int16_t readResponse( String *o_payload, ConnectionBodyHandler i_handler )
+{
+  uint32_t startMillis = millis() ;
+  int16_t HTTPCode ;
+
+  while ( ( HTTPCode = pollResponse(o_payload, i_handler) ) == CONNECTION_PENDING )
+  {
+    if ( millis() - startMillis > CONNECTION_TIMEOUT_MS )
+    {
+      connectionClose() ;
+      return -1 ;
+    }
+    delay(1) ;
+  }
+  return HTTPCode ;
+}
+
+/**
+ * \fn int16_t connectionReadResponse( String *o_payload )
+ * \param[out] o_payload Body of the response, may be NULL to discard it
+ * \return The HTTP code of the response, or -1 if none could be read
+ * \brief Wait for the next response on the connection, which is closed if it can not be reused afterwards
+*/
+int16_t connectionReadResponse( String *o_payload )
+{
+  return readResponse(o_payload, NULL) ;
+}
+
+/**
+ * \fn int16_t post( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, String *o_payload, ConnectionBodyHandler i_handler )
+ * \return The HTTP code of the response, or -1 if none could be read
+ * \brief Send a POST request and wait for its response, reconnecting once if the reused connection had gone stale
+ *        before any byte of the response : a request on a new connection, or answered in part, may have been processed
+*/
+static int16_t post( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, String *o_payload, ConnectionBodyHandler i_handler )
+{
+  int16_t HTTPCode = -1 ;
+  bool stale = true ;
+
+  // A new connection, or a response that started, may have reached the server : the request is not sent again
+  for ( uint8_t iAttempt = 0 ; iAttempt < 2 && HTTPCode < 0 && stale ; iAttempt++ )
+  {
+    uint32_t handshakes = handshakeCount, received ;
+
+    if ( !connectionOpen(i_host) )
+      return -1 ;
+    received  = receivedCount ;
+    stale     = handshakeCount == handshakes ;
+    if ( connectionWriteRequest(i_host, i_endPoint, i_contentType, i_body, i_length) )
+      HTTPCode = readResponse(o_payload, i_handler) ;
+    else
+      connectionClose() ;
+    stale &= receivedCount == received ;
+  }
+  return HTTPCode ;
+}
+
+/**
+ * \fn int16_t connectionPost( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, String *o_payload )
+ * \param[in] i_host Host name of the server
+ * \param[in] i_endPoint End point to send the request to
+ * \param[in] i_contentType Content type of the body
+ * \param[in] i_body Body of the request
+ * \param[in] i_length Size of the body, in bytes
+ * \param[out] o_payload Body of the response, may be NULL to discard it
+ * \return The HTTP code of the response, or -1 if none could be read
+ * \brief Send a POST request and wait for its response, reconnecting once if the reused connection had gone stale
+*/
+int16_t connectionPost( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, String *o_payload )
+{
+  return post(i_host, i_endPoint, i_contentType, i_body, i_length, o_payload, NULL) ;
+}
+
+/**
+ * \fn int16_t connectionPostStream( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, ConnectionBodyHandler i_handler )
+ * \param[in] i_host Host name of the server
+ * \param[in] i_endPoint End point to send the request to
+ * \param[in] i_contentType Content type of the body
+ * \param[in] i_body Body of the request
+ * \param[in] i_length Size of the body, in bytes
+ * \param[in] i_handler Function given each byte of the body of the response as it is read, and -1 before the first one
+ * \return The HTTP code of the response, or -1 if none could be read
+ * \brief Same as connectionPost(), the response being parsed as it arrives rather than stored on the heap. When the
+ *        request is sent again on a new connection, i_handler gets -1 again before the body of the new response.
+*/
+int16_t connectionPostStream( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, ConnectionBodyHandler i_handler )
+{
+  return post(i_host, i_endPoint, i_contentType, i_body, i_length, NULL, i_handler) ;
+}
+
+/**
+ * \fn uint32_t connectionHandshakes( void )
+ * \return The number of connections opened to the server, each one costing a TLS handshake
+*/
+uint32_t connectionHandshakes( void )
+{
+  return handshakeCount ;
+}
@@ -0,0 +1,24 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#define CONNECTION_PORT        443  /*!< The port of the HTTPS server */
+#define CONNECTION_TIMEOUT_MS  5000 /*!< The maximum time to wait for a response from the server, in ms */
+#define CONNECTION_SIZE_HOST   64   /*!< The maximum length of the host name of the server */
+#define CONNECTION_PENDING     -2   /*!< Returned by connectionPollResponse() while the response is not complete */
+
+typedef void (*ConnectionBodyHandler)( int c ) ; /*!< Given each byte of the body of a response, and -1 when a new response starts */
+
+bool connectionOpen( const char *i_host ) ;
+void connectionClose( void ) ;
+bool connectionWriteRequest( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length ) ;
+int16_t connectionPollResponse( String *o_payload ) ;
+int16_t connectionPollResponseStream( ConnectionBodyHandler i_handler ) ;
+int16_t connectionReadResponse( String *o_payload ) ;
+int16_t connectionPost( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, String *o_payload ) ;
+int16_t connectionPostStream( const char *i_host, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length, ConnectionBodyHandler i_handler ) ;
+uint32_t connectionHandshakes( void ) ;
+
+#endif
@@ -0,0 +1,28 @@
+#include "crc32.h"
+
+// CRC-32 (IEEE 802.3, reflected) of each nibble, so that the table stays small
+static const uint32_t crc32Nibbles[16] =
+{
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+} ;
+
+/**
+ * \fn uint32_t crc32( const void *i_data, size_t i_length, uint32_t i_crc )
+ * \param[in] i_data Bytes to compute the CRC of
+ * \param[in] i_length Number of bytes
+ * \param[in] i_crc CRC of the bytes before i_data, to compute the CRC of data in several parts
+ * \return The CRC-32 of the bytes, as computed by zlib
+*/
+uint32_t crc32( const void *i_data, size_t i_length, uint32_t i_crc )
+{
+  const uint8_t *data = (const uint8_t *) i_data ;
+
+  i_crc = ~i_crc ;
+  for ( size_t iByte = 0 ; iByte < i_length ; iByte++ )
+  {
+    i_crc = crc32Nibbles[( i_crc ^ data[iByte] ) & 0x0F] ^ ( i_crc >> 4 ) ;
+    i_crc = crc32Nibbles[( i_crc ^ ( data[iByte] >> 4 ) ) & 0x0F] ^ ( i_crc >> 4 ) ;
+  }
+  return ~i_crc ;
+}
@@ -0,0 +1,9 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint32_t crc32( const void *i_data, size_t i_length, uint32_t i_crc = 0 ) ;
+
+#endif
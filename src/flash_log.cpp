@@ -0,0 +1,244 @@
+/**
+  \file flash_log.cpp
+  \brief Log of the values kept in flash while the server cannot be reached, read back oldest first once it can
+
+  The log is a sequence of fixed-size segments, each in its own SPIFFS file named after its sequence number. A segment
+  is written once with its CRC, never modified, and removed once all its values were sent or when the log is full, so
+  that no page is rewritten in place and SPIFFS spreads the writes over the whole partition. A segment cut by a power
+  loss fails its CRC and is discarded.
+
+  The position of a value is the sequence number of its segment times FLASH_LOG_SEGMENT_VALUES plus its index in the
+  segment. The read position is only kept in RAM : after a reboot, the values already sent from the oldest segment
+  are sent again, at most FLASH_LOG_SEGMENT_VALUES - 1 of them.
+
+  Flash accesses disable the instruction cache on the ESP8266, so the sampler is paused around each of them.
+*/
+#include "flash_log.h"
+#include "crc32.h"
+#include "sampler.h"
+#include <FS.h>
+
+static bool     enabled         = false ;
+static uint32_t oldestSequence  = 0 ;     /*!< Sequence number of the oldest segment kept */
+static uint32_t nextSequence    = 0 ;     /*!< Sequence number of the next segment to write */
+static uint32_t readPosition    = 0 ;     /*!< Position of the oldest value not consumed */
+static uint32_t droppedCount    = 0 ;
+static bool     cacheValid      = false ;
+static uint32_t cacheSequence   = 0 ;
+static int16_t  cacheValues[FLASH_LOG_SEGMENT_VALUES] ; /*!< Values of the segment last read */
+
+
+/**
+ * \fn void segmentPath( uint32_t i_sequence, char *o_path )
+ * \param[in] i_sequence Sequence number of the segment
+ * \param[out] o_path Path of the segment, of at least sizeof(FLASH_LOG_PREFIX) + 8 characters
+*/
+static void segmentPath( uint32_t i_sequence, char *o_path )
+{
+  sprintf(o_path, FLASH_LOG_PREFIX "%08x", (unsigned int) i_sequence) ;
+}
+
+/**
+ * \fn void removeSegment( uint32_t i_sequence )
+ * \param[in] i_sequence Sequence number of the segment
+*/
+static void removeSegment( uint32_t i_sequence )
+{
+  char path[sizeof(FLASH_LOG_PREFIX) + 8] ;
+
+  segmentPath(i_sequence, path) ;
+  samplerPause() ;
+  SPIFFS.remove(path) ;
+  samplerResume() ;
+}
+
+/**
+ * \fn bool loadSegment( uint32_t i_sequence )
+ * \param[in] i_sequence Sequence number of the segment
+ * \return False if the segment is missing, cut or corrupted
+ * \brief Read the values of a segment to cacheValues, unless they are already there
+*/
+static bool loadSegment( uint32_t i_sequence )
+{
+  char path[sizeof(FLASH_LOG_PREFIX) + 8] ;
+  FlashLogHeader header ;
+  File file ;
+  bool valid ;
+
+  if ( cacheValid && cacheSequence == i_sequence )
+    return true ;
+
+  segmentPath(i_sequence, path) ;
+  samplerPause() ;
+  file  = SPIFFS.open(path, "r") ;
+  valid = file && file.size() == sizeof(header) + sizeof(cacheValues)
+        && file.read((uint8_t *) &header, sizeof(header)) == sizeof(header)
+        && file.read((uint8_t *) cacheValues, sizeof(cacheValues)) == sizeof(cacheValues) ;
+  file.close() ;
+  samplerResume() ;
+
+  valid         = valid && header.magic == FLASH_LOG_MAGIC && header.version == FLASH_LOG_VERSION && header.sequence == i_sequence ;
+  valid         = valid && header.crc == crc32(cacheValues, sizeof(cacheValues)) ;
+  cacheValid    = valid ;
+  cacheSequence = i_sequence ;
+  return valid ;
+}
+
+/**
+ * \fn void dropOldestSegment( void )
+ * \brief Remove the oldest segment, counting its values not consumed as dropped
+*/
+static void dropOldestSegment( void )
+{
+  uint32_t end = ( oldestSequence + 1 ) * FLASH_LOG_SEGMENT_VALUES ;
+
+  removeSegment(oldestSequence) ;
+  oldestSequence++ ;
+  if ( readPosition < end )
+  {
+    droppedCount += end - readPosition ;
+    readPosition  = end ;
+  }
+}
+
+/**
+ * \fn bool flashLogBegin( void )
+ * \return False if the file system cannot be mounted, in which case the log stays empty
+ * \brief Mount the file system and find the segments left by the previous run, discarding the last one if it was cut
+*/
+bool flashLogBegin( void )
+{
+  bool found = false ;
+  Dir dir ;
+
+  oldestSequence  = 0 ;
+  nextSequence    = 0 ;
+  cacheValid      = false ;
+
+  samplerPause() ;
+  enabled = SPIFFS.begin() ;
+  if ( enabled )
+    dir = SPIFFS.openDir(FLASH_LOG_PREFIX) ;
+  samplerResume() ;
+
+  while ( enabled && dir.next() )
+  {
+    uint32_t sequence = strtoul(dir.fileName().c_str() + strlen(FLASH_LOG_PREFIX), NULL, 16) ;
+
+    oldestSequence  = !found || sequence < oldestSequence ? sequence : oldestSequence ;
+    nextSequence    = !found || sequence >= nextSequence ? sequence + 1 : nextSequence ;
+    found           = true ;
+  }
+
+  // Only the segment being written when the power was lost can be cut, the others are checked as they are read
+  while ( nextSequence != oldestSequence && !loadSegment(nextSequence - 1) )
+    removeSegment(--nextSequence) ;
+
+  readPosition = oldestSequence * FLASH_LOG_SEGMENT_VALUES ;
+  return enabled ;
+}
+
+/**
+ * \fn bool flashLogAppend( const int16_t *i_values )
+ * \param[in] i_values FLASH_LOG_SEGMENT_VALUES values to write as a new segment
+ * \return False if the segment could not be written, the values are then not in the log
+ * \brief Write a segment after the others, removing the oldest one first if the log is full
+*/
+bool flashLogAppend( const int16_t *i_values )
+{
+  char path[sizeof(FLASH_LOG_PREFIX) + 8] ;
+  FlashLogHeader header ;
+  File file ;
+  bool written ;
+
+  if ( !enabled )
+    return false ;
+  if ( nextSequence - oldestSequence >= FLASH_LOG_MAX_SEGMENTS )
+    dropOldestSegment() ;
+
+  memset(&header, 0, sizeof(header)) ;
+  header.magic    = FLASH_LOG_MAGIC ;
+  header.version  = FLASH_LOG_VERSION ;
+  header.sequence = nextSequence ;
+  header.crc      = crc32(i_values, FLASH_LOG_SEGMENT_VALUES * sizeof(int16_t)) ;
+  segmentPath(nextSequence, path) ;
+
+  samplerPause() ;
+  file    = SPIFFS.open(path, "w") ;
+  written = file && file.write((const uint8_t *) &header, sizeof(header)) == sizeof(header)
+          && file.write((const uint8_t *) i_values, FLASH_LOG_SEGMENT_VALUES * sizeof(int16_t)) == FLASH_LOG_SEGMENT_VALUES * sizeof(int16_t) ;
+  file.close() ;
+  if ( !written )
+    SPIFFS.remove(path) ;
+  samplerResume() ;
+
+  if ( written )
+    nextSequence++ ;
+  return written ;
+}
+
+bool flashLogEmpty( void )
+{
+  return readPosition == nextSequence * FLASH_LOG_SEGMENT_VALUES ;
+}
+
+/**
+ * \fn uint32_t flashLogFront( void )
+ * \return The position of the oldest value not consumed, after skipping the segments that cannot be read
+*/
+uint32_t flashLogFront( void )
+{
+  while ( !flashLogEmpty() && !loadSegment(readPosition / FLASH_LOG_SEGMENT_VALUES) )
+    dropOldestSegment() ;
+  return readPosition ;
+}
+
+/**
+ * \fn uint16_t flashLogSize( void )
+ * \return The number of values not consumed
+*/
+uint16_t flashLogSize( void )
+{
+  return nextSequence * FLASH_LOG_SEGMENT_VALUES - readPosition ;
+}
+
+/**
+ * \fn uint16_t flashLogPeek( uint32_t i_position, const int16_t **o_data )
+ * \param[in] i_position Position of the first value, from flashLogFront()
+ * \param[out] o_data First value, valid until the next call
+ * \return The number of values from i_position up to the end of their segment, 0 if the segment cannot be read
+*/
+uint16_t flashLogPeek( uint32_t i_position, const int16_t **o_data )
+{
+  uint32_t sequence = i_position / FLASH_LOG_SEGMENT_VALUES ;
+
+  if ( sequence < oldestSequence || sequence >= nextSequence || !loadSegment(sequence) )
+    return 0 ;
+  *o_data = &cacheValues[i_position % FLASH_LOG_SEGMENT_VALUES] ;
+  return FLASH_LOG_SEGMENT_VALUES - i_position % FLASH_LOG_SEGMENT_VALUES ;
+}
+
+/**
+ * \fn void flashLogConsume( uint32_t i_position )
+ * \param[in] i_position Position following the last value to free
+ * \brief Free the values before i_position, removing the segments whose values are all freed
+*/
+void flashLogConsume( uint32_t i_position )
+{
+  uint32_t end = nextSequence * FLASH_LOG_SEGMENT_VALUES ;
+
+  if ( (int32_t) ( i_position - readPosition ) <= 0 )
+    return ;
+  readPosition = i_position < end ? i_position : end ;
+  while ( oldestSequence < readPosition / FLASH_LOG_SEGMENT_VALUES )
+    removeSegment(oldestSequence++) ;
+}
+
+/**
+ * \fn uint32_t flashLogDropped( void )
+ * \return The number of values removed from the log before being consumed, because it was full or corrupted
+*/
+uint32_t flashLogDropped( void )
+{
+  return droppedCount ;
+}
@@ -0,0 +1,35 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#define FLASH_LOG_PREFIX          "/log/"  /*!< Path of the segments, followed by their sequence number in hexadecimal */
+#define FLASH_LOG_SEGMENT_VALUES  112      /*!< Values in a segment, so that a segment and its header fit in one SPIFFS page */
+#define FLASH_LOG_MAX_SEGMENTS    128      /*!< Segments kept before the oldest is dropped, about 7.6 hours of values */
+#define FLASH_LOG_MAGIC           0x4C4E   /*!< First bytes of a segment, "NL" */
+#define FLASH_LOG_VERSION         1
+
+/**
+ * \struct FlashLogHeader
+ * \brief Header of a segment, followed by its FLASH_LOG_SEGMENT_VALUES values
+*/
+struct FlashLogHeader
+{
+  uint16_t magic ;
+  uint8_t  version ;
+  uint8_t  reserved ;
+  uint32_t sequence ;  /*!< Number of the segment, also in its path */
+  uint32_t crc ;       /*!< CRC-32 of the values */
+} ;
+
+bool flashLogBegin( void ) ;
+bool flashLogAppend( const int16_t *i_values ) ;
+bool flashLogEmpty( void ) ;
+uint32_t flashLogFront( void ) ;
+uint16_t flashLogSize( void ) ;
+uint16_t flashLogPeek( uint32_t i_position, const int16_t **o_data ) ;
+void flashLogConsume( uint32_t i_position ) ;
+uint32_t flashLogDropped( void ) ;
+
+#endif
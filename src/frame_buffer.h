@@ -0,0 +1,84 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <stdint.h>
+#include <Adafruit_NeoPixel.h>
+
+/**
+ * \class FrameBuffer
+ * \brief Double buffer in front of a LED strip, which only sends the pixels that changed and skips identical frames
+ *
+ * The frame being built (back buffer) is compared with the last frame sent to the strip (front buffer). setPixel()
+ * keeps the range of pixels that may differ, so that show() only has to look at that range, and does not call the
+ * show() of the strip, which disables interrupts while it bit-bangs the data, when no pixel changed.
+*/
+template<uint16_t N> class FrameBuffer
+{
+  public:
+    FrameBuffer( Adafruit_NeoPixel &i_pixels ) : m_pixels(i_pixels), m_dirtyBegin(N), m_dirtyEnd(0), m_framesPushed(0), m_framesSkipped(0)
+    {
+      for ( uint16_t iPixel = 0 ; iPixel < N ; iPixel++ )
+        m_back[iPixel] = m_front[iPixel] = 0 ;
+    }
+
+    /**
+     * \fn void setPixel( uint16_t i_pixel, uint32_t i_color )
+     * \param[in] i_pixel Index of the pixel, between 0 and N - 1
+     * \param[in] i_color Color as packed by Adafruit_NeoPixel::Color()
+     * \brief Set the color of a pixel in the frame being built
+    */
+    void setPixel( uint16_t i_pixel, uint32_t i_color )
+    {
+      m_back[i_pixel] = i_color ;
+      if ( i_color != m_front[i_pixel] )
+      {
+        m_dirtyBegin  = i_pixel < m_dirtyBegin ? i_pixel : m_dirtyBegin ;
+        m_dirtyEnd    = i_pixel >= m_dirtyEnd ? i_pixel + 1 : m_dirtyEnd ;
+      }
+    }
+
+    /**
+     * \fn bool show( void )
+     * \return True if the frame was sent to the strip, false if it was identical to the last one
+     * \brief Send the pixels of the frame being built that differ from the strip, then show the strip
+    */
+    bool show( void )
+    {
+      bool changed = false ;
+
+      for ( uint16_t iPixel = m_dirtyBegin ; iPixel < m_dirtyEnd ; iPixel++ )
+      {
+        if ( m_back[iPixel] != m_front[iPixel] )
+        {
+          m_front[iPixel] = m_back[iPixel] ;
+          m_pixels.setPixelColor(iPixel, m_back[iPixel]) ;
+          changed = true ;
+        }
+      }
+      m_dirtyBegin  = N ;
+      m_dirtyEnd    = 0 ;
+
+      if ( !changed )
+      {
+        m_framesSkipped++ ;
+        return false ;
+      }
+      m_pixels.show() ;
+      m_framesPushed++ ;
+      return true ;
+    }
+
+    uint32_t framesPushed( void ) const { return m_framesPushed ; }
+    uint32_t framesSkipped( void ) const { return m_framesSkipped ; }
+
+  private:
+    Adafruit_NeoPixel  &m_pixels ;
+    uint32_t            m_back[N] ;     /*!< Frame being built */
+    uint32_t            m_front[N] ;    /*!< Last frame sent to the strip */
+    uint16_t            m_dirtyBegin ;  /*!< First pixel that may differ between the two frames */
+    uint16_t            m_dirtyEnd ;    /*!< One past the last pixel that may differ between the two frames */
+    uint32_t            m_framesPushed ;
+    uint32_t            m_framesSkipped ;
+} ;
+
+#endif
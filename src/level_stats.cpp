@@ -0,0 +1,127 @@
+/**
+  \file level_stats.cpp
+  \brief Percentile levels of the sound over each upload interval, from a histogram of constant size
+
+  measure() adds the level of each window to the histogram of the current interval. Once the interval is over, its
+  summary, with the levels of the octave bands of spectrum.cpp over the interval, is queued for the uploader and the
+  histogram starts again : the memory used does not depend on the length of
+  the interval, and the percentiles are within LEVEL_STATS_BIN_WIDTH of the exact ones.
+*/
+#include "level_stats.h"
+#include <Arduino.h>
+
+SpscRing<LevelSummary, LEVEL_STATS_NB_SUMMARIES, SPSC_OVERWRITE_OLDEST> levelSummaries ;
+
+static LevelHistogram histogram ;
+static uint32_t       startMillis = 0 ;  /*!< When the current interval started */
+
+
+/**
+ * \fn void levelHistogramClear( LevelHistogram *o_histogram )
+ * \brief Empty a histogram
+*/
+void levelHistogramClear( LevelHistogram *o_histogram )
+{
+  memset(o_histogram->counts, 0, sizeof(o_histogram->counts)) ;
+  o_histogram->nbLevels = 0 ;
+  o_histogram->min      = INT16_MAX ;
+  o_histogram->max      = INT16_MIN ;
+}
+
+/**
+ * \fn void levelHistogramAdd( LevelHistogram *io_histogram, int16_t i_level )
+ * \param[in] i_level Level to count, in tenths of dB
+ * \brief Count a level in its bin, nothing is counted once the histogram is full
+*/
+void levelHistogramAdd( LevelHistogram *io_histogram, int16_t i_level )
+{
+  int16_t iBin = i_level < 0 ? 0 : i_level / LEVEL_STATS_BIN_WIDTH ;
+
+  if ( io_histogram->nbLevels == UINT16_MAX )
+    return ;
+
+  iBin = iBin < LEVEL_STATS_NB_BINS ? iBin : LEVEL_STATS_NB_BINS - 1 ;
+  io_histogram->counts[iBin]++ ;
+  io_histogram->nbLevels++ ;
+  io_histogram->min = i_level < io_histogram->min ? i_level : io_histogram->min ;
+  io_histogram->max = i_level > io_histogram->max ? i_level : io_histogram->max ;
+}
+
+/**
+ * \fn int16_t levelHistogramPercentile( const LevelHistogram *i_histogram, uint8_t i_percent )
+ * \param[in] i_percent Percentage of the levels, from 1 to 100
+ * \return The level that i_percent of the levels do not exceed, in tenths of dB, 0 if the histogram is empty
+ * \brief Find the bin of the level of rank ceil(i_percent * nbLevels / 100), and interpolate in it as if its levels were evenly spread
+*/
+int16_t levelHistogramPercentile( const LevelHistogram *i_histogram, uint8_t i_percent )
+{
+  uint32_t rank = ( (uint32_t) i_percent * i_histogram->nbLevels + 99 ) / 100 ;
+  uint32_t cumulated = 0 ;
+  uint16_t iBin = 0 ;
+  int32_t  level ;
+
+  if ( i_histogram->nbLevels == 0 )
+    return 0 ;
+  rank = rank > 0 ? rank : 1 ;
+
+  while ( cumulated + i_histogram->counts[iBin] < rank )
+    cumulated += i_histogram->counts[iBin++] ;
+
+  // Middle of the share of the bin of the level of that rank
+  level = iBin * LEVEL_STATS_BIN_WIDTH + ( ( 2 * ( rank - cumulated ) - 1 ) * LEVEL_STATS_BIN_WIDTH ) / ( 2 * i_histogram->counts[iBin] ) ;
+  level = level > i_histogram->min ? level : i_histogram->min ;
+  level = level < i_histogram->max ? level : i_histogram->max ;
+  return level ;
+}
+
+/**
+ * \fn void levelHistogramSummary( const LevelHistogram *i_histogram, LevelSummary *o_summary )
+ * \brief Percentile levels and extremes of a histogram, all 0 if it is empty, the bands are left to 0
+*/
+void levelHistogramSummary( const LevelHistogram *i_histogram, LevelSummary *o_summary )
+{
+  bool empty = i_histogram->nbLevels == 0 ;
+
+  o_summary->nbLevels = i_histogram->nbLevels ;
+  o_summary->min      = empty ? 0 : i_histogram->min ;
+  o_summary->l90      = levelHistogramPercentile(i_histogram, 10) ;
+  o_summary->l50      = levelHistogramPercentile(i_histogram, 50) ;
+  o_summary->l10      = levelHistogramPercentile(i_histogram, 90) ;
+  o_summary->max      = empty ? 0 : i_histogram->max ;
+  memset(o_summary->bands, 0, sizeof(o_summary->bands)) ;
+}
+
+/**
+ * \fn void levelStatsBegin( void )
+ * \brief Start the first interval, the summaries not uploaded yet are kept
+*/
+void levelStatsBegin( void )
+{
+  levelHistogramClear(&histogram) ;
+  startMillis = millis() ;
+}
+
+/**
+ * \fn void levelStatsAdd( int16_t i_level, int32_t i_interval )
+ * \param[in] i_level Level of the last window of measure(), in tenths of dB(A)
+ * \param[in] i_interval Length of an interval, the delay between two uploads, in ms
+ * \brief Count a level in the current interval, and queue the summary of the interval once it is over
+ *
+ * Called from measure() only. When the uploader cannot keep up, the oldest summary is dropped.
+*/
+void levelStatsAdd( int16_t i_level, int32_t i_interval )
+{
+  levelHistogramAdd(&histogram, i_level) ;
+
+  if ( millis() - startMillis >= (uint32_t) i_interval )
+  {
+    LevelSummary summary ;
+
+    levelHistogramSummary(&histogram, &summary) ;
+    spectrumReadBands(summary.bands) ;
+    summary.endMillis = millis() ;
+    levelSummaries.push(summary) ;
+    levelHistogramClear(&histogram) ;
+    startMillis = summary.endMillis ;
+  }
+}
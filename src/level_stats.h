@@ -0,0 +1,58 @@
+/**
+  \file level_stats.h
+  \brief Percentile levels of the sound over each upload interval, from a histogram of constant size
+*/
+#ifndef LEVEL_STATS_H
+#define LEVEL_STATS_H
+
+#include <stdint.h>
+#include "spsc_ring.h"
+#include "spectrum.h"
+
+#define LEVEL_STATS_BIN_WIDTH     5     /*!< Width of a bin of the histogram, in tenths of dB */
+#define LEVEL_STATS_NB_BINS       256   /*!< Number of bins, from 0 dB : levels above the last bin are counted in it */
+#define LEVEL_STATS_NB_SUMMARIES  8     /*!< Size of the queue of summaries waiting to be uploaded, a power of two */
+
+/**
+ * \struct LevelHistogram
+ * \brief Number of levels in each bin of LEVEL_STATS_BIN_WIDTH, with the exact extremes
+*/
+struct LevelHistogram
+{
+  uint16_t  counts[LEVEL_STATS_NB_BINS] ; /*!< Saturate at UINT16_MAX, about 87 min of levels from measure() */
+  uint16_t  nbLevels ;
+  int16_t   min ;
+  int16_t   max ;
+} ;
+
+/**
+ * \struct LevelSummary
+ * \brief Statistics of the levels of one interval, in tenths of dB(A)
+ *
+ * L10 is the level exceeded during 10% of the interval, L50 and L90 during half and 90% of it. The octave bands are
+ * not A-weighted.
+*/
+struct LevelSummary
+{
+  uint32_t  endMillis ;   /*!< millis() when the interval ended */
+  uint16_t  nbLevels ;
+  int16_t   min ;
+  int16_t   l90 ;
+  int16_t   l50 ;
+  int16_t   l10 ;
+  int16_t   max ;
+  int16_t   bands[SPECTRUM_NB_BANDS] ; /*!< Equivalent level of each octave band of spectrum.h, in tenths of dB */
+} ;
+
+void levelHistogramClear( LevelHistogram *o_histogram ) ;
+void levelHistogramAdd( LevelHistogram *io_histogram, int16_t i_level ) ;
+int16_t levelHistogramPercentile( const LevelHistogram *i_histogram, uint8_t i_percent ) ;
+void levelHistogramSummary( const LevelHistogram *i_histogram, LevelSummary *o_summary ) ;
+
+void levelStatsBegin( void ) ;
+void levelStatsAdd( int16_t i_level, int32_t i_interval ) ;
+
+// Filled by measure() at the end of each interval, emptied by the uploader in loop()
+extern SpscRing<LevelSummary, LEVEL_STATS_NB_SUMMARIES, SPSC_OVERWRITE_OLDEST> levelSummaries ;
+
+#endif
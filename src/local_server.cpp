@@ -0,0 +1,433 @@
+/**
+  \file local_server.cpp
+  \brief HTTP server on the LAN giving the levels, the last values and the counters of the board without the cloud
+
+  GET /levels      Leq and octave bands of the last window of measure()
+  GET /values?n=N  Last N values of noiseBufferServer, uploaded or not, oldest first
+  GET /metrics     Runs, misses and jitter of the tasks of the scheduler, failed uploads, and the probes if built with
+                   PROBE_ENABLE
+  GET /events      Server-Sent Events stream of the levels, one event per new window of measure()
+
+  Like the uploader, the server advances by one short step per loop() and never waits for a client : a step accepts
+  the new connections, reads the bytes of the requests that arrived, answers the complete ones and sends the new event
+  to the streams. Every response is chunked and written from a buffer of LOCAL_SERVER_SIZE_CHUNK bytes on the stack,
+  the values straight from the ring buffer, so that clients polling the board do not allocate from the heap.
+*/
+#include "local_server.h"
+#include <ESP8266WiFi.h>
+#include <stdarg.h>
+#include "probe.h"
+#include "scheduler.h"
+#include "server.h"
+#include "spectrum.h"
+#include "uploader.h"
+
+/**
+ * \enum LocalClientState
+ * \brief Step a slot of client is at
+*/
+enum LocalClientState
+{
+  LOCAL_CLIENT_FREE,    /*!< No client */
+  LOCAL_CLIENT_REQUEST, /*!< Receiving the request */
+  LOCAL_CLIENT_EVENTS   /*!< Streaming the events */
+} ;
+
+/**
+ * \struct LocalClient
+ * \brief A client of the server and its request
+*/
+struct LocalClient
+{
+  WiFiClient        client ;
+  LocalClientState  state ;
+  char              request[LOCAL_SERVER_SIZE_REQUEST] ; /*!< Start of the request, null-terminated */
+  uint16_t          length ;      /*!< Bytes of the request received so far */
+  uint8_t           endMatched ;  /*!< Bytes of the blank line ending the headers matched so far */
+  uint32_t          startMillis ;
+  uint32_t          sequence ;    /*!< Sequence of the last event sent */
+} ;
+
+/**
+ * \struct LocalChunk
+ * \brief Text of a response, sent as one chunk whenever the buffer is full
+*/
+struct LocalChunk
+{
+  WiFiClient  *client ;
+  char        buffer[6 + LOCAL_SERVER_SIZE_CHUNK + 2] ; /*!< Room for the size of the chunk before the text and its CRLF after */
+  uint16_t    length ;
+} ;
+
+#define LOCAL_CHUNK_HEADER 6
+
+static WiFiServer   localServer(LOCAL_SERVER_PORT) ;
+static LocalClient  clients[LOCAL_SERVER_MAX_CLIENTS] ;
+static int16_t      publishedLevel    = 0 ;
+static uint32_t     publishedMillis   = 0 ;
+static uint32_t     publishedSequence = 0 ;   /*!< Number of windows published by measure() */
+static uint32_t     nbRequests        = 0 ;
+static uint32_t     nbRejected        = 0 ;
+
+
+/**
+ * \fn void chunkFlush( LocalChunk *io_chunk )
+ * \brief Write the text of the chunk with its size and CRLF in a single write, then empty it
+*/
+static void chunkFlush( LocalChunk *io_chunk )
+{
+  char header[LOCAL_CHUNK_HEADER + 1] ;
+  uint8_t headerLength ;
+
+  if ( io_chunk->length == 0 )
+    return ;
+  headerLength = snprintf(header, sizeof(header), "%x\r\n", io_chunk->length) ;
+  memcpy(io_chunk->buffer + LOCAL_CHUNK_HEADER - headerLength, header, headerLength) ;
+  memcpy(io_chunk->buffer + LOCAL_CHUNK_HEADER + io_chunk->length, "\r\n", 2) ;
+  io_chunk->client->write((const uint8_t *) io_chunk->buffer + LOCAL_CHUNK_HEADER - headerLength, headerLength + io_chunk->length + 2) ;
+  io_chunk->length = 0 ;
+}
+
+/**
+ * \fn void chunkPrintf( LocalChunk *io_chunk, const char *i_format, ... )
+ * \brief Append formatted text to the chunk, sending the chunk first if the text does not fit in what is left of it
+*/
+static void chunkPrintf( LocalChunk *io_chunk, const char *i_format, ... ) __attribute__((format(printf, 2, 3))) ;
+static void chunkPrintf( LocalChunk *io_chunk, const char *i_format, ... )
+{
+  for ( uint8_t iTry = 0 ; iTry < 2 ; iTry++ )
+  {
+    char *text = io_chunk->buffer + LOCAL_CHUNK_HEADER + io_chunk->length ;
+    size_t room = LOCAL_SERVER_SIZE_CHUNK - io_chunk->length ;
+    va_list args ;
+    int length ;
+
+    va_start(args, i_format) ;
+    length = vsnprintf(text, room + 1, i_format, args) ;
+    va_end(args) ;
+    if ( length >= 0 && (size_t) length <= room )
+    {
+      io_chunk->length += length ;
+      return ;
+    }
+    chunkFlush(io_chunk) ;
+  }
+}
+
+/**
+ * \fn void writeHeaders( WiFiClient *io_client, int16_t i_code, const char *i_contentType )
+ * \brief Write the status line and the headers of a chunked response
+*/
+static void writeHeaders( WiFiClient *io_client, int16_t i_code, const char *i_contentType )
+{
+  char headers[224] ;
+  const char *reason = i_code == 200 ? "OK" : ( i_code == 404 ? "Not Found" : ( i_code == 503 ? "Service Unavailable" : "Bad Request" ) ) ;
+  size_t length ;
+
+  length = snprintf(headers, sizeof(headers), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\nCache-Control: no-cache\r\n"
+                    "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n", i_code, reason, i_contentType) ;
+  io_client->write((const uint8_t *) headers, length) ;
+}
+
+/**
+ * \fn void endResponse( LocalClient *io_slot, LocalChunk *io_chunk )
+ * \brief Send the last chunk of the response and close the connection
+*/
+static void endResponse( LocalClient *io_slot, LocalChunk *io_chunk )
+{
+  chunkFlush(io_chunk) ;
+  io_slot->client.write((const uint8_t *) "0\r\n\r\n", 5) ;
+  io_slot->client.stop() ;
+  io_slot->state = LOCAL_CLIENT_FREE ;
+}
+
+/**
+ * \fn void printLevels( LocalChunk *io_chunk )
+ * \brief Append the last levels published, in tenths of dB(A) for the Leq and in tenths of dB for the bands
+*/
+static void printLevels( LocalChunk *io_chunk )
+{
+  const int16_t *bands = spectrumLevels() ;
+
+  chunkPrintf(io_chunk, "{\"age\":%u,\"leq\":%d,\"bands\":[", (unsigned) ( millis() - publishedMillis ), publishedLevel) ;
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+    chunkPrintf(io_chunk, "%s%d", iBand == 0 ? "" : ",", bands[iBand]) ;
+  chunkPrintf(io_chunk, "]}") ;
+}
+
+/**
+ * \fn void printValues( LocalChunk *io_chunk, uint32_t i_nbValues )
+ * \brief Append the last values of noiseBufferServer, read in place
+ *
+ * The values already uploaded are still in the ring until they are overwritten. updateColor() runs from loop(), not
+ * while they are written, but the response still says whether the oldest ones were overwritten.
+*/
+static void printValues( LocalChunk *io_chunk, uint32_t i_nbValues )
+{
+  uint32_t back = noiseBufferServer.back(), position ;
+
+  i_nbValues  = i_nbValues < SERVER_SIZE_BUFFER_DATA - 1 ? i_nbValues : SERVER_SIZE_BUFFER_DATA - 1 ;
+  i_nbValues  = i_nbValues < back ? i_nbValues : back ;
+  position    = back - i_nbValues ;
+
+  chunkPrintf(io_chunk, "{\"values\":[") ;
+  for ( uint32_t iValue = 0 ; iValue < i_nbValues ; )
+  {
+    const int16_t *data ;
+    uint16_t nbData = noiseBufferServer.peek(position + iValue, &data) ;
+
+    if ( nbData == 0 )
+      break ;
+    for ( uint16_t iData = 0 ; iData < nbData && iValue < i_nbValues ; iData++, iValue++ )
+      chunkPrintf(io_chunk, "%s%d", iValue == 0 ? "" : ",", data[iData]) ;
+  }
+  chunkPrintf(io_chunk, "],\"overwritten\":%s}", noiseBufferServer.intact(position) ? "false" : "true") ;
+}
+
+/**
+ * \fn void printMetrics( LocalChunk *io_chunk )
+ * \brief Append the counters of the scheduler, of the uploader and of this server, and the probes when built with them
+*/
+static void printMetrics( LocalChunk *io_chunk )
+{
+  chunkPrintf(io_chunk, "{\"millis\":%lu,\"uploadFailures\":%u,\"uploadRejected\":%u,\"requests\":%u,\"rejected\":%u,\"tasks\":{",
+              (unsigned long) millis(), uploaderFailures(), uploaderRejected(), nbRequests, nbRejected) ;
+  for ( uint8_t iTask = 0 ; iTask < schedulerNbTasks() ; iTask++ )
+  {
+    const SchedulerTask *task = schedulerTask(iTask) ;
+
+    chunkPrintf(io_chunk, "%s\"%s\":{\"runs\":%u,\"misses\":%u,\"maxJitter\":%u,\"maxDuration\":%u}", iTask == 0 ? "" : ",",
+                task->name, task->nbRuns, task->nbMisses, task->maxJitterUs, task->maxDurationUs) ;
+  }
+  chunkPrintf(io_chunk, "}") ;
+
+#ifdef PROBE_ENABLE
+  ProbeSummary summary ;
+
+  chunkPrintf(io_chunk, ",\"probes\":{") ;
+  for ( uint8_t iProbe = 0 ; iProbe < PROBE_NB_PROBES ; iProbe++ )
+  {
+    probeSummarize(iProbe, &summary) ;
+    chunkPrintf(io_chunk, "\"%s\":[%u,%u,%u,%u,%u,%u],", probeName(iProbe), summary.nbCalls, summary.min, summary.mean, summary.p99, summary.max, summary.jitter) ;
+  }
+  chunkPrintf(io_chunk, "\"heap\":[%u,%u]}", probeMinFreeHeap(), probeMaxFragmentation()) ;
+#endif
+
+  chunkPrintf(io_chunk, "}") ;
+}
+
+/**
+ * \fn void answer( LocalClient *io_slot )
+ * \brief Answer the complete request of a client, or start its stream of events
+*/
+static void answer( LocalClient *io_slot )
+{
+  LocalChunk chunk ;
+  char *path = io_slot->request + 4, *query ;
+
+  chunk.client  = &io_slot->client ;
+  chunk.length  = 0 ;
+  nbRequests++ ;
+
+  if ( strncmp(io_slot->request, "GET ", 4) != 0 || strchr(path, ' ') == NULL )
+  {
+    writeHeaders(&io_slot->client, 400, "text/plain") ;
+    chunkPrintf(&chunk, "only GET is served\n") ;
+    endResponse(io_slot, &chunk) ;
+    return ;
+  }
+  *strchr(path, ' ') = '\0' ;
+  query = strchr(path, '?') ;
+  if ( query != NULL )
+    *query++ = '\0' ;
+
+  if ( strcmp(path, "/events") == 0 )
+  {
+    writeHeaders(&io_slot->client, 200, "text/event-stream") ;
+    io_slot->sequence = publishedSequence - 1 ;
+    io_slot->state    = LOCAL_CLIENT_EVENTS ;
+    return ;
+  }
+
+  if ( strcmp(path, "/levels") == 0 )
+  {
+    writeHeaders(&io_slot->client, 200, "application/json") ;
+    printLevels(&chunk) ;
+  }
+  else if ( strcmp(path, "/values") == 0 )
+  {
+    long nbValues = query != NULL && strncmp(query, "n=", 2) == 0 ? strtol(query + 2, NULL, 10) : LOCAL_SERVER_DEFAULT_VALUES ;
+
+    writeHeaders(&io_slot->client, 200, "application/json") ;
+    printValues(&chunk, nbValues > 0 ? nbValues : 0) ;
+  }
+  else if ( strcmp(path, "/metrics") == 0 )
+  {
+    writeHeaders(&io_slot->client, 200, "application/json") ;
+    printMetrics(&chunk) ;
+  }
+  else
+  {
+    writeHeaders(&io_slot->client, 404, "text/plain") ;
+    chunkPrintf(&chunk, "/levels /values?n= /metrics /events\n") ;
+  }
+  endResponse(io_slot, &chunk) ;
+}
+
+/**
+ * \fn void receive( LocalClient *io_slot )
+ * \brief Read the bytes of the request that arrived, and answer it once its headers are complete
+*/
+static void receive( LocalClient *io_slot )
+{
+  static const char endHeaders[] = "\r\n\r\n" ;
+  uint8_t buffer[64] ;
+  int length ;
+
+  while ( ( length = io_slot->client.read(buffer, sizeof(buffer)) ) > 0 )
+  {
+    for ( int iByte = 0 ; iByte < length ; iByte++ )
+    {
+      if ( io_slot->length < LOCAL_SERVER_SIZE_REQUEST - 1 )
+        io_slot->request[io_slot->length] = buffer[iByte] ;
+      io_slot->length++ ;
+      io_slot->endMatched = buffer[iByte] == endHeaders[io_slot->endMatched] ? io_slot->endMatched + 1 : ( buffer[iByte] == '\r' ? 1 : 0 ) ;
+      if ( io_slot->endMatched == 4 )
+      {
+        io_slot->request[io_slot->length < LOCAL_SERVER_SIZE_REQUEST ? io_slot->length : LOCAL_SERVER_SIZE_REQUEST - 1] = '\0' ;
+        answer(io_slot) ;
+        return ;
+      }
+    }
+    if ( io_slot->length > LOCAL_SERVER_MAX_REQUEST )
+      break ;
+  }
+
+  if ( io_slot->length > LOCAL_SERVER_MAX_REQUEST || !io_slot->client.connected() || millis() - io_slot->startMillis > LOCAL_SERVER_TIMEOUT_MS )
+  {
+    io_slot->client.stop() ;
+    io_slot->state = LOCAL_CLIENT_FREE ;
+  }
+}
+
+/**
+ * \fn void sendEvent( LocalClient *io_slot )
+ * \brief Send the last levels to a stream of events if measure() published new ones since its last event
+ *
+ * A stream that cannot keep up gets the last levels only, the windows in between are not queued.
+*/
+static void sendEvent( LocalClient *io_slot )
+{
+  LocalChunk chunk ;
+
+  if ( !io_slot->client.connected() )
+  {
+    io_slot->client.stop() ;
+    io_slot->state = LOCAL_CLIENT_FREE ;
+    return ;
+  }
+  if ( io_slot->sequence == publishedSequence )
+    return ;
+
+  chunk.client  = &io_slot->client ;
+  chunk.length  = 0 ;
+  chunkPrintf(&chunk, "id: %u\ndata: ", publishedSequence) ;
+  printLevels(&chunk) ;
+  chunkPrintf(&chunk, "\n\n") ;
+  chunkFlush(&chunk) ;
+  io_slot->sequence = publishedSequence ;
+}
+
+/**
+ * \fn void localServerBegin( void )
+ * \brief Start listening on LOCAL_SERVER_PORT, once the network is connected : the portal of WiFiManager needs the port
+*/
+void localServerBegin( void )
+{
+  for ( uint8_t iClient = 0 ; iClient < LOCAL_SERVER_MAX_CLIENTS ; iClient++ )
+  {
+    clients[iClient].client.stop() ;
+    clients[iClient].state = LOCAL_CLIENT_FREE ;
+  }
+  nbRequests = 0 ;
+  nbRejected = 0 ;
+  localServer.begin() ;
+  localServer.setNoDelay(true) ;
+}
+
+/**
+ * \fn void localServerStop( void )
+ * \brief Close the clients and stop listening, so that the portal of WiFiManager can open on LOCAL_SERVER_PORT
+*/
+void localServerStop( void )
+{
+  for ( uint8_t iClient = 0 ; iClient < LOCAL_SERVER_MAX_CLIENTS ; iClient++ )
+  {
+    clients[iClient].client.stop() ;
+    clients[iClient].state = LOCAL_CLIENT_FREE ;
+  }
+  localServer.stop() ;
+}
+
+/**
+ * \fn void localServerStep( void )
+ * \brief Accept the new clients, answer the requests received and send the new event to the streams, from each loop()
+*/
+void localServerStep( void )
+{
+  WiFiClient client = localServer.available() ;
+
+  if ( client )
+  {
+    LocalClient *slot = NULL ;
+
+    for ( uint8_t iClient = 0 ; iClient < LOCAL_SERVER_MAX_CLIENTS && slot == NULL ; iClient++ )
+      slot = clients[iClient].state == LOCAL_CLIENT_FREE ? &clients[iClient] : NULL ;
+
+    if ( slot == NULL )
+    {
+      nbRejected++ ;
+      writeHeaders(&client, 503, "text/plain") ;
+      client.write((const uint8_t *) "0\r\n\r\n", 5) ;
+      client.stop() ;
+    }
+    else
+    {
+      slot->client      = client ;
+      slot->state       = LOCAL_CLIENT_REQUEST ;
+      slot->length      = 0 ;
+      slot->endMatched  = 0 ;
+      slot->startMillis = millis() ;
+    }
+  }
+
+  for ( uint8_t iClient = 0 ; iClient < LOCAL_SERVER_MAX_CLIENTS ; iClient++ )
+  {
+    if ( clients[iClient].state == LOCAL_CLIENT_REQUEST )
+      receive(&clients[iClient]) ;
+    else if ( clients[iClient].state == LOCAL_CLIENT_EVENTS )
+      sendEvent(&clients[iClient]) ;
+  }
+}
+
+/**
+ * \fn void localServerPublish( int16_t i_level )
+ * \param[in] i_level Leq of the window, in tenths of dB(A)
+ * \brief Publish the levels of a new window to the streams of events, called by measure()
+*/
+void localServerPublish( int16_t i_level )
+{
+  publishedLevel  = i_level ;
+  publishedMillis = millis() ;
+  publishedSequence++ ;
+}
+
+uint32_t localServerRequests( void )
+{
+  return nbRequests ;
+}
+
+uint32_t localServerRejected( void )
+{
+  return nbRejected ;
+}
@@ -0,0 +1,22 @@
+#ifndef LOCAL_SERVER_H
+#define LOCAL_SERVER_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#define LOCAL_SERVER_PORT           80    /*!< TCP port of the HTTP server on the LAN */
+#define LOCAL_SERVER_MAX_CLIENTS    4     /*!< Clients served at the same time, the streams of events included */
+#define LOCAL_SERVER_SIZE_REQUEST   64    /*!< Bytes kept from the start of a request, enough for its request line */
+#define LOCAL_SERVER_MAX_REQUEST    1024  /*!< Size of the headers of a request above which it is rejected */
+#define LOCAL_SERVER_SIZE_CHUNK     256   /*!< Maximum size of a chunk of a response, written at once */
+#define LOCAL_SERVER_TIMEOUT_MS     5000  /*!< Time given to a client to send its request, in ms */
+#define LOCAL_SERVER_DEFAULT_VALUES 20    /*!< Values of /values when the request does not give n */
+
+void localServerBegin( void ) ;
+void localServerStop( void ) ;
+void localServerStep( void ) ;
+void localServerPublish( int16_t i_level ) ;
+uint32_t localServerRequests( void ) ;
+uint32_t localServerRejected( void ) ;
+
+#endif
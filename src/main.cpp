@@ -6,8 +6,6 @@
 #include <Arduino.h>
 #include <Ticker.h>
 #include <Adafruit_NeoPixel.h>
-#include <ArduinoJson.h>
-#include <EEPROM.h>
 // Libraries for the ESP
 #include <ESP8266WiFi.h>
 // WifiManager with its dependencies
@@ -17,22 +15,59 @@
 
 #include "color.h"
 #include "config.h"
+#include "level_stats.h"
+#include "local_server.h"
+#include "probe.h"
+#include "registration.h"
+#include "report.h"
+#include "sampler.h"
+#include "scheduler.h"
 #include "server.h"
+#include "snapshot.h"
+#include "sound_meter.h"
+#include "spectrum.h"
+#include "strip.h"
+#include "uploader.h"
 
 #define HOST_API "noisey"
-#define NUMPIXELS      24 /*!< The number of pixels in the LED strip */
+#ifndef NUMPIXELS
+#define NUMPIXELS      24 /*!< The number of pixels in the LED strip, can be set by the build flags */
+#endif
+#ifndef PIN_NEOPIXEL
 #define PIN_NEOPIXEL   12 /*!< The PIN linked to the data input of the LED */
-#define SCALE_DELTA    10 /*!< Number of bits to shift the value of hue to apply delta between current and next values */
+#endif
+// A second strip showing the same animations is driven when the build flags define NUMPIXELS_2 and PIN_NEOPIXEL_2
+#ifndef SCALE_DELTA
+#define SCALE_DELTA    10 /*!< Number of bits to shift the value of hue to apply delta between current and next values, can be set by the build flags */
+#endif
+#ifndef RUNNING_AVERAGE_FACTOR_OLD
+#define RUNNING_AVERAGE_FACTOR_OLD 230 /*!< Weight of the old value in the running averages, out of 256, can be set by the build flags */
+#endif
+#define BOOT_WIFI_TIMEOUT_MS  30000 /*!< Time given to the saved network to associate before opening the portal, in ms */
+#define REGISTER_RETRY_MS     30000 /*!< Delay between two attempts to register the device with the server, in ms */
+#define LOOP_STALL_MS         80    /*!< Time without loop() after which a Ticker runs the scheduler, while the portal blocks loop() */
+#define SPECTRUM_DISPLAY_MIN  300   /*!< Level of a band lighting none of its LEDs, in tenths of dB */
+#define SPECTRUM_DISPLAY_MAX  800   /*!< Level of a band lighting all of its LEDs, in tenths of dB */
 
 const int16_t delayAnimation            = 80 ;                                /*!< Delay betwwen two states of the animation of the LED strip, in ms */
-const int32_t delayUpdateValue          = NUMPIXELS * delayAnimation ;        /*!< Delay betwwen two updates of the color to be displayed, in ms */
+const int32_t delayUpdateValue          = STRIP_FRAMES_PER_TURN * delayAnimation ; /*!< Delay betwwen two updates of the color to be displayed, in ms */
 const int16_t nbAnimationBetweenUpdates = delayUpdateValue / delayAnimation ; /*!< Number of animations of the LED strip between two updates of the color */
+// Phases of the tasks in the period of animate() : measure() and the interrupt-disabled show() of animate() never share a slot
+const uint32_t phaseMeasure             = 0 ;
+const uint32_t phaseUpdateColor         = delayAnimation / 4 ;
+const uint32_t phaseAnimate             = delayAnimation / 2 ;
+const uint32_t phaseLED                 = delayAnimation * 3 / 4 ;
+const int32_t delayReportMin            = configDelayDataServer[2] ;          /*!< Shortest delay between two uploads of the adaptive mode, the fastest fixed rate, in ms */
 const int16_t runningAverageBitScale    = 8 ;                                 /*!< The number of bits for the running average factor */
-const int16_t runningAverageFactorOld   = 230 ;                               /*!< The factor to apply to the old value for the running average */
+const int16_t runningAverageFactorOld   = RUNNING_AVERAGE_FACTOR_OLD ;        /*!< The factor to apply to the old value for the running average */
 const int16_t runningAverageFactorNew   = (1 << runningAverageBitScale) - runningAverageFactorOld ; /*!< The factor to apply to the new value for the running average */
+// Range of each setting of a config, in the order of RegistrationField, the one of the thresholds applying to each of them
+const int32_t settingsMin[REGISTRATION_NB_FIELDS] = { configOffsetMin, configSensitivityServerMin, configBrightnessServerMin, configDelayDataServerMin,
+                                                      configDisplayWheel, 0, INT16_MIN, 0, 0 } ;
+const int32_t settingsMax[REGISTRATION_NB_FIELDS] = { configOffsetMax, configSensitivityServerMax, configBrightnessServerMax, configDelayDataServerMax,
+                                                      configDisplaySpectrum, UINT8_MAX, INT16_MAX, UINT8_MAX, INT32_MAX } ;
 
 char shortID[7]     = {'\0'} ;
-byte wheelpos       = 0 ;
 int16_t sample      = 0 ;
 int16_t runningAverage = 0 ;
 int16_t previousRunningAverage = 0 ;
@@ -40,14 +75,34 @@ int16_t maxValueRunningAverage = 0 ;
 int16_t previousMaxValueRunningAverage = 0 ;
 int32_t shiftedHue  = 120 << SCALE_DELTA ;
 int16_t deltaHue    = 0 ;
+int16_t hue         = 120 ;  /*!< Hue of the wheel shown by the last animate() */
+int16_t levelDecibels = 0 ; /*!< A-weighted equivalent sound level over the last window of measure(), in tenths of dB(A) */
 
 int8_t  offsetSignal ;
 int8_t  sensitivitySignal ;
 int32_t delayDataServer ;   /*!< Delay betwwen two POST requests to the distant server, in ms */
-uint8_t brightness ;
+int8_t  brightness ;       /*!< Brightness level of the LED strip, as set on the server */
+int8_t  displayMode ;      /*!< configDisplayWheel or configDisplaySpectrum */
+PyramidTier uploadTier  = PYRAMID_RAW ; /*!< Tier of value_pyramid.h uploaded away from a change, aggregates of a minute at the slowest rate */
+bool    registered        = false ; /*!< Whether the server confirmed shortID since the boot */
+uint32_t firstSampleMillis = 0 ;    /*!< millis() when measure() first got samples : the time to first sample after a boot */
+uint32_t wifiStartMillis   = 0 ;    /*!< When the association with the saved network started */
+uint32_t wifiTimeoutMillis = 0 ;    /*!< Time given to the association before opening the portal */
+uint32_t registerMillis    = 0 ;    /*!< When the last attempt to register started */
+bool    registerAttempted = false ;
+bool    localServerStarted = false ; /*!< Whether the local server listens, only while the portal of WiFiManager is closed */
+int32_t rejectedSettingsVersion = -1 ; /*!< Version of the last config of the server with a setting out of range, -1 if none */
 
 Adafruit_NeoPixel pixels = Adafruit_NeoPixel(NUMPIXELS, PIN_NEOPIXEL, NEO_GRB + NEO_KHZ800);
-Ticker tickerLED, tickerMeasure, tickerUpdateColor, tickerAnimate ;
+Strip<NUMPIXELS> strip(pixels) ;
+#ifdef NUMPIXELS_2
+Adafruit_NeoPixel pixels2 = Adafruit_NeoPixel(NUMPIXELS_2, PIN_NEOPIXEL_2, NEO_GRB + NEO_KHZ800);
+Strip<NUMPIXELS_2> strip2(pixels2) ;
+#endif
+Ticker tickerScheduler ;
+int8_t taskLED ;                    /*!< Task blinking the built-in LED, faster until the device is registered */
+uint32_t loopMillis        = 0 ;    /*!< When loop() last started */
+bool inPortal              = false ; /*!< Whether the portal of WiFiManager blocks loop() */
 
 /**
  * \fn void tick()
@@ -71,69 +126,127 @@ void configModeCallback (WiFiManager *myWiFiManager)
   Serial.println("Entered config mode");
   Serial.println(WiFi.softAPIP());
   Serial.println(myWiFiManager->getConfigPortalSSID());
-  tickerLED.attach(0.2, tick);
+  schedulerSetPeriod(taskLED, 200) ;
+}
+
+/**
+ * \fn void rescueScheduler()
+ * \brief Run the tasks from a Ticker while the portal of WiFiManager blocks loop()
+ *
+ * Only the portal, which blocks for minutes, is rescued. Shorter stalls, such as a TLS handshake, delay the tasks until
+ * the next loop() : measure() and animate() must not preempt the uploader or the local server from the system context.
+*/
+void rescueScheduler()
+{
+  if ( inPortal && millis() - loopMillis >= LOOP_STALL_MS )
+    schedulerRun() ;
+}
+
+/**
+ * \fn void animateSpectrum()
+ * \brief Show the octave bands of the last window of measure() on the LED strips
+ *
+ * Each band is a bar of consecutive LEDs, lit from the first one in proportion to its level between
+ * SPECTRUM_DISPLAY_MIN and SPECTRUM_DISPLAY_MAX, in a color going from green to red as the level rises.
+*/
+void animateSpectrum()
+{
+  const int16_t *levels = spectrumLevels() ;
+  uint8_t fractions[SPECTRUM_NB_BANDS] ;
+  uint32_t colors[SPECTRUM_NB_BANDS] ;
+
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+  {
+    int16_t level = levels[iBand] < SPECTRUM_DISPLAY_MIN ? SPECTRUM_DISPLAY_MIN : ( levels[iBand] > SPECTRUM_DISPLAY_MAX ? SPECTRUM_DISPLAY_MAX : levels[iBand] ) ;
+
+    fractions[iBand]  = (int32_t) ( level - SPECTRUM_DISPLAY_MIN ) * 255 / ( SPECTRUM_DISPLAY_MAX - SPECTRUM_DISPLAY_MIN ) ;
+    colors[iBand]     = hueToColor(120 - 120 * ( level - SPECTRUM_DISPLAY_MIN ) / ( SPECTRUM_DISPLAY_MAX - SPECTRUM_DISPLAY_MIN ), brightness) ;
+  }
+
+  strip.renderBars(fractions, colors, SPECTRUM_NB_BANDS, pixels.Color(0, 0, 0)) ;
+  strip.show() ;
+#ifdef NUMPIXELS_2
+  strip2.renderBars(fractions, colors, SPECTRUM_NB_BANDS, pixels.Color(0, 0, 0)) ;
+  strip2.show() ;
+#endif
 }
 
 /**
  * \fn void animate()
- * \brief Animate the LED strip
+ * \brief Animate the LED strips
  *
- * Animate the LED strip according to the following rules :
- *   - light the LEDs between wheelpos and wheelpos+11 (modulo the number of LEDs in the strip)
+ * Animate the LED strips according to the following rules :
+ *   - light half of the LEDs, from the position of the wheel on
  *   - do not light other LEDs
- * The current color of the LED strip is updated at each call with the delta computed periodically. At the end, increment the position of the beginning of the wheel (wheelpos).
+ * The current color of the LED strip is updated at each call with the delta computed periodically. The wheel makes a
+ * turn in STRIP_FRAMES_PER_TURN calls, whatever the length of the strip.
 */
 void animate()
 {
-  uint8_t red, green, blue ;
-  int16_t hue ;
+  PROBE_SCOPE(PROBE_ANIMATE) ;
   uint32_t colorOn, colorOff ;
 
-  // Update the hue and create the color corresponding
+  if ( displayMode == configDisplaySpectrum )
+  {
+    animateSpectrum() ;
+    return ;
+  }
+
+  // Update the hue and look up the color corresponding
   shiftedHue += deltaHue ;
   hue = shiftedHue >> SCALE_DELTA ;
-  HSBToRGB(hue, 255, brightness, &red, &green, &blue) ;
-  colorOn   = pixels.Color(red, green, blue);
+  colorOn   = hueToColor(hue, brightness) ;
   colorOff  = pixels.Color(0, 0, 0);
 
-  // Set the colors for each pixel of the strip. Half will be lighted, the other half no.
-  for ( byte i = 0 ; i < NUMPIXELS >> 1 ; i++ )
-  {
-    pixels.setPixelColor(( wheelpos + i ) % NUMPIXELS, colorOn ) ;
-    pixels.setPixelColor(( wheelpos - i + NUMPIXELS ) % NUMPIXELS, colorOff ) ;
-  }
-
-  // Show the current state of pixels and update the wheel position
-  pixels.show();
-  wheelpos = ( wheelpos + 1 ) % ( NUMPIXELS - 1 ) ;
+  // Build the frame of the wheel and show the pixels that changed, if any
+  strip.renderWheel(colorOn, colorOff) ;
+  strip.show() ;
+#ifdef NUMPIXELS_2
+  strip2.renderWheel(colorOn, colorOff) ;
+  strip2.show() ;
+#endif
 }
 
 /**
  * \fn int measure()
  * \brief Measure the average and max strength of the signal over a window and over long periods of time
  *
- * During the width of the window, get a value from the ADC and update the average for this set of samples. At the end, update the running averages of the average and max values of the signal.
+ * Consume the blocks of samples filled by the sampler since the last call, which form the window, and compute the average and max of the signal over it. At the end, update the running averages of the average and max values of the signal.
+ * The samples also go through the A-weighting filter of the sound meter, and the level of the window is counted in the
+ * percentile levels of the upload interval. The octave bands are computed over the last SPECTRUM_SIZE samples, and the
+ * levels are published to the local server.
 */
 void measure()
 {
-  unsigned long startMillis   = millis() ;
-  int16_t numberSamples = 0 ;
+  PROBE_SCOPE(PROBE_MEASURE) ;
+  const SampleBlock *block ;
+  int32_t numberSamples = 0 ;
   int32_t sampleSum     = 0 ;
   int16_t sampleAverage = 0 ;
   int32_t runningAverageUnscaled ;
   int16_t maxLvl = 0 ;
 
-  // Sample window width in mS
-  while ( millis() - startMillis < 20 )
+  while ( ( block = samplerPeekBlock() ) != NULL )
   {
-    int16_t sample = analogRead(A0);
-    numberSamples++ ;
-    sampleSum += sample ;
-
-    maxLvl = sample > maxLvl ? sample : maxLvl ;
+    numberSamples += SAMPLER_BLOCK_SIZE ;
+    sampleSum     += block->sum ;
+    maxLvl = block->max > maxLvl ? block->max : maxLvl ;
+    soundMeterProcess(block->samples, SAMPLER_BLOCK_SIZE) ;
+    spectrumAddSamples(block->samples, SAMPLER_BLOCK_SIZE) ;
+    samplerReleaseBlock() ;
   }
 
+  if ( numberSamples == 0 )
+    return ;
+  if ( firstSampleMillis == 0 )
+    firstSampleMillis = millis() ;
+  levelDecibels = soundMeterLeq() ;
+  spectrumUpdate() ;
+  levelStatsAdd(levelDecibels, delayDataServer) ;
+  localServerPublish(levelDecibels) ;
+
   sampleAverage           = sampleSum / numberSamples ;
+  snapshotAdd(levelDecibels, maxLvl - sampleAverage) ;
   // Running average for the average value of samples
   runningAverageUnscaled  = sampleAverage * runningAverageFactorNew + runningAverage * runningAverageFactorOld ;
   runningAverage          = runningAverageUnscaled >> runningAverageBitScale ;
@@ -148,6 +261,7 @@ void measure()
 */
 void updateColor()
 {
+  PROBE_SCOPE(PROBE_UPDATE_COLOR) ;
   int16_t nextHue ;
 
   // Compute the value of the next hue and delta between current and next hue
@@ -156,7 +270,10 @@ void updateColor()
   nextHue = map(-nextHue, -120, 0, 0, 120); // Map the strength of the signal to a hue value : green is at 120 and red at 0
   deltaHue = ( (nextHue << SCALE_DELTA) - shiftedHue ) / nbAnimationBetweenUpdates ;
 
+#ifndef SERVER_STATS_ONLY
   addDataSendServer(maxValueRunningAverage - runningAverage) ;
+#endif
+  reportValue(maxValueRunningAverage - runningAverage) ;
 
   // Update the previous values of the running averages
   previousRunningAverage          = runningAverage ;
@@ -164,106 +281,331 @@ void updateColor()
 }
 
 /**
- * \fn void setup()
- * \brief
+ * \fn void applySettings()
+ * \brief Use the settings in memory, at the boot or when the server changes them
 */
-void setup()
+void applySettings()
 {
-  WiFiManager wifiManager;
-  String response ;
-  StaticJsonBuffer<256> jsonBuffer;
-  int16_t HTTPCode ;
-  bool changeInMemory = false ;
+  int16_t thresholds[CONFIG_NB_THRESHOLDS] ;
+  uint8_t nbThresholds = readThresholdsFromMemory(thresholds) ;
 
-  // Initialize serial communication, Wifi Manager and the pin of the built-in LED as an output pin
-  Serial.begin(9600);
-  pinMode(BUILTIN_LED, OUTPUT);
-  wifiManager.setAPCallback(configModeCallback);
-  wifiManager.setDebugOutput(true) ;
+  // Set together without yielding, so that a Ticker running the tasks sees either the old settings or the new ones
+  offsetSignal      = readOffsetFromMemory() ;
+  sensitivitySignal = readSensitivityFromMemory() ;
+  delayDataServer   = readDelayDataServerFromMemory() ;
+  brightness        = readBrightnessServerFromMemory() ;
+  displayMode       = readDisplayFromMemory() ;
+  Serial.printf("Sensi %d, offset %d, delay %d, brightness %d, display %d\n", sensitivitySignal, offsetSignal, delayDataServer, brightness, displayMode) ;
 
-  // Initiate LED strip
-  pixels.begin();
-  pixels.show() ;
+  // The coarsest tier that still shows the trend, which the adaptive mode only sends away from a change
+  uploadTier = pyramidTierFor(delayDataServer, delayUpdateValue) ;
 
-  EEPROM.begin(64) ;
+  // The fixed rates upload every delayDataServer, the adaptive one as soon as the value changes and at least as often
+  if ( readAdaptiveFromMemory() )
+  {
+    reportConfigure(delayDataServer, delayReportMin, readDeadbandFromMemory(), thresholds, nbThresholds, uploadTier) ;
+    Serial.printf("Adaptive upload, deadband %u, %u thresholds\n", readDeadbandFromMemory(), nbThresholds) ;
+  }
+  else
+    reportConfigure(delayDataServer, delayDataServer, REPORT_DEADBAND_OFF, NULL, 0, uploadTier) ;
+  if ( uploadTier != PYRAMID_RAW )
+    Serial.printf("Upload of aggregates of %u values\n", pyramidSpan(uploadTier)) ;
 
-  // Start blinking the built-in LED repeatedly
-  tickerLED.attach(0.6, tick);
+  // The windows of measure() around a loud event are uploaded apart, when the server set a level
+  if ( readSnapshotLevelFromMemory() != configSnapshotOff )
+  {
+    snapshotConfigure(readSnapshotLevelFromMemory() * 10) ;
+    Serial.printf("Snapshots above %u dB(A)\n", readSnapshotLevelFromMemory()) ;
+  }
+  else
+    snapshotConfigure(SNAPSHOT_OFF) ;
+}
+
+/**
+ * \fn bool settingInRange( uint8_t i_field, int32_t i_value )
+ * \param[in] i_field RegistrationField of the setting
+ * \param[in] i_value Value of the setting in the config, or of one of its thresholds
+ * \return True if the value fits the range of the setting
+*/
+bool settingInRange( uint8_t i_field, int32_t i_value )
+{
+  if ( i_value >= settingsMin[i_field] && i_value <= settingsMax[i_field] )
+    return true ;
+  Serial.printf("Setting %u out of range : %d, config ignored\n", i_field, i_value) ;
+  return false ;
+}
+
+/**
+ * \fn bool writeSettings( const RegistrationResponse *i_settings )
+ * \param[in] i_settings Config of a response of the server
+ * \return False if a setting of the config was out of its range, none of them being then stored
+ * \brief Store in memory the settings present in the config, the others keep their value
+ *
+ * The values are checked before they are narrowed to the types of the memory, where "updateRate":257 would be 1 : a
+ * config is stored as a whole or not at all.
+*/
+bool writeSettings( const RegistrationResponse *i_settings )
+{
+  int16_t thresholds[CONFIG_NB_THRESHOLDS] ;
 
-  // Tries to autoconnect to a network called "Noisey"
-  if ( !wifiManager.autoConnect( "Noisey", getAPPassword().c_str() ) )
+  for ( uint8_t iField = 0 ; iField < REGISTRATION_NB_FIELDS ; iField++ )
+    if ( iField != REGISTRATION_THRESHOLDS && ( i_settings->fields & REGISTRATION_FIELD(iField) )
+         && !settingInRange(iField, i_settings->values[iField]) )
+      return false ;
+  for ( uint8_t iThreshold = 0 ; iThreshold < i_settings->nbThresholds ; iThreshold++ )
   {
-    Serial.println(F("failed to connect and hit timeout"));
-    ESP.reset();
-    delay(1000);
+    if ( !settingInRange(REGISTRATION_THRESHOLDS, i_settings->thresholds[iThreshold]) )
+      return false ;
+    thresholds[iThreshold] = i_settings->thresholds[iThreshold] ;
   }
 
-  // If it managed to connect, send a message to the server
-  char messageToApi[256] ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_OFFSET) )
+    writeOffsetToMemory(i_settings->values[REGISTRATION_OFFSET]) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_SENSITIVITY) )
+    writeSensitivityToMemory(i_settings->values[REGISTRATION_SENSITIVITY]) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_UPDATE_RATE) )
+    writeDelayDataServerToMemory(i_settings->values[REGISTRATION_UPDATE_RATE]) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_LUMINOSITY) )
+    writeBrightnessToMemory(i_settings->values[REGISTRATION_LUMINOSITY]) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_DISPLAY) )
+    writeDisplayToMemory(i_settings->values[REGISTRATION_DISPLAY]) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_DEADBAND) )
+    writeDeadbandToMemory(i_settings->values[REGISTRATION_DEADBAND]) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_THRESHOLDS) )
+    writeThresholdsToMemory(thresholds, i_settings->nbThresholds) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_SNAPSHOT) )
+    writeSnapshotLevelToMemory(i_settings->values[REGISTRATION_SNAPSHOT]) ;
+  if ( i_settings->fields & REGISTRATION_FIELD(REGISTRATION_VERSION) )
+    writeSettingsVersionToMemory(i_settings->values[REGISTRATION_VERSION]) ;
+  return true ;
+}
+
+/**
+ * \fn bool registerDevice()
+ * \return True if the server answered with the short ID of the device
+ * \brief Send the ID of the chip to the server, and store the short ID and the config it answers with
+ *
+ * The response is parsed as it is read, so that its size does not matter and that no heap is used.
+*/
+bool registerDevice()
+{
+  RegistrationResponse registration ;
+  int16_t HTTPCode ;
+  char messageToApi[32] ;
+
   sprintf(messageToApi, "{\"id\":\"%d\"}", ESP.getChipId() ) ;
   Serial.printf("Connected to %s, sending ID to server.\n", WiFi.SSID().c_str() );
-  sendPostRequest(HOST_API, "/api/device/", messageToApi, &HTTPCode, &response);
+  registrationParseBegin(&registration) ;
+  sendPostRequestStream(HOST_API, "/api/device/", messageToApi, &HTTPCode, registrationParse) ;
+  PROBE_HEAP() ;
 
-  // If the server answered
-  if ( HTTPCode == 200 )
+  if ( HTTPCode != 200 )
   {
-    JsonObject& root = jsonBuffer.parseObject(response);
-    strncpy(shortID, root["shortID"], 6) ;
-    Serial.printf("Received short ID from server %s\n", shortID) ;
-
-    // Get the config from the message or the EEPROM if not in the message
-    JsonVariant serverOffset      = root["config"]["offset"] ;
-    JsonVariant serverSensitivity = root["config"]["sensitivity"] ;
-    JsonVariant serverBrightness  = root["config"]["luminosity"] ;
-    JsonVariant serverDelayDataServer   = root["config"]["updateRate"] ;
-    if (serverOffset.success() )
-      changeInMemory |= writeOffsetToMemory(root["config"]["offset"]) ;
-    if (serverSensitivity.success() )
-      changeInMemory |= writeSensitivityToMemory(root["config"]["sensitivity"]) ;
-    if (serverDelayDataServer.success() )
-      changeInMemory |= writeDelayDataServerToMemory(root["config"]["updateRate"]) ;
-    if (serverBrightness.success() )
-      changeInMemory |= writeBrightnessToMemory(root["config"]["luminosity"]) ;
-
-    if ( changeInMemory )
-      EEPROM.commit() ;
+    Serial.printf("Communication with server failed, code %d\n", HTTPCode) ;
+    return false ;
   }
-  else
+  if ( !registrationParseEnd() )
   {
-    Serial.printf("Communication with server failed, code %d, message %s\n", HTTPCode, response.c_str() ) ;
+    Serial.println(F("Malformed response from server, or no short ID")) ;
+    return false ;
   }
 
-  offsetSignal      = readOffsetFromMemory() ;
-  sensitivitySignal = readSensitivityFromMemory() ;
-  delayDataServer   = readDelayDataServerFromMemory() ;
-  brightness        = readBrightnessFromMemory() ;
-  Serial.printf("Sensi %d, offset %d, delay %d, brightness %d\n", sensitivitySignal, offsetSignal, delayDataServer, brightness) ;
+  memcpy(shortID, registration.shortID, sizeof(shortID)) ;
+  Serial.printf("Received short ID from server %s\n", shortID) ;
+  writeShortIDToMemory(shortID) ;
+
+  // Get the config from the message, or from the EEPROM if not in the message or out of range
+  writeSettings(&registration) ;
+
+  // Only the settings that changed, or were migrated from an older firmware, cost an erase of the EEPROM sector
+  configCommit() ;
+  applySettings() ;
+  return true ;
+}
+
+/**
+ * \fn void updateSettings()
+ * \brief Apply and store the settings the server answered an upload with, if their version changed
+ *
+ * The server may send the same settings with several responses : the ones of the version already applied, or already
+ * rejected as out of range, are ignored, so that the EEPROM is only written when the version changes. The settings take effect with the next window
+ * of measure(), without a reboot nor a new registration.
+*/
+void updateSettings()
+{
+  RegistrationResponse settings ;
+
+  if ( !uploaderSettings(&settings) || (uint32_t) settings.values[REGISTRATION_VERSION] == readSettingsVersionFromMemory()
+       || settings.values[REGISTRATION_VERSION] == rejectedSettingsVersion )
+    return ;
+
+  Serial.printf("Settings version %u from the server\n", (uint32_t) settings.values[REGISTRATION_VERSION]) ;
+  if ( !writeSettings(&settings) )
+  {
+    rejectedSettingsVersion = settings.values[REGISTRATION_VERSION] ;
+    return ;
+  }
+  applySettings() ;
+  configCommit() ;
+}
 
-  // Perform a first measure to initialize the running averages
+/**
+ * \fn bool connectAndRegister()
+ * \return True once the device is registered
+ * \brief Advance the connection to the network and the registration of the device, from loop() until they succeed
+ *
+ * The saved network has BOOT_WIFI_TIMEOUT_MS to associate, after which WiFiManager opens its portal : it blocks, but
+ * rescueScheduler() keeps animating meanwhile, as inPortal is set. The sampler is held during the portal, which saves the network to the flash. The registration is retried every REGISTER_RETRY_MS.
+*/
+bool connectAndRegister()
+{
+  if ( WiFi.status() != WL_CONNECTED )
+  {
+    WiFiManager wifiManager;
+    char password[configPasswordMaxLength + 1] ;
+
+    if ( millis() - wifiStartMillis < wifiTimeoutMillis )
+      return false ;
+
+    // The portal listens on the port of the local server
+    if ( localServerStarted )
+    {
+      localServerStop() ;
+      localServerStarted = false ;
+    }
+
+    // Tries to autoconnect to a network called "Noisey", the sampler being held while the SDK may save the network to
+    // the flash
+    wifiManager.setAPCallback(configModeCallback);
+    wifiManager.setDebugOutput(true) ;
+    getAPPassword(password) ;
+    samplerPause() ;
+    inPortal = true ;
+    if ( !wifiManager.autoConnect( "Noisey", password ) )
+    {
+      Serial.println(F("failed to connect and hit timeout"));
+      ESP.reset();
+      delay(1000);
+    }
+    inPortal = false ;
+    samplerResume() ;
+  }
+
+  if ( registerAttempted && millis() - registerMillis < REGISTER_RETRY_MS )
+    return false ;
+  registerAttempted = true ;
+  registerMillis    = millis() ;
+  if ( !registerDevice() )
+    return false ;
+
+  Serial.printf("Registered %lu ms after the boot\n", millis()) ;
+  schedulerSetPeriod(taskLED, delayUpdateValue) ;
+  return true ;
+}
+
+/**
+ * \fn void setup()
+ * \brief Start measuring and animating with the settings in memory, then connect in the background
+ *
+ * The short ID and the settings of the last registration are restored from the EEPROM, so that the strip shows the
+ * noise within milliseconds of a boot. The values measured until loop() registers the device again are kept in the
+ * buffer, and in the flash log if it takes long.
+*/
+void setup()
+{
+  // Initialize serial communication and the pin of the built-in LED as an output pin
+  Serial.begin(9600);
+  pinMode(BUILTIN_LED, OUTPUT);
+
+  // Initiate LED strips
+  pixels.begin();
+  pixels.show() ;
+#ifdef NUMPIXELS_2
+  pixels2.begin();
+  pixels2.show() ;
+#endif
+
+  configBegin() ;
+  strncpy(shortID, readShortIDFromMemory(), 6) ;
+  Serial.printf("Short ID of the last registration %s\n", shortID) ;
+  applySettings() ;
+
+  // Values logged to flash during a previous outage are sent with the next uploads
+  if ( !flashLogBegin() )
+    Serial.println(F("failed to mount the file system, values are lost while the server cannot be reached")) ;
+
+  // Start sampling and perform a first measure to initialize the running averages
+  soundMeterBegin() ;
+  spectrumBegin() ;
+  levelStatsBegin() ;
+  snapshotBegin() ;
+  samplerBegin() ;
+  delay(delayAnimation) ;
   measure() ;
   previousRunningAverage          = runningAverage ;
   previousMaxValueRunningAverage  = maxValueRunningAverage ;
-
-  //
-  tickerLED.attach_ms(delayUpdateValue, tick);
-  tickerMeasure.attach_ms(delayAnimation, measure) ;
-  tickerAnimate.attach_ms(delayAnimation, animate) ;
-  tickerUpdateColor.attach_ms(delayUpdateValue, updateColor) ;
+  Serial.printf("Time to first sample %u ms\n", firstSampleMillis) ;
+
+  // Stagger the periodic jobs run by loop(), and blink the built-in LED repeatedly until the device is registered
+  schedulerBegin() ;
+  schedulerAdd("measure", measure, delayAnimation, phaseMeasure, delayAnimation / 2) ;
+  schedulerAdd("updateColor", updateColor, delayUpdateValue, phaseUpdateColor, delayAnimation / 4) ;
+  schedulerAdd("animate", animate, delayAnimation, phaseAnimate, delayAnimation / 4) ;
+  taskLED = schedulerAdd("LED", tick, 600, phaseLED, delayAnimation) ;
+  PROBE_PERIOD(PROBE_MEASURE, delayAnimation) ;
+  PROBE_PERIOD(PROBE_UPDATE_COLOR, delayUpdateValue) ;
+  PROBE_PERIOD(PROBE_ANIMATE, delayAnimation) ;
+  loopMillis = millis() ;
+  tickerScheduler.attach_ms(delayAnimation / 4, rescueScheduler) ;
+
+  // Connect to the saved network in the background, or open the portal at once if there is none. The SDK saves the mode
+  // to the flash, which the interrupt of the sampler must not preempt
+  samplerPause() ;
+  WiFi.mode(WIFI_STA) ;
+  WiFi.begin() ;
+  samplerResume() ;
+  registered        = false ;
+  registerAttempted = false ;
+  rejectedSettingsVersion = -1 ;
+  wifiStartMillis   = millis() ;
+  wifiTimeoutMillis = WiFi.SSID().length() > 0 ? BOOT_WIFI_TIMEOUT_MS : 0 ;
+  localServerStarted = false ;
 }
 
 
 /**
  * \fn void loop()
- * \brief
+ * \brief Run the periodic jobs that are due, then advance the registration or the upload and the local server by one step
 */
 void loop()
 {
-  static uint32_t lastEventMillis = 0 ;
+  loopMillis = millis() ;
+  schedulerRun() ;
 
-  if ( (uint32_t) (millis() - lastEventMillis) >= delayDataServer )
+  // The values are kept until the server confirms the short ID they are sent with
+  if ( !registered )
+    registered = connectAndRegister() ;
+  else if ( uploaderState() == UPLOADER_IDLE && !snapshotBusy() && reportDue() )
+  {
+    PyramidTier tier = reportStarted() ;
+
+#ifdef PROBE_ENABLE
+    probePrint() ;
+#endif
+    uploaderStart(HOST_API, shortID, delayUpdateValue, tier) ;
+  }
+  uploaderStep() ;
+  updateSettings() ;
+  // A snapshot only uses the connection between two uploads
+  if ( registered && uploaderState() == UPLOADER_IDLE )
+    snapshotStep(HOST_API, shortID, !reportDue()) ;
+  // Serve the levels and the counters on the LAN once the network is up, the portal of WiFiManager being closed then
+  if ( !localServerStarted && WiFi.status() == WL_CONNECTED )
   {
-    lastEventMillis = millis() ;
-    sendDataServer(HOST_API, shortID, delayUpdateValue) ;
+    localServerBegin() ;
+    localServerStarted = true ;
   }
+  if ( localServerStarted )
+    localServerStep() ;
   delay(1) ;
 }
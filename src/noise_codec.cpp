@@ -0,0 +1,201 @@
+/**
+  \file noise_codec.cpp
+  \brief Compact binary format for the noise values sent to /api/data/
+
+  A payload is made of :
+    - the magic bytes 'N' 'B', the version of the format and a byte of flags (NOISE_CODEC_FLAG_*)
+    - the short ID of the device on NOISE_CODEC_SHORT_ID_LENGTH bytes, padded with null characters
+    - the interval between two values in ms, the number of values in the buffer and in this payload, as varints
+    - with NOISE_CODEC_FLAG_SUMMARY, the summary of the levels of an interval : its age in ms and its number of levels
+      as varints, then min, L90, L50, L10 and max in tenths of dB(A) and, since version 3, the SPECTRUM_NB_BANDS
+      octave band levels in tenths of dB, as zigzag varints
+    - the values, each one as the zigzag varint of its difference with the previous one (the first with 0)
+  Varints are little-endian base 128 : 7 bits per byte, the high bit set on all bytes but the last one.
+*/
+#include "noise_codec.h"
+#include "level_stats.h"
+#include <string.h>
+
+/**
+ * \fn uint8_t * writeVarint( uint8_t *o_buffer, const uint8_t *i_end, uint32_t i_value )
+ * \return The position after the varint, or NULL if it does not fit before i_end
+*/
+static uint8_t * writeVarint( uint8_t *o_buffer, const uint8_t *i_end, uint32_t i_value )
+{
+  do
+  {
+    if ( o_buffer == NULL || o_buffer >= i_end )
+      return NULL ;
+    *o_buffer++ = ( i_value & 0x7F ) | ( i_value > 0x7F ? 0x80 : 0 ) ;
+    i_value >>= 7 ;
+  } while ( i_value != 0 ) ;
+  return o_buffer ;
+}
+
+/**
+ * \fn const uint8_t * readVarint( const uint8_t *i_buffer, const uint8_t *i_end, uint32_t *o_value )
+ * \return The position after the varint, or NULL if it is truncated or longer than 5 bytes
+*/
+static const uint8_t * readVarint( const uint8_t *i_buffer, const uint8_t *i_end, uint32_t *o_value )
+{
+  uint32_t value = 0 ;
+
+  for ( uint8_t shift = 0 ; shift < 35 && i_buffer != NULL && i_buffer < i_end ; shift += 7 )
+  {
+    uint8_t current = *i_buffer++ ;
+    value |= (uint32_t) ( current & 0x7F ) << shift ;
+    if ( ( current & 0x80 ) == 0 )
+    {
+      *o_value = value ;
+      return i_buffer ;
+    }
+  }
+  return NULL ;
+}
+
+static inline uint32_t zigzagEncode( int32_t i_value )
+{
+  return ( (uint32_t) i_value << 1 ) ^ (uint32_t) ( i_value >> 31 ) ;
+}
+
+static inline int32_t zigzagDecode( uint32_t i_value )
+{
+  return (int32_t) ( i_value >> 1 ) ^ -(int32_t) ( i_value & 1 ) ;
+}
+
+/**
+ * \fn size_t noiseCodecEncode( uint8_t *o_buffer, size_t i_size, const char *i_shortID, int32_t i_interval, uint16_t i_nbElements, bool i_first, const int16_t *i_values, uint16_t i_nbValues )
+ * \param[out] o_buffer Buffer to write the payload to
+ * \param[in] i_size Size of the buffer, NOISE_CODEC_SIZE_MAX(i_nbValues) is always enough
+ * \param[in] i_shortID ID of the device in short version
+ * \param[in] i_interval Delay between two values, in ms
+ * \param[in] i_nbElements Number of values in the buffer of the device when the upload started
+ * \param[in] i_first Whether this is the first message of the upload
+ * \param[in] i_values Values to send
+ * \param[in] i_nbValues Number of values to send
+ * \param[in] i_summary Summary of the levels of an interval to send with the values, NULL if none
+ * \param[in] i_summaryAge Time since the end of the interval of the summary, in ms
+ * \return The size of the payload, or 0 if it does not fit in the buffer
+ * \brief Encode noise values and their envelope in the binary format
+*/
+size_t noiseCodecEncode( uint8_t *o_buffer, size_t i_size, const char *i_shortID, int32_t i_interval, uint16_t i_nbElements, bool i_first, const int16_t *i_values, uint16_t i_nbValues, const LevelSummary *i_summary, uint32_t i_summaryAge )
+{
+  const uint8_t *end = o_buffer + i_size ;
+  uint8_t *position  = o_buffer ;
+  int16_t previous   = 0 ;
+
+  if ( i_size < 4 + NOISE_CODEC_SHORT_ID_LENGTH )
+    return 0 ;
+
+  *position++ = NOISE_CODEC_MAGIC_0 ;
+  *position++ = NOISE_CODEC_MAGIC_1 ;
+  *position++ = NOISE_CODEC_VERSION ;
+  *position++ = ( i_first ? NOISE_CODEC_FLAG_FIRST : 0 ) | ( i_summary != NULL ? NOISE_CODEC_FLAG_SUMMARY : 0 ) ;
+  strncpy((char *) position, i_shortID, NOISE_CODEC_SHORT_ID_LENGTH) ;
+  position += NOISE_CODEC_SHORT_ID_LENGTH ;
+
+  position = writeVarint(position, end, i_interval) ;
+  position = writeVarint(position, end, i_nbElements) ;
+  position = writeVarint(position, end, i_nbValues) ;
+
+  if ( i_summary != NULL )
+  {
+    position = writeVarint(position, end, i_summaryAge) ;
+    position = writeVarint(position, end, i_summary->nbLevels) ;
+    position = writeVarint(position, end, zigzagEncode(i_summary->min)) ;
+    position = writeVarint(position, end, zigzagEncode(i_summary->l90)) ;
+    position = writeVarint(position, end, zigzagEncode(i_summary->l50)) ;
+    position = writeVarint(position, end, zigzagEncode(i_summary->l10)) ;
+    position = writeVarint(position, end, zigzagEncode(i_summary->max)) ;
+    for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+      position = writeVarint(position, end, zigzagEncode(i_summary->bands[iBand])) ;
+  }
+
+  for ( uint16_t iValue = 0 ; iValue < i_nbValues ; iValue++ )
+  {
+    position = writeVarint(position, end, zigzagEncode((int32_t) i_values[iValue] - previous)) ;
+    previous = i_values[iValue] ;
+  }
+
+  return position != NULL ? position - o_buffer : 0 ;
+}
+
+/**
+ * \fn bool noiseCodecDecode( const uint8_t *i_buffer, size_t i_length, NoisePayloadHeader *o_header, int16_t *o_values, uint16_t i_maxValues, LevelSummary *o_summary )
+ * \param[in] i_buffer Payload to decode
+ * \param[in] i_length Size of the payload, in bytes
+ * \param[out] o_header Envelope of the payload
+ * \param[out] o_values Values of the payload
+ * \param[in] i_maxValues Maximum number of values that o_values can hold
+ * \param[out] o_summary Summary of the levels when the payload holds one, without its endMillis, its bands are 0 before
+ *                       version 3. May be NULL, the summary is then only checked
+ * \return True if the payload is valid and all its values were decoded
+ * \brief Decode a payload written by noiseCodecEncode()
+*/
+bool noiseCodecDecode( const uint8_t *i_buffer, size_t i_length, NoisePayloadHeader *o_header, int16_t *o_values, uint16_t i_maxValues, LevelSummary *o_summary )
+{
+  const uint8_t *end      = i_buffer + i_length ;
+  const uint8_t *position = i_buffer ;
+  uint32_t interval, nbElements, nbValues, delta ;
+  int32_t value = 0 ;
+
+  if ( i_length < 4 + NOISE_CODEC_SHORT_ID_LENGTH || i_buffer[0] != NOISE_CODEC_MAGIC_0 || i_buffer[1] != NOISE_CODEC_MAGIC_1 || i_buffer[2] < 1 || i_buffer[2] > NOISE_CODEC_VERSION )
+    return false ;
+
+  o_header->first       = ( i_buffer[3] & NOISE_CODEC_FLAG_FIRST ) != 0 ;
+  o_header->hasSummary  = ( i_buffer[3] & NOISE_CODEC_FLAG_SUMMARY ) != 0 ;
+  memcpy(o_header->shortID, i_buffer + 4, NOISE_CODEC_SHORT_ID_LENGTH) ;
+  o_header->shortID[NOISE_CODEC_SHORT_ID_LENGTH] = '\0' ;
+  position += 4 + NOISE_CODEC_SHORT_ID_LENGTH ;
+
+  position = readVarint(position, end, &interval) ;
+  position = readVarint(position, end, &nbElements) ;
+  position = readVarint(position, end, &nbValues) ;
+  if ( position == NULL || nbValues > i_maxValues || nbElements > UINT16_MAX )
+    return false ;
+
+  o_header->interval    = interval ;
+  o_header->nbElements  = nbElements ;
+  o_header->nbValues    = nbValues ;
+
+  if ( o_header->hasSummary )
+  {
+    LevelSummary summary ;
+    int16_t *levels[5 + SPECTRUM_NB_BANDS] = { &summary.min, &summary.l90, &summary.l50, &summary.l10, &summary.max } ;
+    uint8_t nbSummaryLevels = i_buffer[2] >= 3 ? 5 + SPECTRUM_NB_BANDS : 5 ;
+    uint32_t nbLevels, level ;
+
+    position = readVarint(position, end, &o_header->summaryAge) ;
+    position = readVarint(position, end, &nbLevels) ;
+    if ( position == NULL || nbLevels > UINT16_MAX )
+      return false ;
+    summary.endMillis = 0 ;
+    summary.nbLevels  = nbLevels ;
+    memset(summary.bands, 0, sizeof(summary.bands)) ;
+
+    for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+      levels[5 + iBand] = &summary.bands[iBand] ;
+    for ( uint8_t iLevel = 0 ; iLevel < nbSummaryLevels ; iLevel++ )
+    {
+      position = readVarint(position, end, &level) ;
+      if ( position == NULL || zigzagDecode(level) < INT16_MIN || zigzagDecode(level) > INT16_MAX )
+        return false ;
+      *levels[iLevel] = zigzagDecode(level) ;
+    }
+    if ( o_summary != NULL )
+      *o_summary = summary ;
+  }
+
+  for ( uint16_t iValue = 0 ; iValue < nbValues ; iValue++ )
+  {
+    position = readVarint(position, end, &delta) ;
+    if ( position == NULL )
+      return false ;
+    value += zigzagDecode(delta) ;
+    if ( value < INT16_MIN || value > INT16_MAX )
+      return false ;
+    o_values[iValue] = value ;
+  }
+
+  return position == end ;
+}
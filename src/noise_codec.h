@@ -0,0 +1,39 @@
+#ifndef NOISE_CODEC_H
+#define NOISE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "spectrum.h"
+
+struct LevelSummary ;
+
+#define NOISE_CODEC_MAGIC_0         'N'
+#define NOISE_CODEC_MAGIC_1         'B'
+#define NOISE_CODEC_VERSION         3   /*!< Version 2 added the summary of the levels, version 3 its octave bands, older payloads are still decoded */
+#define NOISE_CODEC_SHORT_ID_LENGTH 6   /*!< Length of the short ID of a device, sent without its terminating null character */
+#define NOISE_CODEC_FLAG_FIRST      0x01
+#define NOISE_CODEC_FLAG_SUMMARY    0x02 /*!< The header is followed by a summary of the levels */
+#define NOISE_CODEC_CONTENT_TYPE    "application/vnd.noisey.data" /*!< The version of the format is the third byte of the payload */
+#define NOISE_CODEC_SUMMARY_MAX     ( 5 + 3 + ( 5 + SPECTRUM_NB_BANDS ) * 3 ) /*!< Maximum size of the summary of the levels, in bytes */
+#define NOISE_CODEC_HEADER_MAX      ( 4 + NOISE_CODEC_SHORT_ID_LENGTH + 5 + 3 + 3 + NOISE_CODEC_SUMMARY_MAX ) /*!< Maximum size of the header, in bytes */
+#define NOISE_CODEC_SIZE_MAX(n)     ( NOISE_CODEC_HEADER_MAX + 3 * (n) ) /*!< Maximum size of a payload of n values, in bytes */
+
+/**
+ * \struct NoisePayloadHeader
+ * \brief Envelope of a binary payload, the same fields as the JSON message to /api/data/
+*/
+struct NoisePayloadHeader
+{
+  char      shortID[NOISE_CODEC_SHORT_ID_LENGTH + 1] ;
+  int32_t   interval ;    /*!< Delay between two values, in ms */
+  uint16_t  nbElements ;  /*!< Number of values in the buffer of the device when the upload started */
+  bool      first ;       /*!< Whether this is the first message of the upload */
+  uint16_t  nbValues ;    /*!< Number of values in this payload */
+  bool      hasSummary ;  /*!< Whether the payload holds a summary of the levels */
+  uint32_t  summaryAge ;  /*!< Time between the end of the interval of the summary and the encoding, in ms */
+} ;
+
+size_t noiseCodecEncode( uint8_t *o_buffer, size_t i_size, const char *i_shortID, int32_t i_interval, uint16_t i_nbElements, bool i_first, const int16_t *i_values, uint16_t i_nbValues, const LevelSummary *i_summary = NULL, uint32_t i_summaryAge = 0 ) ;
+bool noiseCodecDecode( const uint8_t *i_buffer, size_t i_length, NoisePayloadHeader *o_header, int16_t *o_values, uint16_t i_maxValues, LevelSummary *o_summary = NULL ) ;
+
+#endif
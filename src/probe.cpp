@@ -0,0 +1,222 @@
+/**
+  \file probe.cpp
+  \brief Statistics of the probes of probe.h, in fixed-size histograms
+
+  The durations are binned on a logarithmic scale : 2 ^ PROBE_SUB_BITS bins per power of two of the cycles, from
+  2 ^ PROBE_SHIFT cycles to the 53 s the cycle counter wraps after at 80 MHz. When a bin is full, all the bins of the
+  probe are halved, which keeps the shape of the histogram and so its percentiles.
+
+  The starts of the runs of a periodic probe are timed with micros(), which wraps after 71 min rather than 53 s, and
+  compared with its period : the spread of the raw periods since the boot would mostly measure the pauses of the
+  scheduler, and means nothing for a probe run on demand such as the uploader.
+
+  The free heap is sampled by PROBE_HEAP(), placed where the firmware holds its largest buffers and Strings. The
+  fragmentation walks the heap with the interrupts disabled, for a few tens of us, so it is only sampled there too.
+*/
+#include "probe.h"
+
+#ifdef PROBE_ENABLE
+
+extern "C" {
+#include <umm_malloc/umm_malloc.h>
+}
+
+/**
+ * \struct ProbeStats
+ * \brief Runs of a probe since the boot, in cycles
+*/
+struct ProbeStats
+{
+  uint32_t  nbCalls ;
+  uint32_t  minCycles ;
+  uint32_t  maxCycles ;
+  uint64_t  sumCycles ;
+  bool      timed ;         /*!< Whether lastStartMicros holds the start of a run since the period was set */
+  uint32_t  lastStartMicros ;
+  uint32_t  maxJitter ;     /*!< Largest gap between the time between the starts of two runs and the period, in us */
+  uint16_t  bins[PROBE_NB_BINS] ;
+} ;
+
+static const char * const names[PROBE_NB_PROBES] = { "measure", "animate", "updateColor", "upload" } ;
+
+static ProbeStats stats[PROBE_NB_PROBES] ;
+static uint32_t   periodsMicros[PROBE_NB_PROBES] ; /*!< Period of each probe, 0 if it runs on demand */
+static uint32_t   minFreeHeap       = UINT32_MAX ;
+static uint8_t    maxFragmentation  = 0 ;
+
+
+/**
+ * \fn uint8_t durationBin( uint32_t i_cycles )
+ * \return The bin of a duration
+*/
+static uint8_t durationBin( uint32_t i_cycles )
+{
+  uint32_t value = i_cycles >> PROBE_SHIFT ;
+  uint8_t exponent ;
+
+  if ( value < ( 1U << PROBE_SUB_BITS ) )
+    return value ;
+  exponent = 31 - __builtin_clz(value) ;
+  return ( ( exponent - PROBE_SUB_BITS + 1 ) << PROBE_SUB_BITS ) | ( ( value >> ( exponent - PROBE_SUB_BITS ) ) & ( ( 1U << PROBE_SUB_BITS ) - 1 ) ) ;
+}
+
+/**
+ * \fn uint64_t binUpperBound( uint8_t i_bin )
+ * \return The first duration in cycles above the bin, 2 ^ 32 for the last one
+*/
+static uint64_t binUpperBound( uint8_t i_bin )
+{
+  uint8_t exponent = ( i_bin >> PROBE_SUB_BITS ) + PROBE_SUB_BITS - 1 ;
+
+  if ( i_bin < ( 1U << PROBE_SUB_BITS ) )
+    return (uint64_t) ( i_bin + 1 ) << PROBE_SHIFT ;
+  return (uint64_t) ( ( ( 1U << PROBE_SUB_BITS ) | ( i_bin & ( ( 1U << PROBE_SUB_BITS ) - 1 ) ) ) + 1 ) << ( exponent - PROBE_SUB_BITS + PROBE_SHIFT ) ;
+}
+
+/**
+ * \fn void probeRecord( uint8_t i_probe, uint32_t i_startCycles, uint32_t i_endCycles )
+ * \param[in] i_probe ProbeId of the run
+ * \param[in] i_startCycles ESP.getCycleCount() when the run started
+ * \param[in] i_endCycles ESP.getCycleCount() when the run ended
+ * \brief Count a run in the statistics of its probe, called by ProbeScope
+*/
+void probeRecord( uint8_t i_probe, uint32_t i_startCycles, uint32_t i_endCycles )
+{
+  ProbeStats *probe = &stats[i_probe] ;
+  uint32_t cycles = i_endCycles - i_startCycles ;
+  uint8_t bin = durationBin(cycles) ;
+
+  if ( periodsMicros[i_probe] != 0 )
+  {
+    uint32_t startMicros = micros() - cycles / ESP.getCpuFreqMHz(), period = startMicros - probe->lastStartMicros ;
+    uint32_t jitter = period > periodsMicros[i_probe] ? period - periodsMicros[i_probe] : periodsMicros[i_probe] - period ;
+
+    if ( probe->timed )
+      probe->maxJitter = jitter > probe->maxJitter ? jitter : probe->maxJitter ;
+    probe->timed            = true ;
+    probe->lastStartMicros  = startMicros ;
+  }
+  if ( probe->nbCalls == 0 )
+    probe->minCycles = UINT32_MAX ;
+  probe->nbCalls++ ;
+  probe->sumCycles += cycles ;
+  probe->minCycles  = cycles < probe->minCycles ? cycles : probe->minCycles ;
+  probe->maxCycles  = cycles > probe->maxCycles ? cycles : probe->maxCycles ;
+
+  if ( probe->bins[bin] == UINT16_MAX )
+    for ( uint8_t iBin = 0 ; iBin < PROBE_NB_BINS ; iBin++ )
+      probe->bins[iBin] >>= 1 ;
+  probe->bins[bin]++ ;
+}
+
+/**
+ * \fn void probeSampleHeap( void )
+ * \brief Update the lowest free heap and the highest fragmentation seen, called by PROBE_HEAP()
+ *
+ * The fragmentation is the share of the free heap, in %, that the largest free block misses.
+*/
+void probeSampleHeap( void )
+{
+  uint32_t freeHeap = ESP.getFreeHeap() ;
+  uint8_t fragmentation ;
+
+  umm_info(NULL, 0) ;
+  fragmentation     = ummHeapInfo.freeBlocks == 0 ? 0 : 100 - (uint32_t) ummHeapInfo.maxFreeContiguousBlocks * 100 / ummHeapInfo.freeBlocks ;
+  minFreeHeap       = freeHeap < minFreeHeap ? freeHeap : minFreeHeap ;
+  maxFragmentation  = fragmentation > maxFragmentation ? fragmentation : maxFragmentation ;
+}
+
+/**
+ * \fn void probeSetPeriod( uint8_t i_probe, uint32_t i_periodMs )
+ * \param[in] i_probe ProbeId of a periodic job
+ * \param[in] i_periodMs Time between the starts of two runs of the job, 0 if it runs on demand
+ * \brief Set the period the jitter of a probe is measured against, called by PROBE_PERIOD(), from the next run on
+*/
+void probeSetPeriod( uint8_t i_probe, uint32_t i_periodMs )
+{
+  periodsMicros[i_probe] = i_periodMs * 1000 ;
+  stats[i_probe].timed   = false ;
+}
+
+/**
+ * \fn void probeSummarize( uint8_t i_probe, ProbeSummary *o_summary )
+ * \param[in] i_probe ProbeId to summarize
+ * \param[out] o_summary Statistics of the probe since the boot, all 0 if it never ran
+*/
+void probeSummarize( uint8_t i_probe, ProbeSummary *o_summary )
+{
+  const ProbeStats *probe = &stats[i_probe] ;
+  uint32_t cyclesPerMicro = ESP.getCpuFreqMHz(), total = 0, count = 0 ;
+  uint64_t p99 ;
+  uint8_t iBin ;
+
+  memset(o_summary, 0, sizeof(ProbeSummary)) ;
+  if ( probe->nbCalls == 0 )
+    return ;
+
+  for ( iBin = 0 ; iBin < PROBE_NB_BINS ; iBin++ )
+    total += probe->bins[iBin] ;
+  for ( iBin = 0 ; iBin < PROBE_NB_BINS - 1 && ( count += probe->bins[iBin] ) * 100ULL < total * 99ULL ; iBin++ )
+    ;
+  p99 = binUpperBound(iBin) ;
+  p99 = p99 < probe->maxCycles ? p99 : probe->maxCycles ;
+
+  o_summary->nbCalls  = probe->nbCalls ;
+  o_summary->min      = probe->minCycles / cyclesPerMicro ;
+  o_summary->mean     = probe->sumCycles / probe->nbCalls / cyclesPerMicro ;
+  o_summary->p99      = (uint32_t) p99 / cyclesPerMicro ;
+  o_summary->max      = probe->maxCycles / cyclesPerMicro ;
+  o_summary->jitter   = probe->maxJitter ;
+}
+
+const char * probeName( uint8_t i_probe )
+{
+  return i_probe < PROBE_NB_PROBES ? names[i_probe] : "" ;
+}
+
+/**
+ * \fn uint32_t probeMinFreeHeap( void )
+ * \return The lowest free heap sampled since the boot, in bytes, 0 if it was never sampled
+*/
+uint32_t probeMinFreeHeap( void )
+{
+  return minFreeHeap == UINT32_MAX ? 0 : minFreeHeap ;
+}
+
+/**
+ * \fn uint8_t probeMaxFragmentation( void )
+ * \return The highest fragmentation of the heap sampled since the boot, in %
+*/
+uint8_t probeMaxFragmentation( void )
+{
+  return maxFragmentation ;
+}
+
+/**
+ * \fn void probePrint( void )
+ * \brief Print one line per probe and one for the heap to Serial
+*/
+void probePrint( void )
+{
+  ProbeSummary summary ;
+
+  for ( uint8_t iProbe = 0 ; iProbe < PROBE_NB_PROBES ; iProbe++ )
+  {
+    probeSummarize(iProbe, &summary) ;
+    Serial.printf("probe %-11s n %u min %u mean %u p99 %u max %u jitter %u us\n", names[iProbe], summary.nbCalls, summary.min, summary.mean, summary.p99, summary.max, summary.jitter) ;
+  }
+  Serial.printf("probe heap        free %u fragmentation %u%%\n", probeMinFreeHeap(), probeMaxFragmentation()) ;
+}
+
+/**
+ * \fn void probeClear( void )
+ * \brief Forget the runs and the heap samples so far, but not the periods
+*/
+void probeClear( void )
+{
+  memset(stats, 0, sizeof(stats)) ;
+  minFreeHeap       = UINT32_MAX ;
+  maxFragmentation  = 0 ;
+}
+
+#endif
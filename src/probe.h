@@ -0,0 +1,82 @@
+/**
+  \file probe.h
+  \brief Duration of the hot paths of the firmware and free heap, measured in the field when built with PROBE_ENABLE
+*/
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#define PROBE_SHIFT     4   /*!< Bits dropped from a duration in cycles before it is binned */
+#define PROBE_SUB_BITS  2   /*!< Each power of two of the durations is split into 2 ^ PROBE_SUB_BITS bins */
+#define PROBE_NB_BINS   ( ( 32 - PROBE_SHIFT - PROBE_SUB_BITS + 1 ) << PROBE_SUB_BITS ) /*!< Bins of the histogram of a probe */
+
+/**
+ * \enum ProbeId
+ * \brief Code measured by a probe
+*/
+enum ProbeId
+{
+  PROBE_MEASURE,      /*!< measure() */
+  PROBE_ANIMATE,      /*!< animate() */
+  PROBE_UPDATE_COLOR, /*!< updateColor() */
+  PROBE_UPLOAD,       /*!< One step of the uploader, the TLS handshake included */
+  PROBE_NB_PROBES
+} ;
+
+/**
+ * \struct ProbeSummary
+ * \brief Statistics of the runs of a probe since the boot, in us
+ *
+ * The 99th percentile is the upper bound of its bin, within 25% of the exact one. The jitter is the largest gap
+ * between the time from the start of a run to the start of the next one and the period set by PROBE_PERIOD(), 0 for a
+ * probe without a period such as the uploader.
+*/
+struct ProbeSummary
+{
+  uint32_t  nbCalls ;
+  uint32_t  min ;
+  uint32_t  mean ;
+  uint32_t  p99 ;
+  uint32_t  max ;
+  uint32_t  jitter ;
+} ;
+
+void probeRecord( uint8_t i_probe, uint32_t i_startCycles, uint32_t i_endCycles ) ;
+void probeSampleHeap( void ) ;
+void probeSetPeriod( uint8_t i_probe, uint32_t i_periodMs ) ;
+void probeSummarize( uint8_t i_probe, ProbeSummary *o_summary ) ;
+const char * probeName( uint8_t i_probe ) ;
+uint32_t probeMinFreeHeap( void ) ;
+uint8_t probeMaxFragmentation( void ) ;
+void probePrint( void ) ;
+void probeClear( void ) ;
+
+/**
+ * \class ProbeScope
+ * \brief Count the cycles from its construction to the end of its scope in a probe
+*/
+class ProbeScope
+{
+  public:
+    ProbeScope( uint8_t i_probe ) : m_probe(i_probe), m_start(ESP.getCycleCount()) {}
+    ~ProbeScope() { probeRecord(m_probe, m_start, ESP.getCycleCount()) ; }
+
+  private:
+    uint8_t   m_probe ;
+    uint32_t  m_start ;
+} ;
+
+// Without PROBE_ENABLE, the probes compile to nothing and probe.cpp is empty
+#ifdef PROBE_ENABLE
+#define PROBE_SCOPE(i_probe)              ProbeScope probeScope(i_probe)
+#define PROBE_HEAP()                      probeSampleHeap()
+#define PROBE_PERIOD(i_probe, i_periodMs) probeSetPeriod(i_probe, i_periodMs)
+#else
+#define PROBE_SCOPE(i_probe)
+#define PROBE_HEAP()
+#define PROBE_PERIOD(i_probe, i_periodMs)
+#endif
+
+#endif
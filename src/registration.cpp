@@ -0,0 +1,397 @@
+/**
+  \file registration.cpp
+  \brief Streaming parser of the response to /api/device/, reading the short ID and the config as the bytes arrive,
+         and of the config the responses to /api/data/ may carry
+
+  The response is never stored : each byte goes through a state machine that keeps the current key or value in a
+  fixed buffer, and the nesting of the objects and arrays in a bit field. Only the values at the paths of the short ID
+  and of the settings are kept, in a RegistrationResponse, so that a response of any size is parsed in constant memory
+  and without heap. A key or a value longer than REGISTRATION_SIZE_TOKEN is read to its end but never matches.
+
+  The values convert as ArduinoJson converted them : a number is truncated to an integer, true and false are 1 and 0,
+  and a string holding a number is that number. A malformed response leaves registrationParseEnd() false, so that the
+  caller keeps its settings rather than apply half of them.
+*/
+#include "registration.h"
+#include <errno.h>
+
+/**
+ * \enum ParserState
+ * \brief What the parser expects next
+*/
+enum ParserState
+{
+  PARSER_VALUE,         /*!< A value, after a colon or a comma in an array */
+  PARSER_VALUE_OR_END,  /*!< A value or the end of an array, after its start */
+  PARSER_KEY,           /*!< A key, after a comma in an object */
+  PARSER_KEY_OR_END,    /*!< A key or the end of an object, after its start */
+  PARSER_COLON,
+  PARSER_STRING,        /*!< The characters of a key or of a string value */
+  PARSER_LITERAL,       /*!< The characters of a number, true, false or null */
+  PARSER_AFTER_VALUE,   /*!< A comma or the end of the object or array */
+  PARSER_DONE,          /*!< Only white space, after the end of the root object */
+  PARSER_ERROR
+} ;
+
+#define PARSER_NONE     -1  /*!< Key of no interest */
+#define PARSER_SHORT_ID -2  /*!< Key of the short ID, in the root object */
+#define PARSER_CONFIG   -3  /*!< Key of the config object, in the root object */
+
+/**
+ * \struct RegistrationParser
+ * \brief State of the parsing, so that it goes on with the next byte
+*/
+struct RegistrationParser
+{
+  RegistrationResponse  *response ;
+  ParserState           state ;
+  uint8_t               depth ;       /*!< Objects and arrays open */
+  uint32_t              arrays ;      /*!< Bit depth - 1 set if the innermost container at this depth is an array */
+  bool                  key ;         /*!< Whether the string being read is a key */
+  bool                  escaped ;     /*!< Whether the last character of the string was a backslash */
+  char                  token[REGISTRATION_SIZE_TOKEN] ;
+  uint8_t               lengthToken ;
+  bool                  overflow ;    /*!< Whether the token was longer than the buffer */
+  int8_t                rootKey ;     /*!< Last key of the root object */
+  int8_t                configKey ;   /*!< Last key of the config object, a RegistrationField or PARSER_NONE */
+} ;
+
+static RegistrationParser parser ;
+
+static const char * const fieldNames[REGISTRATION_NB_FIELDS] =
+{
+  "offset", "sensitivity", "luminosity", "updateRate", "display", "deadband", "thresholds", "snapshot", "version"
+} ;
+
+
+static bool inArray( void )
+{
+  return parser.depth > 0 && ( parser.arrays & ( 1UL << ( parser.depth - 1 ) ) ) != 0 ;
+}
+
+static void startToken( char c )
+{
+  parser.lengthToken  = 0 ;
+  parser.overflow     = false ;
+  parser.escaped      = false ;
+  if ( c != '\0' )
+    parser.token[parser.lengthToken++] = c ;
+}
+
+static void appendToken( char c )
+{
+  if ( parser.lengthToken < REGISTRATION_SIZE_TOKEN - 1 )
+    parser.token[parser.lengthToken++] = c ;
+  else
+    parser.overflow = true ;
+}
+
+/**
+ * \fn bool isNumber( const char *i_token )
+ * \return True if the token is a JSON number
+*/
+static bool isNumber( const char *i_token )
+{
+  const char *c = i_token + ( *i_token == '-' ) ;
+
+  if ( !isdigit(*c) )
+    return false ;
+  while ( isdigit(*c) )
+    c++ ;
+  if ( *c == '.' )
+  {
+    if ( !isdigit(*++c) )
+      return false ;
+    while ( isdigit(*c) )
+      c++ ;
+  }
+  if ( *c == 'e' || *c == 'E' )
+  {
+    c += c[1] == '+' || c[1] == '-' ? 2 : 1 ;
+    if ( !isdigit(*c) )
+      return false ;
+    while ( isdigit(*c) )
+      c++ ;
+  }
+  return *c == '\0' ;
+}
+
+/**
+ * \fn bool tokenToInteger( bool i_string, int32_t *o_value )
+ * \param[in] i_string Whether the token was a string
+ * \return False if the token is not a number, true, false or a string starting with a number, or if its number does
+ *         not fit an int32_t : strtol() would clamp it to a long, which is 64-bit on the host
+*/
+static bool tokenToInteger( bool i_string, int32_t *o_value )
+{
+  char *end ;
+  long long value ;
+
+  if ( parser.overflow )
+    return false ;
+  if ( !i_string && strcmp(parser.token, "true") == 0 )
+    *o_value = 1 ;
+  else if ( !i_string && strcmp(parser.token, "false") == 0 )
+    *o_value = 0 ;
+  else
+  {
+    errno = 0 ;
+    value = strtoll(parser.token, &end, 10) ;
+    if ( end == parser.token || errno == ERANGE || value < INT32_MIN || value > INT32_MAX )
+      return false ;
+    *o_value = value ;
+  }
+  return true ;
+}
+
+/**
+ * \fn void endKey( void )
+ * \brief Remember the keys of the root object and of the config object, which give the path of the next value
+*/
+static void endKey( void )
+{
+  parser.token[parser.lengthToken] = '\0' ;
+  parser.state = PARSER_COLON ;
+  if ( parser.depth == 1 )
+  {
+    parser.rootKey = parser.overflow ? PARSER_NONE : strcmp(parser.token, "shortID") == 0 ? PARSER_SHORT_ID
+                   : strcmp(parser.token, "config") == 0 ? PARSER_CONFIG : PARSER_NONE ;
+  }
+  else if ( parser.depth == 2 && parser.rootKey == PARSER_CONFIG )
+  {
+    parser.configKey = PARSER_NONE ;
+    for ( uint8_t iField = 0 ; iField < REGISTRATION_NB_FIELDS && !parser.overflow ; iField++ )
+      if ( strcmp(parser.token, fieldNames[iField]) == 0 )
+        parser.configKey = iField ;
+  }
+}
+
+/**
+ * \fn void endValue( bool i_string )
+ * \param[in] i_string Whether the value was a string
+ * \brief Check a literal, and keep the value if it is at the path of the short ID, of a setting or of a threshold
+*/
+static void endValue( bool i_string )
+{
+  RegistrationResponse *response = parser.response ;
+  int32_t value ;
+
+  parser.token[parser.lengthToken] = '\0' ;
+  parser.state = PARSER_AFTER_VALUE ;
+  if ( !i_string && !parser.overflow && !isNumber(parser.token) && strcmp(parser.token, "true") != 0
+       && strcmp(parser.token, "false") != 0 && strcmp(parser.token, "null") != 0 )
+  {
+    parser.state = PARSER_ERROR ;
+    return ;
+  }
+
+  if ( parser.depth == 1 && parser.rootKey == PARSER_SHORT_ID )
+  {
+    response->shortID[0] = '\0' ;
+    if ( i_string && !parser.overflow && parser.lengthToken > 0 && parser.lengthToken <= configShortIDLength )
+      memcpy(response->shortID, parser.token, parser.lengthToken + 1) ;
+  }
+  else if ( parser.depth == 2 && parser.rootKey == PARSER_CONFIG && !inArray() && parser.configKey >= 0
+            && parser.configKey != REGISTRATION_THRESHOLDS && tokenToInteger(i_string, &value) )
+  {
+    response->values[parser.configKey]  = value ;
+    response->fields                   |= REGISTRATION_FIELD(parser.configKey) ;
+  }
+  else if ( parser.depth == 3 && parser.rootKey == PARSER_CONFIG && inArray() && parser.configKey == REGISTRATION_THRESHOLDS
+            && response->nbThresholds < CONFIG_NB_THRESHOLDS && tokenToInteger(i_string, &value) )
+    response->thresholds[response->nbThresholds++] = value ;
+}
+
+/**
+ * \fn void openContainer( bool i_array )
+ * \brief Enter an object or an array
+*/
+static void openContainer( bool i_array )
+{
+  if ( parser.depth == REGISTRATION_MAX_DEPTH )
+  {
+    parser.state = PARSER_ERROR ;
+    return ;
+  }
+  parser.depth++ ;
+  if ( i_array )
+    parser.arrays |= 1UL << ( parser.depth - 1 ) ;
+  else
+    parser.arrays &= ~( 1UL << ( parser.depth - 1 ) ) ;
+  if ( parser.depth == 2 )
+    parser.configKey = PARSER_NONE ;
+
+  // The thresholds are only those of the last "thresholds" array of the config
+  if ( i_array && parser.depth == 3 && parser.rootKey == PARSER_CONFIG && parser.configKey == REGISTRATION_THRESHOLDS )
+  {
+    parser.response->nbThresholds  = 0 ;
+    parser.response->fields       |= REGISTRATION_FIELD(REGISTRATION_THRESHOLDS) ;
+  }
+  parser.state = i_array ? PARSER_VALUE_OR_END : PARSER_KEY_OR_END ;
+}
+
+/**
+ * \fn void closeContainer( bool i_array )
+ * \brief Leave an object or an array, the end of the root object ending the response
+*/
+static void closeContainer( bool i_array )
+{
+  if ( parser.depth == 0 || inArray() != i_array )
+  {
+    parser.state = PARSER_ERROR ;
+    return ;
+  }
+  parser.depth-- ;
+  parser.state = parser.depth == 0 ? PARSER_DONE : PARSER_AFTER_VALUE ;
+}
+
+/**
+ * \fn void startValue( char c )
+ * \brief Start the value c begins, the root being an object
+*/
+static void startValue( char c )
+{
+  if ( parser.depth == 0 && c != '{' )
+    parser.state = PARSER_ERROR ;
+  else if ( c == '{' || c == '[' )
+    openContainer(c == '[') ;
+  else if ( c == '"' )
+  {
+    startToken('\0') ;
+    parser.key    = false ;
+    parser.state  = PARSER_STRING ;
+  }
+  else if ( c == '-' || isalnum(c) )
+  {
+    startToken(c) ;
+    parser.state = PARSER_LITERAL ;
+  }
+  else
+    parser.state = PARSER_ERROR ;
+}
+
+/**
+ * \fn void registrationParseBegin( RegistrationResponse *o_response )
+ * \param[out] o_response Where to put what the response holds, empty until registrationParse() is given its bytes
+ * \brief Get ready to parse a response
+*/
+void registrationParseBegin( RegistrationResponse *o_response )
+{
+  parser.response = o_response ;
+  registrationParse(-1) ;
+}
+
+/**
+ * \fn void registrationParse( int c )
+ * \param[in] c Next byte of the response, -1 to start again with a new response
+ * \brief Parse one byte, as a ConnectionBodyHandler
+*/
+void registrationParse( int c )
+{
+  if ( c < 0 )
+  {
+    memset(parser.response, 0, sizeof(RegistrationResponse)) ;
+    parser.state      = PARSER_VALUE ;
+    parser.depth      = 0 ;
+    parser.arrays     = 0 ;
+    parser.rootKey    = PARSER_NONE ;
+    parser.configKey  = PARSER_NONE ;
+    return ;
+  }
+
+  if ( parser.state == PARSER_STRING )
+  {
+    if ( parser.escaped )
+    {
+      parser.escaped = false ;
+      appendToken(c) ;
+    }
+    else if ( c == '\\' )
+      parser.escaped = true ;
+    else if ( c != '"' )
+      appendToken(c) ;
+    else if ( parser.key )
+      endKey() ;
+    else
+      endValue(true) ;
+    return ;
+  }
+  if ( parser.state == PARSER_LITERAL )
+  {
+    if ( isalnum(c) || c == '-' || c == '+' || c == '.' )
+    {
+      appendToken(c) ;
+      return ;
+    }
+    endValue(false) ;
+  }
+  if ( c == ' ' || c == '\t' || c == '\r' || c == '\n' )
+    return ;
+
+  switch ( parser.state )
+  {
+    case PARSER_VALUE_OR_END:
+      if ( c == ']' )
+      {
+        closeContainer(true) ;
+        break ;
+      }
+      // Fall through
+    case PARSER_VALUE:
+      startValue(c) ;
+      break ;
+
+    case PARSER_KEY_OR_END:
+      if ( c == '}' )
+      {
+        closeContainer(false) ;
+        break ;
+      }
+      // Fall through
+    case PARSER_KEY:
+      if ( c != '"' )
+      {
+        parser.state = PARSER_ERROR ;
+        break ;
+      }
+      startToken('\0') ;
+      parser.key    = true ;
+      parser.state  = PARSER_STRING ;
+      break ;
+
+    case PARSER_COLON:
+      parser.state = c == ':' ? PARSER_VALUE : PARSER_ERROR ;
+      break ;
+
+    case PARSER_AFTER_VALUE:
+      if ( c == ',' )
+        parser.state = inArray() ? PARSER_VALUE : PARSER_KEY ;
+      else if ( c == '}' || c == ']' )
+        closeContainer(c == ']') ;
+      else
+        parser.state = PARSER_ERROR ;
+      break ;
+
+    default:
+      parser.state = PARSER_ERROR ;
+      break ;
+  }
+}
+
+/**
+ * \fn bool registrationParseDone( void )
+ * \return True if the response was a complete JSON object, with or without a short ID
+*/
+bool registrationParseDone( void )
+{
+  return parser.state == PARSER_DONE ;
+}
+
+/**
+ * \fn bool registrationParseEnd( void )
+ * \return True if the response was a complete JSON object with a valid short ID
+*/
+bool registrationParseEnd( void )
+{
+  return registrationParseDone() && parser.response->shortID[0] != '\0' ;
+}
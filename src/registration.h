@@ -0,0 +1,48 @@
+#ifndef REGISTRATION_H
+#define REGISTRATION_H
+
+#include <stdint.h>
+#include <Arduino.h>
+#include "config.h"
+
+#define REGISTRATION_SIZE_TOKEN 16  /*!< Longest key or value kept by the parser, longer ones are read but ignored */
+#define REGISTRATION_MAX_DEPTH  32  /*!< Deepest nesting of objects and arrays in a response */
+#define REGISTRATION_FIELD(f)   ( 1U << (f) ) /*!< Bit of a RegistrationField in RegistrationResponse::fields */
+
+/**
+ * \enum RegistrationField
+ * \brief Settings of the config object of the response to /api/device/, and of the ones to /api/data/
+*/
+enum RegistrationField
+{
+  REGISTRATION_OFFSET,
+  REGISTRATION_SENSITIVITY,
+  REGISTRATION_LUMINOSITY,
+  REGISTRATION_UPDATE_RATE,
+  REGISTRATION_DISPLAY,
+  REGISTRATION_DEADBAND,
+  REGISTRATION_THRESHOLDS,
+  REGISTRATION_SNAPSHOT,
+  REGISTRATION_VERSION,     /*!< Version of the settings on the server, the config of an upload is ignored if it did not change */
+  REGISTRATION_NB_FIELDS
+} ;
+
+/**
+ * \struct RegistrationResponse
+ * \brief What the server answers to a registration, or the config it answers an upload with
+*/
+struct RegistrationResponse
+{
+  char      shortID[configShortIDLength + 1] ;  /*!< Empty if missing, or not a string of 1 to configShortIDLength characters */
+  uint16_t  fields ;                            /*!< REGISTRATION_FIELD() of the settings in the config object */
+  int32_t   values[REGISTRATION_NB_FIELDS] ;    /*!< Value of each setting present but the thresholds, as read, not range-checked */
+  int32_t   thresholds[CONFIG_NB_THRESHOLDS] ;    /*!< Thresholds of the last array, as read : writeSettings() checks they fit an int16_t */
+  uint8_t   nbThresholds ;
+} ;
+
+void registrationParseBegin( RegistrationResponse *o_response ) ;
+void registrationParse( int c ) ;
+bool registrationParseDone( void ) ;
+bool registrationParseEnd( void ) ;
+
+#endif
@@ -0,0 +1,145 @@
+/**
+  \file report.cpp
+  \brief When to upload : at a fixed rate, or as soon as the value changes, with a heartbeat at the slowest rate
+
+  In the adaptive mode, an upload starts when the value leaves the deadband around the last value the server got, or
+  when it is on the other side of a threshold, but not sooner than the minimum interval after the previous upload.
+  Otherwise the values are coalesced until the heartbeat. The fixed rates are the same without deadband nor threshold.
+
+  The uploads send the tier of value_pyramid.h given to reportConfigure(), the one of the rate. In the adaptive mode,
+  an upload triggered by a change and the heartbeat following it send every value instead, so that the server gets
+  the values around the change exact : the values of the quiet intervals go as aggregates of a minute, at the 300 s
+  heartbeat. bench_report.cpp prints the requests, the bytes and the error of each mode.
+
+  The last value the server has is within the deadband of the current one, and on the same side of the thresholds,
+  except during the minimum interval following a change and the time the upload takes. After a quiet heartbeat, it is
+  the mean of the last complete minute, which the changes are then measured from.
+*/
+#include "report.h"
+
+static uint32_t heartbeat         = 0 ;
+static uint32_t minInterval       = 0 ;
+static uint16_t deadband          = REPORT_DEADBAND_OFF ;
+static int16_t  thresholds[REPORT_MAX_THRESHOLDS] ;
+static uint8_t  nbThresholds      = 0 ;
+static bool     started           = false ; /*!< Whether an upload started since the boot */
+static uint32_t startMillis       = 0 ;     /*!< When the last upload started */
+static int16_t  lastValue         = 0 ;     /*!< Last value given to reportValue() */
+static int16_t  reportedValue     = 0 ;     /*!< Last value when the last upload started, the one the server has */
+static bool     changed           = false ; /*!< Whether the value left the deadband or crossed a threshold since */
+static uint32_t triggered         = 0 ;
+static PyramidTier tier           = PYRAMID_RAW ;   /*!< Tier of the uploads away from a change */
+static bool     lastChanged       = false ; /*!< Whether the last upload started sent a change */
+
+
+/**
+ * \fn uint8_t thresholdSide( int16_t i_value )
+ * \return The number of thresholds at or below a value
+*/
+static uint8_t thresholdSide( int16_t i_value )
+{
+  uint8_t side = 0 ;
+
+  for ( uint8_t iThreshold = 0 ; iThreshold < nbThresholds ; iThreshold++ )
+    side += i_value >= thresholds[iThreshold] ;
+  return side ;
+}
+
+/**
+ * \fn void reportConfigure( uint32_t i_heartbeat, uint32_t i_minInterval, uint16_t i_deadband, const int16_t *i_thresholds, uint8_t i_nbThresholds )
+ * \param[in] i_heartbeat Longest delay between two uploads, in ms
+ * \param[in] i_minInterval Shortest delay between an upload and the next one triggered by a change, in ms
+ * \param[in] i_deadband Largest difference with the last value uploaded that does not trigger an upload, REPORT_DEADBAND_OFF for none
+ * \param[in] i_thresholds Values whose crossing triggers an upload, the ones beyond REPORT_MAX_THRESHOLDS are ignored
+ * \param[in] i_tier Tier of value_pyramid.h sent by the uploads that are not around a change, see pyramidTierFor()
+ * \brief Set when to upload, keeping the time of the last upload
+*/
+void reportConfigure( uint32_t i_heartbeat, uint32_t i_minInterval, uint16_t i_deadband, const int16_t *i_thresholds, uint8_t i_nbThresholds, PyramidTier i_tier )
+{
+  heartbeat     = i_heartbeat ;
+  tier          = i_tier ;
+  minInterval   = i_minInterval ;
+  deadband      = i_deadband ;
+  nbThresholds  = i_nbThresholds < REPORT_MAX_THRESHOLDS ? i_nbThresholds : REPORT_MAX_THRESHOLDS ;
+  for ( uint8_t iThreshold = 0 ; iThreshold < nbThresholds ; iThreshold++ )
+    thresholds[iThreshold] = i_thresholds[iThreshold] ;
+}
+
+/**
+ * \fn void reportValue( int16_t i_value )
+ * \param[in] i_value Value added to the buffer of the uploads
+*/
+void reportValue( int16_t i_value )
+{
+  int32_t difference = (int32_t) i_value - reportedValue ;
+
+  lastValue = i_value ;
+  if ( deadband == REPORT_DEADBAND_OFF || !started )
+    return ;
+  difference = difference < 0 ? -difference : difference ;
+  changed   |= difference > deadband || thresholdSide(i_value) != thresholdSide(reportedValue) ;
+}
+
+/**
+ * \fn bool reportDue( void )
+ * \return True if an upload should start
+*/
+bool reportDue( void )
+{
+  uint32_t elapsed = millis() - startMillis ;
+
+  return !started || elapsed >= heartbeat || ( changed && elapsed >= minInterval ) ;
+}
+
+/**
+ * \fn PyramidTier reportStarted( void )
+ * \return The tier the upload sends : PYRAMID_RAW for a change and the heartbeat following it, the one of
+ *         reportConfigure() otherwise
+ * \brief Take note that an upload started, with the values given so far
+*/
+PyramidTier reportStarted( void )
+{
+  uint32_t elapsed = millis() - startMillis ;
+  bool quiet = deadband == REPORT_DEADBAND_OFF || ( started && !changed && !lastChanged ) ;
+  PyramidRing *ring = pyramidRing(tier) ;
+  const PyramidAggregate *last ;
+
+  triggered    += started && changed && elapsed < heartbeat ;
+  lastChanged   = changed ;
+  started       = true ;
+  startMillis   = millis() ;
+  changed       = false ;
+  if ( !quiet || tier == PYRAMID_RAW )
+  {
+    reportedValue = lastValue ;
+    return PYRAMID_RAW ;
+  }
+
+  // The server gets the mean of the last complete aggregate, or nothing new if it got them all
+  if ( ring->size() > 0 && ring->peek(ring->back() - 1, &last) > 0 )
+    reportedValue = last->mean ;
+  return tier ;
+}
+
+/**
+ * \fn uint32_t reportTriggered( void )
+ * \return The number of uploads started by a change before the heartbeat, since the boot
+*/
+uint32_t reportTriggered( void )
+{
+  return triggered ;
+}
+
+/**
+ * \fn void reportClear( void )
+ * \brief Forget the uploads so far, the next one is due at once
+*/
+void reportClear( void )
+{
+  started       = false ;
+  changed       = false ;
+  lastChanged   = false ;
+  triggered     = 0 ;
+  reportedValue = 0 ;
+  lastValue     = 0 ;
+}
@@ -0,0 +1,18 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdint.h>
+#include <Arduino.h>
+#include "value_pyramid.h"
+
+#define REPORT_MAX_THRESHOLDS 3           /*!< Thresholds whose crossing triggers an upload */
+#define REPORT_DEADBAND_OFF   UINT16_MAX  /*!< Deadband of the fixed rates : only the heartbeat triggers an upload */
+
+void reportConfigure( uint32_t i_heartbeat, uint32_t i_minInterval, uint16_t i_deadband, const int16_t *i_thresholds, uint8_t i_nbThresholds, PyramidTier i_tier = PYRAMID_RAW ) ;
+void reportValue( int16_t i_value ) ;
+bool reportDue( void ) ;
+PyramidTier reportStarted( void ) ;
+uint32_t reportTriggered( void ) ;
+void reportClear( void ) ;
+
+#endif
@@ -0,0 +1,127 @@
+#include "sampler.h"
+
+static_assert( ( SAMPLER_NB_BLOCKS & ( SAMPLER_NB_BLOCKS - 1 ) ) == 0, "SAMPLER_NB_BLOCKS must be a power of two" ) ;
+
+// Queue of blocks : the interrupt fills samplerBlocks[iWriteBlock], measure() consumes from iReadBlock
+static SampleBlock        samplerBlocks[SAMPLER_NB_BLOCKS] ;
+static volatile uint8_t   iReadBlock        = 0 ;
+static volatile uint8_t   iWriteBlock       = 0 ;
+static volatile uint16_t  iSampleInBlock    = 0 ;
+static volatile uint32_t  overrunCount      = 0 ;
+static bool               running           = false ;
+
+
+/**
+ * \fn void samplerISR()
+ * \brief Read one sample from the ADC, add it to the current block and publish the block when it is full
+ *
+ * When the queue is full, the block being filled is recycled and the overrun counter incremented : older blocks are
+ * never modified while measure() may be reading them. analogRead() runs from flash, so the interrupt must not fire
+ * during flash writes that do not already disable interrupts, as EEPROM.commit() does : samplerPause() holds it around
+ * the ones of SPIFFS, of WiFi.mode() and of the portal of WiFiManager.
+*/
+static void ICACHE_RAM_ATTR samplerISR()
+{
+  SampleBlock *block  = &samplerBlocks[iWriteBlock] ;
+  int16_t sample      = analogRead(A0) ;
+
+  block->samples[iSampleInBlock] = sample ;
+  block->sum += sample ;
+  block->max  = sample > block->max ? sample : block->max ;
+
+  if ( ++iSampleInBlock == SAMPLER_BLOCK_SIZE )
+  {
+    uint8_t iNextBlock = ( iWriteBlock + 1 ) & ( SAMPLER_NB_BLOCKS - 1 ) ;
+
+    if ( iNextBlock != iReadBlock )
+      iWriteBlock = iNextBlock ;
+    else
+      overrunCount++ ;
+
+    iSampleInBlock = 0 ;
+    samplerBlocks[iWriteBlock].sum = 0 ;
+    samplerBlocks[iWriteBlock].max = 0 ;
+  }
+}
+
+/**
+ * \fn void samplerBegin( void )
+ * \brief Empty the queue and start sampling the ADC at SAMPLER_RATE_HZ from the timer1 interrupt
+*/
+void samplerBegin( void )
+{
+  iReadBlock      = 0 ;
+  iWriteBlock     = 0 ;
+  iSampleInBlock  = 0 ;
+  samplerBlocks[0].sum = 0 ;
+  samplerBlocks[0].max = 0 ;
+
+  timer1_isr_init() ;
+  timer1_attachInterrupt(samplerISR) ;
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP) ;
+  timer1_write(SAMPLER_TIMER_TICKS) ;
+  running = true ;
+}
+
+/**
+ * \fn void samplerStop( void )
+ * \brief Stop the timer1 interrupt, the blocks already in the queue can still be consumed
+*/
+void samplerStop( void )
+{
+  timer1_disable() ;
+  timer1_detachInterrupt() ;
+  running = false ;
+}
+
+/**
+ * \fn void samplerPause( void )
+ * \brief Hold the timer1 interrupt during a flash write, without touching the queue nor the block being filled
+*/
+void samplerPause( void )
+{
+  timer1_disable() ;
+}
+
+/**
+ * \fn void samplerResume( void )
+ * \brief Sample again after samplerPause(), the samples of the pause are missing from the block being filled
+*/
+void samplerResume( void )
+{
+  if ( !running )
+    return ;
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP) ;
+  timer1_write(SAMPLER_TIMER_TICKS) ;
+}
+
+/**
+ * \fn const SampleBlock * samplerPeekBlock( void )
+ * \return The oldest full block of the queue, or NULL if there is none
+ * \brief Get the oldest full block without removing it from the queue
+*/
+const SampleBlock * samplerPeekBlock( void )
+{
+  if ( iReadBlock == iWriteBlock )
+    return NULL ;
+  return &samplerBlocks[iReadBlock] ;
+}
+
+/**
+ * \fn void samplerReleaseBlock( void )
+ * \brief Give the block returned by samplerPeekBlock() back to the interrupt
+*/
+void samplerReleaseBlock( void )
+{
+  if ( iReadBlock != iWriteBlock )
+    iReadBlock = ( iReadBlock + 1 ) & ( SAMPLER_NB_BLOCKS - 1 ) ;
+}
+
+/**
+ * \fn uint32_t samplerOverruns( void )
+ * \return The number of blocks dropped because measure() did not consume the queue fast enough
+*/
+uint32_t samplerOverruns( void )
+{
+  return overrunCount ;
+}
@@ -0,0 +1,31 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#define SAMPLER_RATE_HZ     2000 /*!< Rate at which the ADC is sampled by the timer interrupt, in Hz */
+#define SAMPLER_BLOCK_SIZE  32   /*!< Number of samples in a block handed from the interrupt to measure() */
+#define SAMPLER_NB_BLOCKS   8    /*!< Number of blocks in the queue, must be a power of two */
+#define SAMPLER_TIMER_TICKS ( 80000000 / 16 / SAMPLER_RATE_HZ ) /*!< Period of timer1 with a divider of 16, in ticks */
+
+/**
+ * \struct SampleBlock
+ * \brief A fixed-size block of consecutive samples, with statistics updated by the interrupt as it is filled
+*/
+struct SampleBlock
+{
+  int16_t samples[SAMPLER_BLOCK_SIZE] ;
+  int32_t sum ;
+  int16_t max ;
+} ;
+
+void samplerBegin( void ) ;
+void samplerStop( void ) ;
+void samplerPause( void ) ;
+void samplerResume( void ) ;
+const SampleBlock * samplerPeekBlock( void ) ;
+void samplerReleaseBlock( void ) ;
+uint32_t samplerOverruns( void ) ;
+
+#endif
@@ -0,0 +1,164 @@
+/**
+  \file scheduler.cpp
+  \brief Cooperative scheduler of the periodic jobs of the firmware, run from loop()
+
+  Each task has a period, a phase and a deadline. schedulerRun() runs the tasks whose release has come, the one with
+  the earliest deadline first, each to completion : a task is never preempted by another one, so they share the
+  globals of main.cpp without locks. Giving the tasks of the same period different phases keeps them from running
+  back to back in the same slot.
+
+  The start of each run is compared with its release : the jitter is counted in a histogram per task, with the runs
+  ending after their deadline. A task late by more than a period skips the releases it missed rather than running
+  several times in a row.
+*/
+#include "scheduler.h"
+
+static SchedulerTask  tasks[SCHEDULER_MAX_TASKS] ;
+static uint8_t        nbTasks     = 0 ;
+static uint32_t       beginMicros = 0 ;     /*!< micros() at schedulerBegin(), from which the phases are counted */
+static bool           running     = false ; /*!< Whether schedulerRun() is in progress, it is not reentrant */
+
+
+/**
+ * \fn uint8_t jitterBin( uint32_t i_jitterUs )
+ * \return The bin of the histogram of a jitter
+*/
+static uint8_t jitterBin( uint32_t i_jitterUs )
+{
+  uint8_t bin = 0 ;
+
+  for ( uint32_t bound = SCHEDULER_JITTER_BIN_US ; i_jitterUs >= bound && bin < SCHEDULER_NB_JITTER_BINS - 1 ; bound <<= 1 )
+    bin++ ;
+  return bin ;
+}
+
+/**
+ * \fn void schedulerBegin( void )
+ * \brief Remove all the tasks, the phases of the next ones are counted from now
+*/
+void schedulerBegin( void )
+{
+  nbTasks     = 0 ;
+  beginMicros = micros() ;
+}
+
+/**
+ * \fn int8_t schedulerAdd( const char *i_name, SchedulerFunction i_function, uint32_t i_periodMs, uint32_t i_phaseMs, uint32_t i_deadlineMs )
+ * \param[in] i_name Name of the task in the reports, must stay valid
+ * \param[in] i_function Job of the task
+ * \param[in] i_periodMs Time between two releases of the task
+ * \param[in] i_phaseMs Time between schedulerBegin() and the first release
+ * \param[in] i_deadlineMs Time after a release by which the run must have ended
+ * \return The index of the task, or -1 if there are already SCHEDULER_MAX_TASKS
+*/
+int8_t schedulerAdd( const char *i_name, SchedulerFunction i_function, uint32_t i_periodMs, uint32_t i_phaseMs, uint32_t i_deadlineMs )
+{
+  SchedulerTask *task ;
+
+  if ( nbTasks == SCHEDULER_MAX_TASKS )
+    return -1 ;
+
+  task = &tasks[nbTasks] ;
+  memset(task, 0, sizeof(SchedulerTask)) ;
+  task->name          = i_name ;
+  task->function      = i_function ;
+  task->periodMs      = i_periodMs ;
+  task->phaseMs       = i_phaseMs ;
+  task->deadlineMs    = i_deadlineMs ;
+  task->releaseMicros = beginMicros + i_phaseMs * 1000 ;
+  return nbTasks++ ;
+}
+
+/**
+ * \fn void schedulerSetPeriod( int8_t i_task, uint32_t i_periodMs )
+ * \brief Change the period of a task, its next release is one new period from now
+*/
+void schedulerSetPeriod( int8_t i_task, uint32_t i_periodMs )
+{
+  if ( i_task < 0 || i_task >= nbTasks )
+    return ;
+  tasks[i_task].periodMs      = i_periodMs ;
+  tasks[i_task].releaseMicros = micros() + i_periodMs * 1000 ;
+}
+
+/**
+ * \fn uint32_t schedulerRun( void )
+ * \return The time until the next release, in ms
+ * \brief Run the tasks released by now, earliest deadline first, to be called from each loop()
+*/
+uint32_t schedulerRun( void )
+{
+  uint32_t nextMs = UINT32_MAX ;
+
+  if ( running )
+    return 0 ;
+  running = true ;
+
+  for ( ;; )
+  {
+    uint32_t now = micros() ;
+    SchedulerTask *next = NULL ;
+
+    for ( uint8_t iTask = 0 ; iTask < nbTasks ; iTask++ )
+    {
+      SchedulerTask *task = &tasks[iTask] ;
+
+      if ( (int32_t) ( now - task->releaseMicros ) >= 0 &&
+           ( next == NULL || (int32_t) ( task->releaseMicros + task->deadlineMs * 1000 - next->releaseMicros - next->deadlineMs * 1000 ) < 0 ) )
+        next = task ;
+    }
+    if ( next == NULL )
+      break ;
+
+    uint32_t jitter = now - next->releaseMicros, duration, period = next->periodMs * 1000 ;
+
+    next->function() ;
+    duration = micros() - now ;
+
+    next->nbRuns++ ;
+    next->jitter[jitterBin(jitter)]++ ;
+    next->maxJitterUs   = jitter > next->maxJitterUs ? jitter : next->maxJitterUs ;
+    next->maxDurationUs = duration > next->maxDurationUs ? duration : next->maxDurationUs ;
+    next->nbMisses     += jitter + duration > next->deadlineMs * 1000 ? 1 : 0 ;
+
+    // Skip the releases already missed, the next run is at most one period late
+    for ( next->releaseMicros += period ; (int32_t) ( micros() - next->releaseMicros ) >= (int32_t) period ; next->releaseMicros += period )
+      next->nbMisses++ ;
+  }
+
+  for ( uint8_t iTask = 0 ; iTask < nbTasks ; iTask++ )
+  {
+    uint32_t untilMs = ( tasks[iTask].releaseMicros - micros() ) / 1000 ;
+    nextMs = untilMs < nextMs ? untilMs : nextMs ;
+  }
+  running = false ;
+  return nextMs ;
+}
+
+uint8_t schedulerNbTasks( void )
+{
+  return nbTasks ;
+}
+
+const SchedulerTask * schedulerTask( uint8_t i_task )
+{
+  return i_task < nbTasks ? &tasks[i_task] : NULL ;
+}
+
+/**
+ * \fn void schedulerClearStats( void )
+ * \brief Reset the counters and the histograms of all the tasks
+*/
+void schedulerClearStats( void )
+{
+  for ( uint8_t iTask = 0 ; iTask < nbTasks ; iTask++ )
+  {
+    SchedulerTask *task = &tasks[iTask] ;
+
+    task->nbRuns        = 0 ;
+    task->nbMisses      = 0 ;
+    task->maxJitterUs   = 0 ;
+    task->maxDurationUs = 0 ;
+    memset(task->jitter, 0, sizeof(task->jitter)) ;
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS       8   /*!< Maximum number of tasks */
+#define SCHEDULER_NB_JITTER_BINS  8   /*!< Bins of the histogram of the jitter of a task */
+#define SCHEDULER_JITTER_BIN_US   500 /*!< Upper bound of the first bin, each next bin is twice as wide, the last one is open */
+
+typedef void (*SchedulerFunction)( void ) ;
+
+/**
+ * \struct SchedulerTask
+ * \brief A periodic job and the statistics of its runs
+ *
+ * The jitter of a run is the time between its release, phase + k * period after schedulerBegin(), and its start. A
+ * run misses its deadline when it ends more than deadline after its release, or when it is skipped because the
+ * previous one was so late that the next release already passed.
+*/
+struct SchedulerTask
+{
+  const char        *name ;
+  SchedulerFunction function ;
+  uint32_t          periodMs ;
+  uint32_t          phaseMs ;     /*!< Offset of the first release from schedulerBegin() */
+  uint32_t          deadlineMs ;  /*!< Time after its release by which a run must have ended */
+  uint32_t          releaseMicros ; /*!< Release of the next run, on micros() */
+  uint32_t          nbRuns ;
+  uint32_t          nbMisses ;
+  uint32_t          maxJitterUs ;
+  uint32_t          maxDurationUs ;
+  uint32_t          jitter[SCHEDULER_NB_JITTER_BINS] ; /*!< Number of runs per bin of jitter */
+} ;
+
+void schedulerBegin( void ) ;
+int8_t schedulerAdd( const char *i_name, SchedulerFunction i_function, uint32_t i_periodMs, uint32_t i_phaseMs, uint32_t i_deadlineMs ) ;
+void schedulerSetPeriod( int8_t i_task, uint32_t i_periodMs ) ;
+uint32_t schedulerRun( void ) ;
+uint8_t schedulerNbTasks( void ) ;
+const SchedulerTask * schedulerTask( uint8_t i_task ) ;
+void schedulerClearStats( void ) ;
+
+#endif
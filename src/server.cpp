@@ -1,14 +1,13 @@
 #include "server.h"
-#include <ESP8266HTTPClient.h>
+#include "connection.h"
+#include "uploader.h"
+#include "noise_codec.h"
+#include "probe.h"
 #include <ArduinoJson.h>
 
 
 // Circular buffer to send data to the server
-int16_t noiseBufferServer[SERVER_SIZE_BUFFER_DATA] ;
-uint8_t iReadNoiseBufferServer  = 0 ;
-uint8_t iWriteNoiseBufferServer = 0 ;
-
-const char* fingerprint = "FB:AD:09:02:B3:19:A5:F7:5F:27:A8:93:16:98:D7:A0:9C:27:D9:AE";
+SpscRing<int16_t, SERVER_SIZE_BUFFER_DATA, SPSC_OVERWRITE_OLDEST> noiseBufferServer ;
 
 
 /**
@@ -18,73 +17,199 @@ const char* fingerprint = "FB:AD:09:02:B3:19:A5:F7:5F:27:A8:93:16:98:D7:A0:9C:27
  * \param[in] i_message Message to be sent in JSON format
  * \param[out] o_HTTPCode HTTP code returned by the server
  * \param[out] o_payload Payload received from the server
- * \brief Send a message (JSON) to an URL using HTTP POST
+ * \brief Send a message (JSON) to an URL using HTTP POST, over the persistent connection to the server
 */
 void sendPostRequest(char *i_hostURL, char *i_endPoint, char *i_message, int16_t *o_HTTPCode, String *o_payload)
 {
-  char completeURL[256] ;
-  HTTPClient http ;
-
-  // Perform the POST
-  http.begin(i_hostURL, 443, i_endPoint, true, fingerprint);
-  http.addHeader("Content-Type", "application/json");
-  *o_HTTPCode = http.POST(i_message);
-  if ( o_payload != NULL )
-    *o_payload  = http.getString();
-  http.end();
+  *o_HTTPCode = connectionPost(i_hostURL, i_endPoint, "application/json", (const uint8_t *) i_message, strlen(i_message), o_payload) ;
 }
 
 /**
- * \fn void sendDataServer(char *i_hostURL, char *i_shortID, int32_t i_delayUpdateValue )
+ * \fn void sendPostRequestStream(char *i_hostURL, char *i_endPoint, char *i_message, int16_t *o_HTTPCode, ConnectionBodyHandler i_handler)
  * \param[in] i_hostURL URL of the server
+ * \param[in] i_endPoint End point to send the message to
+ * \param[in] i_message Message to be sent in JSON format
+ * \param[out] o_HTTPCode HTTP code returned by the server
+ * \param[in] i_handler Parser of the payload received from the server, given its bytes as they arrive
+ * \brief Send a message (JSON) to an URL using HTTP POST, without storing the payload of the response
+*/
+void sendPostRequestStream(char *i_hostURL, char *i_endPoint, char *i_message, int16_t *o_HTTPCode, ConnectionBodyHandler i_handler)
+{
+  *o_HTTPCode = connectionPostStream(i_hostURL, i_endPoint, "application/json", (const uint8_t *) i_message, strlen(i_message), i_handler) ;
+}
+
+/**
+ * \fn void sendPostRequestBinary(char *i_hostURL, char *i_endPoint, uint8_t *i_message, size_t i_length, int16_t *o_HTTPCode, String *o_payload)
+ * \param[in] i_hostURL URL of the server
+ * \param[in] i_endPoint End point to send the message to
+ * \param[in] i_message Message to be sent in the binary format of noise_codec.cpp
+ * \param[in] i_length Size of the message, in bytes
+ * \param[out] o_HTTPCode HTTP code returned by the server
+ * \param[out] o_payload Payload received from the server
+ * \brief Send a binary message to an URL using HTTP POST, over the persistent connection to the server
+*/
+void sendPostRequestBinary(char *i_hostURL, char *i_endPoint, uint8_t *i_message, size_t i_length, int16_t *o_HTTPCode, String *o_payload)
+{
+  *o_HTTPCode = connectionPost(i_hostURL, i_endPoint, NOISE_CODEC_CONTENT_TYPE, i_message, i_length, o_payload) ;
+}
+
+/**
+ * \fn void addSummary(JsonObject& io_root, const LevelSummary *i_summary, uint32_t i_summaryAge)
+ * \brief Add the summary of the levels of an interval to a message for /api/data/
+*/
+static void addSummary(JsonObject& io_root, const LevelSummary *i_summary, uint32_t i_summaryAge)
+{
+  JsonObject& stats = io_root.createNestedObject("stats") ;
+  stats["age"]  = i_summaryAge ;
+  stats["n"]    = i_summary->nbLevels ;
+  stats["min"]  = i_summary->min ;
+  stats["l90"]  = i_summary->l90 ;
+  stats["l50"]  = i_summary->l50 ;
+  stats["l10"]  = i_summary->l10 ;
+  stats["max"]  = i_summary->max ;
+
+  JsonArray& bands = stats.createNestedArray("bands") ;
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+    bands.add( i_summary->bands[iBand] ) ;
+}
+
+#ifdef PROBE_ENABLE
+/**
+ * \fn void addProbes(JsonObject& io_root)
+ * \brief Add the probes since the boot to a message for /api/data/ : n, min, mean, p99, max and jitter in us
+*/
+static void addProbes(JsonObject& io_root)
+{
+  JsonObject& probes = io_root.createNestedObject("probes") ;
+  ProbeSummary probeSummary ;
+
+  for ( uint8_t iProbe = 0 ; iProbe < PROBE_NB_PROBES ; iProbe++ )
+  {
+    JsonArray& probe = probes.createNestedArray(probeName(iProbe)) ;
+
+    probeSummarize(iProbe, &probeSummary) ;
+    probe.add( probeSummary.nbCalls ) ;
+    probe.add( probeSummary.min ) ;
+    probe.add( probeSummary.mean ) ;
+    probe.add( probeSummary.p99 ) ;
+    probe.add( probeSummary.max ) ;
+    probe.add( probeSummary.jitter ) ;
+  }
+  JsonArray& heap = probes.createNestedArray("heap") ;
+  heap.add( probeMinFreeHeap() ) ;
+  heap.add( probeMaxFragmentation() ) ;
+}
+#endif
+
+/**
+ * \fn size_t buildDataMessageJSON(char *o_message, size_t i_size, const char *i_shortID, int32_t i_delayUpdateValue, int16_t i_nbElements, bool i_first, const int16_t *i_data, uint8_t i_nbData, const LevelSummary *i_summary, uint32_t i_summaryAge)
+ * \param[out] o_message Buffer to write the message to
+ * \param[in] i_size Size of the buffer
  * \param[in] i_shortID ID of the device in short version
  * \param[in] i_delayUpdateValue Delay between two updates of the value displayed by the device
- * \brief Send data to the server
+ * \param[in] i_nbElements Number of values in the buffer when the upload started
+ * \param[in] i_first Whether this is the first message of the upload
+ * \param[in] i_data Values to send, at most SERVER_SIZE_MESSAGE_DATA
+ * \param[in] i_nbData Number of values to send
+ * \param[in] i_summary Summary of the levels of an interval to send with the values, NULL if none
+ * \param[in] i_summaryAge Time since the end of the interval of the summary, in ms
+ * \return The length of the message
+ * \brief Build a JSON message of data for /api/data/, the levels of the summary are in tenths of dB(A), its octave bands
+ *        in tenths of dB. When built with PROBE_ENABLE, the first message of an upload also carries the probes.
 */
-void sendDataServer(char *i_hostURL, char *i_shortID, int32_t i_delayUpdateValue )
+size_t buildDataMessageJSON(char *o_message, size_t i_size, const char *i_shortID, int32_t i_delayUpdateValue, int16_t i_nbElements, bool i_first, const int16_t *i_data, uint8_t i_nbData, const LevelSummary *i_summary, uint32_t i_summaryAge)
 {
-  bool firstMessage = true ;
-  int16_t HTTPCode  = 0, nbElements = 0 ;
-  int32_t millisSend ;
+  StaticJsonBuffer<2 * SERVER_SIZE_MESSAGE_JSON> jsonBuffer;
 
-  nbElements = iWriteNoiseBufferServer - iReadNoiseBufferServer ;
-  if ( nbElements < 0 )
-    nbElements += SERVER_SIZE_BUFFER_DATA ;
+  JsonObject& root   = jsonBuffer.createObject();
+  JsonArray& data    = root.createNestedArray("noise") ;
+  root["id"]         = i_shortID ;
+  root["interval"]   = i_delayUpdateValue ;
+  root["nbElements"] = i_nbElements ;
+  root["first"]      = i_first ;
 
-  do
-  {
-    char message[256] ;
-    StaticJsonBuffer<512> jsonBuffer;
+  for ( uint8_t iData = 0 ; iData < i_nbData ; iData++ )
+    data.add( i_data[iData] ) ;
+
+  if ( i_summary != NULL )
+    addSummary(root, i_summary, i_summaryAge) ;
+#ifdef PROBE_ENABLE
+  if ( i_first )
+    addProbes(root) ;
+#endif
+
+  return root.printTo(o_message, i_size) ;
+}
+
+/**
+ * \fn size_t buildAggregateMessageJSON(char *o_message, size_t i_size, const char *i_shortID, int32_t i_interval, int16_t i_nbElements, bool i_first, const PyramidAggregate *i_aggregates, uint8_t i_nbAggregates, const LevelSummary *i_summary, uint32_t i_summaryAge)
+ * \param[in] i_interval Delay covered by each aggregate, in ms
+ * \param[in] i_nbElements Number of aggregates in the tier when the upload started
+ * \param[in] i_aggregates Aggregates to send, at most SERVER_SIZE_MESSAGE_AGGREGATES
+ * \return The length of the message
+ * \brief Build a JSON message of aggregates of value_pyramid.h for /api/data/, the other parameters as in buildDataMessageJSON()
+ *
+ * The means go in the "noise" array, so that a server that only reads it gets one value per interval. The minimums,
+ * maximums and numbers of values follow in the "min", "max" and "n" arrays.
+*/
+size_t buildAggregateMessageJSON(char *o_message, size_t i_size, const char *i_shortID, int32_t i_interval, int16_t i_nbElements, bool i_first, const PyramidAggregate *i_aggregates, uint8_t i_nbAggregates, const LevelSummary *i_summary, uint32_t i_summaryAge)
+{
+  StaticJsonBuffer<2 * SERVER_SIZE_MESSAGE_JSON> jsonBuffer;
 
-    JsonObject& root   = jsonBuffer.createObject();
-    JsonArray& data    = root.createNestedArray("noise") ;
-    root["id"]         = i_shortID ;
-    root["interval"]   = i_delayUpdateValue ;
-    root["nbElements"] = nbElements ;
-    root["first"]      = firstMessage ;
+  JsonObject& root   = jsonBuffer.createObject();
+  JsonArray& means   = root.createNestedArray("noise") ;
+  JsonArray& mins    = root.createNestedArray("min") ;
+  JsonArray& maxs    = root.createNestedArray("max") ;
+  JsonArray& counts  = root.createNestedArray("n") ;
+  root["id"]         = i_shortID ;
+  root["interval"]   = i_interval ;
+  root["nbElements"] = i_nbElements ;
+  root["first"]      = i_first ;
 
-    for ( int8_t iData = 0 ; iData < SERVER_SIZE_MESSAGE_DATA && iReadNoiseBufferServer != iWriteNoiseBufferServer ; iData++ )
-    {
-      data.add( noiseBufferServer[iReadNoiseBufferServer] ) ;
-      iReadNoiseBufferServer = ( iReadNoiseBufferServer + 1 ) % SERVER_SIZE_BUFFER_DATA ;
-    }
+  for ( uint8_t iAggregate = 0 ; iAggregate < i_nbAggregates ; iAggregate++ )
+  {
+    means.add( i_aggregates[iAggregate].mean ) ;
+    mins.add( i_aggregates[iAggregate].min ) ;
+    maxs.add( i_aggregates[iAggregate].max ) ;
+    counts.add( i_aggregates[iAggregate].count ) ;
+  }
 
-    root.printTo(message, sizeof(message)) ;
-    millisSend  = millis()  ;
-    sendPostRequest(i_hostURL, "/api/data/", message, &HTTPCode, NULL) ;
-    firstMessage = false ;
+  if ( i_summary != NULL )
+    addSummary(root, i_summary, i_summaryAge) ;
+#ifdef PROBE_ENABLE
+  if ( i_first )
+    addProbes(root) ;
+#endif
 
-  } while( iReadNoiseBufferServer != iWriteNoiseBufferServer );
+  return root.printTo(o_message, i_size) ;
+}
 
+/**
+ * \fn void sendDataServer(char *i_hostURL, char *i_shortID, int32_t i_delayUpdateValue )
+ * \param[in] i_hostURL URL of the server
+ * \param[in] i_shortID ID of the device in short version
+ * \param[in] i_delayUpdateValue Delay between two updates of the value displayed by the device
+ * \brief Send data to the server, waiting until it is acknowledged or the upload failed
+ *
+ * Blocking version of uploader.cpp, which sends the data as JSON messages of SERVER_SIZE_MESSAGE_DATA values
+ * pipelined over the persistent connection to the server, or when built with SERVER_BINARY_PAYLOAD defined, in the
+ * binary format of noise_codec.cpp. Does nothing while the uploader waits to retry a failed upload.
+*/
+void sendDataServer(char *i_hostURL, char *i_shortID, int32_t i_delayUpdateValue )
+{
+  uploaderStart(i_hostURL, i_shortID, i_delayUpdateValue) ;
+  while ( uploaderStep() > UPLOADER_BACKOFF )
+    delay(1) ;
 }
 
 /**
- * \fn void sendDataServer()
+ * \fn void addDataSendServer(int16_t i_data)
  * \param[in] i_data Data to add to the circular buffer that will be sent to the server
- * \brief Add data to the buffer that will be sent to the server
+ * \brief Add data to the buffer that will be sent to the server, overwriting the oldest value if it is full, and to
+ *        the aggregates of value_pyramid.h
 */
 void addDataSendServer(int16_t i_data)
 {
-  noiseBufferServer[iWriteNoiseBufferServer] = i_data ;
-  iWriteNoiseBufferServer = ( iWriteNoiseBufferServer + 1 ) % SERVER_SIZE_BUFFER_DATA ;
+  noiseBufferServer.push(i_data) ;
+  pyramidAdd(i_data) ;
 }
@@ -3,15 +3,36 @@
 
 #include <stdint.h>
 #include <Arduino.h>
+#include "spsc_ring.h"
+#include "level_stats.h"
+#include "value_pyramid.h"
+#include "connection.h"
 
-#define SERVER_SIZE_BUFFER_DATA 175 /*!< The size of the buffer containing the data to send to the server */
+#define SERVER_SIZE_BUFFER_DATA 256 /*!< The size of the buffer containing the data to send to the server, a power of two */
 #define SERVER_SIZE_MESSAGE_DATA 20 /*!< The number of values from the buffer to send to the server in one message */
+#define SERVER_SIZE_MESSAGE_AGGREGATES 6 /*!< The number of aggregates of value_pyramid.h to send to the server in one message */
+#ifdef PROBE_ENABLE
+#define SERVER_SIZE_MESSAGE_JSON 704 /*!< The size of a JSON message to send to the server, with a summary of the levels, its bands and the probes */
+#else
+#define SERVER_SIZE_MESSAGE_JSON 448 /*!< The size of a JSON message to send to the server, with a summary of the levels and its bands */
+#endif
 
 
 void sendPostRequest(char *i_hostURL, char *i_endPoint, char *i_message, int16_t *o_HTTPCode, String *o_payload) ;
 
+void sendPostRequestStream(char *i_hostURL, char *i_endPoint, char *i_message, int16_t *o_HTTPCode, ConnectionBodyHandler i_handler) ;
+
+void sendPostRequestBinary(char *i_hostURL, char *i_endPoint, uint8_t *i_message, size_t i_length, int16_t *o_HTTPCode, String *o_payload) ;
+
+size_t buildDataMessageJSON(char *o_message, size_t i_size, const char *i_shortID, int32_t i_delayUpdateValue, int16_t i_nbElements, bool i_first, const int16_t *i_data, uint8_t i_nbData, const LevelSummary *i_summary = NULL, uint32_t i_summaryAge = 0) ;
+
+size_t buildAggregateMessageJSON(char *o_message, size_t i_size, const char *i_shortID, int32_t i_interval, int16_t i_nbElements, bool i_first, const PyramidAggregate *i_aggregates, uint8_t i_nbAggregates, const LevelSummary *i_summary = NULL, uint32_t i_summaryAge = 0) ;
+
 void sendDataServer(char *i_hostURL, char *i_shortID, int32_t i_delayUpdateValue ) ;
 
 void addDataSendServer(int16_t i_data) ;
 
+// Filled by updateColor(), run by the scheduler from loop() or from a Ticker during the portal, emptied by the uploader
+extern SpscRing<int16_t, SERVER_SIZE_BUFFER_DATA, SPSC_OVERWRITE_OLDEST> noiseBufferServer ;
+
 #endif
@@ -0,0 +1,288 @@
+/**
+  \file snapshot.cpp
+  \brief Capture of the windows of measure() around a loud event, and their upload when nothing else is to be sent
+
+  The server gets one value per delayUpdateValue, in which a slammed door or the first seconds of an alarm are
+  averaged away. Each window of measure() goes into a ring of SNAPSHOT_NB_WINDOWS, which costs a store and a compare.
+  The first window at or above the threshold triggers the capture. The ring keeps the SNAPSHOT_PRE_WINDOWS windows
+  before it, then records SNAPSHOT_POST_WINDOWS more, and is frozen until the snapshot is sent. The windows of an
+  event that starts meanwhile are lost, and counted. A new event can only trigger once the level has stayed
+  SNAPSHOT_HYSTERESIS below the threshold for SNAPSHOT_REARM_WINDOWS windows, so that a long event sends one snapshot.
+
+  The snapshot is sent to /api/snapshot/ over the connection of the uploader, only while the uploader is idle and no
+  upload is due. It is one JSON message, its levels and peaks as differences with the previous window :
+    {"id":"AB12CD","age":2140,"window":80,"trigger":24,"threshold":700,"level":[452,3,-1,...],"peak":[38,2,...]}
+  where age is the time since the trigger, in ms, and trigger the index of the window that crossed the threshold.
+  A failed attempt is retried after SNAPSHOT_RETRY_MS, and the snapshot is dropped after SNAPSHOT_MAX_ATTEMPTS.
+*/
+#include "snapshot.h"
+#include "connection.h"
+
+#define SNAPSHOT_END_POINT  "/api/snapshot/"
+#define SNAPSHOT_WINDOW_MS  80  /*!< Length of a window of measure(), delayAnimation of main.cpp */
+
+static_assert( ( SNAPSHOT_NB_WINDOWS & ( SNAPSHOT_NB_WINDOWS - 1 ) ) == 0, "the ring of windows must be a power of two" ) ;
+
+/**
+ * \enum CaptureState
+ * \brief What the ring of windows is used for
+*/
+enum CaptureState
+{
+  CAPTURE_ARMED,    /*!< Recording the windows before an event, the next one above the threshold triggers */
+  CAPTURE_POST,     /*!< Recording the windows following the trigger */
+  CAPTURE_FROZEN,   /*!< Holding the snapshot until it is sent */
+  CAPTURE_REARM     /*!< Recording, waiting for the level to fall before a new event can trigger */
+} ;
+
+static SnapshotWindow windows[SNAPSHOT_NB_WINDOWS] ;
+static uint8_t        head            = 0 ;     /*!< Next window to write, the oldest of a frozen snapshot */
+static CaptureState   captureState    = CAPTURE_ARMED ;
+static int16_t        threshold       = SNAPSHOT_OFF ;
+static uint8_t        nbPost          = 0 ;     /*!< Windows recorded since the trigger, or below the threshold while re-arming */
+static bool           above           = false ; /*!< Whether the last window was at or above the threshold */
+static uint32_t       triggerMillis   = 0 ;
+static bool           reading         = false ; /*!< Whether the response to the snapshot is awaited */
+static bool           reusedConnection = false ;
+static bool           retried         = false ;
+static uint8_t        nbAttempts      = 0 ;
+static uint32_t       stepMillis      = 0 ;     /*!< When the request was written, or when the last attempt failed */
+static uint32_t       triggeredCount  = 0 ;
+static uint32_t       missedCount     = 0 ;
+static uint32_t       droppedCount    = 0 ;
+
+
+/**
+ * \fn void snapshotBegin( void )
+ * \brief Empty the ring of windows, and forget the snapshot not sent yet
+*/
+void snapshotBegin( void )
+{
+  memset(windows, 0, sizeof(windows)) ;
+  head            = 0 ;
+  captureState    = CAPTURE_ARMED ;
+  nbPost          = 0 ;
+  above           = false ;
+  reading         = false ;
+  nbAttempts      = 0 ;
+  triggeredCount  = 0 ;
+  missedCount     = 0 ;
+  droppedCount    = 0 ;
+}
+
+/**
+ * \fn void snapshotConfigure( int16_t i_threshold )
+ * \param[in] i_threshold Level of a window that triggers a snapshot, in tenths of dB(A), SNAPSHOT_OFF for none
+*/
+void snapshotConfigure( int16_t i_threshold )
+{
+  threshold = i_threshold ;
+}
+
+/**
+ * \fn void snapshotAdd( int16_t i_level, int16_t i_peak )
+ * \param[in] i_level A-weighted equivalent level of the window, in tenths of dB(A)
+ * \param[in] i_peak Highest sample above the average of the window, in ADC counts
+ * \brief Record the result of a window of measure(), and trigger or end a capture
+*/
+void snapshotAdd( int16_t i_level, int16_t i_peak )
+{
+  bool wasAbove = above ;
+
+  if ( threshold == SNAPSHOT_OFF )
+    return ;
+  above = i_level >= threshold ;
+  if ( captureState == CAPTURE_FROZEN )
+  {
+    missedCount += above && !wasAbove ;
+    return ;
+  }
+
+  windows[head].level = i_level ;
+  windows[head].peak  = i_peak ;
+  head                = ( head + 1 ) & ( SNAPSHOT_NB_WINDOWS - 1 ) ;
+
+  switch ( captureState )
+  {
+    case CAPTURE_ARMED:
+      if ( !above )
+        break ;
+      triggeredCount++ ;
+      triggerMillis = millis() ;
+      nbPost        = 1 ;
+      captureState  = CAPTURE_POST ;
+      break ;
+
+    case CAPTURE_POST:
+      if ( ++nbPost < SNAPSHOT_POST_WINDOWS )
+        break ;
+      nbAttempts    = 0 ;
+      retried       = false ;
+      stepMillis    = millis() - SNAPSHOT_RETRY_MS ;
+      captureState  = CAPTURE_FROZEN ;
+      break ;
+
+    case CAPTURE_REARM:
+      nbPost = i_level < threshold - SNAPSHOT_HYSTERESIS ? nbPost + 1 : 0 ;
+      if ( nbPost >= SNAPSHOT_REARM_WINDOWS )
+        captureState = CAPTURE_ARMED ;
+      break ;
+
+    default:
+      break ;
+  }
+}
+
+/**
+ * \fn bool snapshotPending( void )
+ * \return True if a snapshot waits to be sent
+*/
+bool snapshotPending( void )
+{
+  return captureState == CAPTURE_FROZEN ;
+}
+
+/**
+ * \fn bool snapshotBusy( void )
+ * \return True while the response to a snapshot is awaited on the connection, which the uploader must not use
+*/
+bool snapshotBusy( void )
+{
+  return reading ;
+}
+
+/**
+ * \fn size_t snapshotBuildMessage( char *o_message, size_t i_size, const char *i_shortID )
+ * \param[out] o_message Buffer to write the message to, SNAPSHOT_SIZE_MESSAGE is always enough
+ * \param[in] i_size Size of the buffer
+ * \param[in] i_shortID ID of the device in short version
+ * \return The length of the message, 0 if it does not fit
+ * \brief Build the JSON message of the frozen snapshot, each level and peak as the difference with the previous one
+*/
+size_t snapshotBuildMessage( char *o_message, size_t i_size, const char *i_shortID )
+{
+  size_t length ;
+  int16_t previous ;
+
+  length = snprintf(o_message, i_size, "{\"id\":\"%s\",\"age\":%lu,\"window\":%u,\"trigger\":%u,\"threshold\":%d,\"level\":[",
+                    i_shortID, (unsigned long) ( millis() - triggerMillis ), SNAPSHOT_WINDOW_MS, SNAPSHOT_PRE_WINDOWS, threshold) ;
+  previous = 0 ;
+  for ( uint8_t iWindow = 0 ; iWindow < SNAPSHOT_NB_WINDOWS && length < i_size ; iWindow++ )
+  {
+    const SnapshotWindow *window = &windows[( head + iWindow ) & ( SNAPSHOT_NB_WINDOWS - 1 )] ;
+
+    length   += snprintf(o_message + length, i_size - length, iWindow == 0 ? "%d" : ",%d", window->level - previous) ;
+    previous  = window->level ;
+  }
+  if ( length < i_size )
+    length += snprintf(o_message + length, i_size - length, "],\"peak\":[") ;
+  previous = 0 ;
+  for ( uint8_t iWindow = 0 ; iWindow < SNAPSHOT_NB_WINDOWS && length < i_size ; iWindow++ )
+  {
+    const SnapshotWindow *window = &windows[( head + iWindow ) & ( SNAPSHOT_NB_WINDOWS - 1 )] ;
+
+    length   += snprintf(o_message + length, i_size - length, iWindow == 0 ? "%d" : ",%d", window->peak - previous) ;
+    previous  = window->peak ;
+  }
+  if ( length < i_size )
+    length += snprintf(o_message + length, i_size - length, "]}") ;
+  return length < i_size ? length : 0 ;
+}
+
+/**
+ * \fn void release( bool i_sent )
+ * \brief Free the ring of windows for the next event, once the snapshot is sent or dropped
+*/
+static void release( bool i_sent )
+{
+  droppedCount += !i_sent ;
+  nbPost        = 0 ;
+  captureState  = CAPTURE_REARM ;
+}
+
+/**
+ * \fn void fail( bool i_connectionFailed )
+ * \param[in] i_connectionFailed Whether the connection failed, rather than the server answering with an error
+ * \brief Retry at once on a new connection if the reused one was stale, later otherwise, or drop the snapshot
+*/
+static void fail( bool i_connectionFailed )
+{
+  bool retryNow = i_connectionFailed && reusedConnection && !retried ;
+
+  connectionClose() ;
+  reading     = false ;
+  retried     = retryNow ;
+  stepMillis  = retryNow ? millis() - SNAPSHOT_RETRY_MS : millis() ;
+  nbAttempts += !retryNow ;
+  if ( nbAttempts >= SNAPSHOT_MAX_ATTEMPTS )
+    release(false) ;
+}
+
+/**
+ * \fn void snapshotStep( const char *i_hostURL, const char *i_shortID, bool i_canStart )
+ * \param[in] i_hostURL URL of the server
+ * \param[in] i_shortID ID of the device in short version
+ * \param[in] i_canStart Whether a request can be written, false while an upload of the values is due
+ * \brief Send the frozen snapshot, or read the response to it, to be called from loop() while the uploader is idle
+ *
+ * Opening the connection, if it was closed, blocks for the TLS handshake as it does in the uploader.
+*/
+void snapshotStep( const char *i_hostURL, const char *i_shortID, bool i_canStart )
+{
+  char message[SNAPSHOT_SIZE_MESSAGE] ;
+  uint32_t handshakes = connectionHandshakes() ;
+  int16_t HTTPCode ;
+  size_t length ;
+
+  if ( reading )
+  {
+    HTTPCode = connectionPollResponse(NULL) ;
+    if ( HTTPCode == CONNECTION_PENDING )
+    {
+      if ( millis() - stepMillis > CONNECTION_TIMEOUT_MS )
+        fail(true) ;
+    }
+    else if ( HTTPCode >= 200 && HTTPCode < 300 )
+    {
+      reading = false ;
+      release(true) ;
+    }
+    else
+      fail(HTTPCode < 0) ;
+    return ;
+  }
+
+  if ( captureState != CAPTURE_FROZEN || !i_canStart || millis() - stepMillis < SNAPSHOT_RETRY_MS )
+    return ;
+
+  length            = snapshotBuildMessage(message, sizeof(message), i_shortID) ;
+  reusedConnection  = false ;
+  if ( !connectionOpen(i_hostURL) )
+  {
+    fail(true) ;
+    return ;
+  }
+  reusedConnection  = connectionHandshakes() == handshakes ;
+  if ( !connectionWriteRequest(i_hostURL, SNAPSHOT_END_POINT, "application/json", (const uint8_t *) message, length) )
+  {
+    fail(true) ;
+    return ;
+  }
+  reading     = true ;
+  stepMillis  = millis() ;
+}
+
+uint32_t snapshotTriggered( void )
+{
+  return triggeredCount ;
+}
+
+uint32_t snapshotMissed( void )
+{
+  return missedCount ;
+}
+
+uint32_t snapshotDropped( void )
+{
+  return droppedCount ;
+}
@@ -0,0 +1,42 @@
+/**
+  \file snapshot.h
+  \brief Windows of measure() around a loud event, captured when the level crosses a threshold and uploaded apart
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#define SNAPSHOT_PRE_WINDOWS    24    /*!< Windows kept before the one crossing the threshold */
+#define SNAPSHOT_POST_WINDOWS   40    /*!< Windows captured from the one crossing the threshold */
+#define SNAPSHOT_NB_WINDOWS     ( SNAPSHOT_PRE_WINDOWS + SNAPSHOT_POST_WINDOWS ) /*!< Size of the ring of windows, a power of two */
+#define SNAPSHOT_HYSTERESIS     30    /*!< Fall below the threshold after which a new event can trigger, in tenths of dB */
+#define SNAPSHOT_REARM_WINDOWS  12    /*!< Windows in a row below the threshold minus the hysteresis before a new event can trigger */
+#define SNAPSHOT_RETRY_MS       60000 /*!< Delay before sending a snapshot again after a failure, in ms */
+#define SNAPSHOT_MAX_ATTEMPTS   3     /*!< Attempts to send a snapshot before it is dropped */
+#define SNAPSHOT_SIZE_MESSAGE   1024  /*!< Size of the JSON message of a snapshot, with the worst deltas */
+#define SNAPSHOT_OFF            INT16_MAX /*!< Threshold that never triggers */
+
+/**
+ * \struct SnapshotWindow
+ * \brief Result of a window of measure()
+*/
+struct SnapshotWindow
+{
+  int16_t level ;   /*!< A-weighted equivalent level, in tenths of dB(A) */
+  int16_t peak ;    /*!< Highest sample above the average of the window, in ADC counts */
+} ;
+
+void snapshotBegin( void ) ;
+void snapshotConfigure( int16_t i_threshold ) ;
+void snapshotAdd( int16_t i_level, int16_t i_peak ) ;
+bool snapshotPending( void ) ;
+bool snapshotBusy( void ) ;
+void snapshotStep( const char *i_hostURL, const char *i_shortID, bool i_canStart ) ;
+size_t snapshotBuildMessage( char *o_message, size_t i_size, const char *i_shortID ) ;
+uint32_t snapshotTriggered( void ) ;
+uint32_t snapshotMissed( void ) ;
+uint32_t snapshotDropped( void ) ;
+
+#endif
@@ -1,11 +1,143 @@
-/* db meter library
-   Date: 01-04-2015
-   Autor: J. Lucas Grillo
+/**
+  \file sound_meter.cpp
+  \brief A-weighting filter, energy accumulator and logarithm of the sound meter, without floating point at run time
+
+  The A-weighting curve is the analog filter of IEC 61672, with zeros at 0 Hz and poles at 20.6 Hz (double), 107.7 Hz,
+  737.9 Hz and 12194 Hz (double). At SAMPLER_RATE_HZ, only the band below 1 kHz is seen : the 12194 Hz poles are
+  dropped, the others are mapped with the matched-z transform into two biquads, and the gain is fitted over the octave
+  bands from 31.5 Hz to 800 Hz. The filter follows the curve within 0.3 dB up to 630 Hz, 0.6 dB up to 900 Hz.
+
+  The numerators are (1 - z^-1)^2, computed with additions, so each sample costs four multiplications. The filter also
+  removes the DC offset of the ADC.
 */
 #include "sound_meter.h"
+#include "sampler.h"
+
+#define SOUND_METER_COEFF(x) ( (int32_t) ( (x) * ( 1L << SOUND_METER_COEFF_BITS ) + ( (x) < 0 ? -0.5 : 0.5 ) ) )
+
+static_assert( SAMPLER_RATE_HZ == 2000, "the coefficients of the A-weighting filter are computed for 2000 Hz" ) ;
+
+// Feedback coefficients of the biquads : y = x - 2 x1 + x2 + feedback[0] y1 + feedback[1] y2
+static const int32_t feedback[2][2] =
+{
+  { SOUND_METER_COEFF(1.8746716478), SOUND_METER_COEFF(-0.8785984468) },  // 20.6 Hz twice
+  { SOUND_METER_COEFF(0.8115162802), SOUND_METER_COEFF(-0.0702100837) },  // 107.7 Hz and 737.9 Hz
+} ;
+
+// log2(1 + i / 32), in Q16
+static const uint32_t log2Table[33] =
+{
+  0,     2909,  5732,  8473,  11136, 13727, 16248, 18704, 21098, 23433, 25711,
+  27936, 30109, 32234, 34312, 36346, 38336, 40286, 42196, 44068, 45904, 47705,
+  49472, 51207, 52911, 54584, 56229, 57845, 59434, 60997, 62534, 64047, 65536
+} ;
+
+// Filter state, in Q SOUND_METER_STATE_BITS : input, output of the first and of the second biquad
+static int32_t  x1, x2, y1a, y2a, y1b, y2b ;
+static bool     primed      = false ;
+static uint64_t sumSquares  = 0 ;
+static uint32_t nbSquares   = 0 ;
+static int32_t  offsetLog2  = 0 ;       /*!< Added to log2 of the mean square to get the level, in Q SOUND_METER_LOG2_BITS */
+
+
+/**
+ * \fn int32_t soundMeterLog2( uint64_t i_value )
+ * \param[in] i_value Value to compute the logarithm of, not 0
+ * \return log2(i_value), in Q SOUND_METER_LOG2_BITS, within 0.0003
+ * \brief Integer logarithm : the position of the highest bit, and the fraction from a table interpolated linearly
+*/
+int32_t soundMeterLog2( uint64_t i_value )
+{
+  int8_t   msb      = 63 - __builtin_clzll(i_value) ;
+  uint32_t mantissa = ( i_value << ( 63 - msb ) ) >> 32 ;   // 1.31
+  uint8_t  index    = ( mantissa >> 26 ) & 31 ;
+  uint32_t fraction = ( mantissa >> 10 ) & 0xFFFF ;
+
+  return ( (int32_t) msb << SOUND_METER_LOG2_BITS ) + log2Table[index]
+         + ( ( ( log2Table[index + 1] - log2Table[index] ) * fraction ) >> 16 ) ;
+}
+
+/**
+ * \fn int16_t soundMeterDecibels( int32_t i_log2 )
+ * \param[in] i_log2 log2 of a power, in Q SOUND_METER_LOG2_BITS
+ * \return The power in dB, in tenths of dB
+*/
+int16_t soundMeterDecibels( int32_t i_log2 )
+{
+  // 100 log10(2) / 2^16, in Q32
+  return ( (int64_t) i_log2 * 1972830 + ( 1LL << 31 ) ) >> 32 ;
+}
+
+/**
+ * \fn void soundMeterBegin( void )
+ * \brief Reset the filter and the accumulator, and compute the calibration
+*/
+void soundMeterBegin( void )
+{
+  static const int32_t gainLog2 = (int32_t) ( SOUND_METER_GAIN_DB / 3.0103 * ( 1L << SOUND_METER_LOG2_BITS ) ) ;
+
+  primed      = false ;
+  sumSquares  = 0 ;
+  nbSquares   = 0 ;
+  // Level of a mean square m, in Q 2 (SOUND_METER_STATE_BITS - SOUND_METER_SQUARE_SHIFT) :
+  // 10 log10(m) + SOUND_METER_GAIN_DB - 10 log10(SOUND_METER_REF_RMS^2 in the same Q) + SOUND_METER_REF_DB
+  offsetLog2  = gainLog2 - soundMeterLog2((uint64_t) SOUND_METER_REF_RMS * SOUND_METER_REF_RMS << 2 * ( SOUND_METER_STATE_BITS - SOUND_METER_SQUARE_SHIFT )) ;
+}
+
+/**
+ * \fn void soundMeterProcess( const int16_t *i_samples, uint16_t i_nbSamples )
+ * \param[in] i_samples Consecutive samples of the ADC, following the ones of the previous call
+ * \param[in] i_nbSamples Number of samples
+ * \brief Filter the samples and add their energy to the accumulator
+ *
+ * The first sample after soundMeterBegin() fills the history of the filter, so the DC offset does not ring through it.
+*/
+void soundMeterProcess( const int16_t *i_samples, uint16_t i_nbSamples )
+{
+  for ( uint16_t iSample = 0 ; iSample < i_nbSamples ; iSample++ )
+  {
+    int32_t x = (int32_t) i_samples[iSample] << SOUND_METER_STATE_BITS ;
+    int32_t ya, yb, y ;
+
+    if ( !primed )
+    {
+      x1 = x2 = x ;
+      y1a = y2a = y1b = y2b = 0 ;
+      primed = true ;
+    }
+
+    ya = x - 2 * x1 + x2 + (int32_t) ( ( (int64_t) feedback[0][0] * y1a + (int64_t) feedback[0][1] * y2a + ( 1L << ( SOUND_METER_COEFF_BITS - 1 ) ) ) >> SOUND_METER_COEFF_BITS ) ;
+    yb = ya - 2 * y1a + y2a + (int32_t) ( ( (int64_t) feedback[1][0] * y1b + (int64_t) feedback[1][1] * y2b + ( 1L << ( SOUND_METER_COEFF_BITS - 1 ) ) ) >> SOUND_METER_COEFF_BITS ) ;
+    x2  = x1 ;
+    x1  = x ;
+    y2a = y1a ;
+    y1a = ya ;
+    y2b = y1b ;
+    y1b = yb ;
+
+    y = yb >> SOUND_METER_SQUARE_SHIFT ;
+    sumSquares += (int64_t) y * y ;
+  }
+  nbSquares += i_nbSamples ;
+}
+
+/**
+ * \fn int16_t soundMeterLeq( void )
+ * \return The A-weighted equivalent sound level of the samples processed since the last call, in tenths of dB(A), 0 if there were none
+ * \brief Read the level and empty the accumulator
+*/
+int16_t soundMeterLeq( void )
+{
+  int32_t meanLog2 ;
+
+  if ( nbSquares == 0 || sumSquares == 0 )
+  {
+    nbSquares = 0 ;
+    return 0 ;
+  }
 
-// Returns noise level in decibells
-double get_abs_db(int *input, int sound_pin) {
-   int x = (!input) ? analogRead(sound_pin) : *input;
-   return 20 * log((double)x / (double)ADC_SOUND_REF) + DB_SOUND_REF;
+  meanLog2    = soundMeterLog2(sumSquares) - soundMeterLog2(nbSquares) ;
+  sumSquares  = 0 ;
+  nbSquares   = 0 ;
+  return SOUND_METER_REF_DB * 10 + soundMeterDecibels(meanLog2 + offsetLog2) ;
 }
@@ -1,18 +1,24 @@
-/* db meter library
-   Date: 01-04-2015
-   Autor: J. Lucas Grillo
+/**
+  \file sound_meter.h
+  \brief A-weighted equivalent sound level (Leq) of the samples, in fixed point
 */
-#ifndef _DB_METER_LIB_
-#define _DB_METER_LIB_
+#ifndef SOUND_METER_H
+#define SOUND_METER_H
 
-#define ANALOG_SOUND_PIN 0
-#define ADC_SOUND_REF 60
-#define DB_SOUND_REF 50
+#include <stdint.h>
 
-#include "Arduino.h"
-#include "math.h"
+#define SOUND_METER_REF_RMS       60    /*!< A-weighted RMS of the samples, in ADC counts, read for SOUND_METER_REF_DB by a reference sound level meter */
+#define SOUND_METER_REF_DB        50    /*!< Sound level giving SOUND_METER_REF_RMS, in dB(A) */
+#define SOUND_METER_STATE_BITS    12    /*!< Fractional bits of the samples in the filter */
+#define SOUND_METER_COEFF_BITS    28    /*!< Fractional bits of the coefficients of the filter */
+#define SOUND_METER_SQUARE_SHIFT  4     /*!< Bits dropped from the filtered samples before squaring them */
+#define SOUND_METER_LOG2_BITS     16    /*!< Fractional bits of soundMeterLog2() */
+#define SOUND_METER_GAIN_DB       -7.9358 /*!< Gain to apply to the output of the filter to follow the A-weighting curve, in dB */
 
-// Returns noise level in decibells
-double get_abs_db(int *input = NULL, int sound_pin = 0);
+void soundMeterBegin( void ) ;
+void soundMeterProcess( const int16_t *i_samples, uint16_t i_nbSamples ) ;
+int16_t soundMeterLeq( void ) ;
+int32_t soundMeterLog2( uint64_t i_value ) ;
+int16_t soundMeterDecibels( int32_t i_log2 ) ;
 
 #endif
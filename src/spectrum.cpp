@@ -0,0 +1,292 @@
+/**
+  \file spectrum.cpp
+  \brief Octave band levels of the samples, from a fixed-point real FFT
+
+  The samples, minus their mean, are weighted by a Hann window and packed two by two into the complex numbers of an
+  FFT of half their size, computed in place on 16 bits with a halving at each stage so that it cannot overflow. The
+  spectrum of the real samples is then split out of it. Twiddle factors and the window come from a quarter of a sine
+  table, there is no floating point.
+
+  spectrumUpdate() runs the FFT on the last SPECTRUM_SIZE samples at each call of measure(), and keeps the levels of
+  the bands for the display, and their energy until the uploader reads it with spectrumReadBands().
+*/
+#include "spectrum.h"
+#include "sampler.h"
+#include "sound_meter.h"
+#include <string.h>
+
+#define SPECTRUM_SINE_PERIOD  1024  /*!< Entries of a whole period of the sine table, twice the largest size */
+#define SPECTRUM_INPUT_SHIFT  4     /*!< Bits the 10-bit samples are shifted by, to 14 bits */
+
+static_assert( ( SPECTRUM_SIZE & ( SPECTRUM_SIZE - 1 ) ) == 0 && SPECTRUM_SIZE <= SPECTRUM_MAX_SIZE, "SPECTRUM_SIZE must be a power of two up to SPECTRUM_MAX_SIZE" ) ;
+static_assert( 2 * SPECTRUM_MAX_SIZE <= SPECTRUM_SINE_PERIOD, "the sine table is too short for SPECTRUM_MAX_SIZE" ) ;
+
+/**
+ * \struct SpectrumComplex
+ * \brief A complex number of the FFT, in Q15
+*/
+struct SpectrumComplex
+{
+  int16_t re ;
+  int16_t im ;
+} ;
+
+// sin(2 pi i / SPECTRUM_SINE_PERIOD) for the first quarter of the period, in Q15
+static const int16_t sineTable[SPECTRUM_SINE_PERIOD / 4 + 1] =
+{
+      0,   201,   402,   603,   804,  1005,  1206,  1407,  1608,  1809,  2009,  2210,  2411,  2611,  2811,  3012,
+   3212,  3412,  3612,  3812,  4011,  4211,  4410,  4609,  4808,  5007,  5205,  5404,  5602,  5800,  5998,  6195,
+   6393,  6590,  6787,  6983,  7180,  7376,  7571,  7767,  7962,  8157,  8351,  8546,  8740,  8933,  9127,  9319,
+   9512,  9704,  9896, 10088, 10279, 10469, 10660, 10850, 11039, 11228, 11417, 11605, 11793, 11980, 12167, 12354,
+  12540, 12725, 12910, 13095, 13279, 13463, 13646, 13828, 14010, 14192, 14373, 14553, 14733, 14912, 15091, 15269,
+  15447, 15624, 15800, 15976, 16151, 16326, 16500, 16673, 16846, 17018, 17190, 17361, 17531, 17700, 17869, 18037,
+  18205, 18372, 18538, 18703, 18868, 19032, 19195, 19358, 19520, 19681, 19841, 20001, 20160, 20318, 20475, 20632,
+  20788, 20943, 21097, 21251, 21403, 21555, 21706, 21856, 22006, 22154, 22302, 22449, 22595, 22740, 22884, 23028,
+  23170, 23312, 23453, 23593, 23732, 23870, 24008, 24144, 24279, 24414, 24548, 24680, 24812, 24943, 25073, 25202,
+  25330, 25457, 25583, 25708, 25833, 25956, 26078, 26199, 26320, 26439, 26557, 26674, 26791, 26906, 27020, 27133,
+  27246, 27357, 27467, 27576, 27684, 27791, 27897, 28002, 28106, 28209, 28311, 28411, 28511, 28610, 28707, 28803,
+  28899, 28993, 29086, 29178, 29269, 29359, 29448, 29535, 29622, 29707, 29792, 29875, 29957, 30038, 30118, 30196,
+  30274, 30350, 30425, 30499, 30572, 30644, 30715, 30784, 30853, 30920, 30986, 31050, 31114, 31177, 31238, 31298,
+  31357, 31415, 31471, 31527, 31581, 31634, 31686, 31737, 31786, 31834, 31881, 31927, 31972, 32015, 32058, 32099,
+  32138, 32177, 32214, 32251, 32286, 32319, 32352, 32383, 32413, 32442, 32470, 32496, 32522, 32546, 32568, 32590,
+  32610, 32629, 32647, 32664, 32679, 32693, 32706, 32718, 32729, 32738, 32746, 32753, 32758, 32762, 32766, 32767,
+  32767
+} ;
+
+static SpectrumComplex  work[SPECTRUM_MAX_SIZE / 2] ;       /*!< Data of the FFT of spectrumFFT() */
+static int16_t          window[SPECTRUM_SIZE] ;             /*!< Last samples, the oldest first */
+static uint16_t         nbWindow = 0 ;                      /*!< Number of samples in window since spectrumBegin() */
+static uint32_t         power[SPECTRUM_SIZE / 2 + 1] ;
+static int16_t          levels[SPECTRUM_NB_BANDS] ;         /*!< Levels of the bands at the last update, in tenths of dB */
+static uint64_t         sumEnergies[SPECTRUM_NB_BANDS] ;    /*!< Energies of the bands summed since the last read */
+static uint32_t         nbEnergies = 0 ;
+
+
+/**
+ * \fn int16_t sine( uint16_t i_index )
+ * \return sin(2 pi i_index / SPECTRUM_SINE_PERIOD), in Q15
+*/
+static inline int16_t sine( uint16_t i_index )
+{
+  uint16_t index    = i_index & ( SPECTRUM_SINE_PERIOD - 1 ) ;
+  uint16_t quarter  = index & ( SPECTRUM_SINE_PERIOD / 4 - 1 ) ;
+
+  switch ( index / ( SPECTRUM_SINE_PERIOD / 4 ) )
+  {
+    case 0:   return sineTable[quarter] ;
+    case 1:   return sineTable[SPECTRUM_SINE_PERIOD / 4 - quarter] ;
+    case 2:   return -sineTable[quarter] ;
+    default:  return -sineTable[SPECTRUM_SINE_PERIOD / 4 - quarter] ;
+  }
+}
+
+static inline int16_t cosine( uint16_t i_index )
+{
+  return sine(i_index + SPECTRUM_SINE_PERIOD / 4) ;
+}
+
+/**
+ * \fn void fftComplex( SpectrumComplex *io_data, uint16_t i_size )
+ * \param[in,out] io_data Data to transform in place, i_size complex numbers
+ * \param[in] i_size Size of the FFT, a power of two up to SPECTRUM_MAX_SIZE / 2
+ * \brief Radix-2 decimation in time FFT, scaled by 1 / i_size
+*/
+static void fftComplex( SpectrumComplex *io_data, uint16_t i_size )
+{
+  // Bit-reversed order
+  for ( uint16_t i = 1, j = 0 ; i < i_size ; i++ )
+  {
+    uint16_t bit = i_size >> 1 ;
+
+    for ( ; j & bit ; bit >>= 1 )
+      j ^= bit ;
+    j ^= bit ;
+    if ( i < j )
+    {
+      SpectrumComplex swap = io_data[i] ;
+      io_data[i] = io_data[j] ;
+      io_data[j] = swap ;
+    }
+  }
+
+  for ( uint16_t length = 2 ; length <= i_size ; length <<= 1 )
+  {
+    uint16_t half = length >> 1, step = SPECTRUM_SINE_PERIOD / length ;
+
+    for ( uint16_t k = 0 ; k < half ; k++ )
+    {
+      int32_t c = cosine(k * step), s = sine(k * step) ;
+
+      for ( uint16_t i = k ; i < i_size ; i += length )
+      {
+        SpectrumComplex *a = &io_data[i], *b = &io_data[i + half] ;
+        // b * exp(-2 pi j k / length)
+        int32_t re = ( b->re * c + b->im * s + ( 1 << 14 ) ) >> 15 ;
+        int32_t im = ( b->im * c - b->re * s + ( 1 << 14 ) ) >> 15 ;
+
+        b->re = ( a->re - re + 1 ) >> 1 ;
+        b->im = ( a->im - im + 1 ) >> 1 ;
+        a->re = ( a->re + re + 1 ) >> 1 ;
+        a->im = ( a->im + im + 1 ) >> 1 ;
+      }
+    }
+  }
+}
+
+/**
+ * \fn void spectrumFFT( const int16_t *i_samples, uint16_t i_size, uint32_t *o_power )
+ * \param[in] i_samples Samples of the ADC
+ * \param[in] i_size Number of samples, a power of two from 4 to SPECTRUM_MAX_SIZE
+ * \param[out] o_power Power of the bins 0 to i_size / 2, |X[k] / i_size|^2 for the samples shifted by SPECTRUM_INPUT_SHIFT
+ * \brief Real FFT of the samples, minus their mean, through a Hann window
+*/
+void spectrumFFT( const int16_t *i_samples, uint16_t i_size, uint32_t *o_power )
+{
+  uint16_t half = i_size >> 1 ;
+  int32_t sum = 0, mean ;
+
+  for ( uint16_t iSample = 0 ; iSample < i_size ; iSample++ )
+    sum += i_samples[iSample] ;
+  mean = ( ( sum << SPECTRUM_INPUT_SHIFT ) + i_size / 2 ) / i_size ;
+
+  // Window sin^2(pi n / N) : the complex numbers of the first stage stay under 2^15 / sqrt(2), none can overflow
+  for ( uint16_t iSample = 0 ; iSample < i_size ; iSample++ )
+  {
+    int32_t w = sine(iSample * ( SPECTRUM_SINE_PERIOD / 2 / i_size )) ;
+    int16_t x = ( ( ( i_samples[iSample] << SPECTRUM_INPUT_SHIFT ) - mean ) * ( ( w * w ) >> 15 ) ) >> 15 ;
+
+    if ( iSample & 1 )
+      work[iSample >> 1].im = x ;
+    else
+      work[iSample >> 1].re = x ;
+  }
+
+  fftComplex(work, half) ;
+
+  // X[k] = (Z[k] + Z*[M - k]) / 2 - j exp(-2 pi j k / N) (Z[k] - Z*[M - k]) / 2, halved once more to be scaled by 1 / N
+  o_power[0]    = (uint32_t) ( ( work[0].re + work[0].im ) >> 1 ) * ( ( work[0].re + work[0].im ) >> 1 ) ;
+  o_power[half] = (uint32_t) ( ( work[0].re - work[0].im ) >> 1 ) * ( ( work[0].re - work[0].im ) >> 1 ) ;
+  for ( uint16_t k = 1 ; k < half ; k++ )
+  {
+    const SpectrumComplex *z = &work[k], *zc = &work[half - k] ;
+    int32_t eRe = ( z->re + zc->re ) >> 1, eIm = ( z->im - zc->im ) >> 1 ;
+    int32_t oRe = ( z->im + zc->im ) >> 1, oIm = ( zc->re - z->re ) >> 1 ;
+    int32_t c = cosine(k * ( SPECTRUM_SINE_PERIOD / i_size )), s = sine(k * ( SPECTRUM_SINE_PERIOD / i_size )) ;
+    int32_t re = ( eRe + ( ( c * oRe + s * oIm + ( 1 << 14 ) ) >> 15 ) ) >> 1 ;
+    int32_t im = ( eIm + ( ( c * oIm - s * oRe + ( 1 << 14 ) ) >> 15 ) ) >> 1 ;
+
+    o_power[k] = (uint32_t) ( re * re ) + (uint32_t) ( im * im ) ;
+  }
+}
+
+/**
+ * \fn void spectrumBandEnergies( const uint32_t *i_power, uint16_t i_size, uint16_t i_rateHz, uint64_t *o_energies )
+ * \param[in] i_power Power of the bins, from spectrumFFT()
+ * \param[in] i_size Size of the FFT
+ * \param[in] i_rateHz Sampling rate of the samples
+ * \param[out] o_energies Sum of the power of the bins of each band, the last one up to half of the rate
+*/
+void spectrumBandEnergies( const uint32_t *i_power, uint16_t i_size, uint16_t i_rateHz, uint64_t *o_energies )
+{
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+  {
+    uint32_t first  = ( (uint32_t) spectrumBandEdges[iBand] * i_size + i_rateHz - 1 ) / i_rateHz ;
+    uint32_t last   = ( (uint32_t) spectrumBandEdges[iBand + 1] * i_size + i_rateHz - 1 ) / i_rateHz ;
+
+    last = iBand == SPECTRUM_NB_BANDS - 1 || last > i_size / 2u ? i_size / 2 + 1 : last ;
+    o_energies[iBand] = 0 ;
+    for ( uint32_t k = first ; k < last ; k++ )
+      o_energies[iBand] += i_power[k] ;
+  }
+}
+
+/**
+ * \fn int16_t spectrumDecibels( uint64_t i_energy )
+ * \param[in] i_energy Energy of a band, from spectrumBandEnergies()
+ * \return The level of the band, in tenths of dB calibrated as the sound meter but not weighted, 0 for no energy
+ *
+ * The Hann window keeps 3/8 of the energy and the bins up to half of the rate hold half of it, so the mean square of
+ * the samples is 16/3 of the energy, shifted by SPECTRUM_INPUT_SHIFT bits.
+*/
+int16_t spectrumDecibels( uint64_t i_energy )
+{
+  if ( i_energy == 0 )
+    return 0 ;
+  return SOUND_METER_REF_DB * 10 + soundMeterDecibels(soundMeterLog2(i_energy) + soundMeterLog2(16)
+                                                      - soundMeterLog2(( 3 << ( 2 * SPECTRUM_INPUT_SHIFT ) ) * SOUND_METER_REF_RMS * SOUND_METER_REF_RMS)) ;
+}
+
+/**
+ * \fn void spectrumBegin( void )
+ * \brief Forget the samples and the energies
+*/
+void spectrumBegin( void )
+{
+  nbWindow    = 0 ;
+  nbEnergies  = 0 ;
+  memset(levels, 0, sizeof(levels)) ;
+  memset(sumEnergies, 0, sizeof(sumEnergies)) ;
+}
+
+/**
+ * \fn void spectrumAddSamples( const int16_t *i_samples, uint16_t i_nbSamples )
+ * \brief Add consecutive samples to the window of the next update
+*/
+void spectrumAddSamples( const int16_t *i_samples, uint16_t i_nbSamples )
+{
+  if ( i_nbSamples >= SPECTRUM_SIZE )
+    memcpy(window, i_samples + i_nbSamples - SPECTRUM_SIZE, sizeof(window)) ;
+  else
+  {
+    memmove(window, window + i_nbSamples, ( SPECTRUM_SIZE - i_nbSamples ) * sizeof(int16_t)) ;
+    memcpy(window + SPECTRUM_SIZE - i_nbSamples, i_samples, i_nbSamples * sizeof(int16_t)) ;
+  }
+  nbWindow = nbWindow + i_nbSamples < SPECTRUM_SIZE ? nbWindow + i_nbSamples : SPECTRUM_SIZE ;
+}
+
+/**
+ * \fn bool spectrumUpdate( void )
+ * \return False if there were not SPECTRUM_SIZE samples yet
+ * \brief Compute the levels of the bands over the last SPECTRUM_SIZE samples, and add their energy to the sums
+*/
+bool spectrumUpdate( void )
+{
+  uint64_t energies[SPECTRUM_NB_BANDS] ;
+
+  if ( nbWindow < SPECTRUM_SIZE )
+    return false ;
+
+  spectrumFFT(window, SPECTRUM_SIZE, power) ;
+  spectrumBandEnergies(power, SPECTRUM_SIZE, SAMPLER_RATE_HZ, energies) ;
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+  {
+    levels[iBand]       = spectrumDecibels(energies[iBand]) ;
+    sumEnergies[iBand] += energies[iBand] ;
+  }
+  nbEnergies++ ;
+  return true ;
+}
+
+/**
+ * \fn const int16_t * spectrumLevels( void )
+ * \return The levels of the SPECTRUM_NB_BANDS bands at the last update, in tenths of dB
+*/
+const int16_t * spectrumLevels( void )
+{
+  return levels ;
+}
+
+/**
+ * \fn void spectrumReadBands( int16_t *o_levels )
+ * \param[out] o_levels Equivalent level of each band since the last read, in tenths of dB, 0 if there was no update
+ * \brief Read the levels of the bands averaged over the updates, and empty the sums
+*/
+void spectrumReadBands( int16_t *o_levels )
+{
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+  {
+    o_levels[iBand]     = nbEnergies > 0 ? spectrumDecibels(sumEnergies[iBand] / nbEnergies) : 0 ;
+    sumEnergies[iBand]  = 0 ;
+  }
+  nbEnergies = 0 ;
+}
@@ -0,0 +1,27 @@
+/**
+  \file spectrum.h
+  \brief Octave band levels of the samples, from a fixed-point real FFT
+*/
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <stdint.h>
+
+#define SPECTRUM_SIZE       256   /*!< Number of samples of the FFT of spectrumUpdate(), 128 ms at SAMPLER_RATE_HZ */
+#define SPECTRUM_MAX_SIZE   512   /*!< Largest size of spectrumFFT(), a power of two */
+#define SPECTRUM_NB_BANDS   6     /*!< Octave bands from 31.5 Hz to 1 kHz */
+
+// Edges of the octave bands, in Hz : band i holds the frequencies from spectrumBandEdges[i] to spectrumBandEdges[i + 1]
+const uint16_t spectrumBandEdges[SPECTRUM_NB_BANDS + 1] = { 22, 44, 88, 177, 355, 710, 1000 } ;
+
+void spectrumFFT( const int16_t *i_samples, uint16_t i_size, uint32_t *o_power ) ;
+void spectrumBandEnergies( const uint32_t *i_power, uint16_t i_size, uint16_t i_rateHz, uint64_t *o_energies ) ;
+int16_t spectrumDecibels( uint64_t i_energy ) ;
+
+void spectrumBegin( void ) ;
+void spectrumAddSamples( const int16_t *i_samples, uint16_t i_nbSamples ) ;
+bool spectrumUpdate( void ) ;
+const int16_t * spectrumLevels( void ) ;
+void spectrumReadBands( int16_t *o_levels ) ;
+
+#endif
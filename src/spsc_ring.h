@@ -0,0 +1,170 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * \enum SpscPolicy
+ * \brief What SpscRing::push() does when the ring is full
+*/
+enum SpscPolicy
+{
+  SPSC_DROP_NEWEST,     /*!< Reject the new value */
+  SPSC_OVERWRITE_OLDEST /*!< Overwrite the oldest value, which the consumer then skips */
+} ;
+
+/**
+ * \class SpscRing
+ * \brief Lock-free ring buffer between one producer (a Ticker callback or an interrupt) and one consumer (loop())
+ *
+ * Positions are free-running 32-bit counters, and the slot of a position is found by masking it, so N must be a power
+ * of two. The producer only writes m_head and the consumer only writes m_tail. Each publishes its progress with a
+ * release store that the other reads with an acquire load, so that a slot is written before it is seen as full and
+ * read before it is seen as free.
+ *
+ * The consumer reads the values in place : peek() gives the contiguous span of values from a position, and consume()
+ * frees the values before a position once they are no longer needed. With SPSC_OVERWRITE_OLDEST, the producer never
+ * waits for the consumer, so the consumer can hold at most N - 1 values and must check with intact() that the values it
+ * read were not overwritten in the meantime.
+*/
+template<typename T, uint16_t N, SpscPolicy P = SPSC_DROP_NEWEST> class SpscRing
+{
+  static_assert(N > 1 && ( N & ( N - 1 ) ) == 0, "the capacity of a SpscRing must be a power of two") ;
+
+  public:
+    SpscRing() : m_head(0), m_tail(0), m_overflows(0) {}
+
+    /**
+     * \fn bool push( const T &i_value )
+     * \param[in] i_value Value to add, by the producer only
+     * \return False if the ring was full and the value was dropped
+    */
+    bool push( const T &i_value )
+    {
+      uint32_t head = m_head.load(std::memory_order_relaxed) ;
+
+      if ( head - m_tail.load(std::memory_order_acquire) >= ( P == SPSC_DROP_NEWEST ? N : N - 1 ) )
+      {
+        m_overflows.store(m_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed) ;
+        if ( P == SPSC_DROP_NEWEST )
+          return false ;
+        // Make the new head of the previous push visible before the slot starts to change, for intact()
+        std::atomic_thread_fence(std::memory_order_release) ;
+      }
+
+      m_data[head & ( N - 1 )] = i_value ;
+      m_head.store(head + 1, std::memory_order_release) ;
+      return true ;
+    }
+
+    /**
+     * \fn uint32_t front( void )
+     * \return The position of the oldest value available to the consumer
+    */
+    uint32_t front( void )
+    {
+      uint32_t tail = m_tail.load(std::memory_order_relaxed) ;
+
+      if ( P == SPSC_OVERWRITE_OLDEST )
+      {
+        uint32_t head = m_head.load(std::memory_order_acquire) ;
+        if ( head - tail > N - 1 )
+        {
+          tail = head - ( N - 1 ) ;
+          m_tail.store(tail, std::memory_order_release) ;
+        }
+      }
+      return tail ;
+    }
+
+    /**
+     * \fn uint32_t back( void )
+     * \return The position following the newest value
+    */
+    uint32_t back( void ) const
+    {
+      return m_head.load(std::memory_order_acquire) ;
+    }
+
+    /**
+     * \fn uint16_t size( void )
+     * \return The number of values available to the consumer
+    */
+    uint16_t size( void )
+    {
+      uint32_t tail = front() ;
+      uint32_t head = m_head.load(std::memory_order_acquire) ;
+
+      return P == SPSC_OVERWRITE_OLDEST && head - tail > N - 1 ? N - 1 : head - tail ;
+    }
+
+    /**
+     * \fn uint16_t peek( uint32_t i_position, const T **o_data )
+     * \param[in] i_position Position of the first value, between front() and back()
+     * \param[out] o_data First value
+     * \return The number of values from i_position that are contiguous in memory, 0 if there is none
+    */
+    uint16_t peek( uint32_t i_position, const T **o_data ) const
+    {
+      uint32_t length     = m_head.load(std::memory_order_acquire) - i_position ;
+      uint32_t contiguous = N - ( i_position & ( N - 1 ) ) ;
+
+      *o_data = &m_data[i_position & ( N - 1 )] ;
+      if ( length > N )
+        return 0 ;
+      return length < contiguous ? length : contiguous ;
+    }
+
+    /**
+     * \fn bool intact( uint32_t i_position )
+     * \param[in] i_position Position of the oldest value read since peek()
+     * \return False if the producer may have overwritten the value while it was read, always true with SPSC_DROP_NEWEST
+    */
+    bool intact( uint32_t i_position ) const
+    {
+      if ( P == SPSC_DROP_NEWEST )
+        return true ;
+      std::atomic_thread_fence(std::memory_order_acquire) ;
+      return m_head.load(std::memory_order_relaxed) - i_position < N ;
+    }
+
+    /**
+     * \fn void consume( uint32_t i_position )
+     * \param[in] i_position Position following the last value to free
+     * \brief Free the values before i_position, by the consumer only
+    */
+    void consume( uint32_t i_position )
+    {
+      if ( (int32_t) ( i_position - m_tail.load(std::memory_order_relaxed) ) > 0 )
+        m_tail.store(i_position, std::memory_order_release) ;
+    }
+
+    /**
+     * \fn void clear( void )
+     * \brief Empty the ring and start its positions and its overflows from 0 again, while neither side runs
+    */
+    void clear( void )
+    {
+      m_head.store(0, std::memory_order_relaxed) ;
+      m_tail.store(0, std::memory_order_relaxed) ;
+      m_overflows.store(0, std::memory_order_relaxed) ;
+    }
+
+    /**
+     * \fn uint32_t overflows( void )
+     * \return The number of values dropped or overwritten because the ring was full
+    */
+    uint32_t overflows( void ) const
+    {
+      return m_overflows.load(std::memory_order_relaxed) ;
+    }
+
+  private:
+    T                     m_data[N] ;
+    std::atomic<uint32_t> m_head ;      /*!< Position of the next value to push, written by the producer */
+    std::atomic<uint32_t> m_tail ;      /*!< Position of the oldest value not consumed, written by the consumer */
+    std::atomic<uint32_t> m_overflows ; /*!< Written by the producer */
+} ;
+
+#endif
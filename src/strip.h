@@ -0,0 +1,93 @@
+#ifndef STRIP_H
+#define STRIP_H
+
+#include <stdint.h>
+#include <Adafruit_NeoPixel.h>
+#include "frame_buffer.h"
+
+#define STRIP_FRAMES_PER_TURN 24  /*!< Frames of a whole turn of the wheel, whatever the length of the strip */
+
+/**
+ * \class Strip
+ * \brief Renderer of the animations of a LED strip of N pixels, in front of its FrameBuffer
+ *
+ * The lit arc of the wheel is kept as a mask of 2 N bits holding the pattern twice : the pattern rotated by any
+ * position is then the N consecutive bits starting at N - position, read without a modulo. The wheel advances by
+ * N / STRIP_FRAMES_PER_TURN pixels per frame, spread with an accumulator rather than a division, so that a turn takes
+ * as long on a strip of 300 pixels as on one of 24. Several strips can be driven, each by its own instance.
+*/
+template<uint16_t N> class Strip
+{
+  public:
+    Strip( Adafruit_NeoPixel &i_pixels, uint16_t i_nbLit = N / 2 ) : m_frame(i_pixels), m_position(0), m_remainder(0)
+    {
+      setArc(i_nbLit) ;
+    }
+
+    /**
+     * \fn void setArc( uint16_t i_nbLit )
+     * \param[in] i_nbLit Number of consecutive pixels lit by the wheel, at most N
+     * \brief Precompute the mask of the wheel
+    */
+    void setArc( uint16_t i_nbLit )
+    {
+      for ( uint16_t iWord = 0 ; iWord < STRIP_NB_WORDS ; iWord++ )
+        m_mask[iWord] = 0 ;
+      for ( uint16_t iBit = 0 ; iBit < i_nbLit && iBit < N ; iBit++ )
+      {
+        m_mask[iBit >> 5]         |= 1UL << ( iBit & 31 ) ;
+        m_mask[( iBit + N ) >> 5] |= 1UL << ( ( iBit + N ) & 31 ) ;
+      }
+    }
+
+    /**
+     * \fn void renderWheel( uint32_t i_colorOn, uint32_t i_colorOff )
+     * \brief Build the frame of the wheel at its current position, then advance it for the next frame
+    */
+    void renderWheel( uint32_t i_colorOn, uint32_t i_colorOff )
+    {
+      uint16_t bit = N - m_position ;
+
+      for ( uint16_t iPixel = 0 ; iPixel < N ; iPixel++, bit++ )
+        m_frame.setPixel(iPixel, ( m_mask[bit >> 5] >> ( bit & 31 ) ) & 1 ? i_colorOn : i_colorOff) ;
+
+      for ( m_remainder += N ; m_remainder >= STRIP_FRAMES_PER_TURN ; m_remainder -= STRIP_FRAMES_PER_TURN )
+        m_position = m_position + 1 < N ? m_position + 1 : 0 ;
+    }
+
+    /**
+     * \fn void renderBars( const uint8_t *i_fractions, const uint32_t *i_colors, uint8_t i_nbBars, uint32_t i_colorOff )
+     * \param[in] i_fractions Share of the pixels of each bar to light from its first one, out of 256
+     * \param[in] i_colors Color of each bar
+     * \param[in] i_nbBars Number of bars the strip is split into, the first ones one pixel longer if it does not divide N
+     * \param[in] i_colorOff Color of the pixels that are not lit
+     * \brief Build the frame of bars, such as the bands of a spectrum
+    */
+    void renderBars( const uint8_t *i_fractions, const uint32_t *i_colors, uint8_t i_nbBars, uint32_t i_colorOff )
+    {
+      uint16_t width = N / i_nbBars, longer = N % i_nbBars, iPixel = 0 ;
+
+      for ( uint8_t iBar = 0 ; iBar < i_nbBars ; iBar++ )
+      {
+        uint16_t barWidth = width + ( iBar < longer ? 1 : 0 ) ;
+        uint16_t nbLit    = ( (uint32_t) i_fractions[iBar] * barWidth + 128 ) >> 8 ;
+
+        for ( uint16_t iBarPixel = 0 ; iBarPixel < barWidth ; iBarPixel++, iPixel++ )
+          m_frame.setPixel(iPixel, iBarPixel < nbLit ? i_colors[iBar] : i_colorOff) ;
+      }
+    }
+
+    bool show( void ) { return m_frame.show() ; }
+    uint16_t position( void ) const { return m_position ; }
+    const FrameBuffer<N> & frame( void ) const { return m_frame ; }
+
+  private:
+    static const uint16_t STRIP_NB_WORDS = ( 2 * N + 31 ) / 32 ;
+
+    FrameBuffer<N>  m_frame ;
+    uint32_t        m_mask[STRIP_NB_WORDS] ;  /*!< Bit i of the pattern of the wheel is lit, twice in a row */
+    uint16_t        m_position ;              /*!< Pixel where the lit arc starts */
+    uint16_t        m_remainder ;             /*!< Advance of the wheel not made yet, in 1 / STRIP_FRAMES_PER_TURN of a pixel */
+} ;
+
+#endif
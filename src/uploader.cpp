@@ -0,0 +1,480 @@
+/**
+  \file uploader.cpp
+  \brief Upload of the noise buffer to the server, one short step per call, so that loop() never waits for the network
+
+  An upload goes through connect, write (one message per step), read (the responses, parsed as their bytes arrive)
+  and back to idle. The values of a message are only removed from the buffer once the server acknowledged it with a
+  2xx code, so a failed upload is sent again later, after a delay doubling at each failure. A failure on a reused
+  connection, which the server may have closed in between, is retried at once on a new one. A 4xx code but 408 and 429
+  rejects the message for good : its values are removed as if acknowledged, and the responses to the next messages,
+  which the server may have accepted, are read as usual rather than the messages sent again.
+
+  Opening a connection is the only step that blocks, for the duration of the TLS handshake done by WiFiClientSecure.
+
+  While no attempt is in progress, the oldest values of a buffer about to overflow are moved to the flash log, one
+  segment at a time. The values of the flash log are older than the ones in the buffer, so an attempt sends them
+  first, and attempts follow each other without waiting until both are empty.
+
+  The oldest summary of the levels queued by measure() goes with the first message of an attempt, and is removed from
+  the queue once that message is acknowledged : an attempt is made for the summaries alone when there is no value.
+
+  At the tiers of value_pyramid.h set by uploaderStart(), the aggregates are sent rather than the values, and the flash
+  log is not filled. sentPosition is the position in noiseBufferServer before which the server got the values, in any
+  tier. When the tier lost values after it, in an overflow of noiseBufferServer or of the queue of a coarse tier, an
+  attempt sends them from the next coarser tier still holding them, up to the first value the tier still has. The
+  aggregate holding sentPosition is sent whole, so the server may get the values before it twice.
+
+  The responses are parsed as they arrive by the parser of registration.h : the server may answer an upload with a
+  config object holding a version and the settings that changed, which uploaderSettings() hands to loop(). It costs no
+  request, and no heap.
+*/
+#include "uploader.h"
+#include "connection.h"
+#include "noise_codec.h"
+#include "probe.h"
+
+#define UPLOADER_END_POINT "/api/data/"
+
+static UploaderState  state             = UPLOADER_IDLE ;
+static const char     *hostURL          = NULL ;
+static const char     *shortID          = NULL ;
+static int32_t        delayUpdateValue  = 0 ;
+static PyramidTier    uploadTier        = PYRAMID_RAW ;
+static bool           fromFlash         = false ; /*!< Whether the attempt sends the flash log rather than the buffer */
+static PyramidTier    tier              = PYRAMID_RAW ; /*!< Tier the attempt sends, coarser than uploadTier to fill a gap */
+static uint32_t       sentPosition      = 0 ;     /*!< Position in noiseBufferServer before which the server got the values */
+static uint32_t       rawOverflows      = 0 ;     /*!< Overflows of noiseBufferServer when the last attempt started */
+static int16_t        nbElements        = 0 ;     /*!< Values or aggregates in the source when the attempt started */
+static uint32_t       startPosition     = 0 ;     /*!< Position in the source of the first value of the attempt */
+static uint32_t       writePosition     = 0 ;     /*!< Position in the source of the first value not written yet */
+static uint8_t        nbMessages        = 0 ;
+static uint8_t        nbAcknowledged    = 0 ;
+static uint32_t       endPositions[UPLOADER_MAX_MESSAGES] ; /*!< Position following the last value of each message */
+static uint32_t       summaryPosition   = 0 ;     /*!< Position in levelSummaries of the summary sent by the attempt */
+static uint8_t        summaryMessage    = UPLOADER_MAX_MESSAGES ; /*!< Message holding the summary, UPLOADER_MAX_MESSAGES if none */
+static bool           reusedConnection  = false ;
+static bool           retried           = false ;
+static uint32_t       startStepMillis   = 0 ;     /*!< When the backoff or the wait for the current response started */
+static uint32_t       backoffMillis     = 0 ;
+static uint32_t       failureCount      = 0 ;
+static uint32_t       rejectedCount     = 0 ;     /*!< Messages the server rejected with a 4xx code */
+static RegistrationResponse response ;      /*!< Config of the response being read */
+static RegistrationResponse settings ;      /*!< Config of the last response that had a version */
+static bool           settingsPending   = false ; /*!< Whether settings was not taken by uploaderSettings() yet */
+
+
+/**
+ * \fn uint16_t peekValues( uint32_t i_position, const int16_t **o_data )
+ * \brief peek() of the source of the attempt
+*/
+static uint16_t peekValues( uint32_t i_position, const int16_t **o_data )
+{
+  return fromFlash ? flashLogPeek(i_position, o_data) : noiseBufferServer.peek(i_position, o_data) ;
+}
+
+/**
+ * \fn void consumeValues( uint32_t i_position )
+ * \brief consume() of the source of the attempt, and the values the server got in any tier
+*/
+static void consumeValues( uint32_t i_position )
+{
+  if ( fromFlash )
+  {
+    flashLogConsume(i_position) ;
+    return ;
+  }
+
+  i_position *= pyramidSpan(tier) ;
+  if ( (int32_t) ( i_position - sentPosition ) > 0 )
+    sentPosition = i_position ;
+  noiseBufferServer.consume(sentPosition) ;
+  pyramidMinutes.consume(sentPosition / pyramidSpan(PYRAMID_MINUTE)) ;
+  pyramidQuarters.consume(sentPosition / pyramidSpan(PYRAMID_QUARTER)) ;
+}
+
+/**
+ * \fn bool holds( PyramidTier i_tier, uint32_t i_position )
+ * \return True if a tier still has the value at a position of noiseBufferServer
+*/
+static bool holds( PyramidTier i_tier, uint32_t i_position )
+{
+  if ( i_tier == PYRAMID_RAW )
+    return (int32_t) ( i_position - noiseBufferServer.front() ) >= 0 ;
+  return (int32_t) ( i_position / pyramidSpan(i_tier) - pyramidRing(i_tier)->front() ) >= 0 ;
+}
+
+/**
+ * \fn void selectTier( uint32_t *o_start, int16_t *o_nbElements )
+ * \param[out] o_start Position of the first value or aggregate of the attempt
+ * \param[out] o_nbElements Number of values or aggregates of the attempt
+ * \brief Send the tier of uploaderStart(), or fill the gap it has after sentPosition from the next coarser tier
+*/
+static void selectTier( uint32_t *o_start, int16_t *o_nbElements )
+{
+  uint32_t end ;
+
+  // Values consumed without an overflow were moved to the flash log, or dropped on purpose : the server is not owed them
+  if ( noiseBufferServer.overflows() == rawOverflows && !holds(PYRAMID_RAW, sentPosition) )
+    sentPosition = noiseBufferServer.front() ;
+  rawOverflows = noiseBufferServer.overflows() ;
+
+  tier  = uploadTier ;
+  end   = tier == PYRAMID_RAW ? noiseBufferServer.back() : pyramidRing(tier)->back() * pyramidSpan(tier) ;
+  while ( tier < PYRAMID_QUARTER && !holds(tier, sentPosition) )
+  {
+    end   = tier == PYRAMID_RAW ? noiseBufferServer.front() : pyramidRing(tier)->front() * pyramidSpan(tier) ;
+    tier  = (PyramidTier) ( tier + 1 ) ;
+  }
+  // Lost in every tier : what remains starts at the oldest value of the coarsest one
+  if ( !holds(tier, sentPosition) )
+    sentPosition = tier == PYRAMID_RAW ? noiseBufferServer.front() : pyramidRing(tier)->front() * pyramidSpan(tier) ;
+
+  if ( tier == PYRAMID_RAW )
+  {
+    noiseBufferServer.consume(sentPosition) ;
+    *o_start      = noiseBufferServer.front() ;
+    *o_nbElements = noiseBufferServer.size() ;
+    return ;
+  }
+
+  // The aggregates up to the one holding the end of the gap, which is complete once the finer tier lost values after it
+  end           = ( end + pyramidSpan(tier) - 1 ) / pyramidSpan(tier) ;
+  end           = (int32_t) ( end - pyramidRing(tier)->back() ) < 0 ? end : pyramidRing(tier)->back() ;
+  *o_start      = sentPosition / pyramidSpan(tier) ;
+  *o_nbElements = (int32_t) ( end - *o_start ) > 0 ? end - *o_start : 0 ;
+  if ( *o_nbElements == 0 && tier != uploadTier )
+    sentPosition = end * pyramidSpan(tier) ;
+}
+
+/**
+ * \fn void spill( void )
+ * \brief Move the oldest values of the buffer to the flash log if the buffer is about to overflow
+ *
+ * The values are copied and released without yielding, so updateColor(), which fills the buffer, cannot run in between.
+*/
+static void spill( void )
+{
+  int16_t values[FLASH_LOG_SEGMENT_VALUES] ;
+  uint16_t nbValues = 0, nbData = 1 ;
+  uint32_t position ;
+
+  if ( uploadTier != PYRAMID_RAW || noiseBufferServer.size() < UPLOADER_SPILL_THRESHOLD )
+    return ;
+
+  position = noiseBufferServer.front() ;
+  while ( nbValues < FLASH_LOG_SEGMENT_VALUES && nbData > 0 )
+  {
+    const int16_t *data ;
+
+    nbData    = noiseBufferServer.peek(position + nbValues, &data) ;
+    nbData    = nbData < FLASH_LOG_SEGMENT_VALUES - nbValues ? nbData : FLASH_LOG_SEGMENT_VALUES - nbValues ;
+    memcpy(&values[nbValues], data, nbData * sizeof(int16_t)) ;
+    nbValues += nbData ;
+  }
+
+  if ( nbValues == FLASH_LOG_SEGMENT_VALUES && noiseBufferServer.intact(position) && flashLogAppend(values) )
+    noiseBufferServer.consume(position + FLASH_LOG_SEGMENT_VALUES) ;
+}
+
+/**
+ * \fn void fail( bool i_connectionLost )
+ * \param[in] i_connectionLost Whether the connection failed, rather than the server answering with an error
+ * \brief Retry at once on a new connection if the reused one had gone stale, back off otherwise
+*/
+static void fail( bool i_connectionLost )
+{
+  connectionClose() ;
+  failureCount++ ;
+
+  if ( i_connectionLost && reusedConnection && !retried )
+  {
+    retried = true ;
+    state   = UPLOADER_CONNECT ;
+    return ;
+  }
+
+  backoffMillis   = backoffMillis == 0 ? UPLOADER_BACKOFF_MIN_MS : backoffMillis * 2 ;
+  backoffMillis   = backoffMillis > UPLOADER_BACKOFF_MAX_MS ? UPLOADER_BACKOFF_MAX_MS : backoffMillis ;
+  startStepMillis = millis() ;
+  state           = UPLOADER_BACKOFF ;
+}
+
+/**
+ * \fn void stepConnect( void )
+ * \brief Open the connection and start an attempt with the values in the buffer
+*/
+static void stepConnect( void )
+{
+  uint32_t handshakes = connectionHandshakes() ;
+  uint32_t flashPosition = flashLogFront() ;
+
+  fromFlash       = !flashLogEmpty() ;
+  tier            = PYRAMID_RAW ;
+  if ( fromFlash )
+  {
+    startPosition = flashPosition ;
+    nbElements    = flashLogSize() ;
+  }
+  else
+    selectTier(&startPosition, &nbElements) ;
+  writePosition   = startPosition ;
+  nbMessages      = 0 ;
+  nbAcknowledged  = 0 ;
+  summaryMessage  = UPLOADER_MAX_MESSAGES ;
+  if ( nbElements == 0 && levelSummaries.size() == 0 )
+  {
+    state = UPLOADER_IDLE ;
+    return ;
+  }
+
+  reusedConnection = false ;
+  if ( !connectionOpen(hostURL) )
+  {
+    fail(true) ;
+    return ;
+  }
+  reusedConnection  = connectionHandshakes() == handshakes ;
+  registrationParseBegin(&response) ;
+  state             = UPLOADER_WRITE ;
+}
+
+/**
+ * \fn void stepWrite( void )
+ * \brief Write the next message of the attempt, serialized from the buffer in place, without waiting for its response
+*/
+static void stepWrite( void )
+{
+  uint32_t nbLeft = startPosition + nbElements - writePosition ;
+  bool aggregated = !fromFlash && tier != PYRAMID_RAW ;
+  const int16_t *data = NULL ;
+  const PyramidAggregate *aggregates = NULL ;
+  int16_t nbData = aggregated ? pyramidRing(tier)->peek(writePosition, &aggregates) : peekValues(writePosition, &data) ;
+  const LevelSummary *summary = NULL ;
+  uint32_t summaryAge = 0 ;
+  bool success ;
+
+  if ( (uint32_t) nbData > nbLeft )
+    nbData = nbLeft ;
+  aggregated &= nbData > 0 ;
+
+  // A segment of the flash log could not be read : send what precedes it, the next attempt skips it
+  if ( fromFlash && nbData == 0 )
+  {
+    startStepMillis = millis() ;
+    state           = nbMessages > 0 ? UPLOADER_READ : UPLOADER_CONNECT ;
+    return ;
+  }
+
+  if ( nbMessages == 0 && levelSummaries.size() > 0 )
+  {
+    summaryPosition = levelSummaries.front() ;
+    levelSummaries.peek(summaryPosition, &summary) ;
+    summaryAge      = millis() - summary->endMillis ;
+    summaryMessage  = 0 ;
+  }
+
+  // The aggregates are few, they are sent as JSON in both formats
+#ifdef SERVER_BINARY_PAYLOAD
+  uint8_t     message[NOISE_CODEC_SIZE_MAX(SERVER_SIZE_BUFFER_DATA)] ;
+  const char  *contentType = aggregated ? "application/json" : NOISE_CODEC_CONTENT_TYPE ;
+  size_t      length ;
+
+  static_assert( sizeof(message) >= SERVER_SIZE_MESSAGE_JSON, "a JSON message of aggregates does not fit in the buffer of a binary one" ) ;
+  if ( !aggregated )
+    length = noiseCodecEncode(message, sizeof(message), shortID, delayUpdateValue, nbElements, writePosition == startPosition, data, nbData, summary, summaryAge) ;
+#else
+  char        message[SERVER_SIZE_MESSAGE_JSON] ;
+  const char  *contentType = "application/json" ;
+  size_t      length ;
+
+  nbData  = aggregated || nbData < SERVER_SIZE_MESSAGE_DATA ? nbData : SERVER_SIZE_MESSAGE_DATA ;
+  if ( !aggregated )
+    length = buildDataMessageJSON(message, sizeof(message), shortID, delayUpdateValue, nbElements, writePosition == startPosition, data, nbData, summary, summaryAge) ;
+#endif
+  if ( aggregated )
+  {
+    nbData  = nbData < SERVER_SIZE_MESSAGE_AGGREGATES ? nbData : SERVER_SIZE_MESSAGE_AGGREGATES ;
+    length  = buildAggregateMessageJSON((char *) message, SERVER_SIZE_MESSAGE_JSON, shortID, delayUpdateValue * pyramidSpan(tier), nbElements,
+                                        writePosition == startPosition, aggregates, nbData, summary, summaryAge) ;
+  }
+  PROBE_HEAP() ;
+
+  // The source or the queue of summaries overflowed while the message was built : start again from the oldest value left
+  if ( ( aggregated && !pyramidRing(tier)->intact(writePosition) ) || ( !fromFlash && !aggregated && !noiseBufferServer.intact(writePosition) )
+       || ( summary != NULL && !levelSummaries.intact(summaryPosition) ) )
+  {
+    connectionClose() ;
+    state = UPLOADER_CONNECT ;
+    return ;
+  }
+
+  success = connectionWriteRequest(hostURL, UPLOADER_END_POINT, contentType, (const uint8_t *) message, length) ;
+  if ( !success )
+  {
+    fail(true) ;
+    return ;
+  }
+
+  writePosition               += nbData ;
+  endPositions[nbMessages++]  = writePosition ;
+  if ( writePosition == startPosition + nbElements || nbData == 0 || nbMessages == UPLOADER_MAX_MESSAGES )
+  {
+    startStepMillis = millis() ;
+    state           = UPLOADER_READ ;
+  }
+}
+
+/**
+ * \fn void stepRead( void )
+ * \brief Parse the bytes of the responses received so far, and release the values of each acknowledged message
+*/
+static void stepRead( void )
+{
+  int16_t HTTPCode = connectionPollResponseStream(registrationParse) ;
+
+  if ( HTTPCode == CONNECTION_PENDING )
+  {
+    if ( millis() - startStepMillis > CONNECTION_TIMEOUT_MS )
+      fail(true) ;
+    return ;
+  }
+
+  // A message the server will never accept is dropped, an error it may recover from drops the connection, with the
+  // responses of the next messages, and the attempt is made again after the backoff
+  if ( HTTPCode >= 400 && HTTPCode < 500 && HTTPCode != 408 && HTTPCode != 429 )
+    rejectedCount++ ;
+  else if ( HTTPCode < 200 || HTTPCode >= 300 )
+  {
+    fail(HTTPCode < 0) ;
+    return ;
+  }
+  else if ( registrationParseDone() && ( response.fields & REGISTRATION_FIELD(REGISTRATION_VERSION) ) )
+  {
+    settings        = response ;
+    settingsPending = true ;
+  }
+  if ( nbAcknowledged == summaryMessage )
+    levelSummaries.consume(summaryPosition + 1) ;
+  consumeValues(endPositions[nbAcknowledged++]) ;
+  startStepMillis = millis() ;
+  if ( nbAcknowledged == nbMessages )
+  {
+    bool remaining = fromFlash || writePosition != startPosition + nbElements || levelSummaries.size() > 0 ;
+
+    backoffMillis = 0 ;
+    retried       = false ;
+    state         = remaining ? UPLOADER_CONNECT : UPLOADER_IDLE ;
+  }
+}
+
+/**
+ * \fn void uploaderStart( const char *i_hostURL, const char *i_shortID, int32_t i_delayUpdateValue, PyramidTier i_tier )
+ * \param[in] i_hostURL URL of the server, must stay valid during the upload
+ * \param[in] i_shortID ID of the device in short version, must stay valid during the upload
+ * \param[in] i_delayUpdateValue Delay between two updates of the value displayed by the device
+ * \param[in] i_tier Tier of value_pyramid.h to send, see pyramidTierFor()
+ * \brief Start uploading the buffer, unless an upload is already in progress or waiting to be retried
+*/
+void uploaderStart( const char *i_hostURL, const char *i_shortID, int32_t i_delayUpdateValue, PyramidTier i_tier )
+{
+  if ( state != UPLOADER_IDLE )
+    return ;
+
+  hostURL           = i_hostURL ;
+  shortID           = i_shortID ;
+  delayUpdateValue  = i_delayUpdateValue ;
+  uploadTier        = i_tier ;
+  retried           = false ;
+  state             = UPLOADER_CONNECT ;
+}
+
+/**
+ * \fn void uploaderClear( void )
+ * \brief Forget the attempt in progress, its backoff, and what the server got, along with the clear() of the buffers
+*/
+void uploaderClear( void )
+{
+  connectionClose() ;
+  state           = UPLOADER_IDLE ;
+  sentPosition    = 0 ;
+  rawOverflows    = 0 ;
+  backoffMillis   = 0 ;
+  retried         = false ;
+  settingsPending = false ;
+}
+
+/**
+ * \fn UploaderState uploaderStep( void )
+ * \return The state of the uploader after the step
+ * \brief Advance the upload by one step, to be called from each loop()
+*/
+UploaderState uploaderStep( void )
+{
+  PROBE_SCOPE(PROBE_UPLOAD) ;
+
+  switch ( state )
+  {
+    case UPLOADER_IDLE:
+      spill() ;
+      break ;
+
+    case UPLOADER_BACKOFF:
+      spill() ;
+      if ( millis() - startStepMillis >= backoffMillis )
+      {
+        retried = false ;
+        state   = UPLOADER_CONNECT ;
+      }
+      break ;
+
+    case UPLOADER_CONNECT:
+      stepConnect() ;
+      break ;
+
+    case UPLOADER_WRITE:
+      stepWrite() ;
+      break ;
+
+    case UPLOADER_READ:
+      stepRead() ;
+      break ;
+  }
+  return state ;
+}
+
+UploaderState uploaderState( void )
+{
+  return state ;
+}
+
+/**
+ * \fn bool uploaderSettings( RegistrationResponse *o_settings )
+ * \param[out] o_settings Config of the last acknowledged response that had a version, fields of the settings it holds
+ * \return True if the server answered with a config since the last call
+*/
+bool uploaderSettings( RegistrationResponse *o_settings )
+{
+  if ( !settingsPending )
+    return false ;
+  *o_settings     = settings ;
+  settingsPending = false ;
+  return true ;
+}
+
+/**
+ * \fn uint32_t uploaderFailures( void )
+ * \return The number of attempts that failed since the board started
+*/
+uint32_t uploaderFailures( void )
+{
+  return failureCount ;
+}
+
+/**
+ * \fn uint32_t uploaderRejected( void )
+ * \return The number of messages the server rejected since the board started, whose values were dropped
+*/
+uint32_t uploaderRejected( void )
+{
+  return rejectedCount ;
+}
@@ -0,0 +1,41 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include <stdint.h>
+#include <Arduino.h>
+#include "server.h"
+#include "flash_log.h"
+#include "registration.h"
+
+#define UPLOADER_BACKOFF_MIN_MS 5000   /*!< Delay before retrying after the first failed upload, in ms */
+#define UPLOADER_BACKOFF_MAX_MS 60000  /*!< Maximum delay between two attempts, in ms */
+#define UPLOADER_SPILL_THRESHOLD ( SERVER_SIZE_BUFFER_DATA * 3 / 4 ) /*!< Values in the buffer above which the oldest ones are moved to the flash log */
+
+#ifdef SERVER_BINARY_PAYLOAD
+#define UPLOADER_MAX_MESSAGES 2 /*!< Maximum number of messages in one upload, one per contiguous span of the buffer */
+#else
+#define UPLOADER_MAX_MESSAGES ( ( SERVER_SIZE_BUFFER_DATA + SERVER_SIZE_MESSAGE_DATA - 1 ) / SERVER_SIZE_MESSAGE_DATA + 1 ) /*!< Maximum number of messages in one upload, one more where the buffer wraps */
+#endif
+
+/**
+ * \enum UploaderState
+ * \brief Step the uploader is at
+*/
+enum UploaderState
+{
+  UPLOADER_IDLE,     /*!< Nothing to do until uploaderStart() */
+  UPLOADER_BACKOFF,  /*!< Waiting before retrying a failed upload */
+  UPLOADER_CONNECT,  /*!< Opening the connection, or reusing it */
+  UPLOADER_WRITE,    /*!< Writing the messages, one per step */
+  UPLOADER_READ      /*!< Reading the responses as they arrive */
+} ;
+
+void uploaderStart( const char *i_hostURL, const char *i_shortID, int32_t i_delayUpdateValue, PyramidTier i_tier = PYRAMID_RAW ) ;
+void uploaderClear( void ) ;
+UploaderState uploaderStep( void ) ;
+UploaderState uploaderState( void ) ;
+bool uploaderSettings( RegistrationResponse *o_settings ) ;
+uint32_t uploaderFailures( void ) ;
+uint32_t uploaderRejected( void ) ;
+
+#endif
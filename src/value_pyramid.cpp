@@ -0,0 +1,145 @@
+/**
+  \file value_pyramid.cpp
+  \brief Minimum, maximum and mean of the values sent to the server over about 1 and 15 minutes, updated with each value
+
+  Each value is folded into the running aggregate of the minute tier. Once it holds PYRAMID_MINUTE_VALUES values, it
+  is queued, and its exact sum is folded into the running aggregate of the quarter tier, which is queued in turn
+  after PYRAMID_QUARTER_MINUTES of them : a value costs a few comparisons and additions, whatever the tier. Each tier
+  keeps its last PYRAMID_SIZE_TIER aggregates, 1 kB in all.
+
+  At the slow rates, the uploader sends an aggregate per minute rather than each value. After an outage that outlasted
+  a tier, the values it lost are sent from the next coarser tier still holding them.
+*/
+#include "value_pyramid.h"
+
+/**
+ * \struct PyramidPartial
+ * \brief Aggregate being filled
+*/
+struct PyramidPartial
+{
+  int32_t   sum ;
+  int16_t   min ;
+  int16_t   max ;
+  uint16_t  count ;
+} ;
+
+PyramidRing pyramidMinutes ;
+PyramidRing pyramidQuarters ;
+
+static PyramidPartial minute  = { 0, INT16_MAX, INT16_MIN, 0 } ;
+static PyramidPartial quarter = { 0, INT16_MAX, INT16_MIN, 0 } ;
+
+
+/**
+ * \fn void fold( PyramidPartial *io_partial, int32_t i_sum, int16_t i_min, int16_t i_max, uint16_t i_count )
+ * \brief Add values, or the aggregate of a finer tier, to an aggregate being filled
+*/
+static inline void fold( PyramidPartial *io_partial, int32_t i_sum, int16_t i_min, int16_t i_max, uint16_t i_count )
+{
+  io_partial->sum   += i_sum ;
+  io_partial->min    = i_min < io_partial->min ? i_min : io_partial->min ;
+  io_partial->max    = i_max > io_partial->max ? i_max : io_partial->max ;
+  io_partial->count += i_count ;
+}
+
+/**
+ * \fn void flush( PyramidPartial *io_partial, PyramidRing *o_ring )
+ * \brief Queue a filled aggregate, and start the next one
+*/
+static void flush( PyramidPartial *io_partial, PyramidRing *o_ring )
+{
+  PyramidAggregate aggregate ;
+  int32_t half = io_partial->count / 2 ;
+
+  aggregate.min   = io_partial->min ;
+  aggregate.max   = io_partial->max ;
+  aggregate.mean  = io_partial->sum >= 0 ? ( io_partial->sum + half ) / io_partial->count : -( ( half - io_partial->sum ) / io_partial->count ) ;
+  aggregate.count = io_partial->count ;
+  o_ring->push(aggregate) ;
+
+  io_partial->sum   = 0 ;
+  io_partial->min   = INT16_MAX ;
+  io_partial->max   = INT16_MIN ;
+  io_partial->count = 0 ;
+}
+
+/**
+ * \fn void pyramidAdd( int16_t i_value )
+ * \param[in] i_value Value added to noiseBufferServer, by its producer only
+ * \brief Fold a value into the tiers, in constant time
+*/
+void pyramidAdd( int16_t i_value )
+{
+  fold(&minute, i_value, i_value, i_value, 1) ;
+  if ( minute.count < PYRAMID_MINUTE_VALUES )
+    return ;
+
+  fold(&quarter, minute.sum, minute.min, minute.max, minute.count) ;
+  flush(&minute, &pyramidMinutes) ;
+  if ( quarter.count < PYRAMID_MINUTE_VALUES * PYRAMID_QUARTER_MINUTES )
+    return ;
+  flush(&quarter, &pyramidQuarters) ;
+}
+
+/**
+ * \fn void pyramidClear( void )
+ * \brief Empty the tiers and the aggregates being filled, along with noiseBufferServer.clear() so that their positions
+ *        stay aligned
+*/
+void pyramidClear( void )
+{
+  minute  = { 0, INT16_MAX, INT16_MIN, 0 } ;
+  quarter = { 0, INT16_MAX, INT16_MIN, 0 } ;
+  pyramidMinutes.clear() ;
+  pyramidQuarters.clear() ;
+}
+
+/**
+ * \fn uint32_t pyramidSpan( PyramidTier i_tier )
+ * \return The number of values in an aggregate of the tier, 1 for PYRAMID_RAW
+*/
+uint32_t pyramidSpan( PyramidTier i_tier )
+{
+  switch ( i_tier )
+  {
+    case PYRAMID_MINUTE:
+      return PYRAMID_MINUTE_VALUES ;
+    case PYRAMID_QUARTER:
+      return PYRAMID_MINUTE_VALUES * PYRAMID_QUARTER_MINUTES ;
+    default:
+      return 1 ;
+  }
+}
+
+/**
+ * \fn PyramidRing * pyramidRing( PyramidTier i_tier )
+ * \return The queue of the aggregates of a tier, NULL for PYRAMID_RAW
+*/
+PyramidRing * pyramidRing( PyramidTier i_tier )
+{
+  switch ( i_tier )
+  {
+    case PYRAMID_MINUTE:
+      return &pyramidMinutes ;
+    case PYRAMID_QUARTER:
+      return &pyramidQuarters ;
+    default:
+      return NULL ;
+  }
+}
+
+/**
+ * \fn PyramidTier pyramidTierFor( uint32_t i_uploadInterval, uint32_t i_valueInterval )
+ * \param[in] i_uploadInterval Delay between two uploads, in ms
+ * \param[in] i_valueInterval Delay between two values, in ms
+ * \return The coarsest tier of which an upload still holds PYRAMID_MIN_PER_UPLOAD aggregates
+*/
+PyramidTier pyramidTierFor( uint32_t i_uploadInterval, uint32_t i_valueInterval )
+{
+  uint8_t iTier = PYRAMID_NB_TIERS - 1 ;
+
+  while ( iTier > PYRAMID_RAW && pyramidSpan((PyramidTier) iTier) * i_valueInterval * PYRAMID_MIN_PER_UPLOAD > i_uploadInterval )
+    iTier-- ;
+  return (PyramidTier) iTier ;
+}
@@ -0,0 +1,54 @@
+/**
+  \file value_pyramid.h
+  \brief Minimum, maximum and mean of the values sent to the server over about 1 and 15 minutes, updated with each value
+*/
+#ifndef VALUE_PYRAMID_H
+#define VALUE_PYRAMID_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "spsc_ring.h"
+
+#define PYRAMID_MINUTE_VALUES     32  /*!< Values in an aggregate of the minute tier, 61.44 s at the delayUpdateValue of main.cpp */
+#define PYRAMID_QUARTER_MINUTES   15  /*!< Aggregates of the minute tier in one of the quarter tier, 15.36 min */
+#define PYRAMID_SIZE_TIER         64  /*!< Aggregates kept by each tier, about 1 hour and 16 hours, a power of two */
+#define PYRAMID_MIN_PER_UPLOAD    4   /*!< Aggregates an upload must hold for the tier to be chosen by pyramidTierFor() */
+
+/**
+ * \enum PyramidTier
+ * \brief Resolution of the values sent to the server
+*/
+enum PyramidTier
+{
+  PYRAMID_RAW,      /*!< Each value, from noiseBufferServer and the flash log */
+  PYRAMID_MINUTE,   /*!< Aggregates of PYRAMID_MINUTE_VALUES values */
+  PYRAMID_QUARTER,  /*!< Aggregates of PYRAMID_QUARTER_MINUTES aggregates of the minute tier */
+  PYRAMID_NB_TIERS
+} ;
+
+/**
+ * \struct PyramidAggregate
+ * \brief Values of an interval of a tier
+*/
+struct PyramidAggregate
+{
+  int16_t   min ;
+  int16_t   max ;
+  int16_t   mean ;   /*!< Rounded to the nearest */
+  uint16_t  count ;  /*!< Number of values, pyramidSpan() of the tier */
+} ;
+
+typedef SpscRing<PyramidAggregate, PYRAMID_SIZE_TIER, SPSC_OVERWRITE_OLDEST> PyramidRing ;
+
+void pyramidAdd( int16_t i_value ) ;
+void pyramidClear( void ) ;
+uint32_t pyramidSpan( PyramidTier i_tier ) ;
+PyramidRing * pyramidRing( PyramidTier i_tier ) ;
+PyramidTier pyramidTierFor( uint32_t i_uploadInterval, uint32_t i_valueInterval ) ;
+
+// Filled by addDataSendServer() along with noiseBufferServer : position p of noiseBufferServer is in the aggregate at
+// position p / pyramidSpan() of each tier. Emptied by the uploader.
+extern PyramidRing pyramidMinutes ;
+extern PyramidRing pyramidQuarters ;
+
+#endif
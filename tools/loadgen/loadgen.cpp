@@ -0,0 +1,994 @@
+/**
+  \file loadgen.cpp
+  \brief Load generator emulating a fleet of boards against the Noisey API, to size the servers that ingest their data
+
+  Each simulated device boots, registers with POST /api/device/ and keeps the short ID it is given, then uploads its
+  values as uploader.cpp does : the messages of an attempt built by buildDataMessageJSON() (or noiseCodecEncode() when
+  built with SERVER_BINARY_PAYLOAD), SERVER_SIZE_MESSAGE_DATA values each, pipelined on a keep-alive connection that
+  is reused across uploads, the summary of the levels with the first one. A value is added every delayUpdateValue,
+  and an upload starts every configDelayDataServer of the device. At the rates where pyramidTierFor() picks a tier of
+  value_pyramid.h, the complete aggregates are sent instead, built by buildAggregateMessageJSON(). A failed attempt is
+  retried at once on a new connection when the reused one was stale, then after a delay doubling from
+  UPLOADER_BACKOFF_MIN_MS. A device can also lose the network for a while, during which its values pile up in its
+  buffer and flash log, or in its tiers, to be sent once it reconnects, the gap a tier lost from the next coarser one.
+
+  The devices also hear loud events, and send each one's snapshot to /api/snapshot/, built by snapshotBuildMessage(),
+  while no upload is due. A failed snapshot is sent again after SNAPSHOT_RETRY_MS, and dropped after
+  SNAPSHOT_MAX_ATTEMPTS.
+
+  The devices are spread over threads, each running its own epoll loop, and the connections are plain HTTP : each
+  one stands for a TLS handshake of a board. Every second, and when exiting, the tool prints the requests and bytes
+  per second and the percentiles of the latency, from the time a request is queued to the end of its response, within
+  1/8 of an octave.
+    -e <host:port>  server to load, 127.0.0.1:8080 by default, where tools/stub_server listens
+    -n <devices>    number of devices, 1000 by default
+    -j <threads>    number of threads, 1 by default
+    -u <index>      index of configDelayDataServer of all the devices, spread over the fixed rates by default
+    -s <speed>      speed of the clock of the devices, which add values and upload that much faster, 1 by default
+    -r <seconds>    time over which the devices boot, 10 s by default
+    -x <percent>    chance that a device loses the network for 1 to 60 min before an upload, 0 by default
+    -l <events>     loud events per device and per hour, each sending a snapshot, 2 by default
+    -t <seconds>    duration of the run, 60 s by default
+*/
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../src/config.h"
+#include "../../src/connection.h"
+#include "../../src/flash_log.h"
+#include "../../src/noise_codec.h"
+#include "../../src/server.h"
+#include "../../src/snapshot.h"
+#include "../../src/uploader.h"
+#include "../../src/value_pyramid.h"
+
+#define LOAD_MAX_EVENTS       256
+#define LOAD_VALUE_MS         1920    /*!< Delay between two values of a device, delayUpdateValue of the firmware, in ms */
+#define LOAD_WINDOW_MS        80      /*!< Length of a window of measure(), delayAnimation of the firmware, in ms */
+#define LOAD_MAX_VALUES       ( SERVER_SIZE_BUFFER_DATA + FLASH_LOG_MAX_SEGMENTS * FLASH_LOG_SEGMENT_VALUES ) /*!< Values a device keeps while it cannot upload */
+#define LOAD_REGISTER_RETRY_MS 30000   /*!< Delay between two attempts to register, REGISTER_RETRY_MS of the firmware, in ms */
+#define LOAD_OUTAGE_MIN_MS    60000
+#define LOAD_OUTAGE_MAX_MS    3600000
+#define LOAD_SUB_BITS         3       /*!< Bins of the histogram of the latencies per power of two */
+#define LOAD_NB_BINS          ( 28 << LOAD_SUB_BITS ) /*!< Up to 2 ^ 28 us, about 4.5 minutes */
+#define LOAD_RATE_MIXED       -1
+#define LOAD_SNAPSHOT_LEVEL   700     /*!< Threshold of the snapshots, in tenths of dB(A) */
+#define LOAD_SNAPSHOT_END_POINT "/api/snapshot/"
+
+/**
+ * \enum LoadState
+ * \brief Step a device is at
+*/
+enum LoadState
+{
+  LOAD_BOOT,      /*!< Waiting for its time to boot */
+  LOAD_REGISTER,  /*!< Waiting for the response to its registration */
+  LOAD_IDLE,      /*!< Waiting for its next upload */
+  LOAD_UPLOAD,    /*!< Waiting for the responses to the messages of an attempt */
+  LOAD_BACKOFF,   /*!< Waiting to retry a failed attempt */
+  LOAD_SNAPSHOT,  /*!< Waiting for the response to a snapshot */
+  LOAD_OUTAGE     /*!< Without network */
+} ;
+
+/**
+ * \struct LoadDevice
+ * \brief A simulated board
+*/
+struct LoadDevice
+{
+  uint32_t    chipID ;
+  char        shortID[configShortIDLength + 1] ;
+  LoadState   state ;
+  uint64_t    wakeMicros ;        /*!< When the device has something to do, UINT64_MAX if it waits for the network */
+  uint64_t    intervalMicros ;    /*!< Delay between two uploads, on the clock of the device */
+  PyramidTier tier ;              /*!< Tier of value_pyramid.h uploaded, see pyramidTierFor() */
+  uint32_t    maxValues ;         /*!< Values the device keeps while it cannot upload, in its buffer and flash log or its tiers */
+  uint64_t    lastValueMicros ;   /*!< When the last value was added */
+  uint64_t    lastUploadMicros ;  /*!< When the last upload started */
+  uint32_t    nbValues ;          /*!< Values waiting to be acknowledged, in aggregates or not */
+  uint8_t     nbSummaries ;       /*!< Summaries of the levels waiting to be acknowledged */
+  uint64_t    snapshotMicros ;    /*!< When the snapshot of the next loud event can be sent, UINT64_MAX for none */
+  uint8_t     snapshotAttempts ;
+  uint32_t    backoffMillis ;
+  bool        retried ;
+  uint32_t    seed ;
+  int         fd ;
+  bool        connecting ;
+  bool        reused ;            /*!< Whether the connection of the attempt was opened by an earlier one */
+  std::string output ;            /*!< Bytes of the requests not written yet */
+  std::string input ;             /*!< Bytes of the responses not parsed yet */
+  std::queue<uint64_t> sentMicros ; /*!< When each request waiting for its response was written */
+  std::queue<uint16_t> messageValues ; /*!< Values of each message waiting for its response, the ones of its aggregates included */
+  bool        summarySent ;       /*!< Whether the first message waiting for its response holds a summary */
+  uint64_t    progressMicros ;    /*!< When the last response arrived, or the attempt started */
+} ;
+
+/**
+ * \struct LoadStats
+ * \brief Counters of a thread, and the latencies of its requests
+*/
+struct LoadStats
+{
+  uint64_t  requests ;
+  uint64_t  bytesSent ;
+  uint64_t  bytesReceived ;
+  uint64_t  connections ;
+  uint64_t  errors ;        /*!< Responses with an error code, and connections dropped or timed out during a request */
+  uint64_t  outages ;
+  uint64_t  registered ;
+  uint64_t  snapshots ;     /*!< Snapshots acknowledged */
+  uint32_t  latencies[LOAD_NB_BINS] ;
+} ;
+
+/**
+ * \struct LoadThread
+ * \brief Devices run by a thread, with its counters
+*/
+struct LoadThread
+{
+  std::vector<LoadDevice> devices ;
+  std::mutex  mutex ;       /*!< Protects the counters, read by the main thread every second */
+  LoadStats   interval ;    /*!< Since the last print */
+  LoadStats   total ;
+} ;
+
+static volatile sig_atomic_t  loadRunning   = 1 ;
+static struct sockaddr_in     loadAddress ;
+static char                   loadHost[64]  = "127.0.0.1" ;
+static double                 loadSpeed     = 1 ;
+static uint32_t               loadOutagePercent = 0 ;
+static double                 loadEventsPerHour = 2 ;
+static std::mutex             loadSnapshotMutex ;   /*!< The snapshots are built by the module of the firmware, which has one ring */
+
+
+static void loadStop( int i_signal )
+{
+  (void) i_signal ;
+  loadRunning = 0 ;
+}
+
+static uint64_t loadNowMicros( void )
+{
+  struct timespec now ;
+
+  clock_gettime(CLOCK_MONOTONIC, &now) ;
+  return now.tv_sec * 1000000ULL + now.tv_nsec / 1000 ;
+}
+
+static uint32_t loadRandom( uint32_t *io_seed )
+{
+  *io_seed = *io_seed * 1103515245 + 12345 ;
+  return *io_seed >> 8 ;
+}
+
+/**
+ * \fn uint32_t latencyBin( uint64_t i_micros )
+ * \return The bin of a latency, 2 ^ LOAD_SUB_BITS bins per power of two
+*/
+static uint32_t latencyBin( uint64_t i_micros )
+{
+  uint32_t exponent, bin ;
+
+  if ( i_micros < ( 1U << LOAD_SUB_BITS ) )
+    return i_micros ;
+  exponent = 63 - __builtin_clzll(i_micros) ;
+  bin = ( ( exponent - LOAD_SUB_BITS + 1 ) << LOAD_SUB_BITS ) | ( ( i_micros >> ( exponent - LOAD_SUB_BITS ) ) & ( ( 1U << LOAD_SUB_BITS ) - 1 ) ) ;
+  return bin < LOAD_NB_BINS ? bin : LOAD_NB_BINS - 1 ;
+}
+
+/**
+ * \fn double latencyPercentile( const uint32_t *i_latencies, uint8_t i_percent )
+ * \return The upper bound of the bin of the latency below which i_percent of the requests were, in ms
+*/
+static double latencyPercentile( const uint32_t *i_latencies, uint8_t i_percent )
+{
+  uint64_t total = 0, count = 0 ;
+  uint32_t bin ;
+
+  for ( bin = 0 ; bin < LOAD_NB_BINS ; bin++ )
+    total += i_latencies[bin] ;
+  if ( total == 0 )
+    return 0 ;
+  for ( bin = 0 ; bin < LOAD_NB_BINS - 1 && ( count += i_latencies[bin] ) * 100 < total * i_percent ; bin++ )
+    ;
+  if ( bin < ( 1U << LOAD_SUB_BITS ) )
+    return ( bin + 1 ) / 1000.0 ;
+  return ( ( ( 1ULL << LOAD_SUB_BITS ) | ( bin & ( ( 1U << LOAD_SUB_BITS ) - 1 ) ) ) + 1 ) * (double) ( 1ULL << ( ( bin >> LOAD_SUB_BITS ) - 1 ) ) / 1000.0 ;
+}
+
+static void loadAddStats( LoadStats *io_stats, const LoadStats *i_stats )
+{
+  io_stats->requests      += i_stats->requests ;
+  io_stats->bytesSent     += i_stats->bytesSent ;
+  io_stats->bytesReceived += i_stats->bytesReceived ;
+  io_stats->connections   += i_stats->connections ;
+  io_stats->errors        += i_stats->errors ;
+  io_stats->outages       += i_stats->outages ;
+  io_stats->registered    += i_stats->registered ;
+  io_stats->snapshots     += i_stats->snapshots ;
+  for ( uint32_t iBin = 0 ; iBin < LOAD_NB_BINS ; iBin++ )
+    io_stats->latencies[iBin] += i_stats->latencies[iBin] ;
+}
+
+static void loadPrintStats( const char *i_label, const LoadStats *i_stats, double i_seconds )
+{
+  printf("%-8s %8.0f req/s %9.1f kB/s out %8.1f kB/s in %7.1f conn/s %6llu errors %5llu outages %6llu registered %5llu snapshots   latency p50 %7.2f p90 %7.2f p99 %7.2f max %8.2f ms\n",
+         i_label, i_stats->requests / i_seconds, i_stats->bytesSent / 1024.0 / i_seconds, i_stats->bytesReceived / 1024.0 / i_seconds,
+         i_stats->connections / i_seconds, (unsigned long long) i_stats->errors, (unsigned long long) i_stats->outages, (unsigned long long) i_stats->registered,
+         (unsigned long long) i_stats->snapshots,
+         latencyPercentile(i_stats->latencies, 50), latencyPercentile(i_stats->latencies, 90), latencyPercentile(i_stats->latencies, 99), latencyPercentile(i_stats->latencies, 100)) ;
+}
+
+/**
+ * \fn uint64_t loadNextSnapshot( uint64_t i_nowMicros, uint32_t *io_seed )
+ * \return When the snapshot of the next loud event of a device is captured, UINT64_MAX if they have none
+*/
+static uint64_t loadNextSnapshot( uint64_t i_nowMicros, uint32_t *io_seed )
+{
+  if ( loadEventsPerHour <= 0 )
+    return UINT64_MAX ;
+  return i_nowMicros + (uint64_t) ( ( 2 * 3600e6 / loadEventsPerHour * ( loadRandom(io_seed) % 1000 ) / 1000
+                                      + SNAPSHOT_POST_WINDOWS * LOAD_WINDOW_MS * 1000 ) / loadSpeed ) ;
+}
+
+/**
+ * \fn size_t loadSnapshotMessage( char *o_message, const char *i_shortID, uint32_t *io_seed )
+ * \param[out] o_message Buffer of SNAPSHOT_SIZE_MESSAGE bytes
+ * \return The length of the message of a snapshot, quiet windows before the trigger and loud ones after
+*/
+static size_t loadSnapshotMessage( char *o_message, const char *i_shortID, uint32_t *io_seed )
+{
+  std::lock_guard<std::mutex> lock(loadSnapshotMutex) ;
+
+  snapshotBegin() ;
+  snapshotConfigure(LOAD_SNAPSHOT_LEVEL) ;
+  for ( uint8_t iWindow = 0 ; iWindow < SNAPSHOT_NB_WINDOWS && !snapshotPending() ; iWindow++ )
+  {
+    int16_t level = iWindow < SNAPSHOT_PRE_WINDOWS ? 400 + loadRandom(io_seed) % 100 : LOAD_SNAPSHOT_LEVEL + loadRandom(io_seed) % 200 ;
+
+    snapshotAdd(level, loadRandom(io_seed) % 400) ;
+  }
+  return snapshotBuildMessage(o_message, SNAPSHOT_SIZE_MESSAGE, i_shortID) ;
+}
+
+/**
+ * \class LoadWorker
+ * \brief epoll loop of one thread, running its devices
+*/
+class LoadWorker
+{
+  public:
+    LoadWorker( LoadThread *io_thread ) : m_thread(io_thread), m_poller(epoll_create1(0)) {}
+    ~LoadWorker() { close(m_poller) ; }
+    void run( uint64_t i_endMicros ) ;
+
+  private:
+    typedef std::pair<uint64_t, uint32_t> Timer ;
+
+    void schedule( uint32_t i_device, uint64_t i_wakeMicros ) ;
+    bool openConnection( uint32_t i_device ) ;
+    void closeConnection( uint32_t i_device ) ;
+    void watch( uint32_t i_device ) ;
+    void post( uint32_t i_device, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length ) ;
+    void flush( uint32_t i_device ) ;
+    void receive( uint32_t i_device ) ;
+    void handleResponse( uint32_t i_device, int i_code, const std::string &i_body ) ;
+    void wake( uint32_t i_device, uint64_t i_nowMicros ) ;
+    void idle( uint32_t i_device ) ;
+    void startUpload( uint32_t i_device, uint64_t i_nowMicros ) ;
+    void sendSnapshot( uint32_t i_device, uint64_t i_nowMicros ) ;
+    void releaseSnapshot( uint32_t i_device, uint64_t i_nowMicros ) ;
+    void fail( uint32_t i_device, bool i_retryNow ) ;
+    void count( uint64_t LoadStats::*i_counter, uint64_t i_value ) ;
+
+    LoadThread *m_thread ;
+    int         m_poller ;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer> > m_timers ;
+} ;
+
+void LoadWorker::count( uint64_t LoadStats::*i_counter, uint64_t i_value )
+{
+  std::lock_guard<std::mutex> lock(m_thread->mutex) ;
+
+  m_thread->interval.*i_counter += i_value ;
+}
+
+void LoadWorker::schedule( uint32_t i_device, uint64_t i_wakeMicros )
+{
+  m_thread->devices[i_device].wakeMicros = i_wakeMicros ;
+  m_timers.push(Timer(i_wakeMicros, i_device)) ;
+}
+
+/**
+ * \fn bool LoadWorker::openConnection( uint32_t i_device )
+ * \return False if the socket could not be created, the connection itself completing later
+*/
+bool LoadWorker::openConnection( uint32_t i_device )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  struct epoll_event event ;
+  int noDelay = 1 ;
+
+  device.reused = device.fd >= 0 ;
+  if ( device.fd >= 0 )
+    return true ;
+  device.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0) ;
+  if ( device.fd < 0 )
+    return false ;
+  setsockopt(device.fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) ;
+  if ( connect(device.fd, (struct sockaddr *) &loadAddress, sizeof(loadAddress)) != 0 && errno != EINPROGRESS )
+  {
+    close(device.fd) ;
+    device.fd = -1 ;
+    return false ;
+  }
+  device.connecting = true ;
+  event.events      = EPOLLIN | EPOLLOUT | EPOLLRDHUP ;
+  event.data.u32    = i_device ;
+  epoll_ctl(m_poller, EPOLL_CTL_ADD, device.fd, &event) ;
+  count(&LoadStats::connections, 1) ;
+  return true ;
+}
+
+void LoadWorker::closeConnection( uint32_t i_device )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+
+  if ( device.fd >= 0 )
+    close(device.fd) ;
+  device.fd         = -1 ;
+  device.connecting = false ;
+  device.output.clear() ;
+  device.input.clear() ;
+  device.sentMicros    = std::queue<uint64_t>() ;
+  device.messageValues = std::queue<uint16_t>() ;
+}
+
+/**
+ * \fn void LoadWorker::watch( uint32_t i_device )
+ * \brief Wait for the connection to be writable only while there are bytes to write
+*/
+void LoadWorker::watch( uint32_t i_device )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  struct epoll_event event ;
+
+  event.events    = EPOLLIN | EPOLLRDHUP | ( device.connecting || !device.output.empty() ? (uint32_t) EPOLLOUT : 0u ) ;
+  event.data.u32  = i_device ;
+  epoll_ctl(m_poller, EPOLL_CTL_MOD, device.fd, &event) ;
+}
+
+/**
+ * \fn void LoadWorker::post( uint32_t i_device, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length )
+ * \brief Queue a request with the headers written by connectionWriteRequest()
+*/
+void LoadWorker::post( uint32_t i_device, const char *i_endPoint, const char *i_contentType, const uint8_t *i_body, size_t i_length )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  char headers[256] ;
+  size_t length = snprintf(headers, sizeof(headers), "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: keep-alive\r\n\r\n",
+                           i_endPoint, loadHost, i_contentType, (unsigned) i_length) ;
+
+  device.output.append(headers, length) ;
+  device.output.append((const char *) i_body, i_length) ;
+  device.sentMicros.push(loadNowMicros()) ;
+  {
+    std::lock_guard<std::mutex> lock(m_thread->mutex) ;
+
+    m_thread->interval.requests++ ;
+    m_thread->interval.bytesSent += length + i_length ;
+  }
+  flush(i_device) ;
+}
+
+void LoadWorker::flush( uint32_t i_device )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+
+  while ( !device.connecting && !device.output.empty() )
+  {
+    ssize_t length = send(device.fd, device.output.data(), device.output.size(), MSG_NOSIGNAL) ;
+
+    if ( length <= 0 )
+    {
+      // A broken connection is reported by epoll, and failed by receive()
+      if ( length == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+        device.output.clear() ;
+      break ;
+    }
+    device.output.erase(0, length) ;
+  }
+  watch(i_device) ;
+}
+
+/**
+ * \fn void LoadWorker::receive( uint32_t i_device )
+ * \brief Read what arrived on the connection, and handle the complete responses in order
+*/
+void LoadWorker::receive( uint32_t i_device )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  char buffer[4096] ;
+  ssize_t length ;
+  bool closed = false ;
+
+  while ( ( length = recv(device.fd, buffer, sizeof(buffer), 0) ) > 0 )
+  {
+    device.input.append(buffer, length) ;
+    count(&LoadStats::bytesReceived, length) ;
+  }
+  closed = length == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) ;
+
+  for ( ;; )
+  {
+    size_t endHeaders = device.input.find("\r\n\r\n"), position, contentLength = 0 ;
+    int code = 0 ;
+
+    if ( endHeaders == std::string::npos )
+      break ;
+    if ( ( position = device.input.find("Content-Length:") ) < endHeaders || ( position = device.input.find("content-length:") ) < endHeaders )
+      contentLength = strtoul(device.input.c_str() + position + 15, NULL, 10) ;
+    if ( device.input.size() < endHeaders + 4 + contentLength )
+      break ;
+    sscanf(device.input.c_str(), "HTTP/1.%*d %d", &code) ;
+    std::string body = device.input.substr(endHeaders + 4, contentLength) ;
+    device.input.erase(0, endHeaders + 4 + contentLength) ;
+
+    if ( !device.sentMicros.empty() )
+    {
+      std::lock_guard<std::mutex> lock(m_thread->mutex) ;
+
+      m_thread->interval.latencies[latencyBin(loadNowMicros() - device.sentMicros.front())]++ ;
+      device.sentMicros.pop() ;
+    }
+    handleResponse(i_device, code, body) ;
+    if ( device.fd < 0 )
+      return ;
+  }
+
+  // A connection closed while idle is opened again by the next upload, as the board does
+  if ( closed )
+  {
+    if ( device.sentMicros.empty() )
+      closeConnection(i_device) ;
+    else
+      fail(i_device, true) ;
+  }
+}
+
+/**
+ * \fn void LoadWorker::handleResponse( uint32_t i_device, int i_code, const std::string &i_body )
+ * \brief Take the short ID of a registration, or release the values of an acknowledged message
+*/
+void LoadWorker::handleResponse( uint32_t i_device, int i_code, const std::string &i_body )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  uint64_t now = loadNowMicros() ;
+
+  if ( i_code < 200 || i_code >= 300 )
+  {
+    count(&LoadStats::errors, 1) ;
+    fail(i_device, false) ;
+    return ;
+  }
+
+  if ( device.state == LOAD_REGISTER )
+  {
+    size_t position = i_body.find("\"shortID\":\"") ;
+
+    if ( position != std::string::npos )
+      snprintf(device.shortID, sizeof(device.shortID), "%.*s", configShortIDLength, i_body.c_str() + position + 11) ;
+    count(&LoadStats::registered, 1) ;
+    device.state = LOAD_IDLE ;
+    startUpload(i_device, now) ;
+    return ;
+  }
+
+  if ( device.state == LOAD_SNAPSHOT )
+  {
+    count(&LoadStats::snapshots, 1) ;
+    device.retried = false ;
+    releaseSnapshot(i_device, now) ;
+    idle(i_device) ;
+    return ;
+  }
+
+  if ( device.state != LOAD_UPLOAD || device.messageValues.empty() )
+    return ;
+  device.nbValues      -= device.messageValues.front() < device.nbValues ? device.messageValues.front() : device.nbValues ;
+  device.nbSummaries   -= device.summarySent && device.nbSummaries > 0 ;
+  device.summarySent    = false ;
+  device.progressMicros = now ;
+  device.messageValues.pop() ;
+  if ( !device.messageValues.empty() )
+    return ;
+
+  // The values piled up during an outage are sent by attempts following each other
+  device.backoffMillis = 0 ;
+  device.retried       = false ;
+  device.state         = LOAD_IDLE ;
+  if ( device.nbValues >= pyramidSpan(device.tier) || device.nbSummaries > 0 )
+    startUpload(i_device, now) ;
+  else
+    idle(i_device) ;
+}
+
+/**
+ * \fn void LoadWorker::fail( uint32_t i_device, bool i_retryNow )
+ * \param[in] i_retryNow Whether the connection failed, the attempt being retried at once if it was a reused one
+ * \brief Drop the connection with the responses still expected, and retry later as uploader.cpp does
+*/
+void LoadWorker::fail( uint32_t i_device, bool i_retryNow )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  bool inRequest = !device.sentMicros.empty() ;
+  uint64_t now = loadNowMicros() ;
+
+  if ( inRequest && i_retryNow )
+    count(&LoadStats::errors, 1) ;
+  closeConnection(i_device) ;
+
+  if ( device.state == LOAD_REGISTER )
+  {
+    device.state = LOAD_BOOT ;
+    schedule(i_device, now + LOAD_REGISTER_RETRY_MS * 1000 / loadSpeed) ;
+    return ;
+  }
+  if ( device.state == LOAD_SNAPSHOT )
+  {
+    bool retryNow = i_retryNow && device.reused && !device.retried ;
+
+    device.retried            = retryNow ;
+    device.snapshotAttempts  += !retryNow ;
+    device.snapshotMicros     = retryNow ? now : now + SNAPSHOT_RETRY_MS * 1000ULL / loadSpeed ;
+    if ( device.snapshotAttempts >= SNAPSHOT_MAX_ATTEMPTS )
+      releaseSnapshot(i_device, now) ;
+    idle(i_device) ;
+    return ;
+  }
+  if ( i_retryNow && device.reused && !device.retried )
+  {
+    device.retried = true ;
+    startUpload(i_device, now) ;
+    return ;
+  }
+  device.retried       = false ;
+  device.backoffMillis = device.backoffMillis == 0 ? UPLOADER_BACKOFF_MIN_MS : device.backoffMillis * 2 ;
+  device.backoffMillis = device.backoffMillis < UPLOADER_BACKOFF_MAX_MS ? device.backoffMillis : UPLOADER_BACKOFF_MAX_MS ;
+  device.state         = LOAD_BACKOFF ;
+  schedule(i_device, now + device.backoffMillis * 1000 / loadSpeed) ;
+}
+
+/**
+ * \fn void LoadWorker::startUpload( uint32_t i_device, uint64_t i_nowMicros )
+ * \brief Add the values of the time elapsed, then write the messages of an attempt, or lose the network for a while
+*/
+void LoadWorker::startUpload( uint32_t i_device, uint64_t i_nowMicros )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  uint64_t valueMicros = LOAD_VALUE_MS * 1000 / loadSpeed ;
+  uint32_t nbNew = ( i_nowMicros - device.lastValueMicros ) / valueMicros ;
+  uint32_t capacity = PYRAMID_SIZE_TIER * pyramidSpan(device.tier), span ;
+  int16_t nbElements, data[SERVER_SIZE_BUFFER_DATA] ;
+  PyramidAggregate aggregates[PYRAMID_SIZE_TIER] ;
+  PyramidTier tier = device.tier ;
+  LevelSummary summary ;
+
+  device.lastValueMicros += nbNew * valueMicros ;
+  device.nbValues         = device.nbValues + nbNew < device.maxValues ? device.nbValues + nbNew : device.maxValues ;
+  if ( device.state == LOAD_IDLE && i_nowMicros - device.lastUploadMicros >= device.intervalMicros )
+  {
+    device.lastUploadMicros = i_nowMicros ;
+    device.nbSummaries      = device.nbSummaries < LEVEL_STATS_NB_SUMMARIES ? device.nbSummaries + 1 : LEVEL_STATS_NB_SUMMARIES ;
+    if ( loadRandom(&device.seed) % 100 < loadOutagePercent )
+    {
+      uint32_t outageMillis = LOAD_OUTAGE_MIN_MS + loadRandom(&device.seed) % ( LOAD_OUTAGE_MAX_MS - LOAD_OUTAGE_MIN_MS ) ;
+
+      count(&LoadStats::outages, 1) ;
+      closeConnection(i_device) ;
+      device.state = LOAD_OUTAGE ;
+      schedule(i_device, i_nowMicros + outageMillis * 1000ULL / loadSpeed) ;
+      return ;
+    }
+  }
+
+  // At a coarse tier, the complete aggregates, after the gap the tier lost during an outage, sent from the next one
+  if ( tier != PYRAMID_RAW && tier < PYRAMID_QUARTER && device.nbValues > capacity )
+    tier = (PyramidTier) ( tier + 1 ) ;
+  span = pyramidSpan(tier) ;
+  if ( tier == PYRAMID_RAW )
+    nbElements = device.nbValues < SERVER_SIZE_BUFFER_DATA ? device.nbValues : SERVER_SIZE_BUFFER_DATA ;
+  else
+  {
+    nbElements = tier != device.tier ? ( device.nbValues - capacity + span - 1 ) / span : device.nbValues / span ;
+    nbElements = nbElements < PYRAMID_SIZE_TIER ? nbElements : PYRAMID_SIZE_TIER ;
+    nbElements = nbElements < UPLOADER_MAX_MESSAGES * SERVER_SIZE_MESSAGE_AGGREGATES ? nbElements : UPLOADER_MAX_MESSAGES * SERVER_SIZE_MESSAGE_AGGREGATES ;
+  }
+  if ( nbElements == 0 && device.nbSummaries == 0 )
+  {
+    idle(i_device) ;
+    return ;
+  }
+  if ( !openConnection(i_device) )
+  {
+    fail(i_device, false) ;
+    return ;
+  }
+
+  memset(&summary, 0, sizeof(summary)) ;
+  summary.nbLevels = 3750 ;
+  summary.min      = 350 + loadRandom(&device.seed) % 50 ;
+  summary.l90      = summary.min + 10 ;
+  summary.l50      = summary.min + 50 ;
+  summary.l10      = summary.min + 150 ;
+  summary.max      = summary.min + 300 ;
+  for ( uint8_t iBand = 0 ; iBand < SPECTRUM_NB_BANDS ; iBand++ )
+    summary.bands[iBand] = 300 + loadRandom(&device.seed) % 300 ;
+  for ( int16_t iValue = 0 ; iValue < nbElements && tier == PYRAMID_RAW ; iValue++ )
+    data[iValue] = loadRandom(&device.seed) % 60 ;
+  for ( int16_t iAggregate = 0 ; iAggregate < nbElements && tier != PYRAMID_RAW ; iAggregate++ )
+  {
+    aggregates[iAggregate].min    = loadRandom(&device.seed) % 30 ;
+    aggregates[iAggregate].max    = aggregates[iAggregate].min + loadRandom(&device.seed) % 30 ;
+    aggregates[iAggregate].mean   = ( aggregates[iAggregate].min + aggregates[iAggregate].max ) / 2 ;
+    aggregates[iAggregate].count  = span ;
+  }
+
+  device.state          = LOAD_UPLOAD ;
+  device.summarySent    = device.nbSummaries > 0 ;
+  device.progressMicros = i_nowMicros ;
+  device.wakeMicros     = UINT64_MAX ;
+  for ( int16_t written = 0 ; written < nbElements || written == 0 ; )
+  {
+    const LevelSummary *messageSummary = written == 0 && device.summarySent ? &summary : NULL ;
+
+    // The aggregates are few, they are sent as JSON in both formats
+    if ( tier != PYRAMID_RAW && nbElements > 0 )
+    {
+      char    message[SERVER_SIZE_MESSAGE_JSON] ;
+      int16_t nbData = nbElements - written < SERVER_SIZE_MESSAGE_AGGREGATES ? nbElements - written : SERVER_SIZE_MESSAGE_AGGREGATES ;
+      size_t  length = buildAggregateMessageJSON(message, sizeof(message), device.shortID, LOAD_VALUE_MS * span, nbElements, written == 0,
+                                                 aggregates + written, nbData, messageSummary, 0) ;
+
+      post(i_device, "/api/data/", "application/json", (const uint8_t *) message, length) ;
+      if ( device.fd < 0 )
+        return ;
+      device.messageValues.push(nbData * span) ;
+      written += nbData ;
+      continue ;
+    }
+#ifdef SERVER_BINARY_PAYLOAD
+    uint8_t message[NOISE_CODEC_SIZE_MAX(SERVER_SIZE_BUFFER_DATA)] ;
+    int16_t nbData = nbElements - written ;
+    size_t  length = noiseCodecEncode(message, sizeof(message), device.shortID, LOAD_VALUE_MS, nbElements, written == 0, data + written, nbData, messageSummary, 0) ;
+
+    post(i_device, "/api/data/", NOISE_CODEC_CONTENT_TYPE, message, length) ;
+#else
+    char    message[SERVER_SIZE_MESSAGE_JSON] ;
+    int16_t nbData = nbElements - written < SERVER_SIZE_MESSAGE_DATA ? nbElements - written : SERVER_SIZE_MESSAGE_DATA ;
+    size_t  length = buildDataMessageJSON(message, sizeof(message), device.shortID, LOAD_VALUE_MS, nbElements, written == 0, data + written, nbData, messageSummary, 0) ;
+
+    post(i_device, "/api/data/", "application/json", (const uint8_t *) message, length) ;
+#endif
+    if ( device.fd < 0 )
+      return ;
+    device.messageValues.push(nbData) ;
+    written += nbData ;
+    if ( nbData == 0 )
+      break ;
+  }
+}
+
+/**
+ * \fn void LoadWorker::idle( uint32_t i_device )
+ * \brief Wait for the next upload, or for the snapshot to send before it
+*/
+void LoadWorker::idle( uint32_t i_device )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  uint64_t uploadMicros = device.lastUploadMicros + device.intervalMicros ;
+
+  device.state = LOAD_IDLE ;
+  schedule(i_device, device.snapshotMicros < uploadMicros ? device.snapshotMicros : uploadMicros) ;
+}
+
+/**
+ * \fn void LoadWorker::sendSnapshot( uint32_t i_device, uint64_t i_nowMicros )
+ * \brief Write the snapshot of the last loud event, on the connection of the uploads
+*/
+void LoadWorker::sendSnapshot( uint32_t i_device, uint64_t i_nowMicros )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  char message[SNAPSHOT_SIZE_MESSAGE] ;
+  size_t length = loadSnapshotMessage(message, device.shortID, &device.seed) ;
+
+  device.state = LOAD_SNAPSHOT ;
+  if ( !openConnection(i_device) )
+  {
+    fail(i_device, false) ;
+    return ;
+  }
+  device.progressMicros = i_nowMicros ;
+  device.wakeMicros     = UINT64_MAX ;
+  post(i_device, LOAD_SNAPSHOT_END_POINT, "application/json", (const uint8_t *) message, length) ;
+}
+
+/**
+ * \fn void LoadWorker::releaseSnapshot( uint32_t i_device, uint64_t i_nowMicros )
+ * \brief Forget the snapshot, sent or dropped, and wait for the next loud event
+*/
+void LoadWorker::releaseSnapshot( uint32_t i_device, uint64_t i_nowMicros )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+
+  device.snapshotAttempts = 0 ;
+  device.snapshotMicros   = loadNextSnapshot(i_nowMicros, &device.seed) ;
+}
+
+/**
+ * \fn void LoadWorker::wake( uint32_t i_device, uint64_t i_nowMicros )
+ * \brief Boot, upload or retry, as the state of the device requires
+*/
+void LoadWorker::wake( uint32_t i_device, uint64_t i_nowMicros )
+{
+  LoadDevice &device = m_thread->devices[i_device] ;
+  char message[32] ;
+
+  device.wakeMicros = UINT64_MAX ;
+  switch ( device.state )
+  {
+    case LOAD_BOOT:
+      if ( !openConnection(i_device) )
+      {
+        schedule(i_device, i_nowMicros + LOAD_REGISTER_RETRY_MS * 1000 / loadSpeed) ;
+        return ;
+      }
+      device.state = LOAD_REGISTER ;
+      snprintf(message, sizeof(message), "{\"id\":\"%u\"}", device.chipID) ;
+      post(i_device, "/api/device/", "application/json", (const uint8_t *) message, strlen(message)) ;
+      break ;
+    case LOAD_OUTAGE:
+      device.state = LOAD_IDLE ;
+      startUpload(i_device, i_nowMicros) ;
+      break ;
+    case LOAD_IDLE:
+      // A snapshot is only sent while no upload is due
+      if ( i_nowMicros - device.lastUploadMicros < device.intervalMicros )
+      {
+        if ( i_nowMicros >= device.snapshotMicros )
+          sendSnapshot(i_device, i_nowMicros) ;
+        else
+          idle(i_device) ;
+        break ;
+      }
+      startUpload(i_device, i_nowMicros) ;
+      break ;
+    case LOAD_BACKOFF:
+      device.state = LOAD_IDLE ;
+      startUpload(i_device, i_nowMicros) ;
+      break ;
+    default:
+      break ;
+  }
+}
+
+void LoadWorker::run( uint64_t i_endMicros )
+{
+  struct epoll_event events[LOAD_MAX_EVENTS] ;
+  uint64_t lastCheckMicros = 0 ;
+
+  for ( uint32_t iDevice = 0 ; iDevice < m_thread->devices.size() ; iDevice++ )
+    schedule(iDevice, m_thread->devices[iDevice].wakeMicros) ;
+
+  while ( loadRunning && loadNowMicros() < i_endMicros )
+  {
+    uint64_t now = loadNowMicros() ;
+    int timeout = 100, nbEvents ;
+
+    // The timers of the devices that are due, the stale ones being skipped
+    while ( !m_timers.empty() && m_timers.top().first <= now )
+    {
+      Timer timer = m_timers.top() ;
+
+      m_timers.pop() ;
+      if ( m_thread->devices[timer.second].wakeMicros == timer.first )
+        wake(timer.second, now) ;
+    }
+    if ( !m_timers.empty() )
+      timeout = m_timers.top().first - now < 100000 ? ( m_timers.top().first - now + 999 ) / 1000 : 100 ;
+
+    nbEvents = epoll_wait(m_poller, events, LOAD_MAX_EVENTS, timeout) ;
+    for ( int iEvent = 0 ; iEvent < nbEvents ; iEvent++ )
+    {
+      uint32_t iDevice = events[iEvent].data.u32 ;
+      LoadDevice &device = m_thread->devices[iDevice] ;
+
+      if ( device.fd < 0 )
+        continue ;
+      if ( device.connecting && ( events[iEvent].events & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) ) )
+      {
+        int error = 0 ;
+        socklen_t length = sizeof(error) ;
+
+        getsockopt(device.fd, SOL_SOCKET, SO_ERROR, &error, &length) ;
+        device.connecting = false ;
+        if ( error != 0 )
+        {
+          fail(iDevice, true) ;
+          continue ;
+        }
+      }
+      if ( events[iEvent].events & EPOLLOUT )
+        flush(iDevice) ;
+      if ( device.fd >= 0 && ( events[iEvent].events & ( EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR ) ) )
+        receive(iDevice) ;
+    }
+
+    // Requests without response for CONNECTION_TIMEOUT_MS fail, as they do on the board
+    now = loadNowMicros() ;
+    if ( now - lastCheckMicros < 100000 )
+      continue ;
+    lastCheckMicros = now ;
+    for ( uint32_t iDevice = 0 ; iDevice < m_thread->devices.size() ; iDevice++ )
+    {
+      LoadDevice &device = m_thread->devices[iDevice] ;
+
+      if ( !device.sentMicros.empty() && now - ( device.state == LOAD_UPLOAD ? device.progressMicros : device.sentMicros.front() ) > CONNECTION_TIMEOUT_MS * 1000ULL )
+        fail(iDevice, true) ;
+    }
+  }
+
+  for ( uint32_t iDevice = 0 ; iDevice < m_thread->devices.size() ; iDevice++ )
+    closeConnection(iDevice) ;
+}
+
+static void loadThreadRun( LoadThread *io_thread, uint64_t i_endMicros )
+{
+  LoadWorker worker(io_thread) ;
+
+  worker.run(i_endMicros) ;
+}
+
+int main( int argc, char **argv )
+{
+  const char *endPoint = "127.0.0.1:8080" ;
+  uint32_t nbDevices = 1000, nbThreads = 1, rampSeconds = 10, durationSeconds = 60 ;
+  int rateIndex = LOAD_RATE_MIXED, option ;
+  std::vector<LoadThread *> threads ;
+  std::vector<std::thread> workers ;
+  LoadStats total ;
+  struct rlimit limit ;
+  uint64_t startMicros, endMicros, lastPrintMicros ;
+
+  while ( ( option = getopt(argc, argv, "e:n:j:u:s:r:x:l:t:") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 'e': endPoint          = optarg ; break ;
+      case 'n': nbDevices         = atoi(optarg) ; break ;
+      case 'j': nbThreads         = atoi(optarg) ; break ;
+      case 'u': rateIndex         = atoi(optarg) ; break ;
+      case 's': loadSpeed         = atof(optarg) ; break ;
+      case 'r': rampSeconds       = atoi(optarg) ; break ;
+      case 'x': loadOutagePercent = atoi(optarg) ; break ;
+      case 'l': loadEventsPerHour = atof(optarg) ; break ;
+      case 't': durationSeconds   = atoi(optarg) ; break ;
+      default:
+        fprintf(stderr, "usage: %s [-e host:port] [-n devices] [-j threads] [-u rate_index] [-s speed] [-r ramp_s] [-x outage_percent] [-l events_per_hour] [-t duration_s]\n", argv[0]) ;
+        return 1 ;
+    }
+  }
+  memset(&loadAddress, 0, sizeof(loadAddress)) ;
+  loadAddress.sin_family = AF_INET ;
+  snprintf(loadHost, sizeof(loadHost), "%.*s", (int) ( strchr(endPoint, ':') != NULL ? strchr(endPoint, ':') - endPoint : strlen(endPoint) ), endPoint) ;
+  loadAddress.sin_port   = htons(strchr(endPoint, ':') != NULL ? atoi(strchr(endPoint, ':') + 1) : 80) ;
+  if ( inet_pton(AF_INET, loadHost, &loadAddress.sin_addr) != 1 || nbThreads == 0 || loadSpeed <= 0 ||
+       ( rateIndex != LOAD_RATE_MIXED && ( rateIndex < configDelayDataServerMin || rateIndex > configDelayDataServerMax ) ) )
+  {
+    fprintf(stderr, "%s: the end point must be an IPv4 address and a port, the rate an index of configDelayDataServer\n", argv[0]) ;
+    return 1 ;
+  }
+
+  // Each device holds a connection open
+  getrlimit(RLIMIT_NOFILE, &limit) ;
+  limit.rlim_cur = limit.rlim_max ;
+  setrlimit(RLIMIT_NOFILE, &limit) ;
+  if ( limit.rlim_cur < nbDevices + 64 )
+    fprintf(stderr, "warning: %llu file descriptors for %u devices\n", (unsigned long long) limit.rlim_cur, nbDevices) ;
+
+  signal(SIGINT, loadStop) ;
+  signal(SIGTERM, loadStop) ;
+  signal(SIGPIPE, SIG_IGN) ;
+
+  startMicros = loadNowMicros() ;
+  endMicros   = startMicros + durationSeconds * 1000000ULL ;
+  for ( uint32_t iThread = 0 ; iThread < nbThreads ; iThread++ )
+  {
+    threads.push_back(new LoadThread()) ;
+    memset(&threads.back()->interval, 0, sizeof(LoadStats)) ;
+    memset(&threads.back()->total, 0, sizeof(LoadStats)) ;
+  }
+  for ( uint32_t iDevice = 0 ; iDevice < nbDevices ; iDevice++ )
+  {
+    LoadDevice device ;
+    int rate = rateIndex == LOAD_RATE_MIXED ? iDevice % ( configDelayDataServerAdaptive - configDelayDataServerMin ) + configDelayDataServerMin : rateIndex ;
+
+    device.chipID           = 0x100000 + iDevice ;
+    snprintf(device.shortID, sizeof(device.shortID), "L%05u", iDevice % 100000) ;
+    device.state            = LOAD_BOOT ;
+    device.seed             = iDevice * 2654435761U + 1 ;
+    device.wakeMicros       = startMicros + ( nbDevices > 1 ? rampSeconds * 1000000ULL * iDevice / nbDevices : 0 ) ;
+    device.intervalMicros   = configDelayDataServer[rate] * 1000ULL / loadSpeed ;
+    device.tier             = pyramidTierFor(configDelayDataServer[rate], LOAD_VALUE_MS) ;
+    device.maxValues        = device.tier == PYRAMID_RAW ? LOAD_MAX_VALUES : PYRAMID_SIZE_TIER * pyramidSpan(PYRAMID_QUARTER) ;
+    device.lastValueMicros  = device.wakeMicros ;
+    device.lastUploadMicros = device.wakeMicros - device.intervalMicros ;
+    device.nbValues         = 0 ;
+    device.nbSummaries      = 0 ;
+    device.snapshotMicros   = loadNextSnapshot(device.wakeMicros, &device.seed) ;
+    device.snapshotAttempts = 0 ;
+    device.backoffMillis    = 0 ;
+    device.retried          = false ;
+    device.fd               = -1 ;
+    device.connecting       = false ;
+    device.reused           = false ;
+    device.summarySent      = false ;
+    device.progressMicros   = 0 ;
+    threads[iDevice % nbThreads]->devices.push_back(device) ;
+  }
+  fprintf(stderr, "%u devices on %u threads against %s, clock %.1fx\n", nbDevices, nbThreads, endPoint, loadSpeed) ;
+
+  for ( uint32_t iThread = 0 ; iThread < nbThreads ; iThread++ )
+    workers.push_back(std::thread(loadThreadRun, threads[iThread], endMicros)) ;
+
+  // The counters of the threads, every second
+  memset(&total, 0, sizeof(total)) ;
+  lastPrintMicros = startMicros ;
+  while ( loadRunning && loadNowMicros() < endMicros )
+  {
+    LoadStats interval ;
+    uint64_t now ;
+    char label[16] ;
+
+    usleep(1000000 - ( loadNowMicros() - startMicros ) % 1000000) ;
+    now = loadNowMicros() ;
+    memset(&interval, 0, sizeof(interval)) ;
+    for ( uint32_t iThread = 0 ; iThread < nbThreads ; iThread++ )
+    {
+      std::lock_guard<std::mutex> lock(threads[iThread]->mutex) ;
+
+      loadAddStats(&interval, &threads[iThread]->interval) ;
+      memset(&threads[iThread]->interval, 0, sizeof(LoadStats)) ;
+    }
+    loadAddStats(&total, &interval) ;
+    snprintf(label, sizeof(label), "%.0f s", ( now - startMicros ) / 1e6) ;
+    loadPrintStats(label, &interval, ( now - lastPrintMicros ) / 1e6) ;
+    lastPrintMicros = now ;
+  }
+
+  for ( uint32_t iThread = 0 ; iThread < nbThreads ; iThread++ )
+  {
+    workers[iThread].join() ;
+    loadAddStats(&total, &threads[iThread]->interval) ;
+    delete threads[iThread] ;
+  }
+  loadPrintStats("total", &total, ( loadNowMicros() - startMicros ) / 1e6) ;
+  return 0 ;
+}
@@ -0,0 +1,291 @@
+/**
+  \file replay.cpp
+  \brief Replay of a recorded ADC trace through the firmware on the host, much faster than real time
+
+  The firmware runs as on the board, setup() then loop(), on the virtual clock of lib/hal_native : the sampler reads
+  the trace at the time of each analogRead(), and measure(), updateColor(), animate() and the uploads run from the
+  scheduler and loop() as they would. The in-process server registers the device and acknowledges every upload.
+
+  The trace is a CSV of raw ADC values (0 to 1023, the first column of each line, the lines that do not start with a
+  number being skipped) sampled at -r Hz, or a PCM WAV file (8 or 16 bits, the first channel), mapped to the range of
+  the ADC around 512. It is played in a loop for the duration given by -t. With -o prefix, the run writes :
+    prefix.hue.csv      time_ms,hue,level_ddB,value each time the hue, the level or the value uploaded changes
+    prefix.frames.csv   time_ms,pixels,colors of each frame sent to a strip, the colors in hex
+    prefix.uploads.txt  time_ms end_point length body of each request, the binary bodies in hex
+  The outputs only depend on the trace and on the firmware, so that two builds with different tunings, such as
+  -D RUNNING_AVERAGE_FACTOR_OLD=200 or -D SCALE_DELTA=8, can be compared with diff. The device-hours simulated per
+  second of the host are printed when exiting.
+    -r <Hz>      sample rate of a CSV trace, SAMPLER_RATE_HZ by default
+    -t <hours>   device time to simulate, the duration of the trace by default
+    -o <prefix>  prefix of the output files, none by default
+    -c <json>    config object sent to the device when it registers, {} by default
+*/
+#include <Arduino.h>
+#include <hal_native.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+
+#include "../../src/sampler.h"
+
+#define REPLAY_ADC_MAX    1023
+#define REPLAY_ADC_MIDDLE 512
+
+// The firmware, from main.cpp
+void setup( void ) ;
+void loop( void ) ;
+extern int16_t hue ;
+extern int16_t levelDecibels ;
+extern int16_t runningAverage ;
+extern int16_t maxValueRunningAverage ;
+
+static std::vector<int16_t> replayTrace ;
+static uint32_t     replayRate        = SAMPLER_RATE_HZ ;
+static const char   *replayConfig     = "{}" ;
+static FILE         *replayHue        = NULL ;
+static FILE         *replayFrames     = NULL ;
+static FILE         *replayUploads    = NULL ;
+static uint64_t     replayNbFrames    = 0 ;
+static uint64_t     replayNbRequests  = 0 ;
+
+
+static double replayNowSeconds( void )
+{
+  struct timespec now ;
+
+  clock_gettime(CLOCK_MONOTONIC, &now) ;
+  return now.tv_sec + now.tv_nsec / 1e9 ;
+}
+
+/**
+ * \fn uint32_t readLittleEndian( const uint8_t *i_bytes, uint8_t i_size )
+ * \return The unsigned integer of i_size bytes, least significant first
+*/
+static uint32_t readLittleEndian( const uint8_t *i_bytes, uint8_t i_size )
+{
+  uint32_t value = 0 ;
+
+  for ( uint8_t iByte = i_size ; iByte > 0 ; iByte-- )
+    value = ( value << 8 ) | i_bytes[iByte - 1] ;
+  return value ;
+}
+
+/**
+ * \fn bool loadWAV( const std::vector<uint8_t> &i_file )
+ * \return False if the file is not a PCM WAV file of 8 or 16 bits
+*/
+static bool loadWAV( const std::vector<uint8_t> &i_file )
+{
+  uint16_t nbChannels = 0, bitsPerSample = 0 ;
+  size_t position = 12 ;
+
+  while ( position + 8 <= i_file.size() )
+  {
+    uint32_t size = readLittleEndian(&i_file[position + 4], 4) ;
+    const uint8_t *chunk = &i_file[position + 8] ;
+
+    size = position + 8 + size <= i_file.size() ? size : i_file.size() - position - 8 ;
+    if ( memcmp(&i_file[position], "fmt ", 4) == 0 && size >= 16 )
+    {
+      if ( readLittleEndian(chunk, 2) != 1 )
+        return false ;
+      nbChannels    = readLittleEndian(chunk + 2, 2) ;
+      replayRate    = readLittleEndian(chunk + 4, 4) ;
+      bitsPerSample = readLittleEndian(chunk + 14, 2) ;
+    }
+    else if ( memcmp(&i_file[position], "data", 4) == 0 && nbChannels > 0 && ( bitsPerSample == 8 || bitsPerSample == 16 ) )
+    {
+      uint32_t frameSize = nbChannels * bitsPerSample / 8 ;
+
+      for ( uint32_t offset = 0 ; offset + frameSize <= size ; offset += frameSize )
+        if ( bitsPerSample == 8 )
+          replayTrace.push_back(chunk[offset] << 2) ;
+        else
+          replayTrace.push_back(REPLAY_ADC_MIDDLE + (int16_t) readLittleEndian(chunk + offset, 2) / 64) ;
+      return !replayTrace.empty() ;
+    }
+    position += 8 + size + ( size & 1 ) ;
+  }
+  return false ;
+}
+
+/**
+ * \fn bool loadCSV( const std::vector<uint8_t> &i_file )
+ * \return False if no line starts with a value
+*/
+static bool loadCSV( const std::vector<uint8_t> &i_file )
+{
+  std::string text(i_file.begin(), i_file.end()) ;
+  const char *line = text.c_str() ;
+
+  while ( *line != '\0' )
+  {
+    char *end ;
+    long value = strtol(line, &end, 10) ;
+
+    if ( end != line )
+      replayTrace.push_back(value < 0 ? 0 : ( value > REPLAY_ADC_MAX ? REPLAY_ADC_MAX : value )) ;
+    line = strchr(line, '\n') ;
+    line = line != NULL ? line + 1 : "" ;
+  }
+  return !replayTrace.empty() ;
+}
+
+/**
+ * \fn bool loadTrace( const char *i_path )
+ * \return False if the file cannot be read, or holds no sample
+*/
+static bool loadTrace( const char *i_path )
+{
+  FILE *file = fopen(i_path, "rb") ;
+  std::vector<uint8_t> bytes ;
+  uint8_t buffer[65536] ;
+  size_t length ;
+
+  if ( file == NULL )
+    return false ;
+  while ( ( length = fread(buffer, 1, sizeof(buffer), file) ) > 0 )
+    bytes.insert(bytes.end(), buffer, buffer + length) ;
+  fclose(file) ;
+
+  if ( bytes.size() >= 12 && memcmp(&bytes[0], "RIFF", 4) == 0 && memcmp(&bytes[8], "WAVE", 4) == 0 )
+    return loadWAV(bytes) ;
+  return loadCSV(bytes) ;
+}
+
+/**
+ * \fn int16_t replaySample( uint64_t i_micros )
+ * \brief Source of analogRead() : the sample of the trace at this time, the trace being played in a loop
+*/
+static int16_t replaySample( uint64_t i_micros )
+{
+  return replayTrace[( i_micros * replayRate / 1000000 ) % replayTrace.size()] ;
+}
+
+/**
+ * \fn void replayShow( const uint32_t *i_pixels, uint16_t i_numPixels )
+ * \brief Write a frame sent to a strip
+*/
+static void replayShow( const uint32_t *i_pixels, uint16_t i_numPixels )
+{
+  replayNbFrames++ ;
+  if ( replayFrames == NULL )
+    return ;
+  fprintf(replayFrames, "%lu,%u,", millis(), i_numPixels) ;
+  for ( uint16_t iPixel = 0 ; iPixel < i_numPixels ; iPixel++ )
+    fprintf(replayFrames, "%06x", i_pixels[iPixel]) ;
+  fputc('\n', replayFrames) ;
+}
+
+/**
+ * \fn int16_t replayHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+ * \brief Server registering the device with the config of -c, acknowledging the uploads, and writing the requests
+*/
+static int16_t replayHandler( const char *i_host, const char *i_endPoint, const uint8_t *i_body, size_t i_length, String *o_response )
+{
+  bool printable = true ;
+
+  (void) i_host ;
+  if ( strcmp(i_endPoint, "/api/device/") == 0 )
+    *o_response = ( std::string("{\"shortID\":\"REPLAY\",\"config\":") + replayConfig + "}" ).c_str() ;
+  else
+    *o_response = "{}" ;
+
+  replayNbRequests++ ;
+  if ( replayUploads == NULL )
+    return 200 ;
+  for ( size_t iByte = 0 ; iByte < i_length ; iByte++ )
+    printable &= i_body[iByte] >= 0x20 && i_body[iByte] < 0x7f ;
+  fprintf(replayUploads, "%lu %s %u ", millis(), i_endPoint, (unsigned) i_length) ;
+  for ( size_t iByte = 0 ; iByte < i_length ; iByte++ )
+    fprintf(replayUploads, printable ? "%c" : "%02x", i_body[iByte]) ;
+  fputc('\n', replayUploads) ;
+  return 200 ;
+}
+
+/**
+ * \fn FILE * openOutput( const char *i_prefix, const char *i_suffix )
+ * \return The output file, NULL without prefix
+*/
+static FILE * openOutput( const char *i_prefix, const char *i_suffix )
+{
+  std::string path = i_prefix != NULL ? std::string(i_prefix) + i_suffix : "" ;
+  FILE *file = i_prefix != NULL ? fopen(path.c_str(), "w") : NULL ;
+
+  if ( i_prefix != NULL && file == NULL )
+  {
+    perror(path.c_str()) ;
+    exit(1) ;
+  }
+  return file ;
+}
+
+int main( int argc, char **argv )
+{
+  const char *prefix = NULL ;
+  double hours = 0, startSeconds, elapsedSeconds ;
+  uint64_t durationMicros ;
+  int16_t lastHue = -1, lastLevel = -1, lastValue = -1 ;
+  int option ;
+
+  while ( ( option = getopt(argc, argv, "r:t:o:c:") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 'r': replayRate    = atoi(optarg) ; break ;
+      case 't': hours         = atof(optarg) ; break ;
+      case 'o': prefix        = optarg ; break ;
+      case 'c': replayConfig  = optarg ; break ;
+      default:
+        fprintf(stderr, "usage: %s [-r rate_hz] [-t hours] [-o prefix] [-c config_json] trace.csv|trace.wav\n", argv[0]) ;
+        return 1 ;
+    }
+  }
+  if ( optind >= argc || !loadTrace(argv[optind]) || replayRate == 0 )
+  {
+    fprintf(stderr, "usage: %s [-r rate_hz] [-t hours] [-o prefix] [-c config_json] trace.csv|trace.wav\n", argv[0]) ;
+    return 1 ;
+  }
+  durationMicros = hours > 0 ? hours * 3600e6 : replayTrace.size() * 1000000ULL / replayRate ;
+  fprintf(stderr, "%u samples at %u Hz, %.3f device-hours to simulate\n", (unsigned) replayTrace.size(), replayRate, durationMicros / 3600e6) ;
+
+  replayHue     = openOutput(prefix, ".hue.csv") ;
+  replayFrames  = openOutput(prefix, ".frames.csv") ;
+  replayUploads = openOutput(prefix, ".uploads.txt") ;
+  halSetAnalogSource(replaySample) ;
+  halSetShowHandler(replayShow) ;
+  halSetHTTPHandler(replayHandler) ;
+  halSetListenPort(HAL_LISTEN_PORT_NONE) ;
+
+  startSeconds = replayNowSeconds() ;
+  setup() ;
+  while ( halMicros() < durationMicros )
+  {
+    int16_t value ;
+
+    loop() ;
+    value = maxValueRunningAverage - runningAverage ;
+    if ( replayHue != NULL && ( hue != lastHue || levelDecibels != lastLevel || value != lastValue ) )
+    {
+      fprintf(replayHue, "%lu,%d,%d,%d\n", millis(), hue, levelDecibels, value) ;
+      lastHue   = hue ;
+      lastLevel = levelDecibels ;
+      lastValue = value ;
+    }
+  }
+  elapsedSeconds = replayNowSeconds() - startSeconds ;
+
+  fprintf(stderr, "%.3f device-hours in %.2f s : %.1f device-hours/s, %llu frames, %llu requests\n", halMicros() / 3600e6, elapsedSeconds,
+          halMicros() / 3600e6 / ( elapsedSeconds > 0 ? elapsedSeconds : 1e-9 ), (unsigned long long) replayNbFrames, (unsigned long long) replayNbRequests) ;
+  if ( replayHue != NULL )
+    fclose(replayHue) ;
+  if ( replayFrames != NULL )
+    fclose(replayFrames) ;
+  if ( replayUploads != NULL )
+    fclose(replayUploads) ;
+  return 0 ;
+}
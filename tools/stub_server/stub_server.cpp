@@ -0,0 +1,296 @@
+/**
+  \file stub_server.cpp
+  \brief Local stand-in for the Noisey API, to test and load the upload path of the firmware on the host
+
+  Plain HTTP/1.1 server with keep-alive and pipelining, answering /api/device/ with a short ID and any other end point
+  with an empty JSON object. It counts connections (each one a TLS handshake for a board), requests and bytes, and can
+  be made slow or failing :
+    -p <port>    port to listen on, 8080 by default
+    -d <ms>      delay before each response
+    -f <n>       answer every n-th request with a 500
+    -x <n>       drop the connection instead of answering every n-th request
+    -q           only print the statistics when exiting
+  Statistics are printed every second while there is traffic, and when exiting on SIGINT or SIGTERM.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <map>
+#include <set>
+#include <deque>
+#include <string>
+
+#define STUB_MAX_EVENTS 256
+
+/**
+ * \struct StubConnection
+ * \brief A client connection, with the bytes received and not parsed yet and the responses waiting for their delay
+*/
+struct StubConnection
+{
+  std::string received ;
+  std::deque< std::pair<uint64_t, std::string> > responses ;
+} ;
+
+/**
+ * \struct StubStatistics
+ * \brief Counters of the server, since it started
+*/
+struct StubStatistics
+{
+  uint64_t connections ;
+  uint64_t requests ;
+  uint64_t bytesReceived ;
+  uint64_t bytesSent ;
+  uint64_t failures ;
+  uint64_t drops ;
+  std::map<std::string, uint64_t> requestsPerEndPoint ;
+} ;
+
+static volatile sig_atomic_t stubRunning = 1 ;
+static uint32_t       stubDelayMillis   = 0 ;
+static uint32_t       stubFailEvery     = 0 ;
+static uint32_t       stubDropEvery     = 0 ;
+static StubStatistics stubStatistics    = StubStatistics() ;
+
+
+static void stubStop( int i_signal )
+{
+  (void) i_signal ;
+  stubRunning = 0 ;
+}
+
+static uint64_t stubNowMillis( void )
+{
+  struct timespec now ;
+
+  clock_gettime(CLOCK_MONOTONIC, &now) ;
+  return now.tv_sec * 1000ULL + now.tv_nsec / 1000000 ;
+}
+
+static void stubPrintStatistics( FILE *o_output, double i_elapsedSeconds )
+{
+  fprintf(o_output, "%.1f s: %llu connections, %llu requests, %llu bytes in, %llu bytes out, %llu failed, %llu dropped\n", i_elapsedSeconds,
+          (unsigned long long) stubStatistics.connections, (unsigned long long) stubStatistics.requests, (unsigned long long) stubStatistics.bytesReceived,
+          (unsigned long long) stubStatistics.bytesSent, (unsigned long long) stubStatistics.failures, (unsigned long long) stubStatistics.drops) ;
+  for ( std::map<std::string, uint64_t>::const_iterator endPoint = stubStatistics.requestsPerEndPoint.begin() ; endPoint != stubStatistics.requestsPerEndPoint.end() ; ++endPoint )
+    fprintf(o_output, "  %-20s %llu requests\n", endPoint->first.c_str(), (unsigned long long) endPoint->second) ;
+}
+
+/**
+ * \fn bool stubHandleRequests( StubConnection *io_connection )
+ * \param[in,out] io_connection Connection whose received bytes are parsed
+ * \return False if the connection must be dropped
+ * \brief Answer the complete requests received on a connection, in order
+*/
+static bool stubHandleRequests( StubConnection *io_connection )
+{
+  for ( ;; )
+  {
+    std::string &received = io_connection->received ;
+    size_t endHeaders = received.find("\r\n\r\n"), position, contentLength = 0 ;
+    char method[8] = "", endPoint[128] = "", body[64], response[256] ;
+    int code = 200 ;
+
+    if ( endHeaders == std::string::npos )
+      return received.size() < 8192 ;
+    if ( ( position = received.find("Content-Length:") ) < endHeaders || ( position = received.find("content-length:") ) < endHeaders )
+      contentLength = strtoul(received.c_str() + position + 15, NULL, 10) ;
+    if ( received.size() < endHeaders + 4 + contentLength )
+      return true ;
+    sscanf(received.c_str(), "%7s %127s", method, endPoint) ;
+
+    stubStatistics.requests++ ;
+    stubStatistics.bytesReceived += endHeaders + 4 + contentLength ;
+    stubStatistics.requestsPerEndPoint[endPoint]++ ;
+
+    if ( stubDropEvery > 0 && stubStatistics.requests % stubDropEvery == 0 )
+    {
+      stubStatistics.drops++ ;
+      return false ;
+    }
+
+    if ( strcmp(endPoint, "/api/device/") == 0 )
+    {
+      // Derive a stable short ID from the chip ID sent by the board
+      uint32_t hash = 5381 ;
+      for ( size_t iChar = 0 ; iChar < contentLength ; iChar++ )
+        hash = hash * 33 + received[endHeaders + 4 + iChar] ;
+      snprintf(body, sizeof(body), "{\"shortID\":\"S%05u\"}", hash % 100000) ;
+    }
+    else
+      snprintf(body, sizeof(body), "{}") ;
+
+    if ( stubFailEvery > 0 && stubStatistics.requests % stubFailEvery == 0 )
+    {
+      code = 500 ;
+      stubStatistics.failures++ ;
+    }
+
+    snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: keep-alive\r\n\r\n%s",
+             code, code == 200 ? "OK" : "Internal Server Error", (unsigned int) strlen(body), body) ;
+    io_connection->responses.push_back(std::make_pair(stubNowMillis() + stubDelayMillis, std::string(response))) ;
+    received.erase(0, endHeaders + 4 + contentLength) ;
+  }
+}
+
+/**
+ * \fn bool stubSendResponses( int i_fd, StubConnection *io_connection, uint64_t i_nowMillis )
+ * \return False if the connection failed
+ * \brief Send the responses whose delay has elapsed
+*/
+static bool stubSendResponses( int i_fd, StubConnection *io_connection, uint64_t i_nowMillis )
+{
+  while ( !io_connection->responses.empty() && io_connection->responses.front().first <= i_nowMillis )
+  {
+    std::string &response = io_connection->responses.front().second ;
+    ssize_t length = send(i_fd, response.data(), response.size(), MSG_NOSIGNAL) ;
+
+    if ( length < 0 )
+      return errno == EAGAIN || errno == EWOULDBLOCK ;
+    stubStatistics.bytesSent += length ;
+    if ( (size_t) length < response.size() )
+    {
+      response.erase(0, length) ;
+      return true ;
+    }
+    io_connection->responses.pop_front() ;
+  }
+  return true ;
+}
+
+int main( int argc, char **argv )
+{
+  std::map<int, StubConnection> connections ;
+  std::set<int> waiting ;   /*!< Connections with responses not sent yet */
+  struct epoll_event events[STUB_MAX_EVENTS], event ;
+  struct sockaddr_in address ;
+  uint16_t port   = 8080 ;
+  bool quiet      = false ;
+  int option, listener, poller, reuse = 1 ;
+  uint64_t startMillis, lastPrintMillis, lastPrintedRequests = 0 ;
+
+  while ( ( option = getopt(argc, argv, "p:d:f:x:q") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 'p': port            = atoi(optarg) ; break ;
+      case 'd': stubDelayMillis = atoi(optarg) ; break ;
+      case 'f': stubFailEvery   = atoi(optarg) ; break ;
+      case 'x': stubDropEvery   = atoi(optarg) ; break ;
+      case 'q': quiet           = true ; break ;
+      default:
+        fprintf(stderr, "usage: %s [-p port] [-d delay_ms] [-f fail_every] [-x drop_every] [-q]\n", argv[0]) ;
+        return 1 ;
+    }
+  }
+
+  signal(SIGINT, stubStop) ;
+  signal(SIGTERM, stubStop) ;
+
+  listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0) ;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) ;
+  memset(&address, 0, sizeof(address)) ;
+  address.sin_family      = AF_INET ;
+  address.sin_port        = htons(port) ;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK) ;
+  if ( bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 4096) != 0 )
+  {
+    perror("stub_server") ;
+    return 1 ;
+  }
+
+  poller          = epoll_create1(0) ;
+  event.events    = EPOLLIN ;
+  event.data.fd   = listener ;
+  epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event) ;
+  fprintf(stderr, "listening on 127.0.0.1:%u\n", port) ;
+
+  startMillis = lastPrintMillis = stubNowMillis() ;
+  while ( stubRunning )
+  {
+    int nbEvents = epoll_wait(poller, events, STUB_MAX_EVENTS, waiting.empty() ? 100 : 1) ;
+    uint64_t nowMillis = stubNowMillis() ;
+
+    for ( int iEvent = 0 ; iEvent < nbEvents ; iEvent++ )
+    {
+      int fd = events[iEvent].data.fd ;
+
+      if ( fd == listener )
+      {
+        int client, noDelay = 1 ;
+        while ( ( client = accept4(listener, NULL, NULL, SOCK_NONBLOCK) ) >= 0 )
+        {
+          setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) ;
+          event.events  = EPOLLIN | EPOLLRDHUP ;
+          event.data.fd = client ;
+          epoll_ctl(poller, EPOLL_CTL_ADD, client, &event) ;
+          connections[client] = StubConnection() ;
+          stubStatistics.connections++ ;
+        }
+        continue ;
+      }
+
+      StubConnection &connection = connections[fd] ;
+      bool open = true ;
+      char buffer[4096] ;
+      ssize_t length ;
+
+      while ( ( length = recv(fd, buffer, sizeof(buffer), 0) ) > 0 )
+        connection.received.append(buffer, length) ;
+      if ( length == 0 || ( length < 0 && errno != EAGAIN && errno != EWOULDBLOCK ) )
+        open = false ;
+
+      open = stubHandleRequests(&connection) && open ;
+      open = stubSendResponses(fd, &connection, nowMillis) && open ;
+      if ( !open )
+      {
+        epoll_ctl(poller, EPOLL_CTL_DEL, fd, NULL) ;
+        close(fd) ;
+        connections.erase(fd) ;
+        waiting.erase(fd) ;
+      }
+      else if ( !connection.responses.empty() )
+        waiting.insert(fd) ;
+    }
+
+    // Responses held back by the delay or by a full socket buffer
+    for ( std::set<int>::iterator fd = waiting.begin() ; fd != waiting.end() ; )
+    {
+      StubConnection &connection = connections[*fd] ;
+
+      if ( !stubSendResponses(*fd, &connection, nowMillis) )
+      {
+        epoll_ctl(poller, EPOLL_CTL_DEL, *fd, NULL) ;
+        close(*fd) ;
+        connections.erase(*fd) ;
+        waiting.erase(fd++) ;
+      }
+      else if ( connection.responses.empty() )
+        waiting.erase(fd++) ;
+      else
+        ++fd ;
+    }
+
+    if ( !quiet && nowMillis - lastPrintMillis >= 1000 )
+    {
+      if ( stubStatistics.requests != lastPrintedRequests )
+        stubPrintStatistics(stderr, ( nowMillis - startMillis ) / 1000.0) ;
+      lastPrintedRequests = stubStatistics.requests ;
+      lastPrintMillis     = nowMillis ;
+    }
+  }
+
+  stubPrintStatistics(stdout, ( stubNowMillis() - startMillis ) / 1000.0) ;
+  return 0 ;
+}